@@ -0,0 +1,111 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "debug.h"
+#include "arena.h"
+
+#define CLEW_ARENA_CHUNK_DEFAULT        (4 * 1024 * 1024)
+#define CLEW_ARENA_ALIGN                8
+
+struct clew_arena_chunk {
+        struct clew_arena_chunk *next;
+        uint64_t size;
+        uint64_t used;
+        uint8_t data[];
+};
+
+struct clew_arena {
+        uint64_t chunk;
+        uint64_t memory;
+        struct clew_arena_chunk *head;          /* chunk being filled, older chunks follow */
+};
+
+struct clew_arena * clew_arena_create (uint64_t chunk)
+{
+        struct clew_arena *arena;
+
+        arena = (struct clew_arena *) malloc(sizeof(struct clew_arena));
+        if (arena == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        memset(arena, 0, sizeof(struct clew_arena));
+        arena->chunk = (chunk == 0) ? CLEW_ARENA_CHUNK_DEFAULT : chunk;
+
+        return arena;
+bail:   return NULL;
+}
+
+void clew_arena_destroy (struct clew_arena *arena)
+{
+        if (arena == NULL) {
+                return;
+        }
+        clew_arena_reset(arena);
+        free(arena);
+}
+
+void clew_arena_reset (struct clew_arena *arena)
+{
+        struct clew_arena_chunk *chunk;
+        struct clew_arena_chunk *next;
+
+        for (chunk = arena->head; chunk != NULL; chunk = next) {
+                next = chunk->next;
+                free(chunk);
+        }
+        arena->head   = NULL;
+        arena->memory = 0;
+}
+
+void * clew_arena_alloc (struct clew_arena *arena, uint64_t size)
+{
+        uint64_t csize;
+        struct clew_arena_chunk *chunk;
+
+        size  = (size + (CLEW_ARENA_ALIGN - 1)) & ~(uint64_t) (CLEW_ARENA_ALIGN - 1);
+        chunk = arena->head;
+        if (chunk != NULL && chunk->size - chunk->used >= size) {
+                chunk->used += size;
+                return chunk->data + chunk->used - size;
+        }
+
+        /* large requests get a chunk of their own behind the head, so the head keeps filling */
+        csize = (size > arena->chunk / 4) ? size : arena->chunk;
+        chunk = (struct clew_arena_chunk *) malloc(sizeof(struct clew_arena_chunk) + csize);
+        if (chunk == NULL) {
+                clew_errorf("can not allocate memory");
+                return NULL;
+        }
+        chunk->size = csize;
+        chunk->used = size;
+        if (csize != arena->chunk && arena->head != NULL) {
+                chunk->next       = arena->head->next;
+                arena->head->next = chunk;
+        } else {
+                chunk->next = arena->head;
+                arena->head = chunk;
+        }
+        arena->memory += sizeof(struct clew_arena_chunk) + csize;
+        return chunk->data;
+}
+
+void * clew_arena_memdup (struct clew_arena *arena, const void *src, uint64_t size)
+{
+        void *dst;
+
+        dst = clew_arena_alloc(arena, size);
+        if (dst == NULL) {
+                return NULL;
+        }
+        memcpy(dst, src, size);
+        return dst;
+}
+
+uint64_t clew_arena_memory (const struct clew_arena *arena)
+{
+        return arena->memory;
+}
@@ -0,0 +1,25 @@
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * bump allocator for elements that live until the end of a phase. memory is
+ * handed out from large chunks, 8 byte aligned, and only released all at
+ * once by reset or destroy. an arena must not be used from many threads.
+ */
+struct clew_arena;
+
+struct clew_arena * clew_arena_create (uint64_t chunk);
+void clew_arena_destroy (struct clew_arena *arena);
+void clew_arena_reset (struct clew_arena *arena);
+
+void * clew_arena_alloc (struct clew_arena *arena, uint64_t size);
+void * clew_arena_memdup (struct clew_arena *arena, const void *src, uint64_t size);
+
+uint64_t clew_arena_memory (const struct clew_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
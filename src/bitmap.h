@@ -129,6 +129,55 @@ static inline int clew_bitmap_marked (const struct clew_bitmap *bitmap, uint64_t
 	return !!(bitmap->buffer[at / 8] & (1 << (at % 8)));
 }
 
+static inline int clew_bitmap_or (struct clew_bitmap *bitmap, const struct clew_bitmap *other)
+{
+        int rc;
+        uint64_t i;
+        uint64_t il;
+        if (other->avail == 0) {
+                return 0;
+        }
+        rc = clew_bitmap_reserve(bitmap, other->avail);
+        if (unlikely(rc != 0)) {
+                return -1;
+        }
+        for (i = 0, il = (other->avail + 7) / 8; i < il; i++) {
+                bitmap->buffer[i] |= other->buffer[i];
+        }
+        return 0;
+}
+
+static inline int clew_bitmap_marked_range (const struct clew_bitmap *bitmap, uint64_t from, uint64_t to)
+{
+        uint64_t i;
+        uint64_t first;
+        uint64_t last;
+        uint8_t mask;
+
+        if (unlikely(from > to || from >= bitmap->avail)) {
+                return 0;
+        }
+        if (to >= bitmap->avail) {
+                to = bitmap->avail - 1;
+        }
+
+        first = from / 8;
+        last  = to / 8;
+        if (first == last) {
+                mask = (uint8_t) ((0xff << (from % 8)) & (0xff >> (7 - (to % 8))));
+                return !!(bitmap->buffer[first] & mask);
+        }
+        if (bitmap->buffer[first] & (uint8_t) (0xff << (from % 8))) {
+                return 1;
+        }
+        for (i = first + 1; i < last; i++) {
+                if (bitmap->buffer[i] != 0) {
+                        return 1;
+                }
+        }
+        return !!(bitmap->buffer[last] & (uint8_t) (0xff >> (7 - (to % 8))));
+}
+
 static inline uint64_t clew_bitmap_count (const struct clew_bitmap *bitmap)
 {
         static const uint8_t bitcount[256] = {
@@ -264,6 +313,238 @@ bail:   return -1;
 
 #endif
 
+/*
+ * bitmap that many threads may mark at once. bits live in fixed size
+ * segments that are allocated on first mark and never move, the segment
+ * table is sized for ids below 2^40 up front. marking is a word level
+ * atomic or, or and reset must not race with marking.
+ */
+#define CLEW_BITMAP_ATOMIC_SEGMENT_BITS         24
+#define CLEW_BITMAP_ATOMIC_SEGMENT_WORDS        ((uint64_t) 1 << (CLEW_BITMAP_ATOMIC_SEGMENT_BITS - 6))
+#define CLEW_BITMAP_ATOMIC_SEGMENTS             ((uint64_t) 1 << (40 - CLEW_BITMAP_ATOMIC_SEGMENT_BITS))
+
+struct clew_bitmap_atomic {
+        uint64_t **segments;
+};
+
+static inline struct clew_bitmap_atomic clew_bitmap_atomic_init (void)
+{
+        return (struct clew_bitmap_atomic) {
+                .segments = (uint64_t **) calloc(CLEW_BITMAP_ATOMIC_SEGMENTS, sizeof(uint64_t *))
+        };
+}
+
+static inline void clew_bitmap_atomic_uninit (struct clew_bitmap_atomic *bitmap)
+{
+        uint64_t i;
+        if (bitmap == NULL || bitmap->segments == NULL) {
+                return;
+        }
+        for (i = 0; i < CLEW_BITMAP_ATOMIC_SEGMENTS; i++) {
+                if (bitmap->segments[i] != NULL) {
+                        free(bitmap->segments[i]);
+                }
+        }
+        free(bitmap->segments);
+        bitmap->segments = NULL;
+}
+
+static inline void clew_bitmap_atomic_reset (struct clew_bitmap_atomic *bitmap)
+{
+        uint64_t i;
+        if (bitmap->segments == NULL) {
+                return;
+        }
+        for (i = 0; i < CLEW_BITMAP_ATOMIC_SEGMENTS; i++) {
+                if (bitmap->segments[i] != NULL) {
+                        memset(bitmap->segments[i], 0, sizeof(uint64_t) * CLEW_BITMAP_ATOMIC_SEGMENT_WORDS);
+                }
+        }
+}
+
+static inline uint64_t * clew_bitmap_atomic_segment (const struct clew_bitmap_atomic *bitmap, uint64_t segment)
+{
+        if (unlikely(bitmap->segments == NULL || segment >= CLEW_BITMAP_ATOMIC_SEGMENTS)) {
+                return NULL;
+        }
+        return __atomic_load_n(&bitmap->segments[segment], __ATOMIC_ACQUIRE);
+}
+
+/* returns the segment, allocating it if needed. the loser of a race frees its copy */
+static inline uint64_t * clew_bitmap_atomic_segment_get (struct clew_bitmap_atomic *bitmap, uint64_t segment)
+{
+        uint64_t *words;
+        uint64_t *expected;
+
+        if (unlikely(bitmap->segments == NULL || segment >= CLEW_BITMAP_ATOMIC_SEGMENTS)) {
+                return NULL;
+        }
+        words = __atomic_load_n(&bitmap->segments[segment], __ATOMIC_ACQUIRE);
+        if (likely(words != NULL)) {
+                return words;
+        }
+        words = (uint64_t *) calloc(CLEW_BITMAP_ATOMIC_SEGMENT_WORDS, sizeof(uint64_t));
+        if (unlikely(words == NULL)) {
+                return NULL;
+        }
+        expected = NULL;
+        if (!__atomic_compare_exchange_n(&bitmap->segments[segment], &expected, words, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                free(words);
+                words = expected;
+        }
+        return words;
+}
+
+/* returns 1 if the bit was newly set, 0 if it was already set */
+static inline int clew_bitmap_atomic_mark (struct clew_bitmap_atomic *bitmap, uint64_t at)
+{
+        uint64_t bit;
+        uint64_t old;
+        uint64_t *words;
+
+        words = clew_bitmap_atomic_segment_get(bitmap, at >> CLEW_BITMAP_ATOMIC_SEGMENT_BITS);
+        if (unlikely(words == NULL)) {
+                return -1;
+        }
+        bit = (uint64_t) 1 << (at % 64);
+        old = __atomic_fetch_or(&words[(at % (CLEW_BITMAP_ATOMIC_SEGMENT_WORDS * 64)) / 64], bit, __ATOMIC_RELAXED);
+        return !(old & bit);
+}
+
+static inline int clew_bitmap_atomic_marked (const struct clew_bitmap_atomic *bitmap, uint64_t at)
+{
+        const uint64_t *words;
+
+        words = clew_bitmap_atomic_segment(bitmap, at >> CLEW_BITMAP_ATOMIC_SEGMENT_BITS);
+        if (words == NULL) {
+                return 0;
+        }
+        return !!(__atomic_load_n(&words[(at % (CLEW_BITMAP_ATOMIC_SEGMENT_WORDS * 64)) / 64], __ATOMIC_RELAXED) & ((uint64_t) 1 << (at % 64)));
+}
+
+static inline int clew_bitmap_atomic_marked_range (const struct clew_bitmap_atomic *bitmap, uint64_t from, uint64_t to)
+{
+        uint64_t i;
+        uint64_t il;
+        uint64_t mask;
+        uint64_t word;
+        const uint64_t *words;
+
+        if (unlikely(from > to)) {
+                return 0;
+        }
+        if (to >= (CLEW_BITMAP_ATOMIC_SEGMENTS << CLEW_BITMAP_ATOMIC_SEGMENT_BITS)) {
+                to = (CLEW_BITMAP_ATOMIC_SEGMENTS << CLEW_BITMAP_ATOMIC_SEGMENT_BITS) - 1;
+        }
+        for (i = from / 64, il = to / 64; i <= il; i++) {
+                words = clew_bitmap_atomic_segment(bitmap, i / CLEW_BITMAP_ATOMIC_SEGMENT_WORDS);
+                if (words == NULL) {
+                        i |= CLEW_BITMAP_ATOMIC_SEGMENT_WORDS - 1;
+                        continue;
+                }
+                word = __atomic_load_n(&words[i % CLEW_BITMAP_ATOMIC_SEGMENT_WORDS], __ATOMIC_RELAXED);
+                mask = ~(uint64_t) 0;
+                if (i == from / 64) {
+                        mask &= ~(uint64_t) 0 << (from % 64);
+                }
+                if (i == il) {
+                        mask &= ~(uint64_t) 0 >> (63 - (to % 64));
+                }
+                if (word & mask) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+static inline uint64_t clew_bitmap_atomic_count (const struct clew_bitmap_atomic *bitmap)
+{
+        uint64_t i;
+        uint64_t j;
+        uint64_t count;
+        const uint64_t *words;
+
+        count = 0;
+        for (i = 0; i < CLEW_BITMAP_ATOMIC_SEGMENTS; i++) {
+                words = clew_bitmap_atomic_segment(bitmap, i);
+                if (words == NULL) {
+                        continue;
+                }
+                for (j = 0; j < CLEW_BITMAP_ATOMIC_SEGMENT_WORDS; j++) {
+                        count += __builtin_popcountll(words[j]);
+                }
+        }
+        return count;
+}
+
+/* merges other into bitmap, the word loop is left plain so it vectorizes */
+static inline int clew_bitmap_atomic_or (struct clew_bitmap_atomic *bitmap, const struct clew_bitmap_atomic *other)
+{
+        uint64_t i;
+        uint64_t j;
+        uint64_t *dst;
+        const uint64_t *src;
+
+        for (i = 0; i < CLEW_BITMAP_ATOMIC_SEGMENTS; i++) {
+                src = clew_bitmap_atomic_segment(other, i);
+                if (src == NULL) {
+                        continue;
+                }
+                dst = clew_bitmap_atomic_segment_get(bitmap, i);
+                if (unlikely(dst == NULL)) {
+                        return -1;
+                }
+                for (j = 0; j < CLEW_BITMAP_ATOMIC_SEGMENT_WORDS; j++) {
+                        dst[j] |= src[j];
+                }
+        }
+        return 0;
+}
+
+static inline int clew_bitmap_atomic_foreach (const struct clew_bitmap_atomic *bitmap, int (*callback) (void *context, uint64_t at), void *context)
+{
+        int rc;
+        uint64_t i;
+        uint64_t j;
+        uint64_t word;
+        const uint64_t *words;
+
+        for (i = 0; i < CLEW_BITMAP_ATOMIC_SEGMENTS; i++) {
+                words = clew_bitmap_atomic_segment(bitmap, i);
+                if (words == NULL) {
+                        continue;
+                }
+                for (j = 0; j < CLEW_BITMAP_ATOMIC_SEGMENT_WORDS; j++) {
+                        for (word = words[j]; word != 0; word &= word - 1) {
+                                rc = callback(context, (i << CLEW_BITMAP_ATOMIC_SEGMENT_BITS) + j * 64 + __builtin_ctzll(word));
+                                if (unlikely(rc < 0)) {
+                                        return -1;
+                                } else if (rc == 1) {
+                                        return 0;
+                                }
+                        }
+                }
+        }
+        return 0;
+}
+
+static inline uint64_t clew_bitmap_atomic_memory (const struct clew_bitmap_atomic *bitmap)
+{
+        uint64_t i;
+        uint64_t memory;
+
+        if (bitmap->segments == NULL) {
+                return 0;
+        }
+        memory = sizeof(uint64_t *) * CLEW_BITMAP_ATOMIC_SEGMENTS;
+        for (i = 0; i < CLEW_BITMAP_ATOMIC_SEGMENTS; i++) {
+                if (bitmap->segments[i] != NULL) {
+                        memory += sizeof(uint64_t) * CLEW_BITMAP_ATOMIC_SEGMENT_WORDS;
+                }
+        }
+        return memory;
+}
+
 #ifdef __cplusplus
 }
 #endif
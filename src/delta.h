@@ -0,0 +1,106 @@
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * compact id lists: each id is stored as the zigzag encoded difference to
+ * the previous one, as a little endian base 128 varint. consecutive refs of
+ * a way are close in value, so most take one to three bytes instead of eight.
+ * lists are decoded front to back with an iterator, the count is kept by the
+ * owner.
+ */
+
+#define CLEW_DELTA_MAX_BYTES            10
+
+struct clew_delta_iter {
+        const uint8_t *ptr;
+        uint64_t id;
+};
+
+static inline uint64_t clew_delta_zigzag_encode (int64_t value)
+{
+        return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t clew_delta_zigzag_decode (uint64_t value)
+{
+        return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static inline uint64_t clew_delta_varint_size (uint64_t value)
+{
+        uint64_t size;
+        for (size = 1; value >= 0x80; size++) {
+                value >>= 7;
+        }
+        return size;
+}
+
+static inline uint64_t clew_delta_encoded_size (const uint64_t *ids, uint64_t count)
+{
+        uint64_t i;
+        uint64_t prev;
+        uint64_t size;
+        for (i = 0, prev = 0, size = 0; i < count; i++) {
+                size += clew_delta_varint_size(clew_delta_zigzag_encode((int64_t) (ids[i] - prev)));
+                prev  = ids[i];
+        }
+        return size;
+}
+
+/* dst must hold clew_delta_encoded_size bytes, returns bytes written */
+static inline uint64_t clew_delta_encode (uint8_t *dst, const uint64_t *ids, uint64_t count)
+{
+        uint64_t i;
+        uint64_t prev;
+        uint64_t value;
+        uint8_t *ptr;
+        for (i = 0, prev = 0, ptr = dst; i < count; i++) {
+                value = clew_delta_zigzag_encode((int64_t) (ids[i] - prev));
+                while (value >= 0x80) {
+                        *ptr++ = (uint8_t) (value | 0x80);
+                        value >>= 7;
+                }
+                *ptr++ = (uint8_t) value;
+                prev   = ids[i];
+        }
+        return ptr - dst;
+}
+
+static inline struct clew_delta_iter clew_delta_iter_init (const uint8_t *buffer)
+{
+        struct clew_delta_iter iter;
+        iter.ptr = buffer;
+        iter.id  = 0;
+        return iter;
+}
+
+/* must not be called more often than the number of encoded ids */
+static inline uint64_t clew_delta_iter_next (struct clew_delta_iter *iter)
+{
+        int shift;
+        uint64_t byte;
+        uint64_t value;
+
+        byte = *iter->ptr++;
+        if (byte < 0x80) {
+                iter->id += clew_delta_zigzag_decode(byte);
+                return iter->id;
+        }
+        value = byte & 0x7f;
+        for (shift = 7; ; shift += 7) {
+                byte   = *iter->ptr++;
+                value |= (byte & 0x7f) << shift;
+                if (byte < 0x80) {
+                        break;
+                }
+        }
+        iter->id += clew_delta_zigzag_decode(value);
+        return iter->id;
+}
+
+#ifdef __cplusplus
+}
+#endif
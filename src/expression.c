@@ -20,6 +20,13 @@
 #define TAG_SIZE_MAX            (256)
 #define EXPRESSION_SIZE_MAX     (32 * 1024)
 
+#define DNF_BITS_MAX            (1024)
+#define DNF_WORDS_MAX           (DNF_BITS_MAX / 64)
+#define DNF_CLAUSES_MAX         CLEW_EXPRESSION_CLAUSES_MAX
+
+#define EXPRESSION_CACHE_CLAUSES_MIN    (8)
+#define EXPRESSION_CACHE_WARMUP         (4 * CLEW_EXPRESSION_CACHE_SIZE)
+
 struct clew_expression {
         char *orig;
         char *text;
@@ -27,9 +34,213 @@ struct clew_expression {
         unsigned long long ors;
         unsigned long long ands;
         unsigned long long nots;
+
+        uint32_t *starts;       /* by postfix position, where the operand ending there starts */
+
+        /* disjunctive normal form, clauses are required and forbidden masks
+         * over the tags the expression refers to. not compiled if it grows
+         * too large, matching then runs the postfix program */
+        int compiled;
+        uint32_t nbits;
+        uint32_t nwords;
+        uint32_t nclauses;
+        int nomatch;            /* result for elements with none of the tags */
+        int required;           /* every clause requires a tag, so one of required must be there */
+        uint16_t *bits;         /* by tag id, bit + 1 in the masks, 0 if not referred */
+        uint64_t *clauses;      /* nclauses * (required, forbidden) * nwords */
+        uint64_t *filters;      /* (required by any clause, forbidden by all clauses) * nwords */
+
         uint32_t postfix[0];
 };
 
+struct dnf {
+        uint32_t count;
+        uint32_t avail;
+        uint64_t *words;        /* count * (required, forbidden) * nwords */
+};
+
+#define dnf_required(d, i, nwords)      ((d)->words + (uint64_t) (i) * 2 * (nwords))
+#define dnf_forbidden(d, i, nwords)     ((d)->words + (uint64_t) (i) * 2 * (nwords) + (nwords))
+
+static void dnf_uninit (struct dnf *d)
+{
+        free(d->words);
+        d->words = NULL;
+        d->count = 0;
+        d->avail = 0;
+}
+
+/* returns 0 on success, 1 if there are too many clauses, -1 on error */
+static int dnf_push (struct dnf *d, uint32_t nwords, const uint64_t *required, const uint64_t *forbidden)
+{
+        uint32_t avail;
+        uint64_t *words;
+        if (d->count >= DNF_CLAUSES_MAX) {
+                return 1;
+        }
+        if (d->count == d->avail) {
+                avail = (d->avail == 0) ? 4 : d->avail * 2;
+                words = (uint64_t *) realloc(d->words, sizeof(uint64_t) * 2 * nwords * avail);
+                if (unlikely(words == NULL)) {
+                        clew_errorf("can not allocate memory");
+                        return -1;
+                }
+                d->words = words;
+                d->avail = avail;
+        }
+        memcpy(dnf_required(d, d->count, nwords), required, sizeof(uint64_t) * nwords);
+        memcpy(dnf_forbidden(d, d->count, nwords), forbidden, sizeof(uint64_t) * nwords);
+        d->count += 1;
+        return 0;
+}
+
+static int dnf_literal (struct dnf *d, uint32_t nwords, uint32_t bit, int forbid)
+{
+        uint64_t zero[DNF_WORDS_MAX];
+        uint64_t mask[DNF_WORDS_MAX];
+        memset(zero, 0, sizeof(zero));
+        memset(mask, 0, sizeof(mask));
+        mask[bit / 64] = 1ULL << (bit % 64);
+        return forbid ? dnf_push(d, nwords, zero, mask) : dnf_push(d, nwords, mask, zero);
+}
+
+static int dnf_true (struct dnf *d, uint32_t nwords)
+{
+        uint64_t zero[DNF_WORDS_MAX];
+        memset(zero, 0, sizeof(zero));
+        return dnf_push(d, nwords, zero, zero);
+}
+
+static int dnf_subsumes (const struct dnf *d, uint32_t a, uint32_t b, uint32_t nwords)
+{
+        uint32_t w;
+        uint64_t miss;
+        for (w = 0, miss = 0; w < nwords; w++) {
+                miss |= dnf_required(d, a, nwords)[w] & ~dnf_required(d, b, nwords)[w];
+                miss |= dnf_forbidden(d, a, nwords)[w] & ~dnf_forbidden(d, b, nwords)[w];
+        }
+        return miss == 0;
+}
+
+/* drops clauses implied by another one, of equal clauses the first stays */
+static void dnf_simplify (struct dnf *d, uint32_t nwords)
+{
+        uint32_t i;
+        uint32_t j;
+        uint32_t k;
+        uint8_t drop[DNF_CLAUSES_MAX];
+        for (i = 0; i < d->count; i++) {
+                for (j = 0, drop[i] = 0; j < d->count && drop[i] == 0; j++) {
+                        if (j != i && dnf_subsumes(d, j, i, nwords)) {
+                                drop[i] = (j < i) || !dnf_subsumes(d, i, j, nwords);
+                        }
+                }
+        }
+        for (i = 0, k = 0; i < d->count; i++) {
+                if (drop[i] == 0) {
+                        if (k != i) {
+                                memmove(dnf_required(d, k, nwords), dnf_required(d, i, nwords), sizeof(uint64_t) * 2 * nwords);
+                        }
+                        k++;
+                }
+        }
+        d->count = k;
+}
+
+/* returns 0 on success, 1 if there are too many clauses, -1 on error */
+static int dnf_or (struct dnf *a, const struct dnf *b, uint32_t nwords)
+{
+        int rc;
+        uint32_t i;
+        for (i = 0; i < b->count; i++) {
+                rc = dnf_push(a, nwords, dnf_required(b, i, nwords), dnf_forbidden(b, i, nwords));
+                if (rc != 0) {
+                        return rc;
+                }
+        }
+        dnf_simplify(a, nwords);
+        return 0;
+}
+
+/* a becomes a and b, clauses requiring and forbidding a tag are dropped */
+static int dnf_and (struct dnf *a, const struct dnf *b, uint32_t nwords)
+{
+        int rc;
+        uint32_t i;
+        uint32_t j;
+        uint32_t w;
+        uint64_t both;
+        uint64_t required[DNF_WORDS_MAX];
+        uint64_t forbidden[DNF_WORDS_MAX];
+        struct dnf r;
+
+        memset(&r, 0, sizeof(r));
+        for (i = 0; i < a->count; i++) {
+                for (j = 0; j < b->count; j++) {
+                        for (w = 0, both = 0; w < nwords; w++) {
+                                required[w]  = dnf_required(a, i, nwords)[w] | dnf_required(b, j, nwords)[w];
+                                forbidden[w] = dnf_forbidden(a, i, nwords)[w] | dnf_forbidden(b, j, nwords)[w];
+                                both |= required[w] & forbidden[w];
+                        }
+                        if (both != 0) {
+                                continue;
+                        }
+                        rc = dnf_push(&r, nwords, required, forbidden);
+                        if (rc != 0) {
+                                dnf_uninit(&r);
+                                return rc;
+                        }
+                }
+        }
+        dnf_simplify(&r, nwords);
+        dnf_uninit(a);
+        *a = r;
+        return 0;
+}
+
+/* not of a disjunction is the conjunction of each clause negated */
+static int dnf_not (struct dnf *a, uint32_t nwords)
+{
+        int rc;
+        uint32_t i;
+        uint32_t bit;
+        struct dnf r;
+        struct dnf n;
+
+        memset(&r, 0, sizeof(r));
+        memset(&n, 0, sizeof(n));
+        rc = dnf_true(&r, nwords);
+        if (rc != 0) {
+                goto bail;
+        }
+        for (i = 0; i < a->count; i++) {
+                n.count = 0;
+                for (bit = 0; bit < nwords * 64; bit++) {
+                        if (dnf_required(a, i, nwords)[bit / 64] & (1ULL << (bit % 64))) {
+                                rc = dnf_literal(&n, nwords, bit, 1);
+                        } else if (dnf_forbidden(a, i, nwords)[bit / 64] & (1ULL << (bit % 64))) {
+                                rc = dnf_literal(&n, nwords, bit, 0);
+                        } else {
+                                continue;
+                        }
+                        if (rc != 0) {
+                                goto bail;
+                        }
+                }
+                rc = dnf_and(&r, &n, nwords);
+                if (rc != 0) {
+                        goto bail;
+                }
+        }
+        dnf_uninit(&n);
+        dnf_uninit(a);
+        *a = r;
+        return 0;
+bail:   dnf_uninit(&n);
+        dnf_uninit(&r);
+        return rc;
+}
+
 static struct clew_expression * clew_expression_create_actual (const char *orig, const char *from)
 {
         int i;
@@ -119,6 +330,7 @@ static struct clew_expression * clew_expression_create_actual (const char *orig,
                 clew_errorf("can not allocate memory");
                 goto bail;
         }
+        memset(expression, 0, sizeof(struct clew_expression));
         expression->orig = strdup(orig);
         if (expression->orig == NULL) {
                 clew_errorf("can not allocate memory");
@@ -293,6 +505,186 @@ bail:   if (expression != NULL) {
         return NULL;
 }
 
+/*
+ * records where each operand of the postfix program starts, so the
+ * program can be evaluated from the end with and and or short circuiting.
+ */
+static int clew_expression_link (struct clew_expression *expression)
+{
+        uint32_t i;
+        uint32_t n;
+        uint32_t *tops;
+
+        expression->starts = (uint32_t *) malloc(sizeof(uint32_t) * (expression->count + 1));
+        tops = (uint32_t *) malloc(sizeof(uint32_t) * (expression->count + 1));
+        if (unlikely(expression->starts == NULL || tops == NULL)) {
+                clew_errorf("can not allocate memory");
+                free(tops);
+                return -1;
+        }
+        for (i = 0, n = 0; i < expression->count; i++) {
+                switch (expression->postfix[i]) {
+                        case clew_tag_internal_expression_and:
+                        case clew_tag_internal_expression_or:
+                                n -= 1;
+                                expression->starts[i] = tops[n - 1];
+                                break;
+                        case clew_tag_internal_expression_not:
+                                expression->starts[i] = tops[n - 1];
+                                break;
+                        case clew_tag_internal_expression_any:
+                                expression->starts[i] = i;
+                                expression->starts[i + 1] = i;
+                                tops[n++] = i;
+                                i++;
+                                break;
+                        default:
+                                expression->starts[i] = i;
+                                tops[n++] = i;
+                                break;
+                }
+        }
+        free(tops);
+        return 0;
+}
+
+/*
+ * compiles the postfix program to dnf. an expression referring to too many
+ * tags, or expanding to too many clauses, is left to the postfix program.
+ */
+static int clew_expression_compile (struct clew_expression *expression)
+{
+        int rc;
+        uint32_t i;
+        uint32_t w;
+        uint32_t nbits;
+        uint32_t nwords;
+        uint64_t miss;
+        uint16_t *bits;
+        const uint32_t *tags;
+        const uint32_t *postfix;
+        struct dnf *stack;
+        struct dnf *pstack;
+
+        rc = -1;
+        stack = NULL;
+        bits  = (uint16_t *) calloc(clew_tag_last, sizeof(uint16_t));
+        if (unlikely(bits == NULL)) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        for (nbits = 0, postfix = expression->postfix; *postfix != clew_tag_unknown; postfix++) {
+                switch (*postfix) {
+                        case clew_tag_internal_expression_and:
+                        case clew_tag_internal_expression_or:
+                        case clew_tag_internal_expression_not:
+                                break;
+                        case clew_tag_internal_expression_any:
+                                for (tags = clew_tags_group_value(*++postfix); *tags != clew_tag_unknown; tags++) {
+                                        if (bits[*tags] == 0 && nbits < DNF_BITS_MAX) {
+                                                bits[*tags] = ++nbits;
+                                        }
+                                }
+                                break;
+                        default:
+                                if (bits[*postfix] == 0 && nbits < DNF_BITS_MAX) {
+                                        bits[*postfix] = ++nbits;
+                                }
+                                break;
+                }
+        }
+        if (nbits >= DNF_BITS_MAX) {
+                goto large;
+        }
+        nwords = (nbits == 0) ? 1 : (nbits + 63) / 64;
+
+        stack = (struct dnf *) calloc(expression->count + 1, sizeof(struct dnf));
+        if (unlikely(stack == NULL)) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        for (pstack = stack, postfix = expression->postfix; *postfix != clew_tag_unknown; postfix++) {
+                switch (*postfix) {
+                        case clew_tag_internal_expression_and:
+                                pstack--;
+                                rc = dnf_and(pstack - 1, pstack, nwords);
+                                dnf_uninit(pstack);
+                                break;
+                        case clew_tag_internal_expression_or:
+                                pstack--;
+                                rc = dnf_or(pstack - 1, pstack, nwords);
+                                dnf_uninit(pstack);
+                                break;
+                        case clew_tag_internal_expression_not:
+                                rc = dnf_not(pstack - 1, nwords);
+                                break;
+                        case clew_tag_internal_expression_any:
+                                rc = 0;
+                                for (tags = clew_tags_group_value(*++postfix); rc == 0 && *tags != clew_tag_unknown; tags++) {
+                                        rc = dnf_literal(pstack, nwords, bits[*tags] - 1, 0);
+                                }
+                                pstack++;
+                                break;
+                        default:
+                                rc = dnf_literal(pstack++, nwords, bits[*postfix] - 1, 0);
+                                break;
+                }
+                if (rc > 0) {
+                        goto large;
+                } else if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (unlikely(pstack - stack > 1)) {
+                clew_errorf("invalid expression: '%s'", expression->text);
+                rc = -1;
+                goto bail;
+        }
+
+        /* the cheapest tests that can fail an element, tried before the clauses */
+        expression->filters = (uint64_t *) calloc(2 * nwords, sizeof(uint64_t));
+        if (unlikely(expression->filters == NULL)) {
+                clew_errorf("can not allocate memory");
+                rc = -1;
+                goto bail;
+        }
+        expression->nbits    = nbits;
+        expression->nwords   = nwords;
+        expression->nclauses = stack[0].count;
+        expression->bits     = bits;
+        expression->clauses  = stack[0].words;
+        stack[0].words = NULL;
+
+        expression->nomatch  = 0;
+        expression->required = (expression->nclauses > 0);
+        for (w = 0; w < nwords; w++) {
+                expression->filters[nwords + w] = (expression->nclauses > 0) ? ~0ULL : 0;
+        }
+        for (i = 0; i < expression->nclauses; i++) {
+                for (w = 0, miss = 0; w < nwords; w++) {
+                        miss |= expression->clauses[i * 2 * nwords + w];
+                        expression->filters[w] |= expression->clauses[i * 2 * nwords + w];
+                        expression->filters[nwords + w] &= expression->clauses[i * 2 * nwords + nwords + w];
+                }
+                expression->nomatch  |= (miss == 0);
+                expression->required &= (miss != 0);
+        }
+        expression->compiled = 1;
+        clew_debugf("compiled: %d clauses over %d tags", expression->nclauses, expression->nbits);
+        free(stack);
+        return 0;
+large:  clew_debugf("not compiled, too large: '%s'", expression->text);
+        rc = 0;
+bail:   if (stack != NULL) {
+                for (pstack = stack; pstack < stack + expression->count + 1; pstack++) {
+                        dnf_uninit(pstack);
+                }
+                free(stack);
+        }
+        free(bits);
+        return rc;
+}
+
 const char * clew_expression_orig (struct clew_expression *expression)
 {
         if (expression == NULL) {
@@ -456,6 +848,12 @@ wild_restart:
                 free(str);
                 return NULL;
         }
+        if (unlikely(clew_expression_link(rc) != 0 || clew_expression_compile(rc) != 0)) {
+                clew_errorf("can not compile expression");
+                clew_expression_destroy(rc);
+                free(str);
+                return NULL;
+        }
         //clew_expression_create_actual("A and ( B or C and D ) or ( E ) ");
         //clew_expression_create_actual("A and B or C ");
         //clew_expression_create_actual("A and B and C ");
@@ -470,6 +868,10 @@ void clew_expression_destroy (struct clew_expression *expression)
         }
         free(expression->orig);
         free(expression->text);
+        free(expression->starts);
+        free(expression->bits);
+        free(expression->clauses);
+        free(expression->filters);
         free(expression);
 }
 
@@ -512,6 +914,35 @@ int clew_expression_count (const struct clew_expression *expression)
         return expression->count;
 }
 
+/* evaluates the operand ending at i, the right side of and and or is skipped once the left decides */
+static int expression_match_short (const struct clew_expression *expression, uint32_t i, void *context, int (*_has) (void *context, uint32_t tag))
+{
+        const uint32_t *tags;
+        switch (expression->postfix[i]) {
+                case clew_tag_internal_expression_and:
+                        if (!expression_match_short(expression, expression->starts[i - 1] - 1, context, _has)) {
+                                return 0;
+                        }
+                        return expression_match_short(expression, i - 1, context, _has);
+                case clew_tag_internal_expression_or:
+                        if (expression_match_short(expression, expression->starts[i - 1] - 1, context, _has)) {
+                                return 1;
+                        }
+                        return expression_match_short(expression, i - 1, context, _has);
+                case clew_tag_internal_expression_not:
+                        return !expression_match_short(expression, i - 1, context, _has);
+        }
+        if (expression->starts[i] != i) {
+                for (tags = clew_tags_group_value(expression->postfix[i]); *tags != clew_tag_unknown; tags++) {
+                        if (_has(context, *tags)) {
+                                return 1;
+                        }
+                }
+                return 0;
+        }
+        return !!_has(context, expression->postfix[i]);
+}
+
 int clew_expression_match (
                 const struct clew_expression *expression,
                 void *context,
@@ -548,6 +979,9 @@ int clew_expression_match (
         if (expression->count == 0) {
                 return 0;
         }
+        if (_and == NULL && _or == NULL && _not == NULL && _has != NULL) {
+                return expression_match_short(expression, expression->count - 1, context, _has);
+        }
         if (expression->count <= sizeof(_stack) / sizeof(_stack[0])) {
                 stack = _stack;
         } else {
@@ -643,6 +1077,279 @@ bail:   if (stack != NULL && stack != _stack) {
         return rc;
 }
 
+struct expression_match_tags {
+        const uint32_t *tags;
+        uint64_t ntags;
+};
+
+static int expression_match_tags_has (void *context, uint32_t tag)
+{
+        uint64_t i;
+        const struct expression_match_tags *match = (const struct expression_match_tags *) context;
+        for (i = 0; i < match->ntags; i++) {
+                if (match->tags[i] == tag) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+int clew_expression_match_tags (const struct clew_expression *expression, const uint32_t *tags, uint64_t ntags, struct clew_expression_stats *stats)
+{
+        int rc;
+        uint64_t i;
+        uint32_t c;
+        uint32_t w;
+        uint32_t bit;
+        uint32_t nwords;
+        uint64_t any;
+        uint64_t miss;
+        uint64_t mask[DNF_WORDS_MAX];
+        const uint64_t *clause;
+        struct expression_match_tags match;
+
+        if (unlikely(expression == NULL)) {
+                clew_errorf("expression is null");
+                return -1;
+        }
+        if (stats != NULL) {
+                stats->calls += 1;
+        }
+        if (unlikely(expression->compiled == 0)) {
+                match.tags  = tags;
+                match.ntags = ntags;
+                rc = clew_expression_match(expression, &match, NULL, NULL, NULL, expression_match_tags_has);
+                if (stats != NULL) {
+                        stats->matches += (rc == 1);
+                }
+                return rc;
+        }
+
+        nwords = expression->nwords;
+        memset(mask, 0, sizeof(uint64_t) * nwords);
+        for (i = 0, any = 0; i < ntags; i++) {
+                if (likely(tags[i] < clew_tag_last) && (bit = expression->bits[tags[i]]) != 0) {
+                        bit -= 1;
+                        mask[bit / 64] |= 1ULL << (bit % 64);
+                        any = 1;
+                }
+        }
+        if (any == 0) {
+                if (stats != NULL) {
+                        stats->skipped += 1;
+                        stats->matches += expression->nomatch;
+                }
+                return expression->nomatch;
+        }
+        for (w = 0, any = 0, miss = 0; w < nwords; w++) {
+                any  |= mask[w] & expression->filters[w];
+                miss |= mask[w] & expression->filters[nwords + w];
+        }
+        if ((expression->required && any == 0) || miss != 0) {
+                if (stats != NULL) {
+                        stats->skipped += 1;
+                }
+                return 0;
+        }
+        /* plain word loops, so they vectorize for wide expressions */
+        for (c = 0, clause = expression->clauses; c < expression->nclauses; c++, clause += 2 * nwords) {
+                for (w = 0, miss = 0; w < nwords; w++) {
+                        miss |= (clause[w] & ~mask[w]) | (clause[nwords + w] & mask[w]);
+                }
+                if (miss == 0) {
+                        if (stats != NULL) {
+                                stats->clauses += c + 1;
+                                stats->matches += 1;
+                                stats->hits[c] += 1;
+                        }
+                        return 1;
+                }
+        }
+        if (stats != NULL) {
+                stats->clauses += expression->nclauses;
+        }
+        return 0;
+}
+
+static inline uint64_t expression_cache_mix (uint64_t x)
+{
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+}
+
+static __attribute__ ((noinline)) int expression_match_cached (const struct clew_expression *expression, struct clew_expression_cache *cache, const uint32_t *tags, uint64_t ntags, struct clew_expression_stats *stats)
+{
+        int rc;
+        int hit;
+        uint64_t i;
+        uint64_t n;
+        uint64_t hash;
+        uint64_t check;
+        struct clew_expression_cache_entry *entry;
+
+        /* a sum and a xor of differently mixed ids, so the tags need not be
+         * sorted. once compiled only the tags the expression refers to can
+         * change the result, the others are left out of the key */
+        hash  = 0;
+        check = 0;
+        for (i = 0, n = 0; i < ntags; i++) {
+                if (expression->compiled && (unlikely(tags[i] >= clew_tag_last) || expression->bits[tags[i]] == 0)) {
+                        continue;
+                }
+                hash  += expression_cache_mix(tags[i] + 0x9e3779b97f4a7c15ULL);
+                check ^= expression_cache_mix(((uint64_t) tags[i] << 32) ^ 0xc2b2ae3d27d4eb4fULL);
+                n     += 1;
+        }
+        if (expression->compiled && n == 0) {
+                if (stats != NULL) {
+                        stats->calls   += 1;
+                        stats->skipped += 1;
+                        stats->matches += expression->nomatch;
+                }
+                return expression->nomatch;
+        }
+        hash += expression_cache_mix(n);
+        hash |= 1;
+        entry = &cache->entries[(hash >> 32) & (CLEW_EXPRESSION_CACHE_SIZE - 1)];
+        hit   = (entry->hash == hash && entry->check == check && entry->ntags == n);
+        if (unlikely(cache->lookups < EXPRESSION_CACHE_WARMUP)) {
+                /* tag sets that seldom repeat only pay for the hashing */
+                cache->lookups += 1;
+                cache->hits    += hit;
+                cache->bypass   = (cache->lookups == EXPRESSION_CACHE_WARMUP) && (cache->hits * 2 < cache->lookups);
+        }
+        if (likely(hit)) {
+                if (stats != NULL) {
+                        stats->calls   += 1;
+                        stats->cached  += 1;
+                        stats->matches += entry->match;
+                }
+                return entry->match;
+        }
+        rc = clew_expression_match_tags(expression, tags, ntags, stats);
+        if (rc >= 0) {
+                entry->hash  = hash;
+                entry->check = check;
+                entry->ntags = n;
+                entry->match = rc;
+        }
+        return rc;
+}
+
+int clew_expression_match_cached (const struct clew_expression *expression, struct clew_expression_cache *cache, const uint32_t *tags, uint64_t ntags, struct clew_expression_stats *stats)
+{
+        /* a few clauses are tested faster than the tags are hashed, and so
+         * are the clauses of tag sets that do not repeat */
+        if (unlikely(expression == NULL) ||
+            (expression->compiled && expression->nclauses < EXPRESSION_CACHE_CLAUSES_MIN) ||
+            cache->bypass) {
+                return clew_expression_match_tags(expression, tags, ntags, stats);
+        }
+        return expression_match_cached(expression, cache, tags, ntags, stats);
+}
+
+struct clew_expression * clew_expression_clone (const struct clew_expression *expression)
+{
+        struct clew_expression *clone;
+
+        if (unlikely(expression == NULL)) {
+                clew_errorf("expression is null");
+                return NULL;
+        }
+        clone = (struct clew_expression *) malloc(sizeof(struct clew_expression) + sizeof(uint32_t) * (expression->count + 1));
+        if (unlikely(clone == NULL)) {
+                clew_errorf("can not allocate memory");
+                return NULL;
+        }
+        memcpy(clone, expression, sizeof(struct clew_expression) + sizeof(uint32_t) * (expression->count + 1));
+        clone->orig    = strdup(expression->orig);
+        clone->text    = strdup(expression->text);
+        clone->starts  = (uint32_t *) malloc(sizeof(uint32_t) * (expression->count + 1));
+        clone->bits    = NULL;
+        clone->clauses = NULL;
+        clone->filters = NULL;
+        if (clone->orig == NULL || clone->text == NULL || clone->starts == NULL) {
+                goto bail;
+        }
+        memcpy(clone->starts, expression->starts, sizeof(uint32_t) * (expression->count + 1));
+        if (expression->compiled) {
+                clone->bits    = (uint16_t *) malloc(sizeof(uint16_t) * clew_tag_last);
+                clone->clauses = (uint64_t *) malloc(sizeof(uint64_t) * 2 * expression->nwords * (expression->nclauses + 1));
+                clone->filters = (uint64_t *) malloc(sizeof(uint64_t) * 2 * expression->nwords);
+                if (clone->bits == NULL || clone->clauses == NULL || clone->filters == NULL) {
+                        goto bail;
+                }
+                memcpy(clone->bits, expression->bits, sizeof(uint16_t) * clew_tag_last);
+                memcpy(clone->clauses, expression->clauses, sizeof(uint64_t) * 2 * expression->nwords * expression->nclauses);
+                memcpy(clone->filters, expression->filters, sizeof(uint64_t) * 2 * expression->nwords);
+        }
+        return clone;
+bail:   clew_errorf("can not allocate memory");
+        clew_expression_destroy(clone);
+        return NULL;
+}
+
+void clew_expression_optimize (struct clew_expression *expression, struct clew_expression_stats *stats)
+{
+        uint32_t i;
+        uint32_t j;
+        uint32_t nwords;
+        uint64_t hits;
+        uint64_t clause[2 * DNF_WORDS_MAX];
+
+        if (unlikely(expression == NULL || stats == NULL)) {
+                return;
+        }
+        if (expression->compiled == 0) {
+                return;
+        }
+        /* insertion sort, stable so ties keep the written order */
+        nwords = expression->nwords;
+        for (i = 1; i < expression->nclauses; i++) {
+                hits = stats->hits[i];
+                memcpy(clause, expression->clauses + i * 2 * nwords, sizeof(uint64_t) * 2 * nwords);
+                for (j = i; j > 0 && stats->hits[j - 1] < hits; j--) {
+                        stats->hits[j] = stats->hits[j - 1];
+                        memcpy(expression->clauses + j * 2 * nwords, expression->clauses + (j - 1) * 2 * nwords, sizeof(uint64_t) * 2 * nwords);
+                }
+                stats->hits[j] = hits;
+                memcpy(expression->clauses + j * 2 * nwords, clause, sizeof(uint64_t) * 2 * nwords);
+        }
+        clew_expression_stats_debug(expression, stats);
+}
+
+/* hits are by clause position in one copy of the expression, they are not added */
+void clew_expression_stats_add (struct clew_expression_stats *stats, const struct clew_expression_stats *other)
+{
+        stats->calls   += other->calls;
+        stats->skipped += other->skipped;
+        stats->clauses += other->clauses;
+        stats->matches += other->matches;
+        stats->cached  += other->cached;
+}
+
+void clew_expression_stats_debug (const struct clew_expression *expression, const struct clew_expression_stats *stats)
+{
+        uint32_t i;
+        if (expression == NULL || stats == NULL) {
+                return;
+        }
+        clew_debugf("expression: '%s'", expression->orig);
+        clew_debugf("  compiled: %d, clauses: %d, tags: %d", expression->compiled, expression->nclauses, expression->nbits);
+        clew_debugf("  calls   : %lu, skipped: %lu, matches: %lu", stats->calls, stats->skipped, stats->matches);
+        clew_debugf("  cached  : %lu, %.2f%%", stats->cached, (stats->calls > 0) ? (100.0 * stats->cached) / stats->calls : 0.0);
+        clew_debugf("  clauses : %lu tested, %.2f per call", stats->clauses, (stats->calls > 0) ? (double) stats->clauses / stats->calls : 0.0);
+        for (i = 0; i < expression->nclauses && expression->compiled; i++) {
+                if (stats->hits[i] > 0) {
+                        clew_debugf("  clause %d: %lu hits", i, stats->hits[i]);
+                }
+        }
+}
+
 int clew_expression_compare (const struct clew_expression *first, const struct clew_expression *second)
 {
         if (first == NULL && second == NULL) {
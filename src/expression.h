@@ -5,10 +5,46 @@
 extern "C" {
 #endif
 
+#define CLEW_EXPRESSION_CLAUSES_MAX     256
+
 struct clew_expression;
 
+/* counters of one thread, filled by clew_expression_match_tags */
+struct clew_expression_stats {
+        uint64_t calls;
+        uint64_t skipped;       /* decided before testing a clause */
+        uint64_t clauses;       /* clauses tested */
+        uint64_t matches;
+        uint64_t cached;        /* answered by a clew_expression_cache */
+        uint64_t hits[CLEW_EXPRESSION_CLAUSES_MAX];     /* matches by clause position */
+};
+
+#define CLEW_EXPRESSION_CACHE_SIZE      1024
+
+struct clew_expression_cache_entry {
+        uint64_t hash;          /* 0 if empty */
+        uint64_t check;
+        uint32_t ntags;
+        uint32_t match;
+};
+
+/*
+ * results of one expression by tag set, for one thread, zeroed before use
+ * and only ever used with that expression. direct mapped, keyed by two
+ * independent 64 bit hashes of the tags that do not depend on their order,
+ * a hit needs both and the tag count to be equal. not used for expressions
+ * of a few clauses, and turned off if most of the first lookups miss.
+ */
+struct clew_expression_cache {
+        uint32_t lookups;
+        uint32_t hits;
+        int bypass;
+        struct clew_expression_cache_entry entries[CLEW_EXPRESSION_CACHE_SIZE];
+};
+
 struct clew_expression * clew_expression_create (const char *expression);
 void clew_expression_destroy (struct clew_expression *expression);
+struct clew_expression * clew_expression_clone (const struct clew_expression *expression);
 
 const char * clew_expression_orig (struct clew_expression *expression);
 const char * clew_expression_text (struct clew_expression *expression);
@@ -21,6 +57,17 @@ int clew_expression_match (
 		int (*_not) (int first),
 		int (*_has) (void *context, uint32_t tag));
 
+/* tags need not be sorted, runs the compiled form if there is one. stats may be NULL */
+int clew_expression_match_tags (const struct clew_expression *expression, const uint32_t *tags, uint64_t ntags, struct clew_expression_stats *stats);
+
+/* as match tags, looks the tag set up in cache first */
+int clew_expression_match_cached (const struct clew_expression *expression, struct clew_expression_cache *cache, const uint32_t *tags, uint64_t ntags, struct clew_expression_stats *stats);
+
+/* moves the clauses that matched most to the front, with their hits. must not race with matching */
+void clew_expression_optimize (struct clew_expression *expression, struct clew_expression_stats *stats);
+void clew_expression_stats_add (struct clew_expression_stats *stats, const struct clew_expression_stats *other);
+void clew_expression_stats_debug (const struct clew_expression *expression, const struct clew_expression_stats *stats);
+
 int clew_expression_has (const struct clew_expression *expression, uint32_t tag);
 int clew_expression_count (const struct clew_expression *expression);
 
@@ -0,0 +1,428 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+#include "stack.h"
+#include "graph.h"
+
+#define CLEW_GRAPH_MAGIC                "clewgrf1"
+
+/* followed by ids, lons, lats, offsets and edges, every section is 8 byte aligned */
+struct clew_graph_file_header {
+        char magic[8];
+        uint64_t key;
+        uint64_t count;
+        uint64_t nedges;
+};
+
+struct clew_graph {
+        int completed;
+        uint64_t count;
+        uint64_t nedges;
+
+        struct clew_stack ids;          /* uint64_t */
+        struct clew_stack lons;         /* int32_t */
+        struct clew_stack lats;         /* int32_t */
+        struct clew_stack froms;        /* uint64_t, source of every edge until completed */
+        struct clew_stack offsets;      /* uint64_t, count + 1 offsets into edges */
+        struct clew_stack edges;        /* struct clew_graph_edge */
+
+        /* columns read by the accessors, stack buffers or the file mapping */
+        const uint64_t *pids;
+        const int32_t *plons;
+        const int32_t *plats;
+        const uint64_t *poffsets;
+        const struct clew_graph_edge *pedges;
+        void *map;
+        uint64_t map_size;
+};
+
+static void clew_graph_point_columns (struct clew_graph *graph)
+{
+        graph->pids     = (const uint64_t *) clew_stack_buffer(&graph->ids);
+        graph->plons    = (const int32_t *) clew_stack_buffer(&graph->lons);
+        graph->plats    = (const int32_t *) clew_stack_buffer(&graph->lats);
+        graph->poffsets = (const uint64_t *) clew_stack_buffer(&graph->offsets);
+        graph->pedges   = (const struct clew_graph_edge *) clew_stack_buffer(&graph->edges);
+}
+
+struct clew_graph * clew_graph_create (void)
+{
+        struct clew_graph *graph;
+
+        graph = (struct clew_graph *) malloc(sizeof(struct clew_graph));
+        if (graph == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        memset(graph, 0, sizeof(struct clew_graph));
+        graph->ids      = clew_stack_init2(sizeof(uint64_t), 64 * 1024);
+        graph->lons     = clew_stack_init2(sizeof(int32_t), 64 * 1024);
+        graph->lats     = clew_stack_init2(sizeof(int32_t), 64 * 1024);
+        graph->froms    = clew_stack_init2(sizeof(uint64_t), 64 * 1024);
+        graph->offsets  = clew_stack_init2(sizeof(uint64_t), 64 * 1024);
+        graph->edges    = clew_stack_init2(sizeof(struct clew_graph_edge), 64 * 1024);
+        clew_graph_reset(graph);
+
+        return graph;
+bail:   return NULL;
+}
+
+void clew_graph_destroy (struct clew_graph *graph)
+{
+        if (graph == NULL) {
+                return;
+        }
+        clew_graph_reset(graph);
+        clew_stack_uninit(&graph->ids);
+        clew_stack_uninit(&graph->lons);
+        clew_stack_uninit(&graph->lats);
+        clew_stack_uninit(&graph->froms);
+        clew_stack_uninit(&graph->offsets);
+        clew_stack_uninit(&graph->edges);
+        free(graph);
+}
+
+void clew_graph_reset (struct clew_graph *graph)
+{
+        if (graph->map != NULL) {
+                munmap(graph->map, graph->map_size);
+        }
+        graph->map       = NULL;
+        graph->map_size  = 0;
+        clew_stack_reset(&graph->ids);
+        clew_stack_reset(&graph->lons);
+        clew_stack_reset(&graph->lats);
+        clew_stack_reset(&graph->froms);
+        clew_stack_reset(&graph->offsets);
+        clew_stack_reset(&graph->edges);
+        clew_graph_point_columns(graph);
+        graph->completed = 0;
+        graph->count     = 0;
+        graph->nedges    = 0;
+}
+
+int clew_graph_add_node (struct clew_graph *graph, uint64_t id, int32_t lon, int32_t lat, uint64_t *index)
+{
+        int rc;
+
+        if (graph->completed) {
+                clew_errorf("graph is completed");
+                goto bail;
+        }
+        rc  = clew_stack_push_uint64(&graph->ids, id);
+        rc |= clew_stack_push_int32(&graph->lons, lon);
+        rc |= clew_stack_push_int32(&graph->lats, lat);
+        if (rc != 0) {
+                clew_errorf("can not push graph node");
+                goto bail;
+        }
+        clew_graph_point_columns(graph);
+        *index = graph->count;
+        graph->count += 1;
+
+        return 0;
+bail:   return -1;
+}
+
+int clew_graph_add_edge (struct clew_graph *graph, uint64_t from, uint64_t to, double distance, double duration, double cost)
+{
+        int rc;
+        struct clew_graph_edge edge;
+
+        if (graph->completed) {
+                clew_errorf("graph is completed");
+                goto bail;
+        }
+        edge.node     = to;
+        edge.distance = distance;
+        edge.duration = duration;
+        edge.cost     = cost;
+        rc  = clew_stack_push_uint64(&graph->froms, from);
+        rc |= clew_stack_push(&graph->edges, &edge);
+        if (rc != 0) {
+                clew_errorf("can not push graph edge");
+                goto bail;
+        }
+        graph->nedges += 1;
+
+        return 0;
+bail:   return -1;
+}
+
+/* stable counting sort of the edges by source node */
+int clew_graph_complete (struct clew_graph *graph)
+{
+        int rc;
+        uint64_t i;
+        uint64_t *offsets;
+        uint64_t *cursors;
+        const uint64_t *froms;
+        const struct clew_graph_edge *edges;
+        struct clew_stack sorted;
+
+        if (graph->completed) {
+                return 0;
+        }
+
+        cursors = NULL;
+        sorted  = clew_stack_init2(sizeof(struct clew_graph_edge), 64 * 1024);
+
+        rc  = clew_stack_resize(&graph->offsets, graph->count + 1);
+        rc |= clew_stack_resize(&sorted, graph->nedges);
+        if (rc != 0) {
+                clew_errorf("can not allocate graph edges");
+                goto bail;
+        }
+        cursors = (uint64_t *) malloc(sizeof(uint64_t) * (graph->count + 1));
+        if (cursors == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+
+        offsets = (uint64_t *) clew_stack_buffer(&graph->offsets);
+        froms   = (const uint64_t *) clew_stack_buffer(&graph->froms);
+        edges   = (const struct clew_graph_edge *) clew_stack_buffer(&graph->edges);
+        memset(offsets, 0, sizeof(uint64_t) * (graph->count + 1));
+        for (i = 0; i < graph->nedges; i++) {
+                offsets[froms[i] + 1] += 1;
+        }
+        for (i = 0; i < graph->count; i++) {
+                offsets[i + 1] += offsets[i];
+        }
+        memcpy(cursors, offsets, sizeof(uint64_t) * (graph->count + 1));
+        for (i = 0; i < graph->nedges; i++) {
+                ((struct clew_graph_edge *) clew_stack_buffer(&sorted))[cursors[froms[i]]++] = edges[i];
+        }
+        free(cursors);
+
+        clew_stack_uninit(&graph->froms);
+        clew_stack_uninit(&graph->edges);
+        graph->edges = sorted;
+        clew_graph_point_columns(graph);
+        graph->completed = 1;
+
+        return 0;
+bail:   if (cursors != NULL) {
+                free(cursors);
+        }
+        clew_stack_uninit(&sorted);
+        return -1;
+}
+
+uint64_t clew_graph_count (const struct clew_graph *graph)
+{
+        return graph->count;
+}
+
+uint64_t clew_graph_edges_count (const struct clew_graph *graph)
+{
+        return graph->nedges;
+}
+
+uint64_t clew_graph_memory (const struct clew_graph *graph)
+{
+        uint64_t memory;
+        memory  = graph->ids.avail * sizeof(uint64_t);
+        memory += graph->lons.avail * sizeof(int32_t);
+        memory += graph->lats.avail * sizeof(int32_t);
+        memory += graph->froms.avail * sizeof(uint64_t);
+        memory += graph->offsets.avail * sizeof(uint64_t);
+        memory += graph->edges.avail * sizeof(struct clew_graph_edge);
+        return memory;
+}
+
+uint64_t clew_graph_id (const struct clew_graph *graph, uint64_t index)
+{
+        return graph->pids[index];
+}
+
+int32_t clew_graph_lon (const struct clew_graph *graph, uint64_t index)
+{
+        return graph->plons[index];
+}
+
+int32_t clew_graph_lat (const struct clew_graph *graph, uint64_t index)
+{
+        return graph->plats[index];
+}
+
+const struct clew_graph_edge * clew_graph_edges (const struct clew_graph *graph, uint64_t index, uint64_t *nedges)
+{
+        *nedges = graph->poffsets[index + 1] - graph->poffsets[index];
+        return graph->pedges + graph->poffsets[index];
+}
+
+static uint64_t clew_graph_file_size (uint64_t count, uint64_t nedges)
+{
+        return sizeof(struct clew_graph_file_header) +
+               count * sizeof(uint64_t) +
+               count * sizeof(int32_t) * 2 +
+               (count + 1) * sizeof(uint64_t) +
+               nedges * sizeof(struct clew_graph_edge);
+}
+
+/* offsets start at 0, never decrease and end at nedges, edges point at nodes */
+static int clew_graph_file_valid (uint64_t count, uint64_t nedges, const uint64_t *offsets, const struct clew_graph_edge *edges)
+{
+        uint64_t i;
+
+        if (offsets[0] != 0 || offsets[count] != nedges) {
+                return 0;
+        }
+        for (i = 0; i < count; i++) {
+                if (offsets[i] > offsets[i + 1]) {
+                        return 0;
+                }
+        }
+        for (i = 0; i < nedges; i++) {
+                if (edges[i].node >= count) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+int clew_graph_load (struct clew_graph *graph, const char *path, uint64_t key)
+{
+        int fd;
+        int rc;
+        void *map;
+        uint8_t *ptr;
+        struct stat st;
+        struct clew_graph_file_header header;
+
+        fd = -1;
+        clew_graph_reset(graph);
+
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                goto out;
+        }
+        rc = fstat(fd, &st);
+        if (rc < 0 || (uint64_t) st.st_size < sizeof(header)) {
+                goto out;
+        }
+        if (read(fd, &header, sizeof(header)) != (ssize_t) sizeof(header)) {
+                goto out;
+        }
+        if (memcmp(header.magic, CLEW_GRAPH_MAGIC, sizeof(header.magic)) != 0 ||
+            header.key != key ||
+            header.count > (uint64_t) st.st_size ||
+            header.nedges > (uint64_t) st.st_size ||
+            clew_graph_file_size(header.count, header.nedges) != (uint64_t) st.st_size) {
+                goto out;
+        }
+
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+                clew_errorf("can not map graph: %s", path);
+                goto bail;
+        }
+        close(fd);
+
+        ptr = (uint8_t *) map + sizeof(header);
+        graph->pids     = (const uint64_t *) ptr;
+        ptr            += header.count * sizeof(uint64_t);
+        graph->plons    = (const int32_t *) ptr;
+        ptr            += header.count * sizeof(int32_t);
+        graph->plats    = (const int32_t *) ptr;
+        ptr            += header.count * sizeof(int32_t);
+        graph->poffsets = (const uint64_t *) ptr;
+        ptr            += (header.count + 1) * sizeof(uint64_t);
+        graph->pedges   = (const struct clew_graph_edge *) ptr;
+        if (!clew_graph_file_valid(header.count, header.nedges, graph->poffsets, graph->pedges)) {
+                munmap(map, st.st_size);
+                clew_graph_reset(graph);
+                return 1;
+        }
+        graph->map       = map;
+        graph->map_size  = st.st_size;
+        graph->count     = header.count;
+        graph->nedges    = header.nedges;
+        graph->completed = 1;
+
+        return 0;
+out:    if (fd >= 0) {
+                close(fd);
+        }
+        return 1;
+bail:   if (fd >= 0) {
+                close(fd);
+        }
+        return -1;
+}
+
+int clew_graph_save (const struct clew_graph *graph, const char *path, uint64_t key)
+{
+        int rc;
+        FILE *fp;
+        char *tmp;
+        struct clew_graph_file_header header;
+
+        fp  = NULL;
+        tmp = NULL;
+
+        if (graph->completed == 0) {
+                clew_errorf("graph is not completed");
+                goto bail;
+        }
+
+        tmp = (char *) malloc(strlen(path) + sizeof(".tmp"));
+        if (tmp == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        sprintf(tmp, "%s.tmp", path);
+        fp = fopen(tmp, "wb");
+        if (fp == NULL) {
+                clew_errorf("can not open graph for writing: %s", tmp);
+                goto bail;
+        }
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CLEW_GRAPH_MAGIC, sizeof(header.magic));
+        header.key    = key;
+        header.count  = graph->count;
+        header.nedges = graph->nedges;
+
+        rc  = (fwrite(&header, sizeof(header), 1, fp) != 1);
+        rc |= (fwrite(graph->pids, sizeof(uint64_t), graph->count, fp) != graph->count);
+        rc |= (fwrite(graph->plons, sizeof(int32_t), graph->count, fp) != graph->count);
+        rc |= (fwrite(graph->plats, sizeof(int32_t), graph->count, fp) != graph->count);
+        rc |= (fwrite(graph->poffsets, sizeof(uint64_t), graph->count + 1, fp) != graph->count + 1);
+        rc |= (fwrite(graph->pedges, sizeof(struct clew_graph_edge), graph->nedges, fp) != graph->nedges);
+        if (rc != 0) {
+                clew_errorf("can not write graph: %s", tmp);
+                goto bail;
+        }
+        rc = fclose(fp);
+        fp = NULL;
+        if (rc != 0) {
+                clew_errorf("can not write graph: %s", tmp);
+                goto bail;
+        }
+        rc = rename(tmp, path);
+        if (rc != 0) {
+                clew_errorf("can not rename graph: %s", path);
+                goto bail;
+        }
+
+        free(tmp);
+        return 0;
+bail:   if (fp != NULL) {
+                fclose(fp);
+        }
+        if (tmp != NULL) {
+                unlink(tmp);
+                free(tmp);
+        }
+        return -1;
+}
@@ -0,0 +1,66 @@
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * routing graph in compressed sparse row form. nodes are numbered 0..n-1 in
+ * the order they are added, edges may be added in any order and complete
+ * groups them by source node, keeping the order they were added in. a
+ * completed graph can be saved and later mapped read only from the file,
+ * guarded by a key the caller derives from whatever the graph was built of.
+ */
+
+#define CLEW_GRAPH_NODE_NONE            UINT64_MAX
+#define CLEW_GRAPH_KEY_INIT             0xcbf29ce484222325ULL
+
+/* bump when what a cached graph means changes, tag parsing or way classification for example */
+#define CLEW_GRAPH_VERSION              2
+
+struct clew_graph_edge {
+        uint64_t node;
+        double distance;
+        double duration;
+        double cost;
+};
+
+struct clew_graph;
+
+/* fnv-1a, chain calls starting from CLEW_GRAPH_KEY_INIT */
+static inline uint64_t clew_graph_key_update (uint64_t key, const void *data, uint64_t size)
+{
+        uint64_t i;
+        const uint8_t *ptr = (const uint8_t *) data;
+        for (i = 0; i < size; i++) {
+                key ^= ptr[i];
+                key *= 0x100000001b3ULL;
+        }
+        return key;
+}
+
+struct clew_graph * clew_graph_create (void);
+void clew_graph_destroy (struct clew_graph *graph);
+
+void clew_graph_reset (struct clew_graph *graph);
+int clew_graph_add_node (struct clew_graph *graph, uint64_t id, int32_t lon, int32_t lat, uint64_t *index);
+int clew_graph_add_edge (struct clew_graph *graph, uint64_t from, uint64_t to, double distance, double duration, double cost);
+int clew_graph_complete (struct clew_graph *graph);
+
+uint64_t clew_graph_count (const struct clew_graph *graph);
+uint64_t clew_graph_edges_count (const struct clew_graph *graph);
+uint64_t clew_graph_memory (const struct clew_graph *graph);
+
+uint64_t clew_graph_id (const struct clew_graph *graph, uint64_t index);
+int32_t clew_graph_lon (const struct clew_graph *graph, uint64_t index);
+int32_t clew_graph_lat (const struct clew_graph *graph, uint64_t index);
+/* edges out of index, valid once completed */
+const struct clew_graph_edge * clew_graph_edges (const struct clew_graph *graph, uint64_t index, uint64_t *nedges);
+
+/* returns 1 if file is missing or was built with another key */
+int clew_graph_load (struct clew_graph *graph, const char *path, uint64_t key);
+int clew_graph_save (const struct clew_graph *graph, const char *path, uint64_t key);
+
+#ifdef __cplusplus
+}
+#endif
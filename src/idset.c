@@ -0,0 +1,760 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "debug.h"
+#include "bitmap.h"
+#include "idset.h"
+
+#define CLEW_IDSET_CHUNK_BITS           16
+#define CLEW_IDSET_CHUNK_MASK           0xffff
+#define CLEW_IDSET_ARRAY_MAX            4096
+#define CLEW_IDSET_BITMAP_WORDS         1024
+
+enum {
+        CLEW_IDSET_CONTAINER_ARRAY      = 0,
+        CLEW_IDSET_CONTAINER_BITMAP     = 1,
+        CLEW_IDSET_CONTAINER_RUN        = 2
+};
+
+struct clew_idset_container {
+        uint64_t key;
+        uint32_t type;
+        uint32_t cardinality;
+        uint32_t size;          /* array: values, run: runs */
+        uint32_t avail;         /* array: allocated values, run: allocated runs */
+        uint64_t rank;          /* ids in containers with smaller keys, valid while indexed */
+        uint16_t *ranks;        /* bitmap: ids before each word, run: ids before each run */
+        union {
+                uint16_t *array;        /* sorted values */
+                uint64_t *bitmap;       /* CLEW_IDSET_BITMAP_WORDS words */
+                uint16_t *runs;         /* start, length - 1 pairs */
+        };
+};
+
+static void clew_idset_container_uninit (struct clew_idset_container *container)
+{
+        if (container->array != NULL) {
+                free(container->array);
+        }
+        if (container->ranks != NULL) {
+                free(container->ranks);
+        }
+        container->array = NULL;
+        container->ranks = NULL;
+}
+
+static uint64_t clew_idset_container_memory (const struct clew_idset_container *container)
+{
+        if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                return sizeof(uint64_t) * CLEW_IDSET_BITMAP_WORDS + ((container->ranks != NULL) ? sizeof(uint16_t) * CLEW_IDSET_BITMAP_WORDS : 0);
+        } else if (container->type == CLEW_IDSET_CONTAINER_RUN) {
+                return sizeof(uint16_t) * 2 * container->avail + ((container->ranks != NULL) ? sizeof(uint16_t) * container->size : 0);
+        }
+        return sizeof(uint16_t) * container->avail;
+}
+
+static inline uint32_t clew_idset_array_lower_bound (const uint16_t *array, uint32_t size, uint16_t value)
+{
+        uint32_t l;
+        uint32_t r;
+        uint32_t m;
+
+        l = 0;
+        r = size;
+        while (l < r) {
+                m = l + (r - l) / 2;
+                if (array[m] < value) {
+                        l = m + 1;
+                } else {
+                        r = m;
+                }
+        }
+        return l;
+}
+
+/* returns index of the last run starting at or before value, size if none */
+static inline uint32_t clew_idset_run_find (const uint16_t *runs, uint32_t size, uint16_t value)
+{
+        uint32_t l;
+        uint32_t r;
+        uint32_t m;
+
+        l = 0;
+        r = size;
+        while (l < r) {
+                m = l + (r - l) / 2;
+                if (runs[m * 2] <= value) {
+                        l = m + 1;
+                } else {
+                        r = m;
+                }
+        }
+        return (l == 0) ? size : l - 1;
+}
+
+static inline void clew_idset_bitmap_set_range (uint64_t *bitmap, uint32_t from, uint32_t to)
+{
+        uint32_t i;
+        uint32_t first;
+        uint32_t last;
+
+        first = from / 64;
+        last  = to / 64;
+        if (first == last) {
+                bitmap[first] |= (~0ULL << (from % 64)) & (~0ULL >> (63 - (to % 64)));
+                return;
+        }
+        bitmap[first] |= ~0ULL << (from % 64);
+        for (i = first + 1; i < last; i++) {
+                bitmap[i] = ~0ULL;
+        }
+        bitmap[last] |= ~0ULL >> (63 - (to % 64));
+}
+
+static inline int clew_idset_bitmap_any (const uint64_t *bitmap, uint32_t from, uint32_t to)
+{
+        uint32_t i;
+        uint32_t first;
+        uint32_t last;
+
+        first = from / 64;
+        last  = to / 64;
+        if (first == last) {
+                return !!(bitmap[first] & (~0ULL << (from % 64)) & (~0ULL >> (63 - (to % 64))));
+        }
+        if (bitmap[first] & (~0ULL << (from % 64))) {
+                return 1;
+        }
+        for (i = first + 1; i < last; i++) {
+                if (bitmap[i] != 0) {
+                        return 1;
+                }
+        }
+        return !!(bitmap[last] & (~0ULL >> (63 - (to % 64))));
+}
+
+static inline uint32_t clew_idset_bitmap_cardinality (const uint64_t *bitmap)
+{
+        uint32_t i;
+        uint32_t cardinality;
+        for (i = 0, cardinality = 0; i < CLEW_IDSET_BITMAP_WORDS; i++) {
+                cardinality += __builtin_popcountll(bitmap[i]);
+        }
+        return cardinality;
+}
+
+static int clew_idset_container_to_bitmap (struct clew_idset_container *container)
+{
+        uint32_t i;
+        uint64_t *bitmap;
+
+        if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                return 0;
+        }
+        bitmap = (uint64_t *) calloc(CLEW_IDSET_BITMAP_WORDS, sizeof(uint64_t));
+        if (bitmap == NULL) {
+                clew_errorf("can not allocate memory");
+                return -1;
+        }
+        if (container->type == CLEW_IDSET_CONTAINER_ARRAY) {
+                for (i = 0; i < container->size; i++) {
+                        bitmap[container->array[i] / 64] |= 1ULL << (container->array[i] % 64);
+                }
+        } else {
+                for (i = 0; i < container->size; i++) {
+                        clew_idset_bitmap_set_range(bitmap, container->runs[i * 2], container->runs[i * 2] + container->runs[i * 2 + 1]);
+                }
+        }
+        clew_idset_container_uninit(container);
+        container->type   = CLEW_IDSET_CONTAINER_BITMAP;
+        container->bitmap = bitmap;
+        container->size   = 0;
+        container->avail  = 0;
+        return 0;
+}
+
+/* returns 1 if value was added, 0 if it was already there */
+static int clew_idset_container_add (struct clew_idset_container *container, uint16_t value)
+{
+        int rc;
+        uint32_t at;
+        uint32_t avail;
+        uint16_t *array;
+
+        if (container->type == CLEW_IDSET_CONTAINER_RUN) {
+                rc = clew_idset_container_to_bitmap(container);
+                if (rc < 0) {
+                        return -1;
+                }
+        }
+        if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                if (container->bitmap[value / 64] & (1ULL << (value % 64))) {
+                        return 0;
+                }
+                container->bitmap[value / 64] |= 1ULL << (value % 64);
+                container->cardinality += 1;
+                return 1;
+        }
+
+        at = clew_idset_array_lower_bound(container->array, container->size, value);
+        if (at < container->size && container->array[at] == value) {
+                return 0;
+        }
+        if (container->size == CLEW_IDSET_ARRAY_MAX) {
+                rc = clew_idset_container_to_bitmap(container);
+                if (rc < 0) {
+                        return -1;
+                }
+                return clew_idset_container_add(container, value);
+        }
+        if (container->size == container->avail) {
+                avail = (container->avail == 0) ? 4 : container->avail * 2;
+                avail = (avail > CLEW_IDSET_ARRAY_MAX) ? CLEW_IDSET_ARRAY_MAX : avail;
+                array = (uint16_t *) realloc(container->array, sizeof(uint16_t) * avail);
+                if (array == NULL) {
+                        clew_errorf("can not allocate memory");
+                        return -1;
+                }
+                container->array = array;
+                container->avail = avail;
+        }
+        memmove(container->array + at + 1, container->array + at, sizeof(uint16_t) * (container->size - at));
+        container->array[at]    = value;
+        container->size        += 1;
+        container->cardinality += 1;
+        return 1;
+}
+
+static int clew_idset_container_contains (const struct clew_idset_container *container, uint16_t value)
+{
+        uint32_t at;
+
+        if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                return !!(container->bitmap[value / 64] & (1ULL << (value % 64)));
+        } else if (container->type == CLEW_IDSET_CONTAINER_RUN) {
+                at = clew_idset_run_find(container->runs, container->size, value);
+                return (at < container->size && value <= container->runs[at * 2] + container->runs[at * 2 + 1]);
+        }
+        at = clew_idset_array_lower_bound(container->array, container->size, value);
+        return (at < container->size && container->array[at] == value);
+}
+
+static int clew_idset_container_any (const struct clew_idset_container *container, uint16_t from, uint16_t to)
+{
+        uint32_t at;
+
+        if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                return clew_idset_bitmap_any(container->bitmap, from, to);
+        } else if (container->type == CLEW_IDSET_CONTAINER_RUN) {
+                at = clew_idset_run_find(container->runs, container->size, to);
+                return (at < container->size && container->runs[at * 2] + container->runs[at * 2 + 1] >= from);
+        }
+        at = clew_idset_array_lower_bound(container->array, container->size, from);
+        return (at < container->size && container->array[at] <= to);
+}
+
+/* ors other into container, both arrays are merged while they fit an array */
+static int clew_idset_container_or (struct clew_idset_container *container, const struct clew_idset_container *other)
+{
+        int rc;
+        uint32_t i;
+        uint32_t j;
+        uint32_t n;
+        uint16_t *array;
+
+        if (container->type == CLEW_IDSET_CONTAINER_ARRAY &&
+            other->type == CLEW_IDSET_CONTAINER_ARRAY &&
+            container->size + other->size <= CLEW_IDSET_ARRAY_MAX) {
+                array = (uint16_t *) malloc(sizeof(uint16_t) * (container->size + other->size));
+                if (array == NULL) {
+                        clew_errorf("can not allocate memory");
+                        return -1;
+                }
+                for (i = 0, j = 0, n = 0; i < container->size || j < other->size; ) {
+                        if (j >= other->size || (i < container->size && container->array[i] < other->array[j])) {
+                                array[n++] = container->array[i++];
+                        } else if (i >= container->size || other->array[j] < container->array[i]) {
+                                array[n++] = other->array[j++];
+                        } else {
+                                array[n++] = container->array[i++];
+                                j++;
+                        }
+                }
+                clew_idset_container_uninit(container);
+                container->avail       = container->size + other->size;
+                container->array       = array;
+                container->size        = n;
+                container->cardinality = n;
+                return 0;
+        }
+
+        rc = clew_idset_container_to_bitmap(container);
+        if (rc < 0) {
+                return -1;
+        }
+        if (other->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                for (i = 0; i < CLEW_IDSET_BITMAP_WORDS; i++) {
+                        container->bitmap[i] |= other->bitmap[i];
+                }
+        } else if (other->type == CLEW_IDSET_CONTAINER_RUN) {
+                for (i = 0; i < other->size; i++) {
+                        clew_idset_bitmap_set_range(container->bitmap, other->runs[i * 2], other->runs[i * 2] + other->runs[i * 2 + 1]);
+                }
+        } else {
+                for (i = 0; i < other->size; i++) {
+                        container->bitmap[other->array[i] / 64] |= 1ULL << (other->array[i] % 64);
+                }
+        }
+        container->cardinality = clew_idset_bitmap_cardinality(container->bitmap);
+        return 0;
+}
+
+static int clew_idset_container_foreach (const struct clew_idset_container *container, int (*callback) (void *context, uint64_t id), void *context)
+{
+        int rc;
+        uint32_t i;
+        uint32_t v;
+        uint64_t word;
+        uint64_t base;
+
+        base = container->key << CLEW_IDSET_CHUNK_BITS;
+        if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                for (i = 0; i < CLEW_IDSET_BITMAP_WORDS; i++) {
+                        for (word = container->bitmap[i]; word != 0; word &= word - 1) {
+                                rc = callback(context, base + i * 64 + __builtin_ctzll(word));
+                                if (rc < 0) {
+                                        return -1;
+                                }
+                        }
+                }
+        } else if (container->type == CLEW_IDSET_CONTAINER_RUN) {
+                for (i = 0; i < container->size; i++) {
+                        for (v = container->runs[i * 2]; v <= (uint32_t) container->runs[i * 2] + container->runs[i * 2 + 1]; v++) {
+                                rc = callback(context, base + v);
+                                if (rc < 0) {
+                                        return -1;
+                                }
+                        }
+                }
+        } else {
+                for (i = 0; i < container->size; i++) {
+                        rc = callback(context, base + container->array[i]);
+                        if (rc < 0) {
+                                return -1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static inline const struct clew_idset_container * clew_idset_container_find (const struct clew_idset *idset, uint64_t key)
+{
+        if (key >= idset->directory_size || idset->directory[key] == 0) {
+                return NULL;
+        }
+        return &idset->containers[idset->directory[key] - 1];
+}
+
+static struct clew_idset_container * clew_idset_container_get (struct clew_idset *idset, uint64_t key)
+{
+        uint64_t size;
+        uint32_t *directory;
+        struct clew_idset_container *containers;
+
+        if (key < idset->directory_size && idset->directory[key] != 0) {
+                return &idset->containers[idset->directory[key] - 1];
+        }
+
+        if (key >= idset->directory_size) {
+                size = (idset->directory_size == 0) ? 1024 : idset->directory_size;
+                while (size <= key) {
+                        size *= 2;
+                }
+                directory = (uint32_t *) realloc(idset->directory, sizeof(uint32_t) * size);
+                if (directory == NULL) {
+                        clew_errorf("can not allocate memory");
+                        return NULL;
+                }
+                memset(directory + idset->directory_size, 0, sizeof(uint32_t) * (size - idset->directory_size));
+                idset->directory      = directory;
+                idset->directory_size = size;
+        }
+        if (idset->ncontainers == idset->acontainers) {
+                size = (idset->acontainers == 0) ? 64 : idset->acontainers * 2;
+                containers = (struct clew_idset_container *) realloc(idset->containers, sizeof(struct clew_idset_container) * size);
+                if (containers == NULL) {
+                        clew_errorf("can not allocate memory");
+                        return NULL;
+                }
+                idset->containers  = containers;
+                idset->acontainers = size;
+        }
+
+        memset(&idset->containers[idset->ncontainers], 0, sizeof(struct clew_idset_container));
+        idset->containers[idset->ncontainers].key  = key;
+        idset->containers[idset->ncontainers].type = CLEW_IDSET_CONTAINER_ARRAY;
+        idset->ncontainers += 1;
+        idset->directory[key] = idset->ncontainers;
+        return &idset->containers[idset->ncontainers - 1];
+}
+
+struct clew_idset clew_idset_init (int mode)
+{
+        struct clew_idset idset;
+        memset(&idset, 0, sizeof(struct clew_idset));
+        idset.mode = mode;
+        if (mode == CLEW_IDSET_MODE_DENSE) {
+                idset.dense = clew_bitmap_atomic_init();
+        }
+        return idset;
+}
+
+void clew_idset_uninit (struct clew_idset *idset)
+{
+        uint64_t i;
+
+        if (idset == NULL) {
+                return;
+        }
+        for (i = 0; i < idset->ncontainers; i++) {
+                clew_idset_container_uninit(&idset->containers[i]);
+        }
+        if (idset->containers != NULL) {
+                free(idset->containers);
+        }
+        if (idset->directory != NULL) {
+                free(idset->directory);
+        }
+        clew_bitmap_atomic_uninit(&idset->dense);
+        idset->containers     = NULL;
+        idset->ncontainers    = 0;
+        idset->acontainers    = 0;
+        idset->directory      = NULL;
+        idset->directory_size = 0;
+        idset->count          = 0;
+        idset->indexed        = 0;
+}
+
+void clew_idset_reset (struct clew_idset *idset)
+{
+        uint64_t i;
+
+        for (i = 0; i < idset->ncontainers; i++) {
+                clew_idset_container_uninit(&idset->containers[i]);
+        }
+        idset->ncontainers = 0;
+        if (idset->directory != NULL) {
+                memset(idset->directory, 0, sizeof(uint32_t) * idset->directory_size);
+        }
+        clew_bitmap_atomic_reset(&idset->dense);
+        idset->count   = 0;
+        idset->indexed = 0;
+}
+
+int clew_idset_mark (struct clew_idset *idset, uint64_t id)
+{
+        int rc;
+        struct clew_idset_container *container;
+
+        if (idset->mode == CLEW_IDSET_MODE_DENSE) {
+                rc = clew_bitmap_atomic_mark(&idset->dense, id);
+                if (rc < 0) {
+                        return -1;
+                }
+                if (rc == 1) {
+                        __atomic_fetch_add(&idset->count, 1, __ATOMIC_RELAXED);
+                }
+                return rc;
+        }
+
+        container = clew_idset_container_get(idset, id >> CLEW_IDSET_CHUNK_BITS);
+        if (container == NULL) {
+                return -1;
+        }
+        rc = clew_idset_container_add(container, id & CLEW_IDSET_CHUNK_MASK);
+        if (rc < 0) {
+                return -1;
+        }
+        idset->count   += rc;
+        idset->indexed &= !rc;
+        return rc;
+}
+
+int clew_idset_marked (const struct clew_idset *idset, uint64_t id)
+{
+        const struct clew_idset_container *container;
+
+        if (idset->mode == CLEW_IDSET_MODE_DENSE) {
+                return clew_bitmap_atomic_marked(&idset->dense, id);
+        }
+        container = clew_idset_container_find(idset, id >> CLEW_IDSET_CHUNK_BITS);
+        if (container == NULL) {
+                return 0;
+        }
+        return clew_idset_container_contains(container, id & CLEW_IDSET_CHUNK_MASK);
+}
+
+int clew_idset_marked_range (const struct clew_idset *idset, uint64_t from, uint64_t to)
+{
+        uint64_t key;
+        uint64_t first;
+        uint64_t last;
+        const struct clew_idset_container *container;
+
+        if (idset->mode == CLEW_IDSET_MODE_DENSE) {
+                return clew_bitmap_atomic_marked_range(&idset->dense, from, to);
+        }
+        if (from > to || idset->count == 0) {
+                return 0;
+        }
+
+        first = from >> CLEW_IDSET_CHUNK_BITS;
+        last  = to >> CLEW_IDSET_CHUNK_BITS;
+        if (last >= idset->directory_size) {
+                last = idset->directory_size - 1;
+        }
+        for (key = first; key <= last; key++) {
+                container = clew_idset_container_find(idset, key);
+                if (container == NULL) {
+                        continue;
+                }
+                if (clew_idset_container_any(container,
+                                (key == first) ? (from & CLEW_IDSET_CHUNK_MASK) : 0,
+                                (key == (to >> CLEW_IDSET_CHUNK_BITS)) ? (to & CLEW_IDSET_CHUNK_MASK) : CLEW_IDSET_CHUNK_MASK)) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+uint64_t clew_idset_count (const struct clew_idset *idset)
+{
+        return __atomic_load_n(&idset->count, __ATOMIC_RELAXED);
+}
+
+int clew_idset_concurrent (const struct clew_idset *idset)
+{
+        return idset->mode == CLEW_IDSET_MODE_DENSE;
+}
+
+static int clew_idset_or_mark (void *context, uint64_t id)
+{
+        return (clew_idset_mark((struct clew_idset *) context, id) < 0) ? -1 : 0;
+}
+
+int clew_idset_or (struct clew_idset *idset, const struct clew_idset *other)
+{
+        int rc;
+        uint64_t i;
+        struct clew_idset_container *container;
+
+        if (other->count == 0) {
+                return 0;
+        }
+        idset->indexed = 0;
+        if (idset->mode == CLEW_IDSET_MODE_DENSE && other->mode == CLEW_IDSET_MODE_DENSE) {
+                rc = clew_bitmap_atomic_or(&idset->dense, &other->dense);
+                if (rc < 0) {
+                        return -1;
+                }
+                idset->count = clew_bitmap_atomic_count(&idset->dense);
+                return 0;
+        }
+        if (other->mode == CLEW_IDSET_MODE_DENSE) {
+                return clew_bitmap_atomic_foreach(&other->dense, clew_idset_or_mark, idset);
+        }
+        if (idset->mode == CLEW_IDSET_MODE_DENSE) {
+                for (i = 0; i < other->ncontainers; i++) {
+                        rc = clew_idset_container_foreach(&other->containers[i], clew_idset_or_mark, idset);
+                        if (rc < 0) {
+                                return -1;
+                        }
+                }
+                return 0;
+        }
+
+        for (i = 0; i < other->ncontainers; i++) {
+                container = clew_idset_container_get(idset, other->containers[i].key);
+                if (container == NULL) {
+                        return -1;
+                }
+                idset->count -= container->cardinality;
+                rc = clew_idset_container_or(container, &other->containers[i]);
+                if (rc < 0) {
+                        return -1;
+                }
+                idset->count += container->cardinality;
+        }
+        return 0;
+}
+
+/* converts containers to runs where that is smaller, marking converts them back */
+int clew_idset_optimize (struct clew_idset *idset)
+{
+        uint64_t i;
+        uint32_t j;
+        uint32_t n;
+        uint32_t v;
+        uint32_t nruns;
+        uint64_t word;
+        uint64_t carry;
+        uint16_t *runs;
+        struct clew_idset_container *container;
+
+        if (idset->mode == CLEW_IDSET_MODE_DENSE) {
+                return 0;
+        }
+        for (i = 0; i < idset->ncontainers; i++) {
+                container = &idset->containers[i];
+                if (container->type == CLEW_IDSET_CONTAINER_RUN) {
+                        continue;
+                }
+
+                nruns = 0;
+                if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                        for (j = 0, carry = 0; j < CLEW_IDSET_BITMAP_WORDS; j++) {
+                                word   = container->bitmap[j];
+                                nruns += __builtin_popcountll(word & ~((word << 1) | carry));
+                                carry  = word >> 63;
+                        }
+                } else {
+                        for (j = 0; j < container->size; j++) {
+                                nruns += (j == 0 || container->array[j] != container->array[j - 1] + 1);
+                        }
+                }
+                if (nruns == 0 || sizeof(uint16_t) * 2 * nruns >= clew_idset_container_memory(container)) {
+                        continue;
+                }
+
+                runs = (uint16_t *) malloc(sizeof(uint16_t) * 2 * nruns);
+                if (runs == NULL) {
+                        clew_errorf("can not allocate memory");
+                        return -1;
+                }
+                n = 0;
+                for (v = 0; v <= CLEW_IDSET_CHUNK_MASK; v++) {
+                        if (clew_idset_container_contains(container, v) == 0) {
+                                continue;
+                        }
+                        if (n > 0 && runs[(n - 1) * 2] + runs[(n - 1) * 2 + 1] + 1 == (int) v) {
+                                runs[(n - 1) * 2 + 1] += 1;
+                        } else {
+                                runs[n * 2 + 0] = v;
+                                runs[n * 2 + 1] = 0;
+                                n += 1;
+                        }
+                }
+                clew_idset_container_uninit(container);
+                container->type  = CLEW_IDSET_CONTAINER_RUN;
+                container->runs  = runs;
+                container->size  = n;
+                container->avail = n;
+                idset->indexed   = 0;
+        }
+        return 0;
+}
+
+/* builds rank tables so clew_idset_rank is a popcount or a short search per id */
+int clew_idset_index (struct clew_idset *idset)
+{
+        uint64_t key;
+        uint64_t rank;
+        uint32_t i;
+        uint32_t n;
+        struct clew_idset_container *container;
+
+        if (idset->mode == CLEW_IDSET_MODE_DENSE) {
+                clew_errorf("dense id sets can not be indexed");
+                return -1;
+        }
+        for (key = 0, rank = 0; key < idset->directory_size; key++) {
+                if (idset->directory[key] == 0) {
+                        continue;
+                }
+                container = &idset->containers[idset->directory[key] - 1];
+                container->rank = rank;
+                rank += container->cardinality;
+
+                if (container->ranks != NULL) {
+                        free(container->ranks);
+                        container->ranks = NULL;
+                }
+                if (container->type == CLEW_IDSET_CONTAINER_ARRAY) {
+                        continue;
+                }
+                n = (container->type == CLEW_IDSET_CONTAINER_BITMAP) ? CLEW_IDSET_BITMAP_WORDS : container->size;
+                container->ranks = (uint16_t *) malloc(sizeof(uint16_t) * n);
+                if (container->ranks == NULL) {
+                        clew_errorf("can not allocate memory");
+                        return -1;
+                }
+                if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                        for (i = 0, n = 0; i < CLEW_IDSET_BITMAP_WORDS; i++) {
+                                container->ranks[i] = n;
+                                n += __builtin_popcountll(container->bitmap[i]);
+                        }
+                } else {
+                        for (i = 0, n = 0; i < container->size; i++) {
+                                container->ranks[i] = n;
+                                n += container->runs[i * 2 + 1] + 1;
+                        }
+                }
+        }
+        idset->indexed = 1;
+        return 0;
+}
+
+int clew_idset_rank (const struct clew_idset *idset, uint64_t id, uint64_t *rank)
+{
+        uint32_t at;
+        uint16_t value;
+        const struct clew_idset_container *container;
+
+        if (idset->indexed == 0) {
+                return -1;
+        }
+        container = clew_idset_container_find(idset, id >> CLEW_IDSET_CHUNK_BITS);
+        if (container == NULL) {
+                return 1;
+        }
+        value = id & CLEW_IDSET_CHUNK_MASK;
+        if (container->type == CLEW_IDSET_CONTAINER_BITMAP) {
+                if (!(container->bitmap[value / 64] & (1ULL << (value % 64)))) {
+                        return 1;
+                }
+                *rank = container->rank + container->ranks[value / 64] + __builtin_popcountll(container->bitmap[value / 64] & ((1ULL << (value % 64)) - 1));
+                return 0;
+        } else if (container->type == CLEW_IDSET_CONTAINER_RUN) {
+                at = clew_idset_run_find(container->runs, container->size, value);
+                if (at >= container->size || value > container->runs[at * 2] + container->runs[at * 2 + 1]) {
+                        return 1;
+                }
+                *rank = container->rank + container->ranks[at] + (value - container->runs[at * 2]);
+                return 0;
+        }
+        at = clew_idset_array_lower_bound(container->array, container->size, value);
+        if (at >= container->size || container->array[at] != value) {
+                return 1;
+        }
+        *rank = container->rank + at;
+        return 0;
+}
+
+uint64_t clew_idset_memory (const struct clew_idset *idset)
+{
+        uint64_t i;
+        uint64_t memory;
+
+        if (idset->mode == CLEW_IDSET_MODE_DENSE) {
+                return clew_bitmap_atomic_memory(&idset->dense);
+        }
+        memory  = sizeof(uint32_t) * idset->directory_size;
+        memory += sizeof(struct clew_idset_container) * idset->acontainers;
+        for (i = 0; i < idset->ncontainers; i++) {
+                memory += clew_idset_container_memory(&idset->containers[i]);
+        }
+        return memory;
+}
@@ -0,0 +1,62 @@
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+        CLEW_IDSET_MODE_SPARSE  = 0,
+        CLEW_IDSET_MODE_DENSE   = 1
+};
+
+/*
+ * set of 64 bit ids. sparse mode splits ids into 2^16 chunks, each chunk is
+ * kept as a sorted array, a bitmap or a list of runs depending on how many
+ * ids it holds, and a directory maps chunk number to container. dense mode
+ * is a segmented bitmap, for inputs where most ids are set.
+ *
+ * sparse mode mark and or must not race with other calls, marked,
+ * marked_range and count may be called from many threads on a set that is
+ * not modified. dense mode additionally allows mark from many threads at
+ * once, see clew_idset_concurrent. mark returns 1 if the id was new.
+ *
+ * a sparse set can be indexed, rank then gives the position of an id among
+ * all ids in the set in constant time. modifying the set drops the index.
+ */
+struct clew_idset_container;
+
+struct clew_idset {
+        int mode;
+        int indexed;
+        uint64_t count;
+
+        uint32_t *directory;                            /* container index + 1 per chunk, 0: empty */
+        uint64_t directory_size;
+
+        struct clew_idset_container *containers;
+        uint64_t ncontainers;
+        uint64_t acontainers;
+
+        struct clew_bitmap_atomic dense;
+};
+
+struct clew_idset clew_idset_init (int mode);
+void clew_idset_uninit (struct clew_idset *idset);
+void clew_idset_reset (struct clew_idset *idset);
+
+int clew_idset_mark (struct clew_idset *idset, uint64_t id);
+int clew_idset_marked (const struct clew_idset *idset, uint64_t id);
+int clew_idset_marked_range (const struct clew_idset *idset, uint64_t from, uint64_t to);
+uint64_t clew_idset_count (const struct clew_idset *idset);
+int clew_idset_concurrent (const struct clew_idset *idset);
+
+int clew_idset_or (struct clew_idset *idset, const struct clew_idset *other);
+int clew_idset_optimize (struct clew_idset *idset);
+int clew_idset_index (struct clew_idset *idset);
+/* returns 0 if found, 1 if id is not in set, -1 if set is not indexed */
+int clew_idset_rank (const struct clew_idset *idset, uint64_t id, uint64_t *rank);
+uint64_t clew_idset_memory (const struct clew_idset *idset);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,9 +4,19 @@ extern "C" {
 #endif
 
 struct clew_input_backend;
+struct clew_input_index;
+struct clew_input_index_entry;
+struct clew_input_block;
 
 struct clew_input_backend_init_options {
         const char *path;
+        int threads;
+        int mmap;
+        struct clew_input_index *index;
+        unsigned int kinds;
+
+	int (*callback_blob) (struct clew_input_backend *backend, void *context, const struct clew_input_index_entry *entry);
+	int (*callback_block) (struct clew_input_backend *backend, void *context, const struct clew_input_block *block);
 
 	int (*callback_bounds_start) (struct clew_input_backend *backend, void *context);
 	int (*callback_bounds_end) (struct clew_input_backend *backend, void *context);
@@ -47,6 +57,8 @@ struct clew_input_backend_init_options {
 	int (*callback_k) (struct clew_input_backend *backend, void *context, const char *k);
 	int (*callback_v) (struct clew_input_backend *backend, void *context, const char *v);
 
+	int (*callback_tag) (struct clew_input_backend *backend, void *context, uint32_t tag);
+
         int (*callback_error) (struct clew_input_backend *backend, void *context, unsigned int reason);
 
         void *callback_context;
@@ -0,0 +1,253 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+#include "stack.h"
+#include "input-index.h"
+
+#define CLEW_INPUT_INDEX_MAGIC          "clewidx1"
+
+struct clew_input_index_file_header {
+        char magic[8];
+        uint64_t size;
+        int64_t mtime;
+        uint64_t count;
+};
+
+struct clew_input_index {
+        int completed;
+        uint64_t size;
+        int64_t mtime;
+        struct clew_stack entries;
+};
+
+struct clew_input_index * clew_input_index_create (void)
+{
+        struct clew_input_index *index;
+
+        index = (struct clew_input_index *) malloc(sizeof(struct clew_input_index));
+        if (index == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        memset(index, 0, sizeof(struct clew_input_index));
+        index->entries = clew_stack_init(sizeof(struct clew_input_index_entry));
+
+        return index;
+bail:   return NULL;
+}
+
+void clew_input_index_destroy (struct clew_input_index *index)
+{
+        if (index == NULL) {
+                return;
+        }
+        clew_stack_uninit(&index->entries);
+        free(index);
+}
+
+void clew_input_index_reset (struct clew_input_index *index)
+{
+        clew_stack_reset(&index->entries);
+        index->completed = 0;
+        index->size      = 0;
+        index->mtime     = 0;
+}
+
+int clew_input_index_push (struct clew_input_index *index, const struct clew_input_index_entry *entry)
+{
+        int rc;
+
+        if (index->completed) {
+                clew_errorf("index is already completed");
+                goto bail;
+        }
+        rc = clew_stack_push(&index->entries, entry);
+        if (rc < 0) {
+                clew_errorf("can not push index entry");
+                goto bail;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+int clew_input_index_complete (struct clew_input_index *index, const char *source)
+{
+        int rc;
+        struct stat st;
+
+        rc = stat(source, &st);
+        if (rc < 0) {
+                clew_errorf("can not stat source: %s", source);
+                goto bail;
+        }
+        index->size      = st.st_size;
+        index->mtime     = st.st_mtime;
+        index->completed = 1;
+
+        return 0;
+bail:   return -1;
+}
+
+int clew_input_index_completed (const struct clew_input_index *index)
+{
+        return index->completed;
+}
+
+uint64_t clew_input_index_count (const struct clew_input_index *index)
+{
+        return clew_stack_count(&index->entries);
+}
+
+const struct clew_input_index_entry * clew_input_index_at (const struct clew_input_index *index, uint64_t at)
+{
+        return (const struct clew_input_index_entry *) clew_stack_at(&index->entries, at);
+}
+
+/* loads index from path, returns 1 if index file is missing or does not match source */
+int clew_input_index_load (struct clew_input_index *index, const char *path, const char *source)
+{
+        int rc;
+        FILE *fp;
+        uint64_t i;
+        struct stat st;
+        struct stat ist;
+        const struct clew_input_index_entry *entry;
+        struct clew_input_index_file_header header;
+
+        fp = NULL;
+        clew_input_index_reset(index);
+
+        rc = stat(source, &st);
+        if (rc < 0) {
+                clew_errorf("can not stat source: %s", source);
+                goto bail;
+        }
+
+        fp = fopen(path, "rb");
+        if (fp == NULL) {
+                goto out;
+        }
+        if (fstat(fileno(fp), &ist) < 0) {
+                goto out;
+        }
+        if (fread(&header, sizeof(header), 1, fp) != 1) {
+                goto out;
+        }
+        if (memcmp(header.magic, CLEW_INPUT_INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+            header.size != (uint64_t) st.st_size ||
+            header.mtime != (int64_t) st.st_mtime) {
+                goto out;
+        }
+        /* a truncated or padded file is stale too */
+        if (header.count > ((uint64_t) ist.st_size - sizeof(header)) / sizeof(struct clew_input_index_entry) ||
+            sizeof(header) + header.count * sizeof(struct clew_input_index_entry) != (uint64_t) ist.st_size) {
+                goto out;
+        }
+
+        rc = clew_stack_resize(&index->entries, header.count);
+        if (rc < 0) {
+                clew_errorf("can not resize index entries");
+                goto bail;
+        }
+        if (header.count > 0 &&
+            fread(clew_stack_buffer(&index->entries), sizeof(struct clew_input_index_entry), header.count, fp) != header.count) {
+                clew_input_index_reset(index);
+                goto out;
+        }
+        for (i = 0; i < header.count; i++) {
+                entry = clew_input_index_at(index, i);
+                if (entry->offset > header.size ||
+                    entry->length > header.size - entry->offset) {
+                        clew_input_index_reset(index);
+                        goto out;
+                }
+        }
+
+        index->size      = header.size;
+        index->mtime     = header.mtime;
+        index->completed = 1;
+
+        fclose(fp);
+        return 0;
+out:    if (fp != NULL) {
+                fclose(fp);
+        }
+        return 1;
+bail:   if (fp != NULL) {
+                fclose(fp);
+        }
+        return -1;
+}
+
+int clew_input_index_save (const struct clew_input_index *index, const char *path)
+{
+        int rc;
+        FILE *fp;
+        char *tmp;
+        struct clew_input_index_file_header header;
+
+        fp  = NULL;
+        tmp = NULL;
+
+        if (index->completed == 0) {
+                clew_errorf("index is not completed");
+                goto bail;
+        }
+
+        tmp = (char *) malloc(strlen(path) + sizeof(".tmp"));
+        if (tmp == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        sprintf(tmp, "%s.tmp", path);
+        fp = fopen(tmp, "wb");
+        if (fp == NULL) {
+                clew_errorf("can not open index for writing: %s", tmp);
+                goto bail;
+        }
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CLEW_INPUT_INDEX_MAGIC, sizeof(header.magic));
+        header.size  = index->size;
+        header.mtime = index->mtime;
+        header.count = clew_stack_count(&index->entries);
+
+        if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+                clew_errorf("can not write index: %s", tmp);
+                goto bail;
+        }
+        if (header.count > 0 &&
+            fwrite(clew_stack_buffer(&index->entries), sizeof(struct clew_input_index_entry), header.count, fp) != header.count) {
+                clew_errorf("can not write index: %s", tmp);
+                goto bail;
+        }
+        rc = fclose(fp);
+        fp = NULL;
+        if (rc != 0) {
+                clew_errorf("can not write index: %s", tmp);
+                goto bail;
+        }
+        rc = rename(tmp, path);
+        if (rc != 0) {
+                clew_errorf("can not rename index: %s", path);
+                goto bail;
+        }
+
+        free(tmp);
+        return 0;
+bail:   if (fp != NULL) {
+                fclose(fp);
+        }
+        if (tmp != NULL) {
+                unlink(tmp);
+                free(tmp);
+        }
+        return -1;
+}
@@ -0,0 +1,46 @@
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+        CLEW_INPUT_INDEX_KIND_HEADER    = 0x01,
+        CLEW_INPUT_INDEX_KIND_NODE      = 0x02,
+        CLEW_INPUT_INDEX_KIND_WAY       = 0x04,
+        CLEW_INPUT_INDEX_KIND_RELATION  = 0x08
+};
+
+struct clew_input_index_entry {
+        uint64_t offset;
+        uint64_t length;
+        uint32_t kinds;
+        uint32_t count;
+        uint64_t min_id;
+        uint64_t max_id;
+        int32_t minlon;
+        int32_t minlat;
+        int32_t maxlon;
+        int32_t maxlat;
+};
+
+struct clew_input_index;
+
+struct clew_input_index * clew_input_index_create (void);
+void clew_input_index_destroy (struct clew_input_index *index);
+
+void clew_input_index_reset (struct clew_input_index *index);
+int clew_input_index_push (struct clew_input_index *index, const struct clew_input_index_entry *entry);
+int clew_input_index_complete (struct clew_input_index *index, const char *source);
+int clew_input_index_completed (const struct clew_input_index *index);
+
+uint64_t clew_input_index_count (const struct clew_input_index *index);
+const struct clew_input_index_entry * clew_input_index_at (const struct clew_input_index *index, uint64_t at);
+
+int clew_input_index_load (struct clew_input_index *index, const char *path, const char *source);
+int clew_input_index_save (const struct clew_input_index *index, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
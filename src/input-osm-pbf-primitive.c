@@ -0,0 +1,685 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "debug.h"
+#include "stack.h"
+#include "input-osm-pbf-primitive.h"
+
+#define PACKED_CONTINUATION     0x8080808080808080ULL
+
+enum {
+        PACKED_UINT32,
+        PACKED_DELTA_INT32,
+        PACKED_DELTA_INT64
+};
+
+struct slice {
+        const unsigned char *ptr;
+        const unsigned char *end;
+};
+
+static inline int64_t zigzag (uint64_t value)
+{
+        return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/*
+ * varint fast path: one unaligned 8 byte load, the terminating byte is found
+ * with ctz over the inverted continuation bits, then the 7 bit groups are
+ * compacted in three shift/mask steps. longer varints and the tail of the
+ * buffer take the bytewise path.
+ */
+static inline int decode_varint (const unsigned char **ptr, const unsigned char *end, uint64_t *value)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+        int n;
+        uint64_t word;
+        uint64_t stop;
+
+        if (likely(end - *ptr >= 8)) {
+                memcpy(&word, *ptr, 8);
+                stop = ~word & PACKED_CONTINUATION;
+                if (likely(stop != 0)) {
+                        n = (__builtin_ctzll(stop) >> 3) + 1;
+                        if (n < 8) {
+                                word &= (((uint64_t) 1) << (n * 8)) - 1;
+                        }
+                        word = ((word & 0x7f007f007f007f00ULL) >> 1) | (word & 0x007f007f007f007fULL);
+                        word = ((word & 0x3fff00003fff0000ULL) >> 2) | (word & 0x00003fff00003fffULL);
+                        word = ((word & 0x0fffffff00000000ULL) >> 4) | (word & 0x000000000fffffffULL);
+                        *value = word;
+                        *ptr  += n;
+                        return 0;
+                }
+        }
+#endif
+        return clew_pbf_read_varint(ptr, end, value);
+}
+
+static inline void packed_store (uint8_t *buffer, uint64_t at, int mode, int64_t *sum, uint64_t value)
+{
+        if (mode == PACKED_UINT32) {
+                ((uint32_t *) buffer)[at] = (uint32_t) value;
+        } else {
+                *sum += zigzag(value);
+                if (mode == PACKED_DELTA_INT32) {
+                        ((int32_t *) buffer)[at] = (int32_t) *sum;
+                } else {
+                        ((int64_t *) buffer)[at] = *sum;
+                }
+        }
+}
+
+/*
+ * appends a packed field to stack, zigzag and prefix sum are applied while
+ * decoding for delta coded fields. a packed field holds at most one value
+ * per byte, so space is reserved once up front. runs of eight single byte
+ * values, common for dense lat/lon deltas and tag string ids, are decoded
+ * from one load without per byte branching.
+ */
+static inline int decode_packed (const unsigned char *ptr, const unsigned char *end, struct clew_stack *stack, int mode)
+{
+        int rc;
+        uint64_t count;
+        uint64_t value;
+        int64_t sum;
+        uint8_t *buffer;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+        int i;
+        uint64_t word;
+#endif
+
+        if (ptr == NULL || ptr >= end) {
+                return 0;
+        }
+
+        rc = clew_stack_reserve(stack, clew_stack_count(stack) + (end - ptr));
+        if (rc < 0) {
+                clew_errorf("can not reserve packed field");
+                goto bail;
+        }
+        buffer = clew_stack_buffer(stack);
+        count  = clew_stack_count(stack);
+        sum    = 0;
+
+        while (ptr < end) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+                if (end - ptr >= 8) {
+                        memcpy(&word, ptr, 8);
+                        if ((word & PACKED_CONTINUATION) == 0) {
+                                for (i = 0; i < 8; i++) {
+                                        packed_store(buffer, count++, mode, &sum, (word >> (i * 8)) & 0xff);
+                                }
+                                ptr += 8;
+                                continue;
+                        }
+                }
+#endif
+                rc = decode_varint(&ptr, end, &value);
+                if (rc < 0) {
+                        clew_errorf("packed field is invalid");
+                        goto bail;
+                }
+                packed_store(buffer, count++, mode, &sum, value);
+        }
+        stack->count = count;
+
+        return 0;
+bail:   return -1;
+}
+
+static int decode_packed_uint32 (const struct slice *slice, struct clew_stack *stack)
+{
+        return decode_packed(slice->ptr, slice->end, stack, PACKED_UINT32);
+}
+
+static int decode_packed_delta_int32 (const struct slice *slice, struct clew_stack *stack)
+{
+        return decode_packed(slice->ptr, slice->end, stack, PACKED_DELTA_INT32);
+}
+
+static int decode_packed_delta_int64 (const struct slice *slice, struct clew_stack *stack)
+{
+        return decode_packed(slice->ptr, slice->end, stack, PACKED_DELTA_INT64);
+}
+
+static int read_slice (struct slice *slice, uint32_t wire, uint64_t length, const unsigned char *data)
+{
+        if (wire != 2) {
+                clew_errorf("field is not length delimited");
+                return -1;
+        }
+        slice->ptr = data;
+        slice->end = data + length;
+        return 0;
+}
+
+static int decode_tags (struct clew_input_osm_pbf_primitive *primitive, const struct slice *keys, const struct slice *vals)
+{
+        int rc;
+        uint64_t i;
+        uint64_t il;
+        const uint32_t *k;
+        const uint32_t *v;
+        struct clew_input_osm_pbf_tag *tags;
+
+        clew_stack_reset(&primitive->scratch_a);
+        clew_stack_reset(&primitive->scratch_b);
+        rc  = decode_packed_uint32(keys, &primitive->scratch_a);
+        rc |= decode_packed_uint32(vals, &primitive->scratch_b);
+        if (rc != 0) {
+                goto bail;
+        }
+        il = clew_stack_count(&primitive->scratch_a);
+        if (il != clew_stack_count(&primitive->scratch_b)) {
+                clew_errorf("keys and vals count mismatch");
+                goto bail;
+        }
+        rc = clew_stack_reserve(&primitive->tags, clew_stack_count(&primitive->tags) + il);
+        if (rc < 0) {
+                clew_errorf("can not reserve tags");
+                goto bail;
+        }
+        k    = (const uint32_t *) clew_stack_buffer(&primitive->scratch_a);
+        v    = (const uint32_t *) clew_stack_buffer(&primitive->scratch_b);
+        tags = (struct clew_input_osm_pbf_tag *) clew_stack_buffer(&primitive->tags) + clew_stack_count(&primitive->tags);
+        for (i = 0; i < il; i++) {
+                tags[i].k = k[i];
+                tags[i].v = v[i];
+        }
+        primitive->tags.count += il;
+
+        return 0;
+bail:   return -1;
+}
+
+static int decode_stringtable (struct clew_input_osm_pbf_primitive *primitive, const unsigned char *ptr, const unsigned char *end)
+{
+        int rc;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *data;
+        struct clew_input_osm_pbf_string string;
+
+        while ((rc = clew_pbf_read_field(&ptr, end, &field, &wire, &value, &data)) == 0) {
+                if (field != 1 || wire != 2) {
+                        continue;
+                }
+                string.data   = (const char *) data;
+                string.length = (uint32_t) value;
+                rc = clew_stack_push(&primitive->strings, &string);
+                if (rc < 0) {
+                        clew_errorf("can not push string");
+                        goto bail;
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("stringtable is invalid");
+                goto bail;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+static int decode_dense (struct clew_input_osm_pbf_primitive *primitive, const unsigned char *ptr, const unsigned char *end)
+{
+        int rc;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *data;
+
+        uint64_t i;
+        uint64_t il;
+        uint64_t k;
+        uint64_t kl;
+        uint64_t start;
+        const uint32_t *kv;
+        struct clew_input_osm_pbf_tag tag;
+
+        struct slice ids       = { NULL, NULL };
+        struct slice lats      = { NULL, NULL };
+        struct slice lons      = { NULL, NULL };
+        struct slice keys_vals = { NULL, NULL };
+
+        while ((rc = clew_pbf_read_field(&ptr, end, &field, &wire, &value, &data)) == 0) {
+                if (field == 1) {
+                        rc = read_slice(&ids, wire, value, data);
+                } else if (field == 8) {
+                        rc = read_slice(&lats, wire, value, data);
+                } else if (field == 9) {
+                        rc = read_slice(&lons, wire, value, data);
+                } else if (field == 10) {
+                        rc = read_slice(&keys_vals, wire, value, data);
+                }
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("dense nodes is invalid");
+                goto bail;
+        }
+
+        start = clew_stack_count(&primitive->node_ids);
+        rc  = decode_packed_delta_int64(&ids, &primitive->node_ids);
+        rc |= decode_packed_delta_int32(&lats, &primitive->node_lats);
+        rc |= decode_packed_delta_int32(&lons, &primitive->node_lons);
+        if (rc != 0) {
+                goto bail;
+        }
+        il = clew_stack_count(&primitive->node_ids) - start;
+        if (clew_stack_count(&primitive->node_lats) - start != il ||
+            clew_stack_count(&primitive->node_lons) - start != il) {
+                clew_errorf("dense nodes id, lat, lon count mismatch");
+                goto bail;
+        }
+
+        clew_stack_reset(&primitive->scratch_a);
+        rc = decode_packed_uint32(&keys_vals, &primitive->scratch_a);
+        if (rc < 0) {
+                goto bail;
+        }
+        kv = (const uint32_t *) clew_stack_buffer(&primitive->scratch_a);
+        kl = clew_stack_count(&primitive->scratch_a);
+        for (i = 0, k = 0; i < il; i++) {
+                rc = clew_stack_push_uint64(&primitive->node_tags, clew_stack_count(&primitive->tags));
+                if (rc < 0) {
+                        clew_errorf("can not push node tags");
+                        goto bail;
+                }
+                while (k < kl && kv[k] != 0) {
+                        if (k + 1 >= kl) {
+                                clew_errorf("dense nodes keys_vals is invalid");
+                                goto bail;
+                        }
+                        tag.k = kv[k + 0];
+                        tag.v = kv[k + 1];
+                        rc = clew_stack_push(&primitive->tags, &tag);
+                        if (rc < 0) {
+                                clew_errorf("can not push tag");
+                                goto bail;
+                        }
+                        k += 2;
+                }
+                k++;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+static int decode_node (struct clew_input_osm_pbf_primitive *primitive, const unsigned char *ptr, const unsigned char *end)
+{
+        int rc;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *data;
+
+        int64_t id   = 0;
+        int64_t lat  = 0;
+        int64_t lon  = 0;
+        struct slice keys = { NULL, NULL };
+        struct slice vals = { NULL, NULL };
+
+        while ((rc = clew_pbf_read_field(&ptr, end, &field, &wire, &value, &data)) == 0) {
+                if (field == 1 && wire == 0) {
+                        id = zigzag(value);
+                } else if (field == 2) {
+                        rc = read_slice(&keys, wire, value, data);
+                } else if (field == 3) {
+                        rc = read_slice(&vals, wire, value, data);
+                } else if (field == 8 && wire == 0) {
+                        lat = zigzag(value);
+                } else if (field == 9 && wire == 0) {
+                        lon = zigzag(value);
+                }
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("node is invalid");
+                goto bail;
+        }
+
+        rc  = clew_stack_push_uint64(&primitive->node_ids, id);
+        rc |= clew_stack_push_int32(&primitive->node_lats, (int32_t) lat);
+        rc |= clew_stack_push_int32(&primitive->node_lons, (int32_t) lon);
+        rc |= clew_stack_push_uint64(&primitive->node_tags, clew_stack_count(&primitive->tags));
+        if (rc != 0) {
+                clew_errorf("can not push node");
+                goto bail;
+        }
+        rc = decode_tags(primitive, &keys, &vals);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+static int decode_way (struct clew_input_osm_pbf_primitive *primitive, const unsigned char *ptr, const unsigned char *end)
+{
+        int rc;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *data;
+
+        uint64_t id = 0;
+        struct slice keys = { NULL, NULL };
+        struct slice vals = { NULL, NULL };
+        struct slice refs = { NULL, NULL };
+
+        while ((rc = clew_pbf_read_field(&ptr, end, &field, &wire, &value, &data)) == 0) {
+                if (field == 1 && wire == 0) {
+                        id = value;
+                } else if (field == 2) {
+                        rc = read_slice(&keys, wire, value, data);
+                } else if (field == 3) {
+                        rc = read_slice(&vals, wire, value, data);
+                } else if (field == 8) {
+                        rc = read_slice(&refs, wire, value, data);
+                }
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("way is invalid");
+                goto bail;
+        }
+
+        rc  = clew_stack_push_uint64(&primitive->way_ids, id);
+        rc |= clew_stack_push_uint64(&primitive->way_tags, clew_stack_count(&primitive->tags));
+        rc |= clew_stack_push_uint64(&primitive->way_refs, clew_stack_count(&primitive->refs));
+        if (rc != 0) {
+                clew_errorf("can not push way");
+                goto bail;
+        }
+        rc = decode_tags(primitive, &keys, &vals);
+        if (rc < 0) {
+                goto bail;
+        }
+        rc = decode_packed_delta_int64(&refs, &primitive->refs);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+static int decode_relation (struct clew_input_osm_pbf_primitive *primitive, const unsigned char *ptr, const unsigned char *end)
+{
+        int rc;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *data;
+
+        uint64_t id = 0;
+        struct slice keys   = { NULL, NULL };
+        struct slice vals   = { NULL, NULL };
+        struct slice rsids  = { NULL, NULL };
+        struct slice mids   = { NULL, NULL };
+        struct slice mtypes = { NULL, NULL };
+
+        while ((rc = clew_pbf_read_field(&ptr, end, &field, &wire, &value, &data)) == 0) {
+                if (field == 1 && wire == 0) {
+                        id = value;
+                } else if (field == 2) {
+                        rc = read_slice(&keys, wire, value, data);
+                } else if (field == 3) {
+                        rc = read_slice(&vals, wire, value, data);
+                } else if (field == 8) {
+                        rc = read_slice(&rsids, wire, value, data);
+                } else if (field == 9) {
+                        rc = read_slice(&mids, wire, value, data);
+                } else if (field == 10) {
+                        rc = read_slice(&mtypes, wire, value, data);
+                }
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("relation is invalid");
+                goto bail;
+        }
+
+        rc  = clew_stack_push_uint64(&primitive->relation_ids, id);
+        rc |= clew_stack_push_uint64(&primitive->relation_tags, clew_stack_count(&primitive->tags));
+        rc |= clew_stack_push_uint64(&primitive->relation_members, clew_stack_count(&primitive->member_ids));
+        if (rc != 0) {
+                clew_errorf("can not push relation");
+                goto bail;
+        }
+        rc = decode_tags(primitive, &keys, &vals);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        rc  = decode_packed_uint32(&rsids, &primitive->member_roles);
+        rc |= decode_packed_uint32(&mtypes, &primitive->member_types);
+        rc |= decode_packed_delta_int64(&mids, &primitive->member_ids);
+        if (rc != 0) {
+                goto bail;
+        }
+        if (clew_stack_count(&primitive->member_roles) != clew_stack_count(&primitive->member_ids) ||
+            clew_stack_count(&primitive->member_types) != clew_stack_count(&primitive->member_ids)) {
+                clew_errorf("relation roles, types, memids count mismatch");
+                goto bail;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+enum {
+        PASS_NODES,
+        PASS_WAYS,
+        PASS_RELATIONS
+};
+
+/* decodes elements of one kind from a primitive group */
+static int decode_group (struct clew_input_osm_pbf_primitive *primitive, const struct clew_input_osm_pbf_string *group, int pass)
+{
+        int rc;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *data;
+        const unsigned char *ptr;
+        const unsigned char *end;
+
+        ptr = (const unsigned char *) group->data;
+        end = ptr + group->length;
+        while ((rc = clew_pbf_read_field(&ptr, end, &field, &wire, &value, &data)) == 0) {
+                if (wire != 2) {
+                        continue;
+                }
+                if (pass == PASS_NODES && field == 1) {
+                        rc = decode_node(primitive, data, data + value);
+                } else if (pass == PASS_NODES && field == 2) {
+                        rc = decode_dense(primitive, data, data + value);
+                } else if (pass == PASS_WAYS && field == 3) {
+                        rc = decode_way(primitive, data, data + value);
+                } else if (pass == PASS_RELATIONS && field == 4) {
+                        rc = decode_relation(primitive, data, data + value);
+                }
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("primitive group is invalid");
+                goto bail;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+struct clew_input_osm_pbf_primitive * clew_input_osm_pbf_primitive_create (void)
+{
+        struct clew_input_osm_pbf_primitive *primitive;
+
+        primitive = (struct clew_input_osm_pbf_primitive *) malloc(sizeof(struct clew_input_osm_pbf_primitive));
+        if (primitive == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        memset(primitive, 0, sizeof(struct clew_input_osm_pbf_primitive));
+
+        primitive->strings              = clew_stack_init(sizeof(struct clew_input_osm_pbf_string));
+        primitive->node_ids             = clew_stack_init(sizeof(uint64_t));
+        primitive->node_lons            = clew_stack_init(sizeof(int32_t));
+        primitive->node_lats            = clew_stack_init(sizeof(int32_t));
+        primitive->node_tags            = clew_stack_init(sizeof(uint64_t));
+        primitive->way_ids              = clew_stack_init(sizeof(uint64_t));
+        primitive->way_tags             = clew_stack_init(sizeof(uint64_t));
+        primitive->way_refs             = clew_stack_init(sizeof(uint64_t));
+        primitive->relation_ids         = clew_stack_init(sizeof(uint64_t));
+        primitive->relation_tags        = clew_stack_init(sizeof(uint64_t));
+        primitive->relation_members     = clew_stack_init(sizeof(uint64_t));
+        primitive->tags                 = clew_stack_init(sizeof(struct clew_input_osm_pbf_tag));
+        primitive->refs                 = clew_stack_init(sizeof(uint64_t));
+        primitive->member_ids           = clew_stack_init(sizeof(uint64_t));
+        primitive->member_types         = clew_stack_init(sizeof(uint32_t));
+        primitive->member_roles         = clew_stack_init(sizeof(uint32_t));
+        primitive->groups               = clew_stack_init(sizeof(struct clew_input_osm_pbf_string));
+        primitive->scratch_a            = clew_stack_init(sizeof(uint32_t));
+        primitive->scratch_b            = clew_stack_init(sizeof(uint32_t));
+
+        return primitive;
+bail:   return NULL;
+}
+
+void clew_input_osm_pbf_primitive_destroy (struct clew_input_osm_pbf_primitive *primitive)
+{
+        if (primitive == NULL) {
+                return;
+        }
+        clew_stack_uninit(&primitive->strings);
+        clew_stack_uninit(&primitive->node_ids);
+        clew_stack_uninit(&primitive->node_lons);
+        clew_stack_uninit(&primitive->node_lats);
+        clew_stack_uninit(&primitive->node_tags);
+        clew_stack_uninit(&primitive->way_ids);
+        clew_stack_uninit(&primitive->way_tags);
+        clew_stack_uninit(&primitive->way_refs);
+        clew_stack_uninit(&primitive->relation_ids);
+        clew_stack_uninit(&primitive->relation_tags);
+        clew_stack_uninit(&primitive->relation_members);
+        clew_stack_uninit(&primitive->tags);
+        clew_stack_uninit(&primitive->refs);
+        clew_stack_uninit(&primitive->member_ids);
+        clew_stack_uninit(&primitive->member_types);
+        clew_stack_uninit(&primitive->member_roles);
+        clew_stack_uninit(&primitive->groups);
+        clew_stack_uninit(&primitive->scratch_a);
+        clew_stack_uninit(&primitive->scratch_b);
+        free(primitive);
+}
+
+void clew_input_osm_pbf_primitive_reset (struct clew_input_osm_pbf_primitive *primitive)
+{
+        clew_stack_reset(&primitive->strings);
+        clew_stack_reset(&primitive->node_ids);
+        clew_stack_reset(&primitive->node_lons);
+        clew_stack_reset(&primitive->node_lats);
+        clew_stack_reset(&primitive->node_tags);
+        clew_stack_reset(&primitive->way_ids);
+        clew_stack_reset(&primitive->way_tags);
+        clew_stack_reset(&primitive->way_refs);
+        clew_stack_reset(&primitive->relation_ids);
+        clew_stack_reset(&primitive->relation_tags);
+        clew_stack_reset(&primitive->relation_members);
+        clew_stack_reset(&primitive->tags);
+        clew_stack_reset(&primitive->refs);
+        clew_stack_reset(&primitive->member_ids);
+        clew_stack_reset(&primitive->member_types);
+        clew_stack_reset(&primitive->member_roles);
+        clew_stack_reset(&primitive->groups);
+}
+
+/*
+ * decodes a PrimitiveBlock message. groups are collected first and decoded
+ * in three passes, so tags of nodes, ways and relations each end up in one
+ * contiguous run and every offsets array can be closed with a sentinel.
+ */
+int clew_input_osm_pbf_primitive_decode (struct clew_input_osm_pbf_primitive *primitive, const unsigned char *data, size_t length)
+{
+        int rc;
+        int pass;
+        uint64_t i;
+        uint64_t il;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *ptr;
+        const unsigned char *end;
+        const unsigned char *field_data;
+        struct clew_input_osm_pbf_string group;
+
+        clew_input_osm_pbf_primitive_reset(primitive);
+
+        ptr = data;
+        end = data + length;
+        while ((rc = clew_pbf_read_field(&ptr, end, &field, &wire, &value, &field_data)) == 0) {
+                if (wire != 2) {
+                        continue;
+                }
+                if (field == 1) {
+                        rc = decode_stringtable(primitive, field_data, field_data + value);
+                        if (rc < 0) {
+                                goto bail;
+                        }
+                } else if (field == 2) {
+                        group.data   = (const char *) field_data;
+                        group.length = (uint32_t) value;
+                        rc = clew_stack_push(&primitive->groups, &group);
+                        if (rc < 0) {
+                                clew_errorf("can not push primitive group");
+                                goto bail;
+                        }
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("primitive block is invalid");
+                goto bail;
+        }
+
+        for (pass = PASS_NODES; pass <= PASS_RELATIONS; pass++) {
+                for (i = 0, il = clew_stack_count(&primitive->groups); i < il; i++) {
+                        rc = decode_group(primitive, (const struct clew_input_osm_pbf_string *) clew_stack_at(&primitive->groups, i), pass);
+                        if (rc < 0) {
+                                goto bail;
+                        }
+                }
+                if (pass == PASS_NODES) {
+                        rc = clew_stack_push_uint64(&primitive->node_tags, clew_stack_count(&primitive->tags));
+                } else if (pass == PASS_WAYS) {
+                        rc  = clew_stack_push_uint64(&primitive->way_tags, clew_stack_count(&primitive->tags));
+                        rc |= clew_stack_push_uint64(&primitive->way_refs, clew_stack_count(&primitive->refs));
+                } else {
+                        rc  = clew_stack_push_uint64(&primitive->relation_tags, clew_stack_count(&primitive->tags));
+                        rc |= clew_stack_push_uint64(&primitive->relation_members, clew_stack_count(&primitive->member_ids));
+                }
+                if (rc != 0) {
+                        clew_errorf("can not push offsets");
+                        goto bail;
+                }
+        }
+
+        return 0;
+bail:   return -1;
+}
@@ -0,0 +1,120 @@
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct clew_input_osm_pbf_string {
+        const char *data;
+        uint32_t length;
+};
+
+struct clew_input_osm_pbf_tag {
+        uint32_t k;
+        uint32_t v;
+};
+
+/*
+ * primitive block decoded straight from the wire format into flat arrays.
+ * strings point into the inflated blob, elements reference tags, refs and
+ * members by [offsets[i], offsets[i + 1]) ranges. all arrays are kept
+ * between decodes, so a reused primitive does not allocate once grown.
+ */
+struct clew_input_osm_pbf_primitive {
+        struct clew_stack strings;              /* struct clew_input_osm_pbf_string */
+
+        struct clew_stack node_ids;             /* uint64_t */
+        struct clew_stack node_lons;            /* int32_t */
+        struct clew_stack node_lats;            /* int32_t */
+        struct clew_stack node_tags;            /* uint64_t, count + 1 offsets into tags */
+
+        struct clew_stack way_ids;              /* uint64_t */
+        struct clew_stack way_tags;             /* uint64_t, count + 1 offsets into tags */
+        struct clew_stack way_refs;             /* uint64_t, count + 1 offsets into refs */
+
+        struct clew_stack relation_ids;         /* uint64_t */
+        struct clew_stack relation_tags;        /* uint64_t, count + 1 offsets into tags */
+        struct clew_stack relation_members;     /* uint64_t, count + 1 offsets into member_* */
+
+        struct clew_stack tags;                 /* struct clew_input_osm_pbf_tag */
+        struct clew_stack refs;                 /* uint64_t */
+        struct clew_stack member_ids;           /* uint64_t */
+        struct clew_stack member_types;         /* uint32_t, 0: node, 1: way, 2: relation */
+        struct clew_stack member_roles;         /* uint32_t, string id */
+
+        struct clew_stack groups;               /* struct clew_input_osm_pbf_string, primitive group messages */
+        struct clew_stack scratch_a;            /* uint32_t */
+        struct clew_stack scratch_b;            /* uint32_t */
+};
+
+struct clew_input_osm_pbf_primitive * clew_input_osm_pbf_primitive_create (void);
+void clew_input_osm_pbf_primitive_destroy (struct clew_input_osm_pbf_primitive *primitive);
+void clew_input_osm_pbf_primitive_reset (struct clew_input_osm_pbf_primitive *primitive);
+int clew_input_osm_pbf_primitive_decode (struct clew_input_osm_pbf_primitive *primitive, const unsigned char *data, size_t length);
+
+static inline int clew_pbf_read_varint (const unsigned char **ptr, const unsigned char *end, uint64_t *value)
+{
+        int shift;
+        const unsigned char *p;
+
+        p      = *ptr;
+        *value = 0;
+        for (shift = 0; shift < 64; shift += 7) {
+                if (p >= end) {
+                        return -1;
+                }
+                *value |= ((uint64_t) (*p & 0x7f)) << shift;
+                if ((*p++ & 0x80) == 0) {
+                        *ptr = p;
+                        return 0;
+                }
+        }
+        return -1;
+}
+
+/* reads next field key of a message, returns 1 at end of message */
+static inline int clew_pbf_read_field (const unsigned char **ptr, const unsigned char *end, uint32_t *field, uint32_t *wire, uint64_t *value, const unsigned char **data)
+{
+        int rc;
+        uint64_t key;
+
+        if (*ptr >= end) {
+                return 1;
+        }
+        rc = clew_pbf_read_varint(ptr, end, &key);
+        if (rc < 0) {
+                return -1;
+        }
+        *field = (uint32_t) (key >> 3);
+        *wire  = (uint32_t) (key & 0x07);
+        *data  = NULL;
+        if (*wire == 0) {
+                return clew_pbf_read_varint(ptr, end, value);
+        } else if (*wire == 1) {
+                if (end - *ptr < 8) {
+                        return -1;
+                }
+                *ptr += 8;
+        } else if (*wire == 2) {
+                rc = clew_pbf_read_varint(ptr, end, value);
+                if (rc < 0 || *value > (uint64_t) (end - *ptr)) {
+                        return -1;
+                }
+                *data = *ptr;
+                *ptr += *value;
+        } else if (*wire == 5) {
+                if (end - *ptr < 4) {
+                        return -1;
+                }
+                *ptr += 4;
+        } else {
+                return -1;
+        }
+        return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
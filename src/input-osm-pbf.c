@@ -3,15 +3,25 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <zlib.h>
 
 #include "debug.h"
+#include "stack.h"
 #include "input.h"
 #include "input-backend.h"
+#include "input-index.h"
 #include "input-osm-pbf.h"
+#include "input-osm-pbf-primitive.h"
+#include "tag.h"
+#include "tag-parse.h"
+#include "khash.h"
 
-#include "input-osm-pbf-fileformat.pb-c.h"
 #include "input-osm-pbf-osmformat.pb-c.h"
 
 enum {
@@ -22,185 +32,1723 @@ enum {
         STATE_ERROR
 };
 
+enum {
+        BLOCK_STATE_EMPTY,
+        BLOCK_STATE_READ,
+        BLOCK_STATE_DECODING,
+        BLOCK_STATE_DECODED,
+        BLOCK_STATE_ERROR
+};
+
+KHASH_MAP_INIT_INT64(osm_pbf_tags, uint32_t);
+
+struct clew_input_osm_pbf_block {
+        uint64_t sequence;
+        int state;
+
+        uint64_t offset;
+        uint64_t length;
+
+        char type[16];
+        int32_t datasize;
+
+        const unsigned char *raw;
+        size_t raw_length;
+        int32_t raw_size;
+        const unsigned char *zlib_data;
+        size_t zlib_data_length;
+
+        unsigned char *data;
+        size_t data_size;
+
+        OSMPBF__HeaderBlock *header_block;
+        struct clew_input_osm_pbf_primitive *primitive;
+        int primitive_valid;
+
+        khash_t(osm_pbf_tags) *tags;
+        uint32_t *tag_ids;
+        uint64_t tag_ids_size;
+
+        int skipped;
+        int inflated;           /* data holds the blob, inflated while peeking */
+        struct clew_input_index_entry entry;
+
+        unsigned char *buffer;
+        size_t buffer_size;
+};
+
+struct clew_input_osm_pbf_pipeline {
+        int started;
+        int stop;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        pthread_t reader;
+        pthread_t *workers;
+        int nworkers;
+
+        struct clew_input_osm_pbf_block *blocks;
+        int nblocks;
+
+        uint64_t sequence;
+        uint64_t finished;
+};
+
 struct clew_input_osm_pbf {
         struct clew_input_backend backend;
 
-        char *path;
+        char *path;
+
+	int (*callback_blob) (struct clew_input_backend *backend, void *context, const struct clew_input_index_entry *entry);
+	int (*callback_block) (struct clew_input_backend *backend, void *context, const struct clew_input_block *block);
+
+        int (*callback_bounds_start) (struct clew_input_backend *backend, void *context);
+	int (*callback_bounds_end) (struct clew_input_backend *backend, void *context);
+
+	int (*callback_node_start) (struct clew_input_backend *backend, void *context);
+	int (*callback_node_end) (struct clew_input_backend *backend, void *context);
+
+	int (*callback_way_start) (struct clew_input_backend *backend, void *context);
+	int (*callback_way_end) (struct clew_input_backend *backend, void *context);
+
+	int (*callback_relation_start) (struct clew_input_backend *backend, void *context);
+	int (*callback_relation_end) (struct clew_input_backend *backend, void *context);
+
+	int (*callback_tag_start) (struct clew_input_backend *backend, void *context);
+	int (*callback_tag_end) (struct clew_input_backend *backend, void *context);
+
+	int (*callback_nd_start) (struct clew_input_backend *backend, void *context);
+	int (*callback_nd_end) (struct clew_input_backend *backend, void *context);
+
+	int (*callback_member_start) (struct clew_input_backend *backend, void *context);
+	int (*callback_member_end) (struct clew_input_backend *backend, void *context);
+
+	int (*callback_minlon) (struct clew_input_backend *backend, void *context, int32_t lon);
+	int (*callback_minlat) (struct clew_input_backend *backend, void *context, int32_t lat);
+	int (*callback_maxlon) (struct clew_input_backend *backend, void *context, int32_t lon);
+	int (*callback_maxlat) (struct clew_input_backend *backend, void *context, int32_t lat);
+
+	int (*callback_id) (struct clew_input_backend *backend, void *context, uint64_t id);
+
+	int (*callback_lat) (struct clew_input_backend *backend, void *context, int32_t lat);
+	int (*callback_lon) (struct clew_input_backend *backend, void *context, int32_t lon);
+
+	int (*callback_ref) (struct clew_input_backend *backend, void *context, uint64_t ref);
+
+	int (*callback_type) (struct clew_input_backend *backend, void *context, const char *type);
+	int (*callback_role) (struct clew_input_backend *backend, void *context, const char *role);
+
+	int (*callback_k) (struct clew_input_backend *backend, void *context, const char *k);
+	int (*callback_v) (struct clew_input_backend *backend, void *context, const char *v);
+
+	int (*callback_tag) (struct clew_input_backend *backend, void *context, uint32_t tag);
+
+        int (*callback_error) (struct clew_input_backend *backend, void *context, unsigned int reason);
+
+        void *callback_context;
+
+        FILE *fp;
+        unsigned char *map;
+        size_t map_size;
+        size_t map_offset;
+        int state;
+
+        struct clew_input_osm_pbf_block block;
+
+        int threads;
+        struct clew_input_osm_pbf_pipeline pipeline;
+
+        unsigned int kinds;
+        int resolve;
+
+        struct clew_input_index *index;
+        int index_record;
+        int index_plan;
+        int planned;
+        struct clew_stack plan;
+        uint64_t plan_position;
+
+        khash_t(osm_pbf_tags) *tags;
+
+        char keybuff[1024];
+        char valbuff[1024];
+        char rolebuff[1024];
+};
+
+static int string_ends_with (const char *string, const char *end)
+{
+        int lstring;
+        int lend;
+
+        if (string == NULL) {
+                goto bail;
+        }
+        if (end == NULL) {
+                goto bail;
+        }
+
+        lstring = (int) strlen(string);
+        lend    = (int) strlen(end);
+
+        if (lend > lstring) {
+                return 0;
+        }
+        if (strncasecmp(string + lstring - lend, end, lend) == 0) {
+                return 1;
+        }
+        return 0;
+bail:   return -1;
+}
+
+#define MAX_HEADER_LENGTH	(1024 * 64)
+#define MAX_BLOB_LENGTH		(1024 * 1024 * 32)
+
+/* parses fileformat BlobHeader in place, only type and datasize are used */
+static int parse_header (struct clew_input_osm_pbf_block *block, const unsigned char *buffer, size_t length)
+{
+        int rc;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *data;
+        const unsigned char *end;
+
+        block->type[0]  = '\0';
+        block->datasize = -1;
+
+        end = buffer + length;
+        while ((rc = clew_pbf_read_field(&buffer, end, &field, &wire, &value, &data)) == 0) {
+                if (field == 1 && wire == 2) {
+                        if (value >= sizeof(block->type)) {
+                                clew_errorf("header type is too long: %ld", value);
+                                return -1;
+                        }
+                        memcpy(block->type, data, value);
+                        block->type[value] = '\0';
+                } else if (field == 3 && wire == 0) {
+                        block->datasize = (int32_t) value;
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("can not parse blob header");
+                return -1;
+        }
+        if (block->datasize < 0 || block->datasize > MAX_BLOB_LENGTH) {
+                clew_errorf("invalid block size: %d, max: %d", block->datasize, MAX_BLOB_LENGTH);
+                return -1;
+        }
+        return 0;
+}
+
+/* parses fileformat Blob in place, raw and zlib_data point into buffer */
+static int parse_blob (struct clew_input_osm_pbf_block *block, const unsigned char *buffer, size_t length)
+{
+        int rc;
+        uint32_t field;
+        uint32_t wire;
+        uint64_t value;
+        const unsigned char *data;
+        const unsigned char *end;
+
+        block->raw              = NULL;
+        block->raw_length       = 0;
+        block->raw_size         = 0;
+        block->zlib_data        = NULL;
+        block->zlib_data_length = 0;
+
+        end = buffer + length;
+        while ((rc = clew_pbf_read_field(&buffer, end, &field, &wire, &value, &data)) == 0) {
+                if (field == 1 && wire == 2) {
+                        block->raw        = data;
+                        block->raw_length = value;
+                } else if (field == 2 && wire == 0) {
+                        block->raw_size = (int32_t) value;
+                } else if (field == 3 && wire == 2) {
+                        block->zlib_data        = data;
+                        block->zlib_data_length = value;
+                } else if (field >= 4 && field <= 7 && wire == 2) {
+                        clew_errorf("blob compression is not supported: %d", field);
+                        return -1;
+                }
+        }
+        if (rc < 0) {
+                clew_errorf("can not parse blob");
+                return -1;
+        }
+        if (block->raw == NULL && block->zlib_data == NULL) {
+                clew_errorf("blob has no data");
+                return -1;
+        }
+        if (block->raw_size < 0 || block->raw_size > MAX_BLOB_LENGTH) {
+                clew_errorf("invalid blob raw size: %d, max: %d", block->raw_size, MAX_BLOB_LENGTH);
+                return -1;
+        }
+        return 0;
+}
+
+static int reserve_blob (struct clew_input_osm_pbf_block *block)
+{
+        size_t size;
+        unsigned char *data;
+
+        size = (block->raw_size > 0) ? block->raw_size : 1;
+        if (size > block->data_size) {
+                data = (unsigned char *) realloc(block->data, size);
+                if (data == NULL) {
+                        clew_errorf("can not allocate memory");
+                        return -1;
+                }
+                block->data      = data;
+                block->data_size = size;
+        }
+        return 0;
+}
+
+static int uncompress_blob (struct clew_input_osm_pbf_block *block)
+{
+        int zerr;
+        z_stream strm;
+
+        if (reserve_blob(block) < 0) {
+                return -1;
+        }
+
+        memset(&strm, 0, sizeof(strm));
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        strm.avail_in = block->zlib_data_length;
+        strm.next_in = (unsigned char *) block->zlib_data;
+        strm.avail_out = block->raw_size;
+        strm.next_out = block->data;
+        zerr = inflateInit(&strm);
+        if (zerr != Z_OK) {
+                return -1;
+        }
+        zerr = inflate(&strm, Z_FINISH);
+        inflateEnd(&strm);
+        if (zerr != Z_STREAM_END) {
+                return -1;
+        }
+        return 0;
+}
+
+static int get_string (char *buffer, size_t buffer_size, const struct clew_input_osm_pbf_primitive *primitive, uint32_t id)
+{
+        const struct clew_input_osm_pbf_string *string;
+
+        string = (const struct clew_input_osm_pbf_string *) clew_stack_at(&primitive->strings, id);
+        if (string == NULL || string->length >= buffer_size) {
+                buffer[0] = '\0';
+                return 0;
+        }
+        memcpy(buffer, string->data, string->length);
+        buffer[string->length] = '\0';
+        return 1;
+}
+
+/*
+ * resolves tag string pairs of a decoded block to tag values on the decode
+ * stage, memoized per (key, value) string id pair as pairs repeat heavily
+ * within a block.
+ */
+static int clew_input_osm_pbf_block_resolve (struct clew_input_osm_pbf_block *block)
+{
+        int rc;
+        uint64_t i;
+        uint64_t il;
+        uint64_t key;
+        khint_t it;
+        uint32_t *tag_ids;
+        const struct clew_input_osm_pbf_tag *tags;
+        char k[1024];
+        char v[1024];
+
+        if (block->tags == NULL) {
+                block->tags = kh_init(osm_pbf_tags);
+                if (block->tags == NULL) {
+                        clew_errorf("can not allocate memory");
+                        goto bail;
+                }
+        }
+        kh_clear(osm_pbf_tags, block->tags);
+
+        il = clew_stack_count(&block->primitive->tags);
+        if (il > block->tag_ids_size) {
+                tag_ids = (uint32_t *) realloc(block->tag_ids, sizeof(uint32_t) * il);
+                if (tag_ids == NULL) {
+                        clew_errorf("can not allocate memory");
+                        goto bail;
+                }
+                block->tag_ids      = tag_ids;
+                block->tag_ids_size = il;
+        }
+
+        tags = (const struct clew_input_osm_pbf_tag *) clew_stack_buffer(&block->primitive->tags);
+        for (i = 0; i < il; i++) {
+                key = (((uint64_t) tags[i].k) << 32) | tags[i].v;
+                it  = kh_get(osm_pbf_tags, block->tags, key);
+                if (it == kh_end(block->tags)) {
+                        get_string(k, sizeof(k), block->primitive, tags[i].k);
+                        get_string(v, sizeof(v), block->primitive, tags[i].v);
+                        it = kh_put(osm_pbf_tags, block->tags, key, &rc);
+                        if (rc < 0) {
+                                clew_errorf("can not allocate memory");
+                                goto bail;
+                        }
+                        kh_value(block->tags, it) = clew_tag_parse(k, v);
+                }
+                block->tag_ids[i] = kh_value(block->tags, it);
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+static void clew_input_osm_pbf_block_release (struct clew_input_osm_pbf_block *block)
+{
+        if (block->header_block != NULL) {
+                osmpbf__header_block__free_unpacked(block->header_block, NULL);
+                block->header_block = NULL;
+        }
+        block->primitive_valid  = 0;
+        block->type[0]          = '\0';
+        block->raw              = NULL;
+        block->zlib_data        = NULL;
+        block->skipped          = 0;
+        block->inflated         = 0;
+}
+
+static void clew_input_osm_pbf_block_uninit (struct clew_input_osm_pbf_block *block)
+{
+        clew_input_osm_pbf_block_release(block);
+        if (block->data != NULL) {
+                free(block->data);
+                block->data = NULL;
+        }
+        block->data_size = 0;
+        if (block->buffer != NULL) {
+                free(block->buffer);
+                block->buffer = NULL;
+        }
+        block->buffer_size = 0;
+        if (block->primitive != NULL) {
+                clew_input_osm_pbf_primitive_destroy(block->primitive);
+                block->primitive = NULL;
+        }
+        if (block->tags != NULL) {
+                kh_destroy(osm_pbf_tags, block->tags);
+                block->tags = NULL;
+        }
+        if (block->tag_ids != NULL) {
+                free(block->tag_ids);
+                block->tag_ids = NULL;
+        }
+        block->tag_ids_size = 0;
+}
+
+static int clew_input_osm_pbf_block_reserve (struct clew_input_osm_pbf_block *block, size_t size)
+{
+        unsigned char *buffer;
+
+        size = (size > 0) ? size : 1;
+        if (size > block->buffer_size) {
+                buffer = (unsigned char *) realloc(block->buffer, size);
+                if (buffer == NULL) {
+                        clew_errorf("can not allocate memory");
+                        return -1;
+                }
+                block->buffer      = buffer;
+                block->buffer_size = size;
+        }
+        return 0;
+}
+
+/* i/o stage for stdio: reads next blob header and blob into block buffer */
+static int clew_input_osm_pbf_block_read_file (struct clew_input_osm_pbf_block *block, FILE *fp)
+{
+        int rc;
+        uint32_t len;
+        unsigned char lenb[4];
+
+        block->offset = ftello(fp);
+        if (fread(lenb, 4, 1, fp) != 1) {
+                return 1;
+        }
+        len = ((uint32_t) lenb[0] << 24) | ((uint32_t) lenb[1] << 16) | ((uint32_t) lenb[2] << 8) | lenb[3];
+        if (len > MAX_HEADER_LENGTH) {
+                clew_errorf("invalid block size: %d, max: %d", len, MAX_HEADER_LENGTH);
+                goto bail;
+        }
+
+        rc = clew_input_osm_pbf_block_reserve(block, len);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (fread(block->buffer, len, 1, fp) != 1) {
+                clew_errorf("can not read blob header");
+                goto bail;
+        }
+        rc = parse_header(block, block->buffer, len);
+        if (rc < 0) {
+                goto bail;
+        }
+
+        rc = clew_input_osm_pbf_block_reserve(block, block->datasize);
+        if (rc < 0) {
+                goto bail;
+        }
+        if (fread(block->buffer, block->datasize, 1, fp) != 1) {
+                clew_errorf("can not read blob");
+                goto bail;
+        }
+        rc = parse_blob(block, block->buffer, block->datasize);
+        if (rc < 0) {
+                goto bail;
+        }
+        block->length = 4 + len + block->datasize;
+
+        return 0;
+bail:   return -1;
+}
+
+/* i/o stage for mmap: points block at next blob header and blob inside mapping */
+static int clew_input_osm_pbf_block_read_map (struct clew_input_osm_pbf_block *block, const unsigned char *map, size_t map_size, size_t *map_offset)
+{
+        int rc;
+        uint32_t len;
+        size_t offset;
+        const unsigned char *lenb;
+
+        offset = *map_offset;
+        if (offset == map_size) {
+                return 1;
+        }
+        if (map_size - offset < 4) {
+                clew_errorf("file is truncated");
+                goto bail;
+        }
+        lenb = map + offset;
+        len  = ((uint32_t) lenb[0] << 24) | ((uint32_t) lenb[1] << 16) | ((uint32_t) lenb[2] << 8) | lenb[3];
+        offset += 4;
+        if (len > MAX_HEADER_LENGTH || len > map_size - offset) {
+                clew_errorf("invalid block size: %d, max: %d", len, MAX_HEADER_LENGTH);
+                goto bail;
+        }
+
+        rc = parse_header(block, map + offset, len);
+        if (rc < 0) {
+                goto bail;
+        }
+        offset += len;
+        if ((size_t) block->datasize > map_size - offset) {
+                clew_errorf("file is truncated");
+                goto bail;
+        }
+
+        rc = parse_blob(block, map + offset, block->datasize);
+        if (rc < 0) {
+                goto bail;
+        }
+        offset += block->datasize;
+
+        block->offset = *map_offset;
+        block->length = offset - *map_offset;
+        *map_offset   = offset;
+        return 0;
+bail:   return -1;
+}
+
+/* i/o stage: reads next blob header and blob, returns 1 at end of file */
+static int clew_input_osm_pbf_block_read (struct clew_input_osm_pbf *input, struct clew_input_osm_pbf_block *block)
+{
+        const struct clew_input_index_entry *entry;
+
+        clew_input_osm_pbf_block_release(block);
+
+        if (input->planned) {
+                if (input->plan_position >= clew_stack_count(&input->plan)) {
+                        return 1;
+                }
+                entry = clew_input_index_at(input->index, clew_stack_at_uint64(&input->plan, input->plan_position));
+                input->plan_position += 1;
+                if (input->map != NULL) {
+                        input->map_offset = entry->offset;
+                } else if (fseeko(input->fp, entry->offset, SEEK_SET) != 0) {
+                        clew_errorf("can not seek to blob at: %ld", entry->offset);
+                        return -1;
+                }
+        }
+        if (input->map != NULL) {
+                return clew_input_osm_pbf_block_read_map(block, input->map, input->map_size, &input->map_offset);
+        }
+        return clew_input_osm_pbf_block_read_file(block, input->fp);
+}
+
+static void clew_input_osm_pbf_entry_init (struct clew_input_index_entry *entry, const struct clew_input_osm_pbf_block *block)
+{
+        memset(entry, 0, sizeof(struct clew_input_index_entry));
+        entry->offset = block->offset;
+        entry->length = block->length;
+        entry->min_id = UINT64_MAX;
+        entry->minlon = INT32_MAX;
+        entry->minlat = INT32_MAX;
+        entry->maxlon = INT32_MIN;
+        entry->maxlat = INT32_MIN;
+}
+
+static inline void clew_input_osm_pbf_entry_add_id (struct clew_input_index_entry *entry, uint64_t id)
+{
+        entry->count += 1;
+        if (id < entry->min_id) {
+                entry->min_id = id;
+        }
+        if (id > entry->max_id) {
+                entry->max_id = id;
+        }
+}
+
+static inline void clew_input_osm_pbf_entry_add_lon (struct clew_input_index_entry *entry, int32_t lon)
+{
+        if (lon < entry->minlon) {
+                entry->minlon = lon;
+        }
+        if (lon > entry->maxlon) {
+                entry->maxlon = lon;
+        }
+}
+
+static inline void clew_input_osm_pbf_entry_add_lat (struct clew_input_index_entry *entry, int32_t lat)
+{
+        if (lat < entry->minlat) {
+                entry->minlat = lat;
+        }
+        if (lat > entry->maxlat) {
+                entry->maxlat = lat;
+        }
+}
+
+static void clew_input_osm_pbf_entry_finish (struct clew_input_index_entry *entry)
+{
+        if (entry->count == 0) {
+                entry->min_id = 0;
+        }
+        if (entry->minlon > entry->maxlon || entry->minlat > entry->maxlat) {
+                entry->minlon = 0;
+                entry->minlat = 0;
+                entry->maxlon = 0;
+                entry->maxlat = 0;
+        }
+}
+
+#define PEEK_WINDOW_LENGTH      (1024 * 16)
+
+/*
+ * streaming reader over raw or zlib blob data, used to look into a block
+ * without unpacking it. zlib data is inflated a window at a time into the
+ * block's data buffer, so a wanted block carries on from where peek stopped.
+ */
+struct clew_input_osm_pbf_peek {
+        int zlib;
+        int eof;
+        z_stream strm;
+        uint64_t consumed;
+        unsigned char *data;
+        uint64_t size;
+        const unsigned char *ptr;
+        const unsigned char *end;
+};
+
+static int peek_fill (struct clew_input_osm_pbf_peek *peek)
+{
+        int zerr;
+        uint64_t avail;
+
+        if (peek->eof) {
+                return -1;
+        }
+        if (peek->zlib == 0) {
+                peek->eof = 1;
+                return -1;
+        }
+        avail = peek->size - peek->strm.total_out;
+        peek->strm.next_out  = peek->data + peek->strm.total_out;
+        peek->strm.avail_out = (avail < PEEK_WINDOW_LENGTH) ? avail : PEEK_WINDOW_LENGTH;
+        zerr = inflate(&peek->strm, Z_SYNC_FLUSH);
+        if (zerr != Z_OK && zerr != Z_STREAM_END) {
+                peek->eof = 1;
+                return -1;
+        }
+        peek->end = peek->data + peek->strm.total_out;
+        if (zerr == Z_STREAM_END) {
+                peek->eof = 1;
+        }
+        return (peek->ptr < peek->end) ? 0 : -1;
+}
+
+/* inflates the rest of the blob behind what peek has read */
+static int peek_finish (struct clew_input_osm_pbf_peek *peek)
+{
+        int zerr;
+
+        if (peek->zlib == 0 || peek->eof) {
+                return 0;
+        }
+        peek->strm.next_out  = peek->data + peek->strm.total_out;
+        peek->strm.avail_out = peek->size - peek->strm.total_out;
+        zerr = inflate(&peek->strm, Z_FINISH);
+        return (zerr == Z_STREAM_END) ? 0 : -1;
+}
+
+static inline int peek_byte (struct clew_input_osm_pbf_peek *peek, unsigned char *byte)
+{
+        if (peek->ptr >= peek->end && peek_fill(peek) < 0) {
+                return -1;
+        }
+        *byte = *peek->ptr++;
+        peek->consumed += 1;
+        return 0;
+}
+
+static inline int peek_varint (struct clew_input_osm_pbf_peek *peek, uint64_t *value)
+{
+        int shift;
+        unsigned char byte;
+
+        *value = 0;
+        for (shift = 0; shift < 64; shift += 7) {
+                if (peek_byte(peek, &byte) < 0) {
+                        return -1;
+                }
+                *value |= ((uint64_t) (byte & 0x7f)) << shift;
+                if ((byte & 0x80) == 0) {
+                        return 0;
+                }
+        }
+        return -1;
+}
+
+static inline int64_t peek_zigzag (uint64_t value)
+{
+        return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static int peek_skip (struct clew_input_osm_pbf_peek *peek, uint64_t length)
+{
+        uint64_t take;
+
+        while (length > 0) {
+                if (peek->ptr >= peek->end && peek_fill(peek) < 0) {
+                        return -1;
+                }
+                take = peek->end - peek->ptr;
+                if (take > length) {
+                        take = length;
+                }
+                peek->ptr      += take;
+                peek->consumed += take;
+                length         -= take;
+        }
+        return 0;
+}
+
+static int peek_skip_field (struct clew_input_osm_pbf_peek *peek, uint32_t wire)
+{
+        uint64_t value;
+
+        if (wire == 0) {
+                return peek_varint(peek, &value);
+        } else if (wire == 1) {
+                return peek_skip(peek, 8);
+        } else if (wire == 2) {
+                if (peek_varint(peek, &value) < 0) {
+                        return -1;
+                }
+                return peek_skip(peek, value);
+        } else if (wire == 5) {
+                return peek_skip(peek, 4);
+        }
+        return -1;
+}
+
+/* reads key of next field until end, returns 1 when end is reached */
+static inline int peek_field (struct clew_input_osm_pbf_peek *peek, uint64_t end, uint32_t *field, uint32_t *wire)
+{
+        uint64_t key;
+
+        if (peek->consumed >= end) {
+                return (peek->consumed == end) ? 1 : -1;
+        }
+        if (peek_varint(peek, &key) < 0) {
+                return -1;
+        }
+        *field = (uint32_t) (key >> 3);
+        *wire  = (uint32_t) (key & 0x07);
+        return 0;
+}
+
+/* walks packed sint64 delta array, tracking cumulative value in id, lon or lat */
+static int peek_packed_delta (struct clew_input_osm_pbf_peek *peek, struct clew_input_index_entry *entry, int what)
+{
+        uint64_t end;
+        uint64_t value;
+        int64_t current;
+
+        if (peek_varint(peek, &value) < 0) {
+                return -1;
+        }
+        if (entry == NULL) {
+                return peek_skip(peek, value);
+        }
+        end     = peek->consumed + value;
+        current = 0;
+        while (peek->consumed < end) {
+                if (peek_varint(peek, &value) < 0) {
+                        return -1;
+                }
+                current += peek_zigzag(value);
+                if (what == 1) {
+                        clew_input_osm_pbf_entry_add_id(entry, current);
+                } else if (what == 8) {
+                        clew_input_osm_pbf_entry_add_lat(entry, current);
+                } else if (what == 9) {
+                        clew_input_osm_pbf_entry_add_lon(entry, current);
+                }
+        }
+        return (peek->consumed == end) ? 0 : -1;
+}
+
+/* walks a node, way or relation message, reading only id (and lat, lon for nodes) */
+static int peek_element (struct clew_input_osm_pbf_peek *peek, struct clew_input_index_entry *entry, uint32_t kind)
+{
+        int rc;
+        uint64_t end;
+        uint64_t value;
+        uint32_t field;
+        uint32_t wire;
+
+        if (peek_varint(peek, &value) < 0) {
+                return -1;
+        }
+        if (entry == NULL) {
+                return peek_skip(peek, value);
+        }
+        end = peek->consumed + value;
+        while ((rc = peek_field(peek, end, &field, &wire)) == 0) {
+                if (field == 1 && wire == 0) {
+                        if (peek_varint(peek, &value) < 0) {
+                                return -1;
+                        }
+                        clew_input_osm_pbf_entry_add_id(entry, (kind == CLEW_INPUT_INDEX_KIND_NODE) ? (uint64_t) peek_zigzag(value) : value);
+                } else if (kind == CLEW_INPUT_INDEX_KIND_NODE && (field == 8 || field == 9) && wire == 0) {
+                        if (peek_varint(peek, &value) < 0) {
+                                return -1;
+                        }
+                        if (field == 8) {
+                                clew_input_osm_pbf_entry_add_lat(entry, peek_zigzag(value));
+                        } else {
+                                clew_input_osm_pbf_entry_add_lon(entry, peek_zigzag(value));
+                        }
+                } else if (peek_skip_field(peek, wire) < 0) {
+                        return -1;
+                }
+        }
+        return (rc == 1) ? 0 : -1;
+}
+
+/*
+ * looks into a primitive block without unpacking it. returns 1 as soon as
+ * an element of a wanted kind is found, with zlib data then fully inflated
+ * into block data, 0 when the block has none, in which case entry (if
+ * given) describes the whole block. a group holds a single kind of element,
+ * without entry the rest of a group is skipped once its kind is known.
+ */
+static int clew_input_osm_pbf_block_peek (struct clew_input_osm_pbf_block *block, unsigned int kinds, struct clew_input_index_entry *entry)
+{
+        int rc;
+        int zerr;
+        uint64_t end;
+        uint64_t gend;
+        uint64_t value;
+        uint32_t field;
+        uint32_t wire;
+        uint32_t kind;
+        struct clew_input_osm_pbf_peek _peek;
+        struct clew_input_osm_pbf_peek *peek;
+
+        peek = &_peek;
+        memset(peek, 0, sizeof(struct clew_input_osm_pbf_peek));
+
+        if (block->raw != NULL) {
+                peek->ptr = block->raw;
+                peek->end = block->raw + block->raw_length;
+                end       = block->raw_length;
+        } else {
+                if (reserve_blob(block) < 0) {
+                        return -1;
+                }
+                peek->zlib          = 1;
+                peek->data          = block->data;
+                peek->size          = block->raw_size;
+                peek->ptr           = block->data;
+                peek->end           = block->data;
+                peek->strm.next_in  = (unsigned char *) block->zlib_data;
+                peek->strm.avail_in = block->zlib_data_length;
+                zerr = inflateInit(&peek->strm);
+                if (zerr != Z_OK) {
+                        clew_errorf("can not init inflate");
+                        return -1;
+                }
+                end = block->raw_size;
+        }
+
+        if (entry != NULL) {
+                clew_input_osm_pbf_entry_init(entry, block);
+        }
+
+        while ((rc = peek_field(peek, end, &field, &wire)) == 0) {
+                if (field != 2 || wire != 2) {
+                        if (peek_skip_field(peek, wire) < 0) {
+                                goto bail;
+                        }
+                        continue;
+                }
+                if (peek_varint(peek, &value) < 0) {
+                        goto bail;
+                }
+                gend = peek->consumed + value;
+                while ((rc = peek_field(peek, gend, &field, &wire)) == 0) {
+                        kind = (field == 1 || field == 2) ? CLEW_INPUT_INDEX_KIND_NODE :
+                               (field == 3) ? CLEW_INPUT_INDEX_KIND_WAY :
+                               (field == 4) ? CLEW_INPUT_INDEX_KIND_RELATION : 0;
+                        if (kind == 0 || wire != 2) {
+                                if (peek_skip_field(peek, wire) < 0) {
+                                        goto bail;
+                                }
+                                continue;
+                        }
+                        if (kinds & kind) {
+                                if (peek_finish(peek) < 0) {
+                                        goto bail;
+                                }
+                                block->inflated = peek->zlib;
+                                rc = 1;
+                                goto out;
+                        }
+                        if (entry == NULL) {
+                                if (peek_skip(peek, gend - peek->consumed) < 0) {
+                                        goto bail;
+                                }
+                                continue;
+                        }
+                        entry->kinds |= kind;
+                        if (field != 2) {
+                                if (peek_element(peek, entry, kind) < 0) {
+                                        goto bail;
+                                }
+                                continue;
+                        }
+                        if (peek_varint(peek, &value) < 0) {
+                                goto bail;
+                        }
+                        value += peek->consumed;
+                        while ((rc = peek_field(peek, value, &field, &wire)) == 0) {
+                                if ((field == 1 || field == 8 || field == 9) && wire == 2) {
+                                        rc = peek_packed_delta(peek, entry, field);
+                                } else {
+                                        rc = peek_skip_field(peek, wire);
+                                }
+                                if (rc < 0) {
+                                        goto bail;
+                                }
+                        }
+                        if (rc < 0) {
+                                goto bail;
+                        }
+                }
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        if (rc < 0) {
+                goto bail;
+        }
+
+        if (entry != NULL) {
+                clew_input_osm_pbf_entry_finish(entry);
+        }
+        rc = 0;
+out:    if (peek->zlib) {
+                inflateEnd(&peek->strm);
+        }
+        return rc;
+bail:   clew_errorf("can not peek block");
+        if (peek->zlib) {
+                inflateEnd(&peek->strm);
+        }
+        return -1;
+}
+
+/*
+ * decode stage: inflates and decodes blob, safe to run concurrently on
+ * distinct blocks. data blocks without any element of wanted kinds are
+ * marked as skipped instead, with index entry filled if requested.
+ */
+static int clew_input_osm_pbf_block_decode (struct clew_input_osm_pbf_block *block, unsigned int kinds, int index, int resolve)
+{
+        int rc;
+        size_t length;
+        const unsigned char *data;
+
+        if (kinds != 0 && strcmp(block->type, "OSMData") == 0) {
+                rc = clew_input_osm_pbf_block_peek(block, kinds, (index) ? &block->entry : NULL);
+                if (rc < 0) {
+                        goto bail;
+                } else if (rc == 0) {
+                        block->skipped = 1;
+                        return 0;
+                }
+        }
+
+        if (block->raw != NULL) {
+                data   = block->raw;
+                length = block->raw_length;
+        } else if (block->inflated) {
+                data   = block->data;
+                length = block->raw_size;
+        } else {
+                rc = uncompress_blob(block);
+                if (rc < 0) {
+                        clew_errorf("can not uncompress blob");
+                        goto bail;
+                }
+                data   = block->data;
+                length = block->raw_size;
+        }
+
+        if (strcmp(block->type, "OSMHeader") == 0) {
+                block->header_block = osmpbf__header_block__unpack(NULL, length, data);
+                if (block->header_block == NULL) {
+                        clew_errorf("can not unpack header block");
+                        goto bail;
+                }
+        } else if (strcmp(block->type, "OSMData") == 0) {
+                if (block->primitive == NULL) {
+                        block->primitive = clew_input_osm_pbf_primitive_create();
+                        if (block->primitive == NULL) {
+                                clew_errorf("can not create primitive");
+                                goto bail;
+                        }
+                }
+                rc = clew_input_osm_pbf_primitive_decode(block->primitive, data, length);
+                if (rc < 0) {
+                        clew_errorf("can not decode primitive block");
+                        goto bail;
+                }
+                block->primitive_valid = 1;
+                if (resolve) {
+                        rc = clew_input_osm_pbf_block_resolve(block);
+                        if (rc < 0) {
+                                clew_errorf("can not resolve tags");
+                                goto bail;
+                        }
+                }
+        } else {
+                clew_errorf("unknown header type type '%s'", block->type);
+                goto bail;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+static int clew_input_osm_pbf_deliver_header_block (struct clew_input_osm_pbf *input, OSMPBF__HeaderBlock *header_block)
+{
+        int rc;
+
+        if (input->callback_bounds_start != NULL) {
+                rc = input->callback_bounds_start(&input->backend, input->callback_context);
+                if (rc < 0) {
+                        clew_errorf("input callback_bounds_start failed");
+                        goto bail;
+                }
+        }
+        if (header_block->bbox != NULL) {
+                if (input->callback_minlon != NULL) {
+                        rc = input->callback_minlon(&input->backend, input->callback_context, header_block->bbox->left / 100);
+                        if (rc < 0) {
+                                clew_errorf("input callback_minlon failed");
+                                goto bail;
+                        }
+                }
+                if (input->callback_minlat != NULL) {
+                        rc = input->callback_minlat(&input->backend, input->callback_context, header_block->bbox->top / 100);
+                        if (rc < 0) {
+                                clew_errorf("input callback_minlat failed");
+                                goto bail;
+                        }
+                }
+                if (input->callback_maxlon != NULL) {
+                        rc = input->callback_maxlon(&input->backend, input->callback_context, header_block->bbox->right / 100);
+                        if (rc < 0) {
+                                clew_errorf("input callback_maxlon failed");
+                                goto bail;
+                        }
+                }
+                if (input->callback_maxlat != NULL) {
+                        rc = input->callback_maxlat(&input->backend, input->callback_context, header_block->bbox->bottom / 100);
+                        if (rc < 0) {
+                                clew_errorf("input callback_maxlat failed");
+                                goto bail;
+                        }
+                }
+        }
+        if (input->callback_bounds_end != NULL) {
+                rc = input->callback_bounds_end(&input->backend, input->callback_context);
+                if (rc < 0) {
+                        clew_errorf("input callback_bounds_end failed");
+                        goto bail;
+                }
+        }
+        return 0;
+bail:   return -1;
+}
+
+static int clew_input_osm_pbf_deliver_tags (struct clew_input_osm_pbf *input, const struct clew_input_osm_pbf_block *block, uint64_t from, uint64_t to)
+{
+        int rc;
+        uint64_t k;
+        const struct clew_input_osm_pbf_tag *tags;
+        const struct clew_input_osm_pbf_primitive *primitive = block->primitive;
+
+        tags = (const struct clew_input_osm_pbf_tag *) clew_stack_buffer(&primitive->tags);
+        for (k = from; k < to; k++) {
+                if (input->callback_tag) {
+                        if (block->tag_ids[k] == clew_tag_unknown) {
+                                continue;
+                        }
+                        rc = input->callback_tag(&input->backend, input->callback_context, block->tag_ids[k]);
+                        if (rc < 0) {
+                                clew_errorf("input callback_tag failed");
+                                goto bail;
+                        }
+                        continue;
+                }
+                get_string(input->keybuff, sizeof(input->keybuff), primitive, tags[k].k);
+                get_string(input->valbuff, sizeof(input->valbuff), primitive, tags[k].v);
+                if (input->callback_tag_start) {
+                        rc = input->callback_tag_start(&input->backend, input->callback_context);
+                        if (rc < 0) {
+                                clew_errorf("input callback_tag_start failed");
+                                goto bail;
+                        } else if (rc == 1) {
+                                goto skip_tag;
+                        }
+                }
+                if (input->callback_k) {
+                        rc = input->callback_k(&input->backend, input->callback_context, input->keybuff);
+                        if (rc < 0) {
+                                clew_errorf("input callback_k failed");
+                                goto bail;
+                        }
+                }
+                if (input->callback_v) {
+                        rc = input->callback_v(&input->backend, input->callback_context, input->valbuff);
+                        if (rc < 0) {
+                                clew_errorf("input callback_v failed");
+                                goto bail;
+                        }
+                }
+skip_tag:
+                if (input->callback_tag_end) {
+                        rc = input->callback_tag_end(&input->backend, input->callback_context);
+                        if (rc < 0) {
+                                clew_errorf("input callback_tag_end failed");
+                                goto bail;
+                        }
+                }
+        }
+        return 0;
+bail:   return -1;
+}
+
+/* delivers a decoded block in one call through callback_block */
+static int clew_input_osm_pbf_deliver_block (struct clew_input_osm_pbf *input, const struct clew_input_osm_pbf_block *block)
+{
+        int rc;
+        struct clew_input_block flat;
+        const struct clew_input_osm_pbf_primitive *primitive = block->primitive;
+
+        flat.nnodes             = clew_stack_count(&primitive->node_ids);
+        flat.node_ids           = (const uint64_t *) clew_stack_buffer(&primitive->node_ids);
+        flat.node_lons          = (const int32_t *) clew_stack_buffer(&primitive->node_lons);
+        flat.node_lats          = (const int32_t *) clew_stack_buffer(&primitive->node_lats);
+        flat.node_tags          = (const uint64_t *) clew_stack_buffer(&primitive->node_tags);
+
+        flat.nways              = clew_stack_count(&primitive->way_ids);
+        flat.way_ids            = (const uint64_t *) clew_stack_buffer(&primitive->way_ids);
+        flat.way_tags           = (const uint64_t *) clew_stack_buffer(&primitive->way_tags);
+        flat.way_refs           = (const uint64_t *) clew_stack_buffer(&primitive->way_refs);
+
+        flat.nrelations         = clew_stack_count(&primitive->relation_ids);
+        flat.relation_ids       = (const uint64_t *) clew_stack_buffer(&primitive->relation_ids);
+        flat.relation_tags      = (const uint64_t *) clew_stack_buffer(&primitive->relation_tags);
+        flat.relation_members   = (const uint64_t *) clew_stack_buffer(&primitive->relation_members);
+
+        flat.tags               = block->tag_ids;
+        flat.refs               = (const uint64_t *) clew_stack_buffer(&primitive->refs);
+        flat.member_ids         = (const uint64_t *) clew_stack_buffer(&primitive->member_ids);
+        flat.member_types       = (const uint32_t *) clew_stack_buffer(&primitive->member_types);
+
+        rc = input->callback_block(&input->backend, input->callback_context, &flat);
+        if (rc < 0) {
+                clew_errorf("input callback_block failed");
+                goto bail;
+        }
+
+        return 0;
+bail:   return -1;
+}
+
+static int clew_input_osm_pbf_deliver_primitive_block (struct clew_input_osm_pbf *input, const struct clew_input_osm_pbf_block *block)
+{
+        int rc;
+        uint64_t j;
+        uint64_t jl;
+        uint64_t k;
+        const uint64_t *ids;
+        const int32_t *lats;
+        const int32_t *lons;
+        const uint64_t *tags;
+        const uint64_t *refs;
+        const uint64_t *ref;
+        const uint64_t *members;
+        const uint64_t *member_ids;
+        const uint32_t *member_types;
+        const uint32_t *member_roles;
+        const struct clew_input_osm_pbf_primitive *primitive = block->primitive;
+
+        ids  = (const uint64_t *) clew_stack_buffer(&primitive->node_ids);
+        lats = (const int32_t *) clew_stack_buffer(&primitive->node_lats);
+        lons = (const int32_t *) clew_stack_buffer(&primitive->node_lons);
+        tags = (const uint64_t *) clew_stack_buffer(&primitive->node_tags);
+        for (j = 0, jl = clew_stack_count(&primitive->node_ids); j < jl; j++) {
+                if (input->callback_node_start) {
+                        rc = input->callback_node_start(&input->backend, input->callback_context);
+                        if (rc < 0) {
+                                clew_errorf("input callback_node_start failed");
+                                goto bail;
+                        } else if (rc == 1) {
+                                goto skip_node;
+                        }
+                }
+                if (input->callback_id) {
+                        rc = input->callback_id(&input->backend, input->callback_context, ids[j]);
+                        if (rc < 0) {
+                                clew_errorf("input callback_id failed");
+                                goto bail;
+                        } else if (rc == 1) {
+                                goto skip_node;
+                        }
+                }
+                if (input->callback_lon) {
+                        rc = input->callback_lon(&input->backend, input->callback_context, lons[j]);
+                        if (rc < 0) {
+                                clew_errorf("input callback_lon failed");
+                                goto bail;
+                        }
+                }
+                if (input->callback_lat) {
+                        rc = input->callback_lat(&input->backend, input->callback_context, lats[j]);
+                        if (rc < 0) {
+                                clew_errorf("input callback_lat failed");
+                                goto bail;
+                        }
+                }
+                rc = clew_input_osm_pbf_deliver_tags(input, block, tags[j], tags[j + 1]);
+                if (rc < 0) {
+                        goto bail;
+                }
+skip_node:
+                if (input->callback_node_end) {
+                        rc = input->callback_node_end(&input->backend, input->callback_context);
+                        if (rc < 0) {
+                                clew_errorf("input callback_node_end failed");
+                                goto bail;
+                        }
+                }
+        }
+
+        ids  = (const uint64_t *) clew_stack_buffer(&primitive->way_ids);
+        tags = (const uint64_t *) clew_stack_buffer(&primitive->way_tags);
+        refs = (const uint64_t *) clew_stack_buffer(&primitive->way_refs);
+        ref  = (const uint64_t *) clew_stack_buffer(&primitive->refs);
+        for (j = 0, jl = clew_stack_count(&primitive->way_ids); j < jl; j++) {
+                if (input->callback_way_start) {
+                        rc = input->callback_way_start(&input->backend, input->callback_context);
+                        if (rc < 0) {
+                                clew_errorf("input callback_way_start failed");
+                                goto bail;
+                        } else if (rc == 1) {
+                                goto skip_way;
+                        }
+                }
+                if (input->callback_id) {
+                        rc = input->callback_id(&input->backend, input->callback_context, ids[j]);
+                        if (rc < 0) {
+                                clew_errorf("input callback_id failed");
+                                goto bail;
+                        } else if (rc == 1) {
+                                goto skip_way;
+                        }
+                }
+                for (k = refs[j]; k < refs[j + 1]; k++) {
+                        if (input->callback_nd_start) {
+                                rc = input->callback_nd_start(&input->backend, input->callback_context);
+                                if (rc < 0) {
+                                        clew_errorf("input callback_nd_start failed");
+                                        goto bail;
+                                }
+                        }
+                        if (input->callback_ref) {
+                                rc = input->callback_ref(&input->backend, input->callback_context, ref[k]);
+                                if (rc < 0) {
+                                        clew_errorf("input callback_ref failed");
+                                        goto bail;
+                                }
+                        }
+                        if (input->callback_nd_end) {
+                                rc = input->callback_nd_end(&input->backend, input->callback_context);
+                                if (rc < 0) {
+                                        clew_errorf("input callback_nd_end failed");
+                                        goto bail;
+                                }
+                        }
+                }
+                rc = clew_input_osm_pbf_deliver_tags(input, block, tags[j], tags[j + 1]);
+                if (rc < 0) {
+                        goto bail;
+                }
+skip_way:
+                if (input->callback_way_end) {
+                        rc = input->callback_way_end(&input->backend, input->callback_context);
+                        if (rc < 0) {
+                                clew_errorf("input callback_way_end failed");
+                                goto bail;
+                        }
+                }
+        }
+
+        ids     = (const uint64_t *) clew_stack_buffer(&primitive->relation_ids);
+        tags    = (const uint64_t *) clew_stack_buffer(&primitive->relation_tags);
+        members = (const uint64_t *) clew_stack_buffer(&primitive->relation_members);
+        member_ids   = (const uint64_t *) clew_stack_buffer(&primitive->member_ids);
+        member_types = (const uint32_t *) clew_stack_buffer(&primitive->member_types);
+        member_roles = (const uint32_t *) clew_stack_buffer(&primitive->member_roles);
+        for (j = 0, jl = clew_stack_count(&primitive->relation_ids); j < jl; j++) {
+                if (input->callback_relation_start) {
+                        rc = input->callback_relation_start(&input->backend, input->callback_context);
+                        if (rc < 0) {
+                                clew_errorf("input callback_relation_start failed");
+                                goto bail;
+                        } else if (rc == 1) {
+                                goto skip_relation;
+                        }
+                }
+                if (input->callback_id) {
+                        rc = input->callback_id(&input->backend, input->callback_context, ids[j]);
+                        if (rc < 0) {
+                                clew_errorf("input callback_id failed");
+                                goto bail;
+                        } else if (rc == 1) {
+                                goto skip_relation;
+                        }
+                }
+                for (k = members[j]; k < members[j + 1]; k++) {
+                        get_string(input->rolebuff, sizeof(input->rolebuff), primitive, member_roles[k]);
+                        if (input->callback_member_start) {
+                                rc = input->callback_member_start(&input->backend, input->callback_context);
+                                if (rc < 0) {
+                                        clew_errorf("input callback_member_start failed");
+                                        goto bail;
+                                }
+                        }
+                        if (input->callback_type != NULL) {
+                                rc = input->callback_type(&input->backend, input->callback_context, (member_types[k] == 0) ? "node" : (member_types[k] == 1) ? "way" : (member_types[k] == 2) ? "relation" : "unknown");
+                                if (rc < 0) {
+                                        clew_errorf("input callback_type failed");
+                                        goto bail;
+                                }
+                        }
+                        if (input->callback_ref != NULL) {
+                                rc = input->callback_ref(&input->backend, input->callback_context, member_ids[k]);
+                                if (rc < 0) {
+                                        clew_errorf("input callback_ref failed");
+                                        goto bail;
+                                }
+                        }
+                        if (input->callback_role != NULL) {
+                                rc = input->callback_role(&input->backend, input->callback_context, input->rolebuff);
+                                if (rc < 0) {
+                                        clew_errorf("input callback_role failed");
+                                        goto bail;
+                                }
+                        }
+                        if (input->callback_member_end) {
+                                rc = input->callback_member_end(&input->backend, input->callback_context);
+                                if (rc < 0) {
+                                        clew_errorf("input callback_member_end failed");
+                                        goto bail;
+                                }
+                        }
+                }
+                rc = clew_input_osm_pbf_deliver_tags(input, block, tags[j], tags[j + 1]);
+                if (rc < 0) {
+                        goto bail;
+                }
+skip_relation:
+                if (input->callback_relation_end) {
+                        rc = input->callback_relation_end(&input->backend, input->callback_context);
+                        if (rc < 0) {
+                                clew_errorf("input callback_relation_end failed");
+                                goto bail;
+                        }
+                }
+        }
+
+        return 0;
+bail:   return -1;
+}
 
-        int (*callback_bounds_start) (struct clew_input_backend *backend, void *context);
-	int (*callback_bounds_end) (struct clew_input_backend *backend, void *context);
+static void clew_input_osm_pbf_block_index (const struct clew_input_osm_pbf_block *block, struct clew_input_index_entry *entry)
+{
+        uint64_t j;
+        uint64_t jl;
+        const uint64_t *ids;
+        const int32_t *lats;
+        const int32_t *lons;
 
-	int (*callback_node_start) (struct clew_input_backend *backend, void *context);
-	int (*callback_node_end) (struct clew_input_backend *backend, void *context);
+        clew_input_osm_pbf_entry_init(entry, block);
 
-	int (*callback_way_start) (struct clew_input_backend *backend, void *context);
-	int (*callback_way_end) (struct clew_input_backend *backend, void *context);
+        if (block->header_block != NULL) {
+                entry->kinds = CLEW_INPUT_INDEX_KIND_HEADER;
+        }
+        if (block->primitive_valid) {
+                ids  = (const uint64_t *) clew_stack_buffer(&block->primitive->node_ids);
+                lats = (const int32_t *) clew_stack_buffer(&block->primitive->node_lats);
+                lons = (const int32_t *) clew_stack_buffer(&block->primitive->node_lons);
+                for (j = 0, jl = clew_stack_count(&block->primitive->node_ids); j < jl; j++) {
+                        entry->kinds |= CLEW_INPUT_INDEX_KIND_NODE;
+                        clew_input_osm_pbf_entry_add_id(entry, ids[j]);
+                        clew_input_osm_pbf_entry_add_lon(entry, lons[j]);
+                        clew_input_osm_pbf_entry_add_lat(entry, lats[j]);
+                }
+                ids = (const uint64_t *) clew_stack_buffer(&block->primitive->way_ids);
+                for (j = 0, jl = clew_stack_count(&block->primitive->way_ids); j < jl; j++) {
+                        entry->kinds |= CLEW_INPUT_INDEX_KIND_WAY;
+                        clew_input_osm_pbf_entry_add_id(entry, ids[j]);
+                }
+                ids = (const uint64_t *) clew_stack_buffer(&block->primitive->relation_ids);
+                for (j = 0, jl = clew_stack_count(&block->primitive->relation_ids); j < jl; j++) {
+                        entry->kinds |= CLEW_INPUT_INDEX_KIND_RELATION;
+                        clew_input_osm_pbf_entry_add_id(entry, ids[j]);
+                }
+        }
 
-	int (*callback_relation_start) (struct clew_input_backend *backend, void *context);
-	int (*callback_relation_end) (struct clew_input_backend *backend, void *context);
+        clew_input_osm_pbf_entry_finish(entry);
+}
 
-	int (*callback_tag_start) (struct clew_input_backend *backend, void *context);
-	int (*callback_tag_end) (struct clew_input_backend *backend, void *context);
+/* builds list of index entries to read, asking consumer for each blob up front */
+static int clew_input_osm_pbf_plan (struct clew_input_osm_pbf *input)
+{
+        int rc;
+        uint64_t i;
+        uint64_t il;
+        const struct clew_input_index_entry *entry;
 
-	int (*callback_nd_start) (struct clew_input_backend *backend, void *context);
-	int (*callback_nd_end) (struct clew_input_backend *backend, void *context);
+        clew_stack_reset(&input->plan);
+        for (i = 0, il = clew_input_index_count(input->index); i < il; i++) {
+                entry = clew_input_index_at(input->index, i);
+                if (input->kinds != 0 && (entry->kinds & (input->kinds | CLEW_INPUT_INDEX_KIND_HEADER)) == 0) {
+                        continue;
+                }
+                if (input->callback_blob != NULL) {
+                        rc = input->callback_blob(&input->backend, input->callback_context, entry);
+                        if (rc < 0) {
+                                clew_errorf("input callback_blob failed");
+                                goto bail;
+                        } else if (rc == 1) {
+                                continue;
+                        }
+                }
+                rc = clew_stack_push_uint64(&input->plan, i);
+                if (rc < 0) {
+                        clew_errorf("can not push plan entry");
+                        goto bail;
+                }
+        }
+        input->plan_position = 0;
+        input->planned       = 1;
 
-	int (*callback_member_start) (struct clew_input_backend *backend, void *context);
-	int (*callback_member_end) (struct clew_input_backend *backend, void *context);
+        return 0;
+bail:   return -1;
+}
 
-	int (*callback_minlon) (struct clew_input_backend *backend, void *context, int32_t lon);
-	int (*callback_minlat) (struct clew_input_backend *backend, void *context, int32_t lat);
-	int (*callback_maxlon) (struct clew_input_backend *backend, void *context, int32_t lon);
-	int (*callback_maxlat) (struct clew_input_backend *backend, void *context, int32_t lat);
+/* delivery stage: fires callbacks for a decoded block on the calling thread */
+static int clew_input_osm_pbf_deliver (struct clew_input_osm_pbf *input, struct clew_input_osm_pbf_block *block)
+{
+        int rc;
+        struct clew_input_index_entry entry;
 
-	int (*callback_id) (struct clew_input_backend *backend, void *context, uint64_t id);
+        if (block->skipped) {
+                if (input->index_record) {
+                        rc = clew_input_index_push(input->index, &block->entry);
+                        if (rc < 0) {
+                                clew_errorf("can not push index entry");
+                                return -1;
+                        }
+                }
+                return 0;
+        }
 
-	int (*callback_lat) (struct clew_input_backend *backend, void *context, int32_t lat);
-	int (*callback_lon) (struct clew_input_backend *backend, void *context, int32_t lon);
+        if (input->index_record) {
+                clew_input_osm_pbf_block_index(block, &entry);
+                rc = clew_input_index_push(input->index, &entry);
+                if (rc < 0) {
+                        clew_errorf("can not push index entry");
+                        return -1;
+                }
+        }
 
-	int (*callback_ref) (struct clew_input_backend *backend, void *context, uint64_t ref);
+        if (block->header_block != NULL) {
+                rc = clew_input_osm_pbf_deliver_header_block(input, block->header_block);
+        } else if (block->primitive_valid && input->callback_block != NULL) {
+                rc = clew_input_osm_pbf_deliver_block(input, block);
+        } else if (block->primitive_valid) {
+                rc = clew_input_osm_pbf_deliver_primitive_block(input, block);
+        } else {
+                clew_errorf("block is invalid");
+                rc = -1;
+        }
 
-	int (*callback_type) (struct clew_input_backend *backend, void *context, const char *type);
-	int (*callback_role) (struct clew_input_backend *backend, void *context, const char *role);
+        return rc;
+}
 
-	int (*callback_k) (struct clew_input_backend *backend, void *context, const char *k);
-	int (*callback_v) (struct clew_input_backend *backend, void *context, const char *v);
+static void * clew_input_osm_pbf_pipeline_reader (void *context)
+{
+        int rc;
+        uint64_t sequence;
+        struct clew_input_osm_pbf *input = (struct clew_input_osm_pbf *) context;
+        struct clew_input_osm_pbf_pipeline *pipeline = &input->pipeline;
+        struct clew_input_osm_pbf_block *block;
 
-        int (*callback_error) (struct clew_input_backend *backend, void *context, unsigned int reason);
+        pthread_mutex_lock(&pipeline->mutex);
+        for (sequence = 0; pipeline->stop == 0; sequence++) {
+                block = &pipeline->blocks[sequence % pipeline->nblocks];
+                while (pipeline->stop == 0 && block->state != BLOCK_STATE_EMPTY) {
+                        pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+                }
+                if (pipeline->stop != 0) {
+                        break;
+                }
+                pthread_mutex_unlock(&pipeline->mutex);
+                rc = clew_input_osm_pbf_block_read(input, block);
+                pthread_mutex_lock(&pipeline->mutex);
+                block->sequence = sequence;
+                if (rc == 1) {
+                        pipeline->finished = sequence;
+                        pthread_cond_broadcast(&pipeline->cond);
+                        break;
+                } else if (rc < 0) {
+                        block->state = BLOCK_STATE_ERROR;
+                        pthread_cond_broadcast(&pipeline->cond);
+                        break;
+                }
+                block->state = BLOCK_STATE_READ;
+                pthread_cond_broadcast(&pipeline->cond);
+        }
+        pthread_mutex_unlock(&pipeline->mutex);
 
-        void *callback_context;
+        return NULL;
+}
 
-        FILE *fp;
-        unsigned char *buffer;
-        int state;
+static void * clew_input_osm_pbf_pipeline_worker (void *context)
+{
+        int i;
+        int rc;
+        struct clew_input_osm_pbf *input = (struct clew_input_osm_pbf *) context;
+        struct clew_input_osm_pbf_pipeline *pipeline = &input->pipeline;
+        struct clew_input_osm_pbf_block *block;
 
-        OSMPBF__BlobHeader *header;
-        OSMPBF__Blob *blob;
-        unsigned char *data;
+        pthread_mutex_lock(&pipeline->mutex);
+        while (pipeline->stop == 0) {
+                block = NULL;
+                for (i = 0; i < pipeline->nblocks; i++) {
+                        if (pipeline->blocks[i].state != BLOCK_STATE_READ) {
+                                continue;
+                        }
+                        if (block == NULL || pipeline->blocks[i].sequence < block->sequence) {
+                                block = &pipeline->blocks[i];
+                        }
+                }
+                if (block == NULL) {
+                        pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+                        continue;
+                }
+                block->state = BLOCK_STATE_DECODING;
+                pthread_mutex_unlock(&pipeline->mutex);
+                rc = clew_input_osm_pbf_block_decode(block, input->kinds, input->index_record, input->resolve);
+                pthread_mutex_lock(&pipeline->mutex);
+                block->state = (rc < 0) ? BLOCK_STATE_ERROR : BLOCK_STATE_DECODED;
+                pthread_cond_broadcast(&pipeline->cond);
+        }
+        pthread_mutex_unlock(&pipeline->mutex);
 
-        char keybuff[1024];
-        char valbuff[1024];
-        char rolebuff[1024];
-};
+        return NULL;
+}
 
-static int string_ends_with (const char *string, const char *end)
+static void clew_input_osm_pbf_pipeline_stop (struct clew_input_osm_pbf *input)
 {
-        int lstring;
-        int lend;
+        int i;
+        struct clew_input_osm_pbf_pipeline *pipeline = &input->pipeline;
 
-        if (string == NULL) {
+        if (pipeline->started == 0) {
+                return;
+        }
+
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->stop = 1;
+        pthread_cond_broadcast(&pipeline->cond);
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        pthread_join(pipeline->reader, NULL);
+        for (i = 0; i < pipeline->nworkers; i++) {
+                pthread_join(pipeline->workers[i], NULL);
+        }
+
+        for (i = 0; i < pipeline->nblocks; i++) {
+                clew_input_osm_pbf_block_uninit(&pipeline->blocks[i]);
+        }
+        free(pipeline->blocks);
+        free(pipeline->workers);
+
+        pthread_cond_destroy(&pipeline->cond);
+        pthread_mutex_destroy(&pipeline->mutex);
+
+        memset(pipeline, 0, sizeof(struct clew_input_osm_pbf_pipeline));
+}
+
+static int clew_input_osm_pbf_pipeline_start (struct clew_input_osm_pbf *input)
+{
+        int i;
+        int rc;
+        struct clew_input_osm_pbf_pipeline *pipeline = &input->pipeline;
+
+        memset(pipeline, 0, sizeof(struct clew_input_osm_pbf_pipeline));
+
+        pipeline->nworkers = input->threads;
+        pipeline->nblocks  = input->threads * 2;
+        pipeline->finished = UINT64_MAX;
+
+        pipeline->workers = (pthread_t *) malloc(sizeof(pthread_t) * pipeline->nworkers);
+        if (pipeline->workers == NULL) {
+                clew_errorf("can not allocate memory");
                 goto bail;
         }
-        if (end == NULL) {
+        pipeline->blocks = (struct clew_input_osm_pbf_block *) malloc(sizeof(struct clew_input_osm_pbf_block) * pipeline->nblocks);
+        if (pipeline->blocks == NULL) {
+                clew_errorf("can not allocate memory");
                 goto bail;
         }
+        memset(pipeline->blocks, 0, sizeof(struct clew_input_osm_pbf_block) * pipeline->nblocks);
 
-        lstring = (int) strlen(string);
-        lend    = (int) strlen(end);
+        pthread_mutex_init(&pipeline->mutex, NULL);
+        pthread_cond_init(&pipeline->cond, NULL);
+        pipeline->started = 1;
 
-        if (lend > lstring) {
-                return 0;
+        pipeline->nworkers = 0;
+        rc = pthread_create(&pipeline->reader, NULL, clew_input_osm_pbf_pipeline_reader, input);
+        if (rc != 0) {
+                clew_errorf("can not create reader thread");
+                pipeline->started = 0;
+                pthread_cond_destroy(&pipeline->cond);
+                pthread_mutex_destroy(&pipeline->mutex);
+                goto bail;
         }
-        if (strncasecmp(string + lstring - lend, end, lend) == 0) {
-                return 1;
+        for (i = 0; i < input->threads; i++) {
+                rc = pthread_create(&pipeline->workers[i], NULL, clew_input_osm_pbf_pipeline_worker, input);
+                if (rc != 0) {
+                        clew_errorf("can not create worker thread");
+                        goto bail;
+                }
+                pipeline->nworkers += 1;
         }
+
         return 0;
-bail:   return -1;
+bail:   if (pipeline->started) {
+                clew_input_osm_pbf_pipeline_stop(input);
+        } else {
+                free(pipeline->blocks);
+                free(pipeline->workers);
+                memset(pipeline, 0, sizeof(struct clew_input_osm_pbf_pipeline));
+        }
+        return -1;
 }
 
-#define MAX_HEADER_LENGTH	(1024 * 64)
-#define MAX_BLOB_LENGTH		(1024 * 1024 * 32)
+static int clew_input_osm_pbf_read_pipeline (struct clew_input_osm_pbf *input)
+{
+        int rc;
+        struct clew_input_osm_pbf_pipeline *pipeline = &input->pipeline;
+        struct clew_input_osm_pbf_block *block;
+
+        if (pipeline->started == 0) {
+                rc = clew_input_osm_pbf_pipeline_start(input);
+                if (rc < 0) {
+                        clew_errorf("can not start pipeline");
+                        goto bail;
+                }
+        }
+
+        pthread_mutex_lock(&pipeline->mutex);
+        block = &pipeline->blocks[pipeline->sequence % pipeline->nblocks];
+        while (block->state != BLOCK_STATE_DECODED &&
+               block->state != BLOCK_STATE_ERROR &&
+               pipeline->sequence < pipeline->finished) {
+                pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+        }
+        if (block->state == BLOCK_STATE_ERROR) {
+                pthread_mutex_unlock(&pipeline->mutex);
+                clew_errorf("can not decode block: %ld", pipeline->sequence);
+                goto bail;
+        }
+        if (block->state != BLOCK_STATE_DECODED) {
+                pthread_mutex_unlock(&pipeline->mutex);
+                goto finish;
+        }
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        rc = clew_input_osm_pbf_deliver(input, block);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        clew_input_osm_pbf_block_release(block);
+        block->state = BLOCK_STATE_EMPTY;
+        pipeline->sequence += 1;
+        pthread_cond_broadcast(&pipeline->cond);
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        if (rc < 0) {
+                goto bail;
+        }
 
-#define SANITY_CHECK_LENGTH(length, max_length) \
-	if (length > max_length) { \
-		clew_errorf("invalid block size: %d, max: %d", length, max_length); \
-		return NULL; \
-	}
-
-static OSMPBF__BlobHeader * read_header (FILE *f)
-{
-	int len;
-	unsigned char lenb[4];
-	unsigned char *buffer;
-	static OSMPBF__BlobHeader *blob_header;
-	if (fread(lenb, 4, 1, f) != 1) {
-		return NULL;
-	}
-	len = (lenb[0] << 24) | (lenb[1] << 16) | (lenb[2] << 8) | lenb[3];
-	SANITY_CHECK_LENGTH(len, MAX_HEADER_LENGTH)
-	buffer = (unsigned char *) malloc(len);
-	if (buffer == NULL) {
-		clew_errorf("can not allocate memory");
-		return NULL;
-	}
-	if (fread(buffer, len, 1, f) != 1) {
-		free(buffer);
-		return NULL;
-	}
-	blob_header = osmpbf__blob_header__unpack(NULL, len, buffer);
-	free(buffer);
-	return blob_header;
-}
-
-static OSMPBF__Blob * read_blob (OSMPBF__BlobHeader *blob_header, FILE *f, unsigned char *buffer)
-{
-	int len;
-	len = blob_header->datasize;
-	SANITY_CHECK_LENGTH(len, MAX_BLOB_LENGTH)
-	if (fread(buffer, len, 1, f) != 1) {
-		return NULL;
-	}
-	return osmpbf__blob__unpack(NULL, len, buffer);
-}
-
-static unsigned char * uncompress_blob (OSMPBF__Blob *blob)
-{
-	int zerr;
-	z_stream strm;
-	unsigned char *ret;
-	ret = (unsigned char *) malloc(blob->raw_size);
-	if (!ret) {
-		clew_errorf("can not allocate memory");
-		return NULL;
-	}
-	strm.zalloc = Z_NULL;
-	strm.zfree = Z_NULL;
-	strm.opaque = Z_NULL;
-	strm.avail_in = blob->zlib_data.len;
-	strm.next_in = blob->zlib_data.data;
-	strm.avail_out = blob->raw_size;
-	strm.next_out = ret;
-	zerr = inflateInit(&strm);
-	if (zerr != Z_OK) {
-		free(ret);
-		return NULL;
-	}
-	zerr = inflate(&strm, Z_NO_FLUSH);
-	if (zerr != Z_STREAM_END) {
-		free(ret);
-		return NULL;
-	}
-	inflateEnd(&strm);
-	return ret;
-}
-
-static int get_string (char *buffer, size_t buffer_size, OSMPBF__PrimitiveBlock *primitive_block, uint32_t id)
-{
-	int len;
-	char *data;
-	len = primitive_block->stringtable->s[id].len;
-	data = (char *) primitive_block->stringtable->s[id].data;
-	if (primitive_block->stringtable->s[id].len >= buffer_size) {
-		buffer[0] = '\0';
-		return 0;
-	}
-	strncpy(buffer, data, len);
-	buffer[len] = '\0';
-	return 1;
+        return 0;
+finish: return 1;
+bail:   return -1;
 }
 
 static int clew_input_osm_pbf_read (struct clew_input_backend *backend)
 {
+        int rc;
         struct clew_input_osm_pbf *input = (struct clew_input_osm_pbf *) backend;
 
         if (input == NULL) {
@@ -208,440 +1756,60 @@ static int clew_input_osm_pbf_read (struct clew_input_backend *backend)
                 goto bail;
         }
 
-        if (input->state == STATE_READ_HEADER) {
-                if (input->header != NULL) {
-                        osmpbf__blob_header__free_unpacked(input->header, NULL);
-                        input->header = NULL;
-                }
-                if (input->blob != NULL) {
-                        osmpbf__blob__free_unpacked(input->blob, NULL);
-                        input->blob = NULL;
-                }
-                if (input->data != NULL) {
-                        free(input->data);
-                        input->data  = NULL;
+        if (input->index_plan && input->planned == 0) {
+                rc = clew_input_osm_pbf_plan(input);
+                if (rc < 0) {
+                        goto bail;
                 }
+        }
 
-                input->header = read_header(input->fp);
-                if (input->header == NULL) {
-                        input->state = STATE_FINISHED;
+        if (input->state == STATE_FINISHED) {
+                goto bail;
+        } else if (input->state == STATE_ERROR) {
+                goto bail;
+        } else if (input->threads > 1) {
+                rc = clew_input_osm_pbf_read_pipeline(input);
+                if (rc < 0) {
+                        goto bail;
+                } else if (rc == 1) {
                         goto finish;
-                } else {
-                        input->state = STATE_READ_BLOB;
-                }
-        } else if (input->state == STATE_READ_BLOB) {
-                if (input->blob != NULL) {
-                        osmpbf__blob__free_unpacked(input->blob, NULL);
-                        input->blob = NULL;
-                }
-                if (input->data != NULL) {
-                        free(input->data);
-                        input->data  = NULL;
                 }
-
-                input->blob = read_blob(input->header, input->fp, input->buffer);
-                if (input->blob == NULL) {
-                        clew_errorf("can not read blob");
+        } else if (input->state == STATE_READ_HEADER) {
+                rc = clew_input_osm_pbf_block_read(input, &input->block);
+                if (rc < 0) {
                         goto bail;
+                } else if (rc == 1) {
+                        goto finish;
                 }
-                input->data = uncompress_blob(input->blob);
-                if (input->data == NULL) {
-                        clew_errorf("can not read blob");
+                input->state = STATE_READ_BLOB;
+        } else if (input->state == STATE_READ_BLOB) {
+                rc = clew_input_osm_pbf_block_decode(&input->block, input->kinds, input->index_record, input->resolve);
+                if (rc < 0) {
                         goto bail;
                 }
                 input->state = STATE_READ_OSM;
         } else if (input->state == STATE_READ_OSM) {
-		if (strcmp(input->header->type, "OSMHeader") == 0) {
-                        int rc;
-                        OSMPBF__HeaderBlock *header_block;
-                        header_block = osmpbf__header_block__unpack(NULL, input->blob->raw_size, input->data);
-                        if (input->callback_bounds_start != NULL) {
-                                rc = input->callback_bounds_start(&input->backend, input->callback_context);
-                                if (rc < 0) {
-                                        clew_errorf("input callback_bounds_start failed");
-                                        osmpbf__header_block__free_unpacked(header_block, NULL);
-                                        goto bail;
-                                }
-                        }
-                        if (header_block->bbox != NULL) {
-                                if (input->callback_minlon != NULL) {
-                                        rc = input->callback_minlon(&input->backend, input->callback_context, header_block->bbox->left / 100);
-                                        if (rc < 0) {
-                                                clew_errorf("input callback_minlon failed");
-                                                osmpbf__header_block__free_unpacked(header_block, NULL);
-                                                goto bail;
-                                        }
-                                }
-                                if (input->callback_minlat != NULL) {
-                                        rc = input->callback_minlat(&input->backend, input->callback_context, header_block->bbox->top / 100);
-                                        if (rc < 0) {
-                                                clew_errorf("input callback_minlat failed");
-                                                osmpbf__header_block__free_unpacked(header_block, NULL);
-                                                goto bail;
-                                        }
-                                }
-                                if (input->callback_maxlon != NULL) {
-                                        rc = input->callback_maxlon(&input->backend, input->callback_context, header_block->bbox->right / 100);
-                                        if (rc < 0) {
-                                                clew_errorf("input callback_maxlon failed");
-                                                osmpbf__header_block__free_unpacked(header_block, NULL);
-                                                goto bail;
-                                        }
-                                }
-                                if (input->callback_maxlat != NULL) {
-                                        rc = input->callback_maxlat(&input->backend, input->callback_context, header_block->bbox->bottom / 100);
-                                        if (rc < 0) {
-                                                clew_errorf("input callback_maxlat failed");
-                                                osmpbf__header_block__free_unpacked(header_block, NULL);
-                                                goto bail;
-                                        }
-                                }
-                        }
-                        if (input->callback_bounds_end != NULL) {
-                                rc = input->callback_bounds_end(&input->backend, input->callback_context);
-                                if (rc < 0) {
-                                        clew_errorf("input callback_bounds_end failed");
-                                        osmpbf__header_block__free_unpacked(header_block, NULL);
-                                        goto bail;
-                                }
-                        }
-                        osmpbf__header_block__free_unpacked(header_block, NULL);
-                        input->state = STATE_READ_HEADER;
-		} else if (strcmp(input->header->type, "OSMData") == 0) {
-                        int rc;
-                        uint64_t i;
-                        uint64_t j;
-                        uint64_t k;
-                        uint64_t id;
-                        int32_t lat;
-                        int32_t lon;
-                        uint64_t ref;
-                        OSMPBF__PrimitiveBlock *primitive_block;
-                        primitive_block = osmpbf__primitive_block__unpack(NULL, input->blob->raw_size, input->data);
-                        for (i = 0; i < primitive_block->n_primitivegroup; i++) {
-                                OSMPBF__PrimitiveGroup *primitive_group = primitive_block->primitivegroup[i];
-                                for (j = 0, id = 0, lat = 0, lon = 0, k = 0; primitive_group->dense != NULL && j < primitive_group->dense->n_id ; j++) {
-                                        id += primitive_group->dense->id[j];
-                                        lat += primitive_group->dense->lat[j];
-                                        lon += primitive_group->dense->lon[j];
-                                        if (input->callback_node_start) {
-                                                rc = input->callback_node_start(&input->backend, input->callback_context);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_node_start failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                } else if (rc == 1) {
-                                                        goto skip_node;
-                                                }
-                                        }
-                                        if (input->callback_id) {
-                                                rc = input->callback_id(&input->backend, input->callback_context, id);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_id failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                } else if (rc == 1) {
-                                                        goto skip_node;
-                                                }
-                                        }
-                                        if (input->callback_lon) {
-                                                rc = input->callback_lon(&input->backend, input->callback_context, lon);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_lon failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                }
-                                        }
-                                        if (input->callback_lat) {
-                                                rc = input->callback_lat(&input->backend, input->callback_context, lat);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_lat failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                }
-                                        }
-                                        if (primitive_group->dense->keys_vals) {
-                                                while (primitive_group->dense->keys_vals[k]) {
-                                                        get_string(input->keybuff, sizeof(input->keybuff), primitive_block, primitive_group->dense->keys_vals[k + 0]);
-                                                        get_string(input->valbuff, sizeof(input->valbuff), primitive_block, primitive_group->dense->keys_vals[k + 1]);
-                                                        if (input->callback_tag_start) {
-                                                                rc = input->callback_tag_start(&input->backend, input->callback_context);
-                                                                if (rc < 0) {
-                                                                        clew_errorf("input callback_tag_start failed");
-                                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                        goto bail;
-                                                                } else if (rc == 1) {
-                                                                        goto skip_node_tag;
-                                                                }
-                                                        }
-                                                        if (input->callback_k) {
-                                                                rc = input->callback_k(&input->backend, input->callback_context, input->keybuff);
-                                                                if (rc < 0) {
-                                                                        clew_errorf("input callback_k failed");
-                                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                        goto bail;
-                                                                }
-                                                        }
-                                                        if (input->callback_v) {
-                                                                rc = input->callback_v(&input->backend, input->callback_context, input->valbuff);
-                                                                if (rc < 0) {
-                                                                        clew_errorf("input callback_v failed");
-                                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                        goto bail;
-                                                                }
-                                                        }
-skip_node_tag:
-                                                        if (input->callback_tag_end) {
-                                                                rc = input->callback_tag_end(&input->backend, input->callback_context);
-                                                                if (rc < 0) {
-                                                                        clew_errorf("input callback_tag_end failed");
-                                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                        goto bail;
-                                                                }
-                                                        }
-                                                        k += 2;
-                                                }
-                                                k++;
-                                        }
-skip_node:
-                                        if (input->callback_node_end) {
-                                                rc = input->callback_node_end(&input->backend, input->callback_context);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_node_end failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                }
-                                        }
-                                }
-                                for (j = 0, k = 0; j < primitive_group->n_ways; j++) {
-                                        if (input->callback_way_start) {
-                                                rc = input->callback_way_start(&input->backend, input->callback_context);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_way_start failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                } else if (rc == 1) {
-                                                        goto skip_way;
-                                                }
-                                        }
-                                        if (input->callback_id) {
-                                                rc = input->callback_id(&input->backend, input->callback_context, primitive_group->ways[j]->id);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_id failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                } else if (rc == 1) {
-                                                        goto skip_way;
-                                                }
-                                        }
-                                        for (k = 0, ref = 0; k < primitive_group->ways[j]->n_refs; k++) {
-                                                ref += primitive_group->ways[j]->refs[k];
-                                                if (input->callback_nd_start) {
-                                                        rc = input->callback_nd_start(&input->backend, input->callback_context);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_nd_start failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                                if (input->callback_ref) {
-                                                        rc = input->callback_ref(&input->backend, input->callback_context, ref);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_ref failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                                if (input->callback_nd_end) {
-                                                        rc = input->callback_nd_end(&input->backend, input->callback_context);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_nd_end failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                        }
-                                        for (k = 0; k < primitive_group->ways[j]->n_keys; k++) {
-                                                get_string(input->keybuff, sizeof(input->keybuff), primitive_block, primitive_group->ways[j]->keys[k]);
-                                                get_string(input->valbuff, sizeof(input->valbuff), primitive_block, primitive_group->ways[j]->vals[k]);
-                                                if (input->callback_tag_start) {
-                                                        rc = input->callback_tag_start(&input->backend, input->callback_context);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_tag_start failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        } else if (rc == 1) {
-                                                                goto skip_way_tag;
-                                                        }
-                                                }
-                                                if (input->callback_k) {
-                                                        rc = input->callback_k(&input->backend, input->callback_context, input->keybuff);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_k failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                                if (input->callback_v) {
-                                                        rc = input->callback_v(&input->backend, input->callback_context, input->valbuff);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_v failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-skip_way_tag:
-                                                if (input->callback_tag_end) {
-                                                        rc = input->callback_tag_end(&input->backend, input->callback_context);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_tag_end failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                        }
-skip_way:
-                                        if (input->callback_way_end) {
-                                                rc = input->callback_way_end(&input->backend, input->callback_context);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_way_end failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                }
-                                        }
-                                }
-                                for (j = 0; j < primitive_group->n_relations; j++) {
-                                        if (input->callback_relation_start) {
-                                                rc = input->callback_relation_start(&input->backend, input->callback_context);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_relation_start failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                } else if (rc == 1) {
-                                                        goto skip_relation;
-                                                }
-                                        }
-                                        if (input->callback_id) {
-                                                rc = input->callback_id(&input->backend, input->callback_context, primitive_group->relations[j]->id);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_id failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                } else if (rc == 1) {
-                                                        goto skip_relation;
-                                                }
-                                        }
-                                        for (k = 0, ref = 0; k < primitive_group->relations[j]->n_roles_sid; k++) {
-                                                ref += primitive_group->relations[j]->memids[k];
-                                                get_string(input->rolebuff, sizeof(input->rolebuff), primitive_block, primitive_group->relations[j]->roles_sid[k]);
-                                                if (input->callback_member_start) {
-                                                        rc = input->callback_member_start(&input->backend, input->callback_context);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_member_start failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                                if (input->callback_type != NULL) {
-                                                        rc = input->callback_type(&input->backend, input->callback_context, (primitive_group->relations[j]->types[k] == 0) ? "node" : (primitive_group->relations[j]->types[k] == 1) ? "way" : (primitive_group->relations[j]->types[k] == 2) ? "relation" : "unknown");
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_type failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                                if (input->callback_ref != NULL) {
-                                                        rc = input->callback_ref(&input->backend, input->callback_context, ref);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_ref failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                                if (input->callback_role != NULL) {
-                                                        rc = input->callback_role(&input->backend, input->callback_context, input->rolebuff);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_role failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                                if (input->callback_member_end) {
-                                                        rc = input->callback_member_end(&input->backend, input->callback_context);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_member_end failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                        }
-                                        for (k = 0; k < primitive_group->relations[j]->n_keys; k++) {
-                                                get_string(input->keybuff, sizeof(input->keybuff), primitive_block, primitive_group->relations[j]->keys[k]);
-                                                get_string(input->valbuff, sizeof(input->valbuff), primitive_block, primitive_group->relations[j]->vals[k]);
-                                                if (input->callback_tag_start) {
-                                                        rc = input->callback_tag_start(&input->backend, input->callback_context);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_tag_start failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        } else if (rc == 1) {
-                                                                goto skip_relation_tag;
-                                                        }
-                                                }
-                                                if (input->callback_k) {
-                                                        rc = input->callback_k(&input->backend, input->callback_context, input->keybuff);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_k failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                                if (input->callback_v) {
-                                                        rc = input->callback_v(&input->backend, input->callback_context, input->valbuff);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_v failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-skip_relation_tag:
-                                                if (input->callback_tag_end) {
-                                                        rc = input->callback_tag_end(&input->backend, input->callback_context);
-                                                        if (rc < 0) {
-                                                                clew_errorf("input callback_tag_end failed");
-                                                                osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                                goto bail;
-                                                        }
-                                                }
-                                        }
-skip_relation:
-                                        if (input->callback_relation_end) {
-                                                rc = input->callback_relation_end(&input->backend, input->callback_context);
-                                                if (rc < 0) {
-                                                        clew_errorf("input callback_relation_end failed");
-                                                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                                                        goto bail;
-                                                }
-                                        }
-                                }
-                        }
-                        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
-                        input->state = STATE_READ_HEADER;
-		} else {
-			clew_errorf("unknown header type type '%s'", input->header->type);
-			goto bail;
-		}
-        } else if (input->state == STATE_FINISHED) {
-                goto bail;
-        } else if (input->state == STATE_ERROR) {
-                goto bail;
+                rc = clew_input_osm_pbf_deliver(input, &input->block);
+                clew_input_osm_pbf_block_release(&input->block);
+                if (rc < 0) {
+                        goto bail;
+                }
+                input->state = STATE_READ_HEADER;
         } else {
                 clew_errorf("state is invalid");
                 goto bail;
         }
 
         return 0;
-finish: input->state = STATE_FINISHED;
+finish: if (input->index_record) {
+                rc = clew_input_index_complete(input->index, input->path);
+                if (rc < 0) {
+                        clew_errorf("can not complete index");
+                        goto bail;
+                }
+                input->index_record = 0;
+        }
+        input->state = STATE_FINISHED;
         return 1;
 bail:   input->state = STATE_ERROR;
         if (input->callback_error) {
@@ -659,21 +1827,16 @@ static int clew_input_osm_pbf_reset (struct clew_input_backend *backend)
                 goto bail;
         }
 
-        if (input->header != NULL) {
-                osmpbf__blob_header__free_unpacked(input->header, NULL);
-                input->header = NULL;
-        }
-        if (input->blob != NULL) {
-                osmpbf__blob__free_unpacked(input->blob, NULL);
-                input->blob = NULL;
-        }
-        if (input->data != NULL) {
-                free(input->data);
-                input->data  = NULL;
-        }
+        clew_input_osm_pbf_pipeline_stop(input);
+        clew_input_osm_pbf_block_release(&input->block);
         if (input->fp != NULL) {
                 fseek(input->fp, 0, SEEK_SET);
         }
+        input->map_offset = 0;
+        input->plan_position = 0;
+        if (input->index_record) {
+                clew_input_index_reset(input->index);
+        }
         input->state = STATE_READ_HEADER;
 
         return 0;
@@ -689,21 +1852,61 @@ static void clew_input_osm_pbf_destroy (struct clew_input_backend *backend)
         }
 
         clew_input_osm_pbf_reset(&input->backend);
+        clew_input_osm_pbf_block_uninit(&input->block);
+        clew_stack_uninit(&input->plan);
 
-        if (input->buffer != NULL) {
-                free(input->buffer);
-        }
-        if (input->fp != NULL) {
+        if (input->fp != NULL && input->fp != stdin) {
                 fclose(input->fp);
         }
+        if (input->map != NULL) {
+                munmap(input->map, input->map_size);
+        }
         if (input->path != NULL) {
                 free(input->path);
         }
         free(input);
 }
 
-struct clew_input_backend * clew_input_osm_pbf_create (struct clew_input_backend_init_options *options)
+static int clew_input_osm_pbf_open_map (struct clew_input_osm_pbf *input)
+{
+        int fd;
+        int rc;
+        void *map;
+        struct stat st;
+
+        fd = open(input->path, O_RDONLY);
+        if (fd < 0) {
+                clew_warningf("can not open path for reading");
+                goto bail;
+        }
+        rc = fstat(fd, &st);
+        if (rc < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+                clew_warningf("path is not a mappable file");
+                goto bail;
+        }
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+                clew_warningf("can not map path");
+                goto bail;
+        }
+        close(fd);
+
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        madvise(map, st.st_size, MADV_WILLNEED);
+
+        input->map        = (unsigned char *) map;
+        input->map_size   = st.st_size;
+        input->map_offset = 0;
+        return 0;
+bail:   if (fd >= 0) {
+                close(fd);
+        }
+        return -1;
+}
+
+static struct clew_input_backend * clew_input_osm_pbf_create_common (struct clew_input_backend_init_options *options, int map)
 {
+        int rc;
         struct clew_input_osm_pbf *input;
 
         input = NULL;
@@ -756,29 +1959,51 @@ struct clew_input_backend * clew_input_osm_pbf_create (struct clew_input_backend
 	input->callback_role            = options->callback_role;
 	input->callback_k               = options->callback_k;
 	input->callback_v               = options->callback_v;
+	input->callback_tag             = options->callback_tag;
         input->callback_error           = options->callback_error;
         input->callback_context         = options->callback_context;
 
+        input->callback_blob            = options->callback_blob;
+        input->callback_block           = options->callback_block;
+
+        input->threads                  = options->threads;
+        input->kinds                    = options->kinds;
+        input->resolve                  = (input->callback_tag != NULL || input->callback_block != NULL);
+
+        input->plan  = clew_stack_init(sizeof(uint64_t));
+        input->index = options->index;
+        if (input->index != NULL) {
+                if (clew_input_index_completed(input->index)) {
+                        input->index_plan = (input->callback_blob != NULL || input->kinds != 0);
+                } else {
+                        clew_input_index_reset(input->index);
+                        input->index_record = 1;
+                }
+        }
+
         input->backend.read     = clew_input_osm_pbf_read;
         input->backend.reset    = clew_input_osm_pbf_reset;
         input->backend.destroy  = clew_input_osm_pbf_destroy;
 
-        if (string_ends_with(input->path, "osm.pbf") != 1) {
+        if (strcmp(input->path, "-") != 0 && string_ends_with(input->path, "osm.pbf") != 1) {
                 clew_errorf("path suffix is invalid");
                 goto bail;
         }
 
-        input->fp = fopen(input->path, "rb");
-        if (input->fp == NULL) {
-                clew_errorf("can not open path for reading");
-                goto bail;
+        if (strcmp(input->path, "-") == 0) {
+                input->fp = stdin;
+        } else if (map) {
+                rc = clew_input_osm_pbf_open_map(input);
+                if (rc < 0) {
+                        goto bail;
+                }
+        } else {
+                input->fp = fopen(input->path, "rb");
+                if (input->fp == NULL) {
+                        clew_errorf("can not open path for reading");
+                        goto bail;
+                }
         }
-	input->buffer = (unsigned char *) malloc(MAX_BLOB_LENGTH);
-	if (input->buffer == NULL) {
-		clew_errorf("can not allocate memory");
-		goto bail;
-	}
-
         input->state = STATE_READ_HEADER;
 
         return &input->backend;
@@ -787,3 +2012,19 @@ bail:   if (input != NULL) {
         }
         return NULL;
 }
+
+struct clew_input_backend * clew_input_osm_pbf_create (struct clew_input_backend_init_options *options)
+{
+        return clew_input_osm_pbf_create_common(options, 0);
+}
+
+struct clew_input_backend * clew_input_osm_pbf_mmap_create (struct clew_input_backend_init_options *options)
+{
+        if (options == NULL || options->mmap == 0) {
+                return NULL;
+        }
+        if (string_ends_with(options->path, "osm.pbf") != 1) {
+                return NULL;
+        }
+        return clew_input_osm_pbf_create_common(options, 1);
+}
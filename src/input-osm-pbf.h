@@ -4,6 +4,7 @@ extern "C" {
 #endif
 
 struct clew_input_backend * clew_input_osm_pbf_create (struct clew_input_backend_init_options *options);
+struct clew_input_backend * clew_input_osm_pbf_mmap_create (struct clew_input_backend_init_options *options);
 
 #ifdef __cplusplus
 }
@@ -12,6 +12,9 @@
 struct clew_input {
         struct clew_input_backend *backend;
 
+	int (*callback_blob) (struct clew_input *input, void *context, const struct clew_input_index_entry *entry);
+	int (*callback_block) (struct clew_input *input, void *context, const struct clew_input_block *block);
+
 	int (*callback_bounds_start) (struct clew_input *input, void *context);
 	int (*callback_bounds_end) (struct clew_input *input, void *context);
 
@@ -51,6 +54,8 @@ struct clew_input {
 	int (*callback_k) (struct clew_input *input, void *context, const char *k);
 	int (*callback_v) (struct clew_input *input, void *context, const char *v);
 
+	int (*callback_tag) (struct clew_input *input, void *context, uint32_t tag);
+
         int error;
         int (*callback_error) (struct clew_input *input, void *context, unsigned int reason);
 
@@ -61,9 +66,71 @@ struct {
         const char *name;
         struct clew_input_backend * (*creator) (struct clew_input_backend_init_options *options);
 } g_backends[] = {
+        { "osm-pbf-mmap", clew_input_osm_pbf_mmap_create },
         { "osm-pbf", clew_input_osm_pbf_create }
 };
 
+static int clew_input_backend_callback_blob (struct clew_input_backend *backend, void *context, const struct clew_input_index_entry *entry)
+{
+        int rc;
+        struct clew_input *input = (struct clew_input *) context;
+
+        if (backend == NULL) {
+                clew_errorf("backend is invalid");
+                goto bail;
+        }
+        if (input == NULL) {
+                clew_errorf("input is invalid");
+                goto bail;
+        }
+        if (entry == NULL) {
+                clew_errorf("entry is invalid");
+                goto bail;
+        }
+
+        rc = 0;
+        if (input->callback_blob != NULL) {
+                rc = input->callback_blob(input, input->callback_context, entry);
+                if (rc < 0) {
+                        clew_errorf("input callback_blob failed");
+                        goto bail;
+                }
+        }
+
+        return rc;
+bail:   return -1;
+}
+
+static int clew_input_backend_callback_block (struct clew_input_backend *backend, void *context, const struct clew_input_block *block)
+{
+        int rc;
+        struct clew_input *input = (struct clew_input *) context;
+
+        if (backend == NULL) {
+                clew_errorf("backend is invalid");
+                goto bail;
+        }
+        if (input == NULL) {
+                clew_errorf("input is invalid");
+                goto bail;
+        }
+        if (block == NULL) {
+                clew_errorf("block is invalid");
+                goto bail;
+        }
+
+        if (input->callback_block != NULL) {
+                rc = input->callback_block(input, input->callback_context, block);
+                if (rc < 0) {
+                        clew_errorf("input callback_block failed");
+                        goto bail;
+                }
+        }
+
+        return 0;
+bail:   return -1;
+}
+
 static int clew_input_backend_callback_bounds_start (struct clew_input_backend *backend, void *context)
 {
         int rc;
@@ -745,6 +812,32 @@ static int clew_input_backend_callback_v (struct clew_input_backend *backend, vo
 bail:   return -1;
 }
 
+static int clew_input_backend_callback_tag (struct clew_input_backend *backend, void *context, uint32_t tag)
+{
+        int rc;
+        struct clew_input *input = (struct clew_input *) context;
+
+        if (backend == NULL) {
+                clew_errorf("backend is invalid");
+                goto bail;
+        }
+        if (input == NULL) {
+                clew_errorf("input is invalid");
+                goto bail;
+        }
+
+        if (input->callback_tag != NULL) {
+                rc = input->callback_tag(input, input->callback_context, tag);
+                if (rc < 0) {
+                        clew_errorf("input callback_tag failed");
+                        goto bail;
+                }
+        }
+
+        return 0;
+bail:   return -1;
+}
+
 static int clew_input_backend_callback_error (struct clew_input_backend *backend, void *context, unsigned int reason)
 {
         int rc;
@@ -804,6 +897,8 @@ struct clew_input * clew_input_create (struct clew_input_init_options *options)
         }
         memset(input, 0, sizeof(struct clew_input));
 
+	input->callback_blob            = options->callback_blob;
+	input->callback_block           = options->callback_block;
 	input->callback_bounds_start    = options->callback_bounds_start;
 	input->callback_bounds_end      = options->callback_bounds_end;
 	input->callback_node_start      = options->callback_node_start;
@@ -830,11 +925,18 @@ struct clew_input * clew_input_create (struct clew_input_init_options *options)
 	input->callback_role            = options->callback_role;
 	input->callback_k               = options->callback_k;
 	input->callback_v               = options->callback_v;
+	input->callback_tag             = options->callback_tag;
         input->callback_error           = options->callback_error;
         input->callback_context         = options->callback_context;
 
         memset(&backend_options, 0, sizeof(struct clew_input_backend_init_options));
         backend_options.path                    = options->path;
+        backend_options.threads                 = options->threads;
+        backend_options.mmap                    = options->mmap;
+        backend_options.index                   = options->index;
+        backend_options.kinds                   = options->kinds;
+	backend_options.callback_blob           = (options->callback_blob != NULL) ? clew_input_backend_callback_blob : NULL;
+	backend_options.callback_block          = (options->callback_block != NULL) ? clew_input_backend_callback_block : NULL;
 	backend_options.callback_bounds_start   = clew_input_backend_callback_bounds_start;
 	backend_options.callback_bounds_end     = clew_input_backend_callback_bounds_end;
 	backend_options.callback_node_start     = clew_input_backend_callback_node_start;
@@ -861,6 +963,7 @@ struct clew_input * clew_input_create (struct clew_input_init_options *options)
 	backend_options.callback_role           = clew_input_backend_callback_role;
 	backend_options.callback_k              = clew_input_backend_callback_k;
 	backend_options.callback_v              = clew_input_backend_callback_v;
+	backend_options.callback_tag            = (options->callback_tag != NULL) ? clew_input_backend_callback_tag : NULL;
         backend_options.callback_error          = clew_input_backend_callback_error;
         backend_options.callback_context        = input;
 
@@ -4,14 +4,58 @@ extern "C" {
 #endif
 
 struct clew_input;
+struct clew_input_index;
+struct clew_input_index_entry;
 
 enum {
 	CLEW_INPUT_ERROR_SUCCESS	= 0,
 	CLEW_INPUT_ERROR_UNKNOWN
 };
 
+enum {
+        CLEW_INPUT_MEMBER_TYPE_NODE     = 0,
+        CLEW_INPUT_MEMBER_TYPE_WAY      = 1,
+        CLEW_INPUT_MEMBER_TYPE_RELATION = 2
+};
+
+/*
+ * one decoded data block as flat arrays. tags, refs and members of element i
+ * are [x_tags[i], x_tags[i + 1]) style ranges, tags holds resolved tag values
+ * with clew_tag_unknown for tags that did not resolve. arrays are only valid
+ * during callback_block.
+ */
+struct clew_input_block {
+        uint64_t nnodes;
+        const uint64_t *node_ids;
+        const int32_t *node_lons;
+        const int32_t *node_lats;
+        const uint64_t *node_tags;
+
+        uint64_t nways;
+        const uint64_t *way_ids;
+        const uint64_t *way_tags;
+        const uint64_t *way_refs;
+
+        uint64_t nrelations;
+        const uint64_t *relation_ids;
+        const uint64_t *relation_tags;
+        const uint64_t *relation_members;
+
+        const uint32_t *tags;
+        const uint64_t *refs;
+        const uint64_t *member_ids;
+        const uint32_t *member_types;
+};
+
 struct clew_input_init_options {
         const char *path;
+        int threads;
+        int mmap;
+        struct clew_input_index *index;
+        unsigned int kinds;
+
+	int (*callback_blob) (struct clew_input *input, void *context, const struct clew_input_index_entry *entry);
+	int (*callback_block) (struct clew_input *input, void *context, const struct clew_input_block *block);
 
 	int (*callback_bounds_start) (struct clew_input *input, void *context);
 	int (*callback_bounds_end) (struct clew_input *input, void *context);
@@ -52,6 +96,8 @@ struct clew_input_init_options {
 	int (*callback_k) (struct clew_input *input, void *context, const char *k);
 	int (*callback_v) (struct clew_input *input, void *context, const char *v);
 
+	int (*callback_tag) (struct clew_input *input, void *context, uint32_t tag);
+
         int (*callback_error) (struct clew_input *input, void *context, unsigned int reason);
 
         void *callback_context;
@@ -0,0 +1,221 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "debug.h"
+#include "stack.h"
+#include "location.h"
+
+#define CLEW_LOCATION_MISSING           INT32_MIN
+
+struct clew_location_entry {
+        uint64_t id;
+        int32_t lon;
+        int32_t lat;
+};
+
+struct clew_location {
+        int sorted;
+        int completed;
+        uint64_t count;
+        uint64_t min_id;
+        uint64_t max_id;
+
+        struct clew_stack entries;      /* struct clew_location_entry, sparse layout */
+
+        int32_t *dense;                 /* lon, lat pairs indexed by id - min_id, dense layout */
+        uint64_t dense_size;
+};
+
+static int clew_location_entry_compare (const void *a, const void *b)
+{
+        const struct clew_location_entry *e1 = (const struct clew_location_entry *) a;
+        const struct clew_location_entry *e2 = (const struct clew_location_entry *) b;
+        if (e1->id < e2->id) {
+                return -1;
+        }
+        if (e1->id > e2->id) {
+                return 1;
+        }
+        return 0;
+}
+
+struct clew_location * clew_location_create (void)
+{
+        struct clew_location *location;
+
+        location = (struct clew_location *) malloc(sizeof(struct clew_location));
+        if (location == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        memset(location, 0, sizeof(struct clew_location));
+        location->entries = clew_stack_init2(sizeof(struct clew_location_entry), 1024 * 1024);
+        clew_location_reset(location);
+
+        return location;
+bail:   return NULL;
+}
+
+void clew_location_destroy (struct clew_location *location)
+{
+        if (location == NULL) {
+                return;
+        }
+        clew_stack_uninit(&location->entries);
+        if (location->dense != NULL) {
+                free(location->dense);
+        }
+        free(location);
+}
+
+void clew_location_reset (struct clew_location *location)
+{
+        clew_stack_reset(&location->entries);
+        if (location->dense != NULL) {
+                free(location->dense);
+        }
+        location->dense      = NULL;
+        location->dense_size = 0;
+        location->sorted     = 1;
+        location->completed  = 0;
+        location->count      = 0;
+        location->min_id     = UINT64_MAX;
+        location->max_id     = 0;
+}
+
+int clew_location_push (struct clew_location *location, uint64_t id, int32_t lon, int32_t lat)
+{
+        int rc;
+        struct clew_location_entry entry;
+
+        if (location->completed) {
+                clew_errorf("location is completed");
+                goto bail;
+        }
+        if (location->count > 0 && id <= location->max_id) {
+                location->sorted = 0;
+        }
+
+        entry.id  = id;
+        entry.lon = lon;
+        entry.lat = lat;
+        rc = clew_stack_push(&location->entries, &entry);
+        if (rc < 0) {
+                clew_errorf("can not push location");
+                goto bail;
+        }
+
+        location->count  += 1;
+        location->min_id  = (id < location->min_id) ? id : location->min_id;
+        location->max_id  = (id > location->max_id) ? id : location->max_id;
+        return 0;
+bail:   return -1;
+}
+
+int clew_location_complete (struct clew_location *location)
+{
+        uint64_t i;
+        uint64_t span;
+        const struct clew_location_entry *entries;
+
+        if (location->completed) {
+                return 0;
+        }
+        location->completed = 1;
+        if (location->count == 0) {
+                return 0;
+        }
+        if (location->sorted == 0) {
+                clew_stack_sort(&location->entries, clew_location_entry_compare);
+                location->sorted = 1;
+        }
+
+        /* a dense pair costs 8 bytes per id in range, a sparse entry 16 bytes per node */
+        span = location->max_id - location->min_id + 1;
+        if (span > location->count * 2) {
+                return 0;
+        }
+
+        location->dense = (int32_t *) malloc(sizeof(int32_t) * 2 * span);
+        if (location->dense == NULL) {
+                clew_warningf("can not allocate memory for dense locations, keeping sparse");
+                return 0;
+        }
+        for (i = 0; i < span; i++) {
+                location->dense[i * 2 + 0] = CLEW_LOCATION_MISSING;
+                location->dense[i * 2 + 1] = CLEW_LOCATION_MISSING;
+        }
+        entries = (const struct clew_location_entry *) clew_stack_buffer(&location->entries);
+        for (i = 0; i < location->count; i++) {
+                location->dense[(entries[i].id - location->min_id) * 2 + 0] = entries[i].lon;
+                location->dense[(entries[i].id - location->min_id) * 2 + 1] = entries[i].lat;
+        }
+        location->dense_size = span;
+        clew_stack_uninit(&location->entries);
+        location->entries = clew_stack_init2(sizeof(struct clew_location_entry), 1024 * 1024);
+
+        return 0;
+}
+
+uint64_t clew_location_count (const struct clew_location *location)
+{
+        return location->count;
+}
+
+int clew_location_dense (const struct clew_location *location)
+{
+        return location->dense != NULL;
+}
+
+uint64_t clew_location_memory (const struct clew_location *location)
+{
+        if (location->dense != NULL) {
+                return sizeof(int32_t) * 2 * location->dense_size;
+        }
+        return location->entries.avail * sizeof(struct clew_location_entry);
+}
+
+int clew_location_get (const struct clew_location *location, uint64_t id, int32_t *lon, int32_t *lat)
+{
+        uint64_t l;
+        uint64_t r;
+        uint64_t m;
+        const struct clew_location_entry *entries;
+
+        if (location->completed == 0) {
+                clew_errorf("location is not completed");
+                return -1;
+        }
+        if (location->count == 0 || id < location->min_id || id > location->max_id) {
+                return 1;
+        }
+        if (location->dense != NULL) {
+                if (location->dense[(id - location->min_id) * 2 + 0] == CLEW_LOCATION_MISSING) {
+                        return 1;
+                }
+                *lon = location->dense[(id - location->min_id) * 2 + 0];
+                *lat = location->dense[(id - location->min_id) * 2 + 1];
+                return 0;
+        }
+
+        entries = (const struct clew_location_entry *) clew_stack_buffer(&location->entries);
+        l = 0;
+        r = location->count;
+        while (l < r) {
+                m = l + (r - l) / 2;
+                if (entries[m].id < id) {
+                        l = m + 1;
+                } else {
+                        r = m;
+                }
+        }
+        if (l >= location->count || entries[l].id != id) {
+                return 1;
+        }
+        *lon = entries[l].lon;
+        *lat = entries[l].lat;
+        return 0;
+}
@@ -0,0 +1,31 @@
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * temporary store of node coordinates by id, used by single pass reading to
+ * resolve way refs after the ways are selected. locations are pushed as they
+ * stream by, complete then picks a dense array indexed by id or sorted
+ * id/coordinate pairs, whichever is smaller for the id range seen.
+ */
+struct clew_location;
+
+struct clew_location * clew_location_create (void);
+void clew_location_destroy (struct clew_location *location);
+
+void clew_location_reset (struct clew_location *location);
+int clew_location_push (struct clew_location *location, uint64_t id, int32_t lon, int32_t lat);
+int clew_location_complete (struct clew_location *location);
+
+uint64_t clew_location_count (const struct clew_location *location);
+int clew_location_dense (const struct clew_location *location);
+uint64_t clew_location_memory (const struct clew_location *location);
+
+/* returns 0 if found, 1 if id is not in store */
+int clew_location_get (const struct clew_location *location, uint64_t id, int32_t *lon, int32_t *lat);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,21 +7,31 @@
 
 #include <ctype.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include <clipper2/clipper.h>
 
 #define CLEW_DEBUG_NAME                 "main"
 #include "debug.h"
 #include "input.h"
+#include "input-index.h"
+#include "location.h"
+#include "arena.h"
+#include "node-store.h"
+#include "tagset.h"
+#include "graph.h"
+#include "delta.h"
 #include "bound.h"
 #include "point.h"
 #include "bitmap.h"
+#include "idset.h"
 #include "stack.h"
-#include "khash.h"
 #include "pqueue.h"
 #include "expression.h"
 #include "projection-mercator.h"
 #include "tag.h"
+#include "tag-parse.h"
 
 #define OPTION_HELP                     'h'
 #define OPTION_DEBUG                    'd'
@@ -34,6 +44,14 @@
 #define OPTION_FILTER                   'f'
 #define OPTION_POINTS                   'p'
 
+#define OPTION_THREADS                  't'
+#define OPTION_MMAP                     0x400
+#define OPTION_INDEX                    0x401
+#define OPTION_SINGLE_PASS              0x402
+#define OPTION_DENSE_IDS                0x403
+#define OPTION_MEMORY_LIMIT             0x404
+#define OPTION_GRAPH_CACHE              0x405
+
 #define OPTION_CLIP_PATH                0x200
 #define OPTION_CLIP_BOUND               0x201
 #define OPTION_CLIP_OFFSET              0x202
@@ -48,7 +66,10 @@
 #define OPTION_KEEP_WAYS                'w'
 #define OPTION_KEEP_RELATIONS           'r'
 
-static const char *g_short_options     = "+i:o:m:f:p:k:n:w:r:d:h";
+/* elements a reader matches before it orders its filter clauses by hits, about one block */
+#define CLEW_FILTER_WARMUP              8000
+
+static const char *g_short_options     = "+i:o:m:f:p:t:k:n:w:r:d:h";
 static struct option g_long_options[] = {
         { "help",               no_argument,            0,      OPTION_HELP                     },
         { "input",              required_argument,      0,      OPTION_INPUT                    },
@@ -60,6 +81,13 @@ static struct option g_long_options[] = {
         { "clip-strategy",      required_argument,      0,      OPTION_CLIP_STRATEGY            },
         { "filter",             required_argument,      0,      OPTION_FILTER                   },
         { "points",             required_argument,      0,      OPTION_POINTS                   },
+        { "threads",            required_argument,      0,      OPTION_THREADS                  },
+        { "mmap",               required_argument,      0,      OPTION_MMAP                     },
+        { "index",              required_argument,      0,      OPTION_INDEX                    },
+        { "single-pass",        required_argument,      0,      OPTION_SINGLE_PASS              },
+        { "dense-ids",          required_argument,      0,      OPTION_DENSE_IDS                },
+        { "memory-limit",       required_argument,      0,      OPTION_MEMORY_LIMIT             },
+        { "graph-cache",        required_argument,      0,      OPTION_GRAPH_CACHE              },
         { "keep-tags",          required_argument,      0,      OPTION_KEEP_TAGS                },
         { "keep-tags-node",     required_argument,      0,      OPTION_KEEP_TAGS_NODE           },
         { "keep-tags-way",      required_argument,      0,      OPTION_KEEP_TAGS_WAY            },
@@ -70,10 +98,6 @@ static struct option g_long_options[] = {
         { 0,                    0,                      0,      0                               }
 };
 
-#define mesh_node_hash_func(key)		kh_int64_hash_func(key)
-#define mesh_node_hash_equal(a, b)		(a == b)
-KHASH_INIT(mesh_nodes, uint64_t, struct clew_mesh_node *, 1, mesh_node_hash_func, mesh_node_hash_equal);
-
 enum {
         CLEW_STATE_INITIAL                      = 0,
         CLEW_STATE_SELECT                       = 1,
@@ -123,6 +147,13 @@ struct clew_options {
         struct clew_stack clip_path;
         int clip_strategy;
         struct clew_stack points;
+        int threads;
+        int mmap;
+        int index;
+        int single_pass;
+        int dense_ids;
+        uint64_t memory_limit;
+        const char *graph_cache;
         struct clew_expression *filter;
         struct clew_expression *keep_tags;
         struct clew_expression *keep_tags_node;
@@ -133,20 +164,12 @@ struct clew_options {
         int keep_relations;
 };
 
-struct clew_node {
-        uint64_t id;
-        int32_t lon;
-        int32_t lat;
-        uint32_t ntags;
-        uint32_t *tags;
-};
-
 struct clew_way {
         uint64_t id;
-        uint32_t ntags;
-        uint32_t *tags;
+        uint32_t tagset;                        /* id in clew tagsets */
         uint32_t nrefs;
-        uint64_t *refs;
+        uint32_t srefs;
+        uint8_t *refs;                          /* delta coded, walk with clew_delta_iter */
 };
 
 struct clew_relation {
@@ -170,21 +193,17 @@ struct clew_mesh_way {
         uint32_t maxspeed;
 };
 
-struct clew_mesh_node_neighbour {
-        struct clew_mesh_node *mesh_node;
-        double distance;
-        double duration;
-        double cost;
-};
-
-struct clew_mesh_node {
-        struct clew_node *node;
-        struct clew_stack mesh_ways;
-        struct clew_stack mesh_neighbours;
+/*
+ * the mesh is a struct clew_graph, nodes are numbered 0..n-1 in the order
+ * they are first met while building it and search state and solutions refer
+ * to them by that index. osm ids are only mapped at the node store boundary.
+ */
 
+/* shortest path state of one mesh node, kept in a flat array by mesh index */
+struct clew_mesh_search {
         double pqueue_cost;
         uint64_t pqueue_pos;
-        struct clew_mesh_node *pqueue_prev;
+        uint64_t pqueue_prev;
 
         double pqueue_duration;
         double pqueue_distance;
@@ -195,14 +214,14 @@ struct clew_mesh_point {
         int32_t lon;
         int32_t lat;
         double nearest_distance;
-        struct clew_mesh_node *nearest_node;
+        uint64_t nearest_node;
         int _solved;
 };
 
 struct clew_mesh_solution {
         struct clew_mesh_point *source;
         struct clew_mesh_point *destination;
-        struct clew_stack mesh_nodes;
+        struct clew_stack mesh_nodes;           /* uint64_t mesh indices */
 
         double duration;
         double distance;
@@ -214,42 +233,93 @@ struct clew {
 
         int state;
 
-        struct clew_bitmap node_ids;
-        struct clew_bitmap way_ids;
-        struct clew_bitmap relation_ids;
-
-        struct clew_stack nodes;
+        struct clew_idset node_ids;
+        struct clew_idset way_ids;
+        struct clew_idset relation_ids;
+
+        struct clew_stack input_indexes;
+        struct clew_stack readers;
+        struct clew_expression_stats filter_stats;      /* merged from readers */
+
+        struct clew_stack arenas;               /* ways, with their refs, live here */
+        struct clew_tagset *tagsets;            /* tags of extracted nodes and ways, readers intern under tagsets_mutex */
+        pthread_mutex_t tagsets_mutex;
+        int keep_tags_prune;                    /* CLEW_READ_STATE_NODE and _WAY if the tags below are the only ones stored */
+        struct clew_bitmap keep_tags_node;      /* by tag id, compiled from keep-tags and keep-tags-node */
+        struct clew_bitmap keep_tags_way;       /* by tag id, compiled from keep-tags and keep-tags-way, plus the tags mesh ways need */
+        struct clew_node_store *nodes;
         struct clew_stack ways;
         struct clew_stack relations;
 
         struct clew_stack mesh_ways;
-        khash_t(mesh_nodes) *mesh_nodes;
+        struct clew_stack mesh_way_types;       /* struct clew_mesh_way_type by tag set id, tag unknown if not routable */
+        struct clew_graph *mesh;
+        struct clew_stack mesh_node_index;      /* uint64_t mesh index by node store index */
+        struct clew_stack mesh_visited;         /* uint32_t stamp by mesh index */
+        uint32_t mesh_visited_stamp;
 
         struct clew_stack mesh_points;
         struct clew_stack mesh_solutions;
 
+        uint64_t read_node_start;
+        uint64_t read_way_start;
+        uint64_t read_relation_start;
+
+        uint64_t read_blobs;
+        uint64_t read_blobs_skipped;
+};
+
+/*
+ * one input being read, on its own thread when there are several. selection
+ * bitmaps and extracted elements are reader local and merged into clew after
+ * the phase, the selection of the previous phase is only read from clew.
+ * selections that take concurrent marks are marked in clew directly, the
+ * mark_* pointers select the target and the local sets then stay empty.
+ */
+struct clew_reader {
+        struct clew *clew;
+        const char *path;
+        struct clew_input_init_options input_init_options;
+        int index_loaded;
+
+        pthread_t thread;
+        int error;
+
         struct clew_stack read_state;
         int read_keep;
 
-        uint64_t read_id;
-        int64_t read_lon;
-        int64_t read_lat;
-
         struct clew_stack read_tags;
-        #define READ_TAG_K_LENGTH       512
-        #define READ_TAG_V_LENGTH       512
-        #define READ_TAG_S_LENGTH       (READ_TAG_K_LENGTH + READ_TAG_V_LENGTH)
-        char read_tag_k[512];
-        char read_tag_v[512];
-        char read_tag_s[1024];
 
-        struct clew_stack read_refs;
+        struct clew_expression *filter;         /* own copy, its clauses are ordered by what this reader sees */
+        struct clew_expression_stats filter_stats;
+        struct clew_expression_cache filter_cache; /* of filter, zeroed with the reader */
+
+        struct clew_tagset *tagsets;            /* sets seen by this reader, so the shared dictionary is only locked for new ones */
+        struct clew_stack tagset_ids;           /* uint32_t clew tag set id by local id */
+
+        struct clew_idset node_ids;
+        struct clew_idset way_ids;
+        struct clew_idset relation_ids;
+
+        struct clew_idset *mark_node_ids;
+        struct clew_idset *mark_way_ids;
+        struct clew_idset *mark_relation_ids;
+
+        struct clew_arena *arena;
+        struct clew_node_store *nodes;
+        struct clew_stack ways;
+
+        struct clew_location *locations;
 
         uint64_t read_node_start;
         uint64_t read_way_start;
         uint64_t read_relation_start;
+
+        uint64_t read_blobs;
+        uint64_t read_blobs_skipped;
 };
 
+/* indexed by clew_tag_highway_rank - 1 */
 static const struct clew_mesh_way_type clew_mesh_way_types[] = {
         { clew_tag_highway_motorway,            clew_tag_oneway_yes,    clew_tag_maxspeed_140 },
         { clew_tag_highway_motorway_link,       clew_tag_oneway_yes,    clew_tag_maxspeed_110 },
@@ -299,74 +369,45 @@ static const char *g_filter_preset_motorcycle_scenic_plus =
         "and not ( motor_vehicle_no or motor_vehicle_private ) "
         "and not ( access_no or access_private) ";
 
-static int tags_expression_match_has (void *context, uint32_t tag);
-
-static uint32_t parse_tag_fix_length_value (const char *v_raw);
-static void parse_tag_fix_length (char *k, char *v);
-static void parse_tag_fix_layer (char *k, char *v);
-static void parse_tag_fix (char *k, char *v);
-
+static int input_callback_select_block (struct clew_input *input, void *context, const struct clew_input_block *block);
 static int input_callback_select_bounds_start (struct clew_input *input, void *context);
 static int input_callback_select_bounds_end (struct clew_input *input, void *context);
-static int input_callback_select_node_start (struct clew_input *input, void *context);
-static int input_callback_select_node_end (struct clew_input *input, void *context);
-static int input_callback_select_way_start (struct clew_input *input, void *context);
-static int input_callback_select_way_end (struct clew_input *input, void *context);
-static int input_callback_select_relation_start (struct clew_input *input, void *context);
-static int input_callback_select_relation_end (struct clew_input *input, void *context);
-static int input_callback_select_tag_start (struct clew_input *input, void *context);
-static int input_callback_select_tag_end (struct clew_input *input, void *context);
-static int input_callback_select_nd_start (struct clew_input *input, void *context);
-static int input_callback_select_nd_end (struct clew_input *input, void *context);
-static int input_callback_select_member_start (struct clew_input *input, void *context);
-static int input_callback_select_member_end (struct clew_input *input, void *context);
 static int input_callback_select_minlon (struct clew_input *input, void *context, int32_t lon);
 static int input_callback_select_minlat (struct clew_input *input, void *context, int32_t lat);
 static int input_callback_select_maxlon (struct clew_input *input, void *context, int32_t lon);
 static int input_callback_select_maxlat (struct clew_input *input, void *context, int32_t lat);
-static int input_callback_select_id (struct clew_input *input, void *context, uint64_t id);
-static int input_callback_select_lon (struct clew_input *input, void *context, int32_t lon);
-static int input_callback_select_lat (struct clew_input *input, void *context, int32_t lat);
-static int input_callback_select_ref (struct clew_input *input, void *context, uint64_t ref);
-static int input_callback_select_type (struct clew_input *input, void *context, const char *type);
-static int input_callback_select_role (struct clew_input *input, void *context, const char *role);
-static int input_callback_select_k (struct clew_input *input, void *context, const char *k);
-static int input_callback_select_v (struct clew_input *input, void *context, const char *v);
 static int input_callback_select_error (struct clew_input *input, void *context, unsigned int reason);
 
+static int input_callback_extract_blob (struct clew_input *input, void *context, const struct clew_input_index_entry *entry);
+static int input_callback_extract_block (struct clew_input *input, void *context, const struct clew_input_block *block);
 static int input_callback_extract_bounds_start (struct clew_input *input, void *context);
 static int input_callback_extract_bounds_end (struct clew_input *input, void *context);
-static int input_callback_extract_node_start (struct clew_input *input, void *context);
-static int input_callback_extract_node_end (struct clew_input *input, void *context);
-static int input_callback_extract_way_start (struct clew_input *input, void *context);
-static int input_callback_extract_way_end (struct clew_input *input, void *context);
-static int input_callback_extract_relation_start (struct clew_input *input, void *context);
-static int input_callback_extract_relation_end (struct clew_input *input, void *context);
-static int input_callback_extract_tag_start (struct clew_input *input, void *context);
-static int input_callback_extract_tag_end (struct clew_input *input, void *context);
-static int input_callback_extract_nd_start (struct clew_input *input, void *context);
-static int input_callback_extract_nd_end (struct clew_input *input, void *context);
-static int input_callback_extract_member_start (struct clew_input *input, void *context);
-static int input_callback_extract_member_end (struct clew_input *input, void *context);
 static int input_callback_extract_minlon (struct clew_input *input, void *context, int32_t lon);
 static int input_callback_extract_minlat (struct clew_input *input, void *context, int32_t lat);
 static int input_callback_extract_maxlon (struct clew_input *input, void *context, int32_t lon);
 static int input_callback_extract_maxlat (struct clew_input *input, void *context, int32_t lat);
-static int input_callback_extract_id (struct clew_input *input, void *context, uint64_t id);
-static int input_callback_extract_lon (struct clew_input *input, void *context, int32_t lon);
-static int input_callback_extract_lat (struct clew_input *input, void *context, int32_t lat);
-static int input_callback_extract_ref (struct clew_input *input, void *context, uint64_t ref);
-static int input_callback_extract_type (struct clew_input *input, void *context, const char *type);
-static int input_callback_extract_role (struct clew_input *input, void *context, const char *role);
-static int input_callback_extract_k (struct clew_input *input, void *context, const char *k);
-static int input_callback_extract_v (struct clew_input *input, void *context, const char *v);
 static int input_callback_extract_error (struct clew_input *input, void *context, unsigned int reason);
 
-static int node_stack_compare_elements (const void *a, const void *b);
-static void node_stack_destroy_element (void *context, void *elem);
+static int input_callback_single_block (struct clew_input *input, void *context, const struct clew_input_block *block);
+
+static struct clew_reader * clew_reader_add (struct clew *clew, const char *path);
+static void clew_reader_destroy (struct clew_reader *reader);
+static int clew_reader_read (struct clew_reader *reader);
+static void * clew_reader_thread (void *context);
+static void clew_readers_reset (struct clew *clew);
+static int clew_readers_read (struct clew *clew);
+static int clew_readers_merge (struct clew *clew);
+static void reader_stack_destroy_element (void *context, void *elem);
+
+
+static void input_index_stack_destroy_element (void *context, void *elem);
+static void arena_stack_destroy_element (void *context, void *elem);
+
+static int clew_way_set_refs (struct clew_arena *arena, struct clew_way *way, const uint64_t *refs, uint32_t nrefs);
+static void clew_mesh_way_classify (const uint32_t *tags, uint32_t ntags, struct clew_mesh_way_type *type);
 
 static int way_stack_compare_elements (const void *a, const void *b);
-static void way_stack_destroy_element (void *context, void *elem);
+static uint64_t way_stack_unique (struct clew_stack *ways);
 
 static int relation_stack_compare_elements (const void *a, const void *b);
 static void relation_stack_destroy_element (void *context, void *elem);
@@ -377,25 +418,23 @@ static uint64_t mesh_node_pqueue_getpos (const void *a);
 
 static void mesh_solution_stack_destroy_element (void *context, void *elem);
 
-KHASH_SET_INIT_INT64(mesh_visited);
-
 static int64_t clew_mesh_node_neighbours_count_depth (
-        struct clew_mesh_node *mnode,
+        struct clew *clew,
+        uint64_t mnode,
         int64_t depth,
         int64_t mdepth,
         int64_t count,
-        int64_t mcount,
-        khash_t(mesh_visited) *visited);
-static int64_t clew_mesh_node_neighbours_count (struct clew_mesh_node *mnode, int64_t mcount);
-static void clew_mesh_node_destroy (struct clew_mesh_node *mnode);
+        int64_t mcount);
+static int64_t clew_mesh_node_neighbours_count (struct clew *clew, uint64_t mnode, int64_t mcount);
 
-static void clew_node_destroy (struct clew_node *node);
-static void clew_way_destroy (struct clew_way *way);
 static void clew_relation_destroy (struct clew_relation *relation);
 
 static const char * clew_clip_strategy_string (int strategy);
 static int clew_clip_strategy_value (const char *strategy);
 
+static int clew_graph_cache_key (struct clew *clew, uint64_t *key);
+static int clew_keep_tags_compile (struct clew_bitmap *bitmap, const struct clew_expression *all, const struct clew_expression *element, int mesh);
+
 static void print_help (const char *pname)
 {
         fprintf(stdout, "%s usage:\n", pname);
@@ -408,12 +447,19 @@ static void print_help (const char *pname)
         fprintf(stdout, "  --clip-strategy          : clip strategy; simple, complete_ways, smart (default: complete_ways)\n");
         fprintf(stdout, "  --filter             / -f: filter expression (default: \"\")\n");
         fprintf(stdout, "  --points             / -p: points to visit, ex: lon1,lat1 lon2,lat2 ... (default: \"\")\n");
+        fprintf(stdout, "  --threads            / -t: number of blob decode threads (default: 1)\n");
+        fprintf(stdout, "  --mmap                   : read input through memory mapping (default: 1)\n");
+        fprintf(stdout, "  --index                  : load and save blob index as <input>.idx sidecar (default: 0)\n");
+        fprintf(stdout, "  --single-pass            : select and extract in one read, required for stdin input \"-\" (default: 0)\n");
+        fprintf(stdout, "  --dense-ids              : keep selected ids in plain bitmaps instead of compressed sets, for planet sized inputs (default: 0)\n");
+        fprintf(stdout, "  --memory-limit           : megabytes of extracted nodes kept in memory, the rest is sorted to temporary files, 0 for no limit (default: 0)\n");
+        fprintf(stdout, "  --graph-cache            : load the mesh from path if it was built from the same inputs and options, save it there otherwise (default: \"\")\n");
         fprintf(stdout, "  --keep-nodes         / -n: filter nodes (default: 0)\n");
         fprintf(stdout, "  --keep-ways          / -w: filter ways (default: 0)\n");
         fprintf(stdout, "  --keep-relations     / -r: filter relations (default: 0)\n");
-        fprintf(stdout, "  --keep-tags          / -k: keep tag (default: \"\")\n");
-        fprintf(stdout, "  --keep-tags-node         : keep node tag (default: \"\")\n");
-        fprintf(stdout, "  --keep-tags-way          : keep way tag (default: \"\")\n");
+        fprintf(stdout, "  --keep-tags          / -k: tags kept on extracted nodes and ways, others are dropped, all are kept if no keep tags are given (default: \"\")\n");
+        fprintf(stdout, "  --keep-tags-node         : tags kept on extracted nodes, in addition to keep tags (default: \"\")\n");
+        fprintf(stdout, "  --keep-tags-way          : tags kept on extracted ways, in addition to keep tags and the tags routing needs (default: \"\")\n");
         fprintf(stdout, "  --keep-tags-relation     : keep relation tag (default: \"\")\n");
         fprintf(stdout, "\n");
         fprintf(stdout, "clip strategies;\n");
@@ -501,141 +547,193 @@ static void print_help (const char *pname)
         fprintf(stdout, "    highway_via_ferrata   : a via ferrata is a route equipped with fixed cables, stemples, ladders, and bridges in order to increase ease and security for climbers.\n");
 }
 
-static int tags_expression_match_has (void *context, uint32_t tag)
-{
-        uint64_t pos;
-        struct clew_stack *tags = (struct clew_stack *) context;
-        pos = clew_stack_search_uint32(tags, tag);
-        return (pos == UINT64_MAX) ? 0 : 1;
-}
-
-static uint32_t parse_tag_fix_length_value (const char *v_raw)
+static int input_block_tags (struct clew_reader *reader, const struct clew_input_block *block, uint64_t from, uint64_t to)
 {
-        const char *v = v_raw;
-        char *endptr = NULL;
-        double meters = 0.0;
-
-        const char *apos = strchr(v, '\'');  // typewriter apostrophe
-        const char *quote = strchr(v, '"');  // typewriter quote
-
-        // 1. Handle feet + inches like 16'3" or 6' or 3"
-        if (apos || quote) {
-                double feet = 0.0, inches = 0.0;
+        int rc;
+        uint64_t i;
 
-                if (apos) {
-                        feet = strtod(v, &endptr);
-                        if (endptr != apos) return UINT32_MAX; // invalid format
+        clew_stack_reset(&reader->read_tags);
+        for (i = from; i < to; i++) {
+                if (block->tags[i] == clew_tag_unknown) {
+                        continue;
                 }
-
-                if (quote) {
-                        if (apos) {
-                                inches = strtod(apos + 1, &endptr);
-                                if (endptr != quote) return UINT32_MAX;
-                        } else {
-                                inches = strtod(v, &endptr);
-                                if (endptr != quote) return UINT32_MAX;
-                        }
+                rc = clew_stack_push_uint32(&reader->read_tags, block->tags[i]);
+                if (rc != 0) {
+                        clew_errorf("can not add tag");
+                        goto bail;
                 }
-
-                meters = (feet * 0.3048) + (inches * 0.0254);
-                return (uint32_t) round((meters < 0.0) ? 0.0 : meters);
         }
 
-        // 2. Handle suffix units: "2 m", "0.6 mi", etc.
-        double value = strtod(v, &endptr);
-
-        if (endptr == v) return UINT32_MAX; // no valid number found
+        return 0;
+bail:   return -1;
+}
 
-        while (*endptr && isspace(*endptr)) ++endptr;
+static int input_block_match (struct clew_reader *reader, const struct clew_input_block *block, uint64_t from, uint64_t to)
+{
+        int rc;
 
-        if (strncmp(endptr, "m", 1) == 0 || *endptr == '\0') {
-                // meters (default)
-                meters = value;
-        } else if (strncmp(endptr, "mi", 2) == 0) {
-                meters = value * 1609.344;
-        } else {
-                // unsupported unit
-                return UINT32_MAX;
+        rc = input_block_tags(reader, block, from, to);
+        if (rc != 0) {
+                return -1;
         }
-
-        return (uint32_t) round((meters < 0.0) ? 0.0 : meters);
+        if (clew_stack_count(&reader->read_tags) == 0) {
+                return 0;
+        }
+        rc = clew_expression_match_cached(reader->filter, &reader->filter_cache, (const uint32_t *) clew_stack_buffer(&reader->read_tags), clew_stack_count(&reader->read_tags), &reader->filter_stats);
+        if (reader->filter_stats.calls == CLEW_FILTER_WARMUP) {
+                clew_expression_optimize(reader->filter, &reader->filter_stats);
+        }
+        return rc > 0;
 }
 
-static void parse_tag_fix_length (char *k, char *v)
+/*
+ * interns the element's tags, sets new to the reader are added to the clew
+ * dictionary. element is CLEW_READ_STATE_NODE or _WAY, and selects which
+ * keep tags apply.
+ */
+static int input_block_tagset (struct clew_reader *reader, const struct clew_input_block *block, uint64_t from, uint64_t to, int element, uint32_t *tagset)
 {
-        int length;
-        uint32_t tag;
-        (void) k;
-        length = parse_tag_fix_length_value(v);
-        if (length == 0) {
-                tag = clew_tag_length_0;
-        } else if (length >= 1 && length <= 100) {
-                tag = clew_tag_length_1 + (length - 1);
-        } else if (length >= 110 && length <= 1000) {
-                tag = clew_tag_length_110 + ((length - 110) / 10);
-        } else if (length >= 1010 && length <= 5000) {
-                tag = clew_tag_length_1010 + ((length - 1010) / 10);
-        } else if (length >= 5025 && length <= 10000) {
-                tag = clew_tag_length_5025 + ((length - 5025) / 25);
-        } else if (length >= 10050 && length <= 50000) {
-                tag = clew_tag_length_10050 + ((length - 10050) / 50);
-        } else if (length >= 50100 && length <= 100000) {
-                tag = clew_tag_length_50100 + ((length - 50100) / 100);
-        } else if (length >= 100250 && length <= 500000) {
-                tag = clew_tag_length_100250 + ((length - 100250) / 250);
-        } else if (length >= 500500 && length <= 1000000) {
-                tag = clew_tag_length_500500 + ((length - 500500) / 500);
-        } else {
-                tag = clew_tag_length_unknown;
+        int rc;
+        uint32_t id;
+        uint32_t global;
+        uint64_t i;
+        uint64_t il;
+        uint64_t kept;
+        uint32_t *tags;
+        const struct clew_bitmap *keep;
+
+        rc = input_block_tags(reader, block, from, to);
+        if (rc != 0) {
+                return -1;
+        }
+        if (reader->clew->keep_tags_prune & element) {
+                keep = (element == CLEW_READ_STATE_NODE) ? &reader->clew->keep_tags_node : &reader->clew->keep_tags_way;
+                tags = (uint32_t *) clew_stack_buffer(&reader->read_tags);
+                for (i = 0, il = clew_stack_count(&reader->read_tags), kept = 0; i < il; i++) {
+                        if (clew_bitmap_marked(keep, tags[i])) {
+                                tags[kept++] = tags[i];
+                        }
+                }
+                clew_stack_resize(&reader->read_tags, kept);
+        }
+        clew_stack_sort_uint32(&reader->read_tags);
+        rc = clew_tagset_intern(reader->tagsets, (const uint32_t *) clew_stack_buffer(&reader->read_tags), clew_stack_count(&reader->read_tags), &id);
+        if (rc < 0) {
+                clew_errorf("can not intern tags");
+                return -1;
+        } else if (rc == 0) {
+                *tagset = clew_stack_at_uint32(&reader->tagset_ids, id);
+                return 0;
+        }
+
+        pthread_mutex_lock(&reader->clew->tagsets_mutex);
+        rc = clew_tagset_intern(reader->clew->tagsets, (const uint32_t *) clew_stack_buffer(&reader->read_tags), clew_stack_count(&reader->read_tags), &global);
+        pthread_mutex_unlock(&reader->clew->tagsets_mutex);
+        if (rc < 0) {
+                clew_errorf("can not intern tags");
+                return -1;
+        }
+        rc = clew_stack_push_uint32(&reader->tagset_ids, global);
+        if (rc < 0) {
+                clew_errorf("can not push tag set");
+                return -1;
         }
-        snprintf(v, READ_TAG_V_LENGTH, "length_%d", tag - clew_tag_length_0);
+        *tagset = global;
+        return 0;
 }
 
-static void parse_tag_fix_layer (char *k, char *v)
+static void input_block_count (struct clew_reader *reader, const struct clew_input_block *block)
 {
-        int layer;
-        (void) k;
-        layer = atoi(v);
-        if (layer == 0) {
-                snprintf(v, READ_TAG_V_LENGTH, "layer_ground");
-        } else if (layer > 0) {
-                snprintf(v, READ_TAG_V_LENGTH, "layer_above_%d", layer);
-        } else {
-                snprintf(v, READ_TAG_V_LENGTH, "layer_below_%d", -layer);
+        if (reader->read_node_start == 0 && block->nnodes > 0) {
+                clew_infof("      reading nodes");
+        }
+        reader->read_node_start += block->nnodes;
+        if (reader->read_way_start == 0 && block->nways > 0) {
+                clew_infof("      reading ways");
         }
+        reader->read_way_start += block->nways;
+        if (reader->read_relation_start == 0 && block->nrelations > 0) {
+                clew_infof("      reading relations");
+        }
+        reader->read_relation_start += block->nrelations;
 }
 
-static void parse_tag_fix (char *k, char *v)
+static int input_callback_select_block (struct clew_input *input, void *context, const struct clew_input_block *block)
 {
-        char *c;
-        for (c = k; c && *c; c++) {
-                if (*c == '-') {
-                        *c = '_';
+        int rc;
+        int match;
+        uint64_t i;
+        uint64_t r;
+        struct clew_reader *reader = (struct clew_reader *) context;
+
+        (void) input;
+
+        input_block_count(reader, block);
+
+        for (i = 0; (reader->read_keep & CLEW_READ_STATE_NODE) && i < block->nnodes; i++) {
+                match = input_block_match(reader, block, block->node_tags[i], block->node_tags[i + 1]);
+                if (match < 0) {
+                        goto bail;
+                } else if (match == 0) {
+                        continue;
+                }
+                rc = clew_idset_mark(reader->mark_node_ids, block->node_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not push node id");
+                        goto bail;
                 }
         }
-        for (c = v; c && *c; c++) {
-                if (*c == '-') {
-                        *c = '_';
+
+        for (i = 0; (reader->read_keep & CLEW_READ_STATE_WAY) && i < block->nways; i++) {
+                match = input_block_match(reader, block, block->way_tags[i], block->way_tags[i + 1]);
+                if (match < 0) {
+                        goto bail;
+                } else if (match == 0) {
+                        continue;
+                }
+                rc = clew_idset_mark(reader->mark_way_ids, block->way_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not push way id");
+                        goto bail;
+                }
+                for (r = block->way_refs[i]; r < block->way_refs[i + 1]; r++) {
+                        rc = clew_idset_mark(reader->mark_node_ids, block->refs[r]);
+                        if (rc < 0) {
+                                clew_errorf("can not push node id");
+                                goto bail;
+                        }
                 }
         }
-        if (strcasecmp(k, "layer") == 0) {
-                parse_tag_fix_layer(k, v);
-        } else if (strcasecmp(k, "length") == 0) {
-                parse_tag_fix_length(k, v);
+
+        for (i = 0; (reader->read_keep & CLEW_READ_STATE_RELATION) && i < block->nrelations; i++) {
+                match = input_block_match(reader, block, block->relation_tags[i], block->relation_tags[i + 1]);
+                if (match < 0) {
+                        goto bail;
+                } else if (match == 0) {
+                        continue;
+                }
+                rc = clew_idset_mark(reader->mark_relation_ids, block->relation_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not push relation id");
+                        goto bail;
+                }
         }
+
+        return 0;
+bail:   return -1;
 }
 
 static int input_callback_select_bounds_start (struct clew_input *input, void *context)
 {
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_UNKNOWN) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_UNKNOWN);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_UNKNOWN) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_UNKNOWN);
                 goto bail;
         }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_BOUNDS);
+        clew_stack_push_uint32(&reader->read_state, CLEW_READ_STATE_BOUNDS);
 
         return 0;
 bail:   return -1;
@@ -643,1212 +741,787 @@ bail:   return -1;
 
 static int input_callback_select_bounds_end (struct clew_input *input, void *context)
 {
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
-        clew_stack_pop(&clew->read_state);
+        clew_stack_pop(&reader->read_state);
 
         return 0;
 bail:   return -1;
 }
 
-static int input_callback_select_node_start (struct clew_input *input, void *context)
+static int input_callback_select_minlon (struct clew_input *input, void *context, int32_t lon)
 {
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
+        (void) lon;
 
-        if (clew->read_node_start == 0) {
-                clew_infof("      reading nodes");
-        }
-        clew->read_node_start++;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_UNKNOWN) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_UNKNOWN);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_NODE);
 
-        clew_stack_reset(&clew->read_tags);
+        return 0;
+bail:   return -1;
+}
+
+static int input_callback_select_minlat (struct clew_input *input, void *context, int32_t lat)
+{
+        struct clew_reader *reader = (struct clew_reader *) context;
+
+        (void) input;
+        (void) lat;
 
-        if ((clew->read_keep & CLEW_READ_STATE_NODE) == 0) {
-                goto skip;
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
+                goto bail;
         }
 
         return 0;
-skip:   return 1;
 bail:   return -1;
 }
 
-static int input_callback_select_node_end (struct clew_input *input, void *context)
+static int input_callback_select_maxlon (struct clew_input *input, void *context, int32_t lon)
 {
-        int rc;
-        int match;
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
+        (void) lon;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_NODE) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
-        clew_stack_pop(&clew->read_state);
 
-        match = 0;
-        if (clew_stack_count(&clew->read_tags) > 0) {
-                clew_stack_sort_uint32(&clew->read_tags);
-                match = clew_expression_match(clew->options.filter, &clew->read_tags, NULL, NULL, NULL, tags_expression_match_has);
-        }
-        if (match == 0) {
-                goto out;
-        }
+        return 0;
+bail:   return -1;
+}
 
-        rc = clew_bitmap_mark(&clew->node_ids, clew->read_id);
-        if (rc < 0) {
-                clew_errorf("can not push node id");
+static int input_callback_select_maxlat (struct clew_input *input, void *context, int32_t lat)
+{
+        struct clew_reader *reader = (struct clew_reader *) context;
+
+        (void) input;
+        (void) lat;
+
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
 
-out:    return 0;
+        return 0;
 bail:   return -1;
 }
 
-static int input_callback_select_way_start (struct clew_input *input, void *context)
+static int input_callback_select_error (struct clew_input *input, void *context, unsigned int reason)
+{
+        struct clew_reader *reader = (struct clew_reader *) context;
+        (void) input;
+        (void) reader;
+        (void) reason;
+        return 0;
+}
+
+static int input_callback_extract_blob (struct clew_input *input, void *context, const struct clew_input_index_entry *entry)
 {
-        struct clew *clew = (struct clew *) context;
+        int need;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
 
-        if (clew->read_way_start == 0) {
-                clew_infof("      reading ways");
+        need = 0;
+        if (entry->kinds & CLEW_INPUT_INDEX_KIND_HEADER) {
+                need = 1;
         }
-        clew->read_way_start++;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_UNKNOWN) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_UNKNOWN);
-                goto bail;
+        if (need == 0 && (entry->kinds & CLEW_INPUT_INDEX_KIND_NODE)) {
+                need = clew_idset_marked_range(&reader->clew->node_ids, entry->min_id, entry->max_id);
         }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_WAY);
-
-        clew_stack_reset(&clew->read_tags);
-        clew_stack_reset(&clew->read_refs);
-
-        if ((clew->read_keep & CLEW_READ_STATE_WAY) == 0) {
-                goto skip;
+        if (need == 0 && (entry->kinds & CLEW_INPUT_INDEX_KIND_WAY)) {
+                need = clew_idset_marked_range(&reader->clew->way_ids, entry->min_id, entry->max_id);
+        }
+        if (need == 0 && (entry->kinds & CLEW_INPUT_INDEX_KIND_RELATION)) {
+                need = clew_idset_marked_range(&reader->clew->relation_ids, entry->min_id, entry->max_id);
         }
 
+        reader->read_blobs++;
+        if (need == 0) {
+                reader->read_blobs_skipped++;
+                return 1;
+        }
         return 0;
-skip:   return 1;
-bail:   return -1;
 }
 
-static int input_callback_select_way_end (struct clew_input *input, void *context)
+static int input_callback_extract_block (struct clew_input *input, void *context, const struct clew_input_block *block)
 {
         int rc;
         int match;
-
         uint64_t i;
-        uint64_t il;
-        uint64_t ref;
-
-        struct clew *clew = (struct clew *) context;
+        uint32_t tagset;
+        struct clew_way *way;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_WAY) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_WAY);
-                goto bail;
-        }
-        clew_stack_pop(&clew->read_state);
+        input_block_count(reader, block);
 
-        match = 0;
-        if (clew_stack_count(&clew->read_tags) > 0) {
-                clew_stack_sort_uint32(&clew->read_tags);
-                match = clew_expression_match(clew->options.filter, &clew->read_tags, NULL, NULL, NULL, tags_expression_match_has);
-        }
-        if (match == 0) {
-                goto out;
-        }
+        for (i = 0; i < block->nnodes; i++) {
+                rc = clew_idset_marked(&reader->clew->node_ids, block->node_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not read bitmap");
+                        goto bail;
+                } else if (rc == 0) {
+                        continue;
+                }
 
-        rc = clew_bitmap_mark(&clew->way_ids, clew->read_id);
-        if (rc < 0) {
-                clew_errorf("can not push way id");
-                goto bail;
-        }
+                tagset = CLEW_TAGSET_EMPTY;
+                if (reader->read_keep & CLEW_READ_STATE_NODE) {
+                        rc = input_block_tagset(reader, block, block->node_tags[i], block->node_tags[i + 1], CLEW_READ_STATE_NODE, &tagset);
+                        if (rc != 0) {
+                                goto bail;
+                        }
+                }
 
-        for (i = 0, il = clew_stack_count(&clew->read_refs); i < il; i++) {
-                ref = clew_stack_at_uint64(&clew->read_refs, i);
-                rc = clew_bitmap_mark(&clew->node_ids, ref);
+                rc = clew_node_store_push(reader->nodes, block->node_ids[i], block->node_lons[i], block->node_lats[i], tagset);
                 if (rc < 0) {
-                        clew_errorf("can not push node id");
+                        clew_errorf("can not push node");
                         goto bail;
                 }
         }
 
-out:    return 0;
-bail:   return -1;
-}
+        for (i = 0; i < block->nways; i++) {
+                rc = clew_idset_marked(&reader->clew->way_ids, block->way_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not read bitmap");
+                        goto bail;
+                } else if (rc == 0) {
+                        continue;
+                }
 
-static int input_callback_select_relation_start (struct clew_input *input, void *context)
-{
-        struct clew *clew = (struct clew *) context;
+                way = (struct clew_way *) clew_arena_alloc(reader->arena, sizeof(struct clew_way));
+                if (way == NULL) {
+                        clew_errorf("can not allocate memory");
+                        goto bail;
+                }
+                memset(way, 0, sizeof(struct clew_way));
 
-        (void) input;
+                way->id = block->way_ids[i];
 
-        if (clew->read_relation_start == 0) {
-                clew_infof("      reading relations");
-        }
-        clew->read_relation_start++;
+                way->tagset = CLEW_TAGSET_EMPTY;
+                if (reader->read_keep & CLEW_READ_STATE_WAY) {
+                        rc = input_block_tagset(reader, block, block->way_tags[i], block->way_tags[i + 1], CLEW_READ_STATE_WAY, &way->tagset);
+                        if (rc != 0) {
+                                goto bail;
+                        }
+                }
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_UNKNOWN) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_UNKNOWN);
-                goto bail;
-        }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_RELATION);
+                rc = clew_way_set_refs(reader->arena, way, block->refs + block->way_refs[i], block->way_refs[i + 1] - block->way_refs[i]);
+                if (rc < 0) {
+                        goto bail;
+                }
 
-        clew_stack_reset(&clew->read_tags);
-        clew_stack_reset(&clew->read_refs);
+                rc = clew_stack_push(&reader->ways, &way);
+                if (rc < 0) {
+                        clew_errorf("can not push way");
+                        goto bail;
+                }
+        }
 
-        if ((clew->read_keep & CLEW_READ_STATE_RELATION) == 0) {
-                goto skip;
+        for (i = 0; (reader->read_keep & CLEW_READ_STATE_RELATION) && i < block->nrelations; i++) {
+                match = input_block_match(reader, block, block->relation_tags[i], block->relation_tags[i + 1]);
+                if (match < 0) {
+                        goto bail;
+                } else if (match == 0) {
+                        continue;
+                }
+                rc = clew_idset_mark(reader->mark_relation_ids, block->relation_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not push relation id");
+                        goto bail;
+                }
         }
 
         return 0;
-skip:   return 1;
 bail:   return -1;
 }
 
-static int input_callback_select_relation_end (struct clew_input *input, void *context)
+static int input_callback_extract_bounds_start (struct clew_input *input, void *context)
 {
-        int rc;
-        int match;
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_RELATION) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_RELATION);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_UNKNOWN) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_UNKNOWN);
                 goto bail;
         }
-        clew_stack_pop(&clew->read_state);
+        clew_stack_push_uint32(&reader->read_state, CLEW_READ_STATE_BOUNDS);
 
-        match = 0;
-        if (clew_stack_count(&clew->read_tags) > 0) {
-                clew_stack_sort_uint32(&clew->read_tags);
-                match = clew_expression_match(clew->options.filter, &clew->read_tags, NULL, NULL, NULL, tags_expression_match_has);
-        }
-        if (match == 0) {
-                goto out;
-        }
+        return 0;
+bail:   return -1;
+}
 
-        rc = clew_bitmap_mark(&clew->relation_ids, clew->read_id);
-        if (rc < 0) {
-                clew_errorf("can not push relation id");
+static int input_callback_extract_bounds_end (struct clew_input *input, void *context)
+{
+        struct clew_reader *reader = (struct clew_reader *) context;
+
+        (void) input;
+
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
+        clew_stack_pop(&reader->read_state);
 
-out:    return 0;
+        return 0;
 bail:   return -1;
 }
 
-static int input_callback_select_tag_start (struct clew_input *input, void *context)
+static int input_callback_extract_minlon (struct clew_input *input, void *context, int32_t lon)
 {
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
+        (void) lon;
 
-        if ((clew_stack_peek_uint32(&clew->read_state) & (CLEW_READ_STATE_NODE | CLEW_READ_STATE_WAY | CLEW_READ_STATE_RELATION)) == 0) {
-                clew_errorf("read_state is invalid, %d != %d | %d | %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE, CLEW_READ_STATE_WAY, CLEW_READ_STATE_RELATION);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_TAG);
-
-        clew->read_tag_k[0] = '\0';
-        clew->read_tag_v[0] = '\0';
 
         return 0;
 bail:   return -1;
 }
 
-static int input_callback_select_tag_end (struct clew_input *input, void *context)
+static int input_callback_extract_minlat (struct clew_input *input, void *context, int32_t lat)
 {
-        int rc;
-        int kl;
-        int vl;
-        int sl;
-        uint32_t tag;
-
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
+        (void) lat;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_TAG) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_TAG);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
-        clew_stack_pop(&clew->read_state);
 
-        kl = strlen(clew->read_tag_k);
-        if (kl <= 0) {
-                clew_debugf("k is invalid: %s = %s", clew->read_tag_k, clew->read_tag_v);
-                goto out;
-        }
-        vl = strlen(clew->read_tag_v);
-        if (vl <= 0) {
-                clew_debugf("v is invalid: %s = %s", clew->read_tag_k, clew->read_tag_v);
-                goto out;
-        }
-        if (kl + 1 + vl >= (int) sizeof(clew->read_tag_s)) {
-                clew_errorf("tag string too long: %s_%s", clew->read_tag_k, clew->read_tag_v);
-                goto out;
-        }
-
-        parse_tag_fix(clew->read_tag_k, clew->read_tag_v);
-
-        sl = 0;
-        clew->read_tag_s[sl] = '\0';
-        memcpy(clew->read_tag_s + sl, clew->read_tag_k, kl); sl += kl;
-        memcpy(clew->read_tag_s + sl, "_", 1);               sl += 1;
-        memcpy(clew->read_tag_s + sl, clew->read_tag_v, vl); sl += vl;
-        clew->read_tag_s[sl] = '\0';
-
-        tag = clew_tag_value(clew->read_tag_s);
-        if (tag == clew_tag_unknown) {
-                //clew_todof("tag is invalid, '%s' = '%s'", clew->read_tag_k, clew->read_tag_v);
-                goto out;
-        }
-
-        rc = clew_stack_push_uint32(&clew->read_tags, tag);
-        if (rc != 0) {
-                clew_errorf("can not add tag");
-                goto bail;
-        }
-
-out:    return 0;
+        return 0;
 bail:   return -1;
 }
 
-static int input_callback_select_nd_start (struct clew_input *input, void *context)
+static int input_callback_extract_maxlon (struct clew_input *input, void *context, int32_t lon)
 {
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
+        (void) lon;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_WAY) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_WAY);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_ND);
 
         return 0;
 bail:   return -1;
 }
 
-static int input_callback_select_nd_end (struct clew_input *input, void *context)
+static int input_callback_extract_maxlat (struct clew_input *input, void *context, int32_t lat)
 {
-        struct clew *clew = (struct clew *) context;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
+        (void) lat;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_ND) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_ND);
+        if (clew_stack_peek_uint32(&reader->read_state) != CLEW_READ_STATE_BOUNDS) {
+                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&reader->read_state), CLEW_READ_STATE_BOUNDS);
                 goto bail;
         }
-        clew_stack_pop(&clew->read_state);
 
         return 0;
 bail:   return -1;
 }
 
-static int input_callback_select_member_start (struct clew_input *input, void *context)
+static int input_callback_extract_error (struct clew_input *input, void *context, unsigned int reason)
 {
-        struct clew *clew = (struct clew *) context;
-
+        struct clew_reader *reader = (struct clew_reader *) context;
         (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_RELATION) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_RELATION);
-                goto bail;
-        }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_MEMBER);
-
+        (void) reader;
+        (void) reason;
         return 0;
-bail:   return -1;
 }
 
-static int input_callback_select_member_end (struct clew_input *input, void *context)
+static int input_callback_single_block (struct clew_input *input, void *context, const struct clew_input_block *block)
 {
-        struct clew *clew = (struct clew *) context;
+        int rc;
+        int match;
+        uint64_t i;
+        uint32_t tagset;
+        struct clew_way *way;
+        struct clew_reader *reader = (struct clew_reader *) context;
 
         (void) input;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_MEMBER) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_MEMBER);
-                goto bail;
-        }
-        clew_stack_pop(&clew->read_state);
-
-        return 0;
-bail:   return -1;
-}
+        input_block_count(reader, block);
 
-static int input_callback_select_minlon (struct clew_input *input, void *context, int32_t lon)
-{
-        struct clew *clew = (struct clew *) context;
+        for (i = 0; i < block->nnodes; i++) {
+                rc = clew_location_push(reader->locations, block->node_ids[i], block->node_lons[i], block->node_lats[i]);
+                if (rc < 0) {
+                        clew_errorf("can not push location");
+                        goto bail;
+                }
+                if ((reader->read_keep & CLEW_READ_STATE_NODE) == 0) {
+                        continue;
+                }
+                match = input_block_match(reader, block, block->node_tags[i], block->node_tags[i + 1]);
+                if (match < 0) {
+                        goto bail;
+                } else if (match == 0) {
+                        continue;
+                }
+                rc = clew_idset_mark(reader->mark_node_ids, block->node_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not push node id");
+                        goto bail;
+                } else if (rc == 0) {
+                        continue;
+                }
 
-        (void) input;
-        (void) lon;
+                rc = input_block_tagset(reader, block, block->node_tags[i], block->node_tags[i + 1], CLEW_READ_STATE_NODE, &tagset);
+                if (rc != 0) {
+                        goto bail;
+                }
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
+                rc = clew_node_store_push(reader->nodes, block->node_ids[i], block->node_lons[i], block->node_lats[i], tagset);
+                if (rc < 0) {
+                        clew_errorf("can not push node");
+                        goto bail;
+                }
         }
 
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_select_minlat (struct clew_input *input, void *context, int32_t lat)
-{
-        struct clew *clew = (struct clew *) context;
+        for (i = 0; (reader->read_keep & CLEW_READ_STATE_WAY) && i < block->nways; i++) {
+                match = input_block_match(reader, block, block->way_tags[i], block->way_tags[i + 1]);
+                if (match < 0) {
+                        goto bail;
+                } else if (match == 0) {
+                        continue;
+                }
+                rc = clew_idset_mark(reader->mark_way_ids, block->way_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not push way id");
+                        goto bail;
+                } else if (rc == 0) {
+                        continue;
+                }
 
-        (void) input;
-        (void) lat;
+                way = (struct clew_way *) clew_arena_alloc(reader->arena, sizeof(struct clew_way));
+                if (way == NULL) {
+                        clew_errorf("can not allocate memory");
+                        goto bail;
+                }
+                memset(way, 0, sizeof(struct clew_way));
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
-        }
+                way->id = block->way_ids[i];
 
-        return 0;
-bail:   return -1;
-}
+                rc = input_block_tagset(reader, block, block->way_tags[i], block->way_tags[i + 1], CLEW_READ_STATE_WAY, &way->tagset);
+                if (rc != 0) {
+                        goto bail;
+                }
 
-static int input_callback_select_maxlon (struct clew_input *input, void *context, int32_t lon)
-{
-        struct clew *clew = (struct clew *) context;
+                rc = clew_way_set_refs(reader->arena, way, block->refs + block->way_refs[i], block->way_refs[i + 1] - block->way_refs[i]);
+                if (rc < 0) {
+                        goto bail;
+                }
 
-        (void) input;
-        (void) lon;
+                rc = clew_stack_push(&reader->ways, &way);
+                if (rc < 0) {
+                        clew_errorf("can not push way");
+                        goto bail;
+                }
+        }
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
+        for (i = 0; (reader->read_keep & CLEW_READ_STATE_RELATION) && i < block->nrelations; i++) {
+                match = input_block_match(reader, block, block->relation_tags[i], block->relation_tags[i + 1]);
+                if (match < 0) {
+                        goto bail;
+                } else if (match == 0) {
+                        continue;
+                }
+                rc = clew_idset_mark(reader->mark_relation_ids, block->relation_ids[i]);
+                if (rc < 0) {
+                        clew_errorf("can not push relation id");
+                        goto bail;
+                }
         }
 
         return 0;
 bail:   return -1;
 }
 
-static int input_callback_select_maxlat (struct clew_input *input, void *context, int32_t lat)
+static void * clew_reader_thread (void *context)
 {
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-        (void) lat;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
-        }
-
-        return 0;
-bail:   return -1;
+        struct clew_reader *reader = (struct clew_reader *) context;
+        reader->error = (clew_reader_read(reader) < 0);
+        return NULL;
 }
 
-static int input_callback_select_id (struct clew_input *input, void *context, uint64_t id)
+static int clew_reader_read (struct clew_reader *reader)
 {
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
+        int rc;
+        struct clew_input *input;
 
-        if ((clew_stack_peek_uint32(&clew->read_state) & (CLEW_READ_STATE_NODE | CLEW_READ_STATE_WAY | CLEW_READ_STATE_RELATION)) == 0) {
-                clew_errorf("read_state is invalid, %d != %d | %d | %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE, CLEW_READ_STATE_WAY, CLEW_READ_STATE_RELATION);
+        input = clew_input_create(&reader->input_init_options);
+        if (input == NULL) {
+                clew_errorf("can not create input for path: %s", reader->path);
                 goto bail;
         }
-
-        clew->read_id = id;
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_select_lon (struct clew_input *input, void *context, int32_t lon)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_NODE) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE);
+        while (clew_input_read(input) == 0) {
+                rc = clew_input_get_error(input);
+                if (rc != 0) {
+                        clew_errorf("input error occured, path: %s, error: %d", reader->path, rc);
+                        goto bail;
+                }
+        }
+        rc = clew_input_get_error(input);
+        if (rc != 0) {
+                clew_errorf("input error occured, path: %s, error: %d", reader->path, rc);
                 goto bail;
         }
-
-        clew->read_lon = lon;
+        clew_input_destroy(input);
 
         return 0;
-bail:   return -1;
+bail:   if (input != NULL) {
+                clew_input_destroy(input);
+        }
+        return -1;
 }
 
-static int input_callback_select_lat (struct clew_input *input, void *context, int32_t lat)
+static void clew_reader_destroy (struct clew_reader *reader)
 {
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_NODE) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE);
-                goto bail;
+        if (reader == NULL) {
+                return;
         }
-
-        clew->read_lat = lat;
-
-        return 0;
-bail:   return -1;
+        clew_stack_uninit(&reader->read_state);
+        clew_stack_uninit(&reader->read_tags);
+        clew_expression_destroy(reader->filter);
+        clew_tagset_destroy(reader->tagsets);
+        clew_stack_uninit(&reader->tagset_ids);
+        clew_idset_uninit(&reader->node_ids);
+        clew_idset_uninit(&reader->way_ids);
+        clew_idset_uninit(&reader->relation_ids);
+        clew_node_store_destroy(reader->nodes);
+        clew_stack_uninit(&reader->ways);
+        clew_arena_destroy(reader->arena);
+        clew_location_destroy(reader->locations);
+        free(reader);
 }
 
-static int input_callback_select_ref (struct clew_input *input, void *context, uint64_t ref)
+static struct clew_reader * clew_reader_add (struct clew *clew, const char *path)
 {
         int rc;
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
+        struct clew_reader *reader;
 
-        if ((clew_stack_peek_uint32(&clew->read_state) & (CLEW_READ_STATE_ND | CLEW_READ_STATE_MEMBER | CLEW_READ_STATE_RELATION)) == 0) {
-                clew_errorf("read_state is invalid, %d != %d || %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_ND, CLEW_READ_STATE_MEMBER);
+        reader = (struct clew_reader *) malloc(sizeof(struct clew_reader));
+        if (reader == NULL) {
+                clew_errorf("can not allocate memory");
                 goto bail;
         }
+        memset(reader, 0, sizeof(struct clew_reader));
 
-        rc = clew_stack_push_uint64(&clew->read_refs, ref);
+        reader->clew            = clew;
+        reader->path            = path;
+        reader->read_state      = clew_stack_init(sizeof(uint32_t));
+        reader->read_tags       = clew_stack_init(sizeof(uint32_t));
+        reader->tagset_ids      = clew_stack_init2(sizeof(uint32_t), 4096);
+        reader->node_ids        = clew_idset_init(CLEW_IDSET_MODE_SPARSE);
+        reader->way_ids         = clew_idset_init(CLEW_IDSET_MODE_SPARSE);
+        reader->relation_ids    = clew_idset_init(CLEW_IDSET_MODE_SPARSE);
+        reader->mark_node_ids           = clew_idset_concurrent(&clew->node_ids)     ? &clew->node_ids     : &reader->node_ids;
+        reader->mark_way_ids            = clew_idset_concurrent(&clew->way_ids)      ? &clew->way_ids      : &reader->way_ids;
+        reader->mark_relation_ids       = clew_idset_concurrent(&clew->relation_ids) ? &clew->relation_ids : &reader->relation_ids;
+        reader->ways            = clew_stack_init2(sizeof(struct clew_way *), 64 * 1024);
+        reader->locations       = NULL;
+
+        reader->arena = clew_arena_create(0);
+        if (reader->arena == NULL) {
+                clew_errorf("can not create arena");
+                goto bail;
+        }
+        reader->nodes = clew_node_store_create();
+        if (reader->nodes == NULL) {
+                clew_errorf("can not create node store");
+                goto bail;
+        }
+        reader->filter = clew_expression_clone(clew->options.filter);
+        if (reader->filter == NULL) {
+                clew_errorf("can not clone filter");
+                goto bail;
+        }
+        reader->tagsets = clew_tagset_create();
+        if (reader->tagsets == NULL) {
+                clew_errorf("can not create tag sets");
+                goto bail;
+        }
+        rc = clew_stack_push_uint32(&reader->tagset_ids, CLEW_TAGSET_EMPTY);
         if (rc < 0) {
-                clew_errorf("can not push ref");
+                clew_errorf("can not push tag set");
                 goto bail;
         }
+        /* readers run side by side with the merged store, the limit is shared among them */
+        clew_node_store_set_limit(reader->nodes, clew->options.memory_limit / (clew_stack_count(&clew->options.inputs) + 1));
 
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_select_type (struct clew_input *input, void *context, const char *type)
-{
-        struct clew *clew = (struct clew *) context;
+        clew_stack_push_uint32(&reader->read_state, CLEW_READ_STATE_UNKNOWN);
+        reader->read_keep  = clew->options.keep_nodes     ? CLEW_READ_STATE_NODE     : 0;
+        reader->read_keep |= clew->options.keep_ways      ? CLEW_READ_STATE_WAY      : 0;
+        reader->read_keep |= clew->options.keep_relations ? CLEW_READ_STATE_RELATION : 0;
 
-        (void) input;
-        (void) type;
+        clew_input_init_options_default(&reader->input_init_options);
+        reader->input_init_options.path                 = path;
+        reader->input_init_options.threads              = clew->options.threads;
+        reader->input_init_options.mmap                 = clew->options.mmap;
+        reader->input_init_options.callback_context     = reader;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_MEMBER) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_MEMBER);
+        rc = clew_stack_push(&clew->readers, &reader);
+        if (rc < 0) {
+                clew_errorf("can not push reader");
                 goto bail;
         }
 
-        return 0;
-bail:   return -1;
+        return reader;
+bail:   clew_reader_destroy(reader);
+        return NULL;
 }
 
-static int input_callback_select_role (struct clew_input *input, void *context, const char *role)
+static void clew_readers_reset (struct clew *clew)
 {
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-        (void) role;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_MEMBER) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_MEMBER);
-                goto bail;
+        uint64_t i;
+        uint64_t il;
+        for (i = 0, il = clew_stack_count(&clew->readers); i < il; i++) {
+                clew_reader_destroy(*(struct clew_reader **) clew_stack_at(&clew->readers, i));
         }
-
-        return 0;
-bail:   return -1;
+        clew_stack_reset(&clew->readers);
 }
 
-static int input_callback_select_k (struct clew_input *input, void *context, const char *k)
+/* reads every input on its own thread, a single input is read in place */
+static int clew_readers_read (struct clew *clew)
 {
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
+        int rc;
+        int error;
+        uint64_t i;
+        uint64_t il;
+        uint64_t started;
+        struct clew_reader *reader;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_TAG) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_TAG);
-                goto bail;
+        error = 0;
+        il    = clew_stack_count(&clew->readers);
+        if (il == 1) {
+                reader = *(struct clew_reader **) clew_stack_at(&clew->readers, 0);
+                return clew_reader_read(reader);
         }
 
-        strncpy(clew->read_tag_k, k, sizeof(clew->read_tag_k) - 1);
-        clew->read_tag_k[sizeof(clew->read_tag_k) - 1] = '\0';
+        for (started = 0; started < il; started++) {
+                reader = *(struct clew_reader **) clew_stack_at(&clew->readers, started);
+                rc = pthread_create(&reader->thread, NULL, clew_reader_thread, reader);
+                if (rc != 0) {
+                        clew_errorf("can not create reader thread");
+                        error = 1;
+                        break;
+                }
+        }
+        for (i = 0; i < started; i++) {
+                reader = *(struct clew_reader **) clew_stack_at(&clew->readers, i);
+                pthread_join(reader->thread, NULL);
+                error |= reader->error;
+        }
 
-        return 0;
-bail:   return -1;
+        return (error) ? -1 : 0;
 }
 
-static int input_callback_select_v (struct clew_input *input, void *context, const char *v)
+/* ors reader selections into clew, and moves extracted elements over */
+static int clew_readers_merge (struct clew *clew)
 {
-        struct clew *clew = (struct clew *) context;
+        int rc;
+        uint64_t i;
+        uint64_t il;
+        uint64_t j;
+        uint64_t jl;
+        struct clew_reader *reader;
 
-        (void) input;
+        clew->read_node_start     = 0;
+        clew->read_way_start      = 0;
+        clew->read_relation_start = 0;
+        clew->read_blobs          = 0;
+        clew->read_blobs_skipped  = 0;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_TAG) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_TAG);
-                goto bail;
-        }
+        for (i = 0, il = clew_stack_count(&clew->readers); i < il; i++) {
+                reader = *(struct clew_reader **) clew_stack_at(&clew->readers, i);
 
-        strncpy(clew->read_tag_v, v, sizeof(clew->read_tag_v) - 1);
-        clew->read_tag_v[sizeof(clew->read_tag_v) - 1] = '\0';
+                rc  = clew_idset_or(&clew->node_ids, &reader->node_ids);
+                rc |= clew_idset_or(&clew->way_ids, &reader->way_ids);
+                rc |= clew_idset_or(&clew->relation_ids, &reader->relation_ids);
+                if (rc != 0) {
+                        clew_errorf("can not merge selection");
+                        goto bail;
+                }
 
-        return 0;
-bail:   return -1;
-}
+                rc = clew_node_store_append(clew->nodes, reader->nodes);
+                if (rc < 0) {
+                        clew_errorf("can not merge nodes");
+                        goto bail;
+                }
+                clew_node_store_reset(reader->nodes);
 
-static int input_callback_select_error (struct clew_input *input, void *context, unsigned int reason)
-{
-        struct clew *clew = (struct clew *) context;
-        (void) input;
-        (void) clew;
-        (void) reason;
-        return 0;
-}
+                rc = clew_stack_reserve(&clew->ways, clew_stack_count(&clew->ways) + clew_stack_count(&reader->ways));
+                if (rc < 0) {
+                        clew_errorf("can not reserve ways");
+                        goto bail;
+                }
+                for (j = 0, jl = clew_stack_count(&reader->ways); j < jl; j++) {
+                        clew_stack_push(&clew->ways, clew_stack_at(&reader->ways, j));
+                }
+                clew_stack_reset(&reader->ways);
 
-static int input_callback_extract_bounds_start (struct clew_input *input, void *context)
-{
-        struct clew *clew = (struct clew *) context;
+                rc = clew_stack_push(&clew->arenas, &reader->arena);
+                if (rc < 0) {
+                        clew_errorf("can not push arena");
+                        goto bail;
+                }
+                reader->arena = NULL;
 
-        (void) input;
+                clew->read_node_start     += reader->read_node_start;
+                clew->read_way_start      += reader->read_way_start;
+                clew->read_relation_start += reader->read_relation_start;
+                clew->read_blobs          += reader->read_blobs;
+                clew->read_blobs_skipped  += reader->read_blobs_skipped;
 
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_UNKNOWN) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_UNKNOWN);
-                goto bail;
+                clew_expression_stats_add(&clew->filter_stats, &reader->filter_stats);
+                memset(&reader->filter_stats, 0, sizeof(reader->filter_stats));
         }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_BOUNDS);
 
         return 0;
 bail:   return -1;
 }
 
-static int input_callback_extract_bounds_end (struct clew_input *input, void *context)
+static void reader_stack_destroy_element (void *context, void *elem)
 {
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
-        }
-        clew_stack_pop(&clew->read_state);
-
-        return 0;
-bail:   return -1;
+        (void) context;
+        clew_reader_destroy(*(struct clew_reader **) elem);
 }
 
-static int input_callback_extract_node_start (struct clew_input *input, void *context)
+static void input_index_stack_destroy_element (void *context, void *elem)
 {
-        struct clew *clew = (struct clew *) context;
+        (void) context;
+        clew_input_index_destroy(*(struct clew_input_index **) elem);
+}
 
-        (void) input;
+static void arena_stack_destroy_element (void *context, void *elem)
+{
+        (void) context;
+        clew_arena_destroy(*(struct clew_arena **) elem);
+}
 
-        if (clew->read_node_start == 0) {
-                clew_infof("      reading nodes");
+static int clew_way_set_refs (struct clew_arena *arena, struct clew_way *way, const uint64_t *refs, uint32_t nrefs)
+{
+        way->nrefs = nrefs;
+        way->srefs = 0;
+        way->refs  = NULL;
+        if (nrefs == 0) {
+                return 0;
         }
-        clew->read_node_start++;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_UNKNOWN) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_UNKNOWN);
-                goto bail;
+        way->srefs = clew_delta_encoded_size(refs, nrefs);
+        way->refs  = (uint8_t *) clew_arena_alloc(arena, way->srefs);
+        if (way->refs == NULL) {
+                clew_errorf("can not allocate memory");
+                return -1;
         }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_NODE);
-
-        clew_stack_reset(&clew->read_tags);
-
+        clew_delta_encode(way->refs, refs, nrefs);
         return 0;
-bail:   return -1;
 }
 
-static int input_callback_extract_node_end (struct clew_input *input, void *context)
+/* type of the highest ranked routable highway tag, with the way's own oneway and maxspeed if it has them */
+static void clew_mesh_way_classify (const uint32_t *tags, uint32_t ntags, struct clew_mesh_way_type *type)
 {
-        int rc;
-        struct clew_node *node;
-
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_NODE) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE);
-                goto bail;
-        }
-        clew_stack_pop(&clew->read_state);
-
-        rc = clew_bitmap_marked(&clew->node_ids, clew->read_id);
-        if (rc < 0) {
-                clew_errorf("can not read bitmap");
-                goto bail;
-        } else if (rc == 0) {
-                goto out;
-        }
-
-        node = (struct clew_node *) malloc(sizeof(struct clew_node));
-        if (node == NULL) {
-                clew_errorf("can not allocate memory");
-                goto bail;
-        }
-        memset(node, 0, sizeof(struct clew_node));
-
-        node->id  = clew->read_id;
-        node->lon = clew->read_lon;
-        node->lat = clew->read_lat;
-
-        node->ntags = clew_stack_count(&clew->read_tags);
-        if (node->ntags > 0) {
-                node->tags  = (uint32_t *) malloc(sizeof(uint32_t) * node->ntags);
-                if (node->tags == NULL) {
-                        clew_errorf("can not allocate memory");
-                        goto bail;
+        uint32_t t;
+        uint32_t rank;
+        uint32_t oneway;
+        uint32_t maxspeed;
+        const struct clew_tag_property *property;
+
+        rank     = 0;
+        oneway   = clew_tag_unknown;
+        maxspeed = clew_tag_unknown;
+        for (t = 0; t < ntags; t++) {
+                property = &clew_tag_properties[tags[t]];
+                if (property->highway != 0 && (rank == 0 || property->highway < rank)) {
+                        rank = property->highway;
                 }
-                memcpy(node->tags, clew_stack_buffer(&clew->read_tags), sizeof(uint32_t) * node->ntags);
-        }
-
-        rc = clew_stack_push(&clew->nodes, &node);
-        if (rc < 0) {
-                clew_errorf("can not push node");
-                clew_node_destroy(node);
-                goto bail;
-        }
-
-out:    return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_way_start (struct clew_input *input, void *context)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew->read_way_start == 0) {
-                clew_infof("      reading ways");
-        }
-        clew->read_way_start++;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_UNKNOWN) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_UNKNOWN);
-                goto bail;
-        }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_WAY);
-
-        clew_stack_reset(&clew->read_tags);
-        clew_stack_reset(&clew->read_refs);
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_way_end (struct clew_input *input, void *context)
-{
-        int rc;
-        struct clew_way *way;
-
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        way = NULL;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_WAY) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_WAY);
-                goto bail;
-        }
-        clew_stack_pop(&clew->read_state);
-
-        rc = clew_bitmap_marked(&clew->way_ids, clew->read_id);
-        if (rc < 0) {
-                clew_errorf("can not read bitmap");
-                goto bail;
-        } else if (rc == 0) {
-                goto out;
-        }
-
-        way = (struct clew_way *) malloc(sizeof(struct clew_way));
-        if (way == NULL) {
-                clew_errorf("can not allocate memory");
-                goto bail;
-        }
-        memset(way, 0, sizeof(struct clew_way));
-
-        way->id = clew->read_id;
-
-        way->ntags = clew_stack_count(&clew->read_tags);
-        if (way->ntags > 0) {
-                way->tags  = (uint32_t *) malloc(sizeof(uint32_t) * way->ntags);
-                if (way->tags == NULL) {
-                        clew_errorf("can not allocate memory");
-                        goto bail;
+                if (property->oneway != CLEW_TAG_ONEWAY_NONE && oneway == clew_tag_unknown) {
+                        oneway = tags[t];
                 }
-                memcpy(way->tags, clew_stack_buffer(&clew->read_tags), sizeof(uint32_t) * way->ntags);
-        }
-
-        way->nrefs = clew_stack_count(&clew->read_refs);
-        if (way->nrefs > 0) {
-                way->refs  = (uint64_t *) malloc(sizeof(uint64_t) * way->nrefs);
-                if (way->refs == NULL) {
-                        clew_errorf("can not allocate memory");
-                        goto bail;
+                if ((property->groups & CLEW_TAG_GROUP_BIT(clew_tag_group_maxspeed)) && maxspeed == clew_tag_unknown) {
+                        maxspeed = tags[t];
                 }
-                memcpy(way->refs, clew_stack_buffer(&clew->read_refs), sizeof(uint64_t) * way->nrefs);
-        }
-
-        rc = clew_stack_push(&clew->ways, &way);
-        if (rc < 0) {
-                clew_errorf("can not push way");
-                goto bail;
-        }
-
-out:    return 0;
-bail:   if (way != NULL) {
-                clew_way_destroy(way);
-        }
-        return -1;
-}
-
-static int input_callback_extract_relation_start (struct clew_input *input, void *context)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew->read_relation_start == 0) {
-                clew_infof("      reading relations");
-        }
-        clew->read_relation_start++;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_UNKNOWN) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_UNKNOWN);
-                goto bail;
-        }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_RELATION);
-
-        clew_stack_reset(&clew->read_tags);
-        clew_stack_reset(&clew->read_refs);
-
-        if ((clew->read_keep & CLEW_READ_STATE_RELATION) == 0) {
-                goto skip;
-        }
-
-        return 0;
-skip:   return 1;
-bail:   return -1;
-}
-
-static int input_callback_extract_relation_end (struct clew_input *input, void *context)
-{
-        int rc;
-        int match;
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_RELATION) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_RELATION);
-                goto bail;
         }
-        clew_stack_pop(&clew->read_state);
 
-        match = 0;
-        if (clew_stack_count(&clew->read_tags) > 0) {
-                clew_stack_sort_uint32(&clew->read_tags);
-                match = clew_expression_match(clew->options.filter, &clew->read_tags, NULL, NULL, NULL, tags_expression_match_has);
+        if (rank == 0) {
+                type->tag      = clew_tag_unknown;
+                type->oneway   = clew_tag_oneway_no;
+                type->maxspeed = clew_tag_maxspeed_20;
+                return;
         }
-        if (match == 0) {
-                goto out;
+        *type = clew_mesh_way_types[rank - 1];
+        if (oneway != clew_tag_unknown) {
+                type->oneway = oneway;
         }
-
-        rc = clew_bitmap_mark(&clew->relation_ids, clew->read_id);
-        if (rc < 0) {
-                clew_errorf("can not push relation id");
-                goto bail;
+        if (maxspeed != clew_tag_unknown) {
+                type->maxspeed = maxspeed;
         }
-
-out:    return 0;
-bail:   return -1;
 }
 
-static int input_callback_extract_tag_start (struct clew_input *input, void *context)
-{
-        int read_state;
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        read_state = clew_stack_peek_uint32(&clew->read_state);
-        if ((read_state & (CLEW_READ_STATE_NODE | CLEW_READ_STATE_WAY | CLEW_READ_STATE_RELATION)) == 0) {
-                clew_errorf("read_state is invalid, %d != %d | %d | %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE, CLEW_READ_STATE_WAY, CLEW_READ_STATE_RELATION);
-                goto bail;
-        }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_TAG);
-
-        clew->read_tag_k[0] = '\0';
-        clew->read_tag_v[0] = '\0';
-
-        if ((clew->read_keep & read_state) == 0) {
-                goto skip;
-        }
-
-        return 0;
-skip:   return 1;
-bail:   return -1;
-}
-
-static int input_callback_extract_tag_end (struct clew_input *input, void *context)
+/*
+ * marks every tag id the keep expressions select on its own, so a tag is
+ * kept with a single bit test instead of evaluating the expressions. ways
+ * also keep the tags mesh way classification reads.
+ */
+static int clew_keep_tags_compile (struct clew_bitmap *bitmap, const struct clew_expression *all, const struct clew_expression *element, int mesh)
 {
         int rc;
-        int kl;
-        int vl;
-        int sl;
+        int keep;
         uint32_t tag;
 
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_TAG) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_TAG);
-                goto bail;
-        }
-        clew_stack_pop(&clew->read_state);
-
-        kl = strlen(clew->read_tag_k);
-        if (kl <= 0) {
-                clew_debugf("k is invalid: %s = %s", clew->read_tag_k, clew->read_tag_v);
-                goto out;
-        }
-        vl = strlen(clew->read_tag_v);
-        if (vl <= 0) {
-                clew_debugf("v is invalid: %s = %s", clew->read_tag_k, clew->read_tag_v);
-                goto out;
-        }
-        if (kl + 1 + vl >= (int) sizeof(clew->read_tag_s)) {
-                clew_errorf("tag string too long: %s_%s", clew->read_tag_k, clew->read_tag_v);
-                goto out;
-        }
-
-        parse_tag_fix(clew->read_tag_k, clew->read_tag_v);
-
-        sl = 0;
-        clew->read_tag_s[sl] = '\0';
-        memcpy(clew->read_tag_s + sl, clew->read_tag_k, kl); sl += kl;
-        memcpy(clew->read_tag_s + sl, "_", 1);               sl += 1;
-        memcpy(clew->read_tag_s + sl, clew->read_tag_v, vl); sl += vl;
-        clew->read_tag_s[sl] = '\0';
-
-        tag = clew_tag_value(clew->read_tag_s);
-        if (tag == clew_tag_unknown) {
-                //clew_todof("tag is invalid, '%s' = '%s'", clew->read_tag_k, clew->read_tag_v);
-                goto out;
-        }
-
-        rc = clew_stack_push_uint32(&clew->read_tags, tag);
-        if (rc != 0) {
-                clew_errorf("can not add tag");
-                goto bail;
-        }
-
-out:    return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_nd_start (struct clew_input *input, void *context)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_WAY) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_WAY);
-                goto bail;
-        }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_ND);
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_nd_end (struct clew_input *input, void *context)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_ND) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_ND);
-                goto bail;
-        }
-        clew_stack_pop(&clew->read_state);
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_member_start (struct clew_input *input, void *context)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_RELATION) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_RELATION);
-                goto bail;
-        }
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_MEMBER);
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_member_end (struct clew_input *input, void *context)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_MEMBER) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_MEMBER);
-                goto bail;
-        }
-        clew_stack_pop(&clew->read_state);
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_minlon (struct clew_input *input, void *context, int32_t lon)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-        (void) lon;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
-        }
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_minlat (struct clew_input *input, void *context, int32_t lat)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-        (void) lat;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
-        }
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_maxlon (struct clew_input *input, void *context, int32_t lon)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-        (void) lon;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
-        }
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_maxlat (struct clew_input *input, void *context, int32_t lat)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-        (void) lat;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_BOUNDS) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_BOUNDS);
-                goto bail;
-        }
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_id (struct clew_input *input, void *context, uint64_t id)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if ((clew_stack_peek_uint32(&clew->read_state) & (CLEW_READ_STATE_NODE | CLEW_READ_STATE_WAY | CLEW_READ_STATE_RELATION)) == 0) {
-                clew_errorf("read_state is invalid, %d != %d | %d | %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE, CLEW_READ_STATE_WAY, CLEW_READ_STATE_RELATION);
-                goto bail;
-        }
-
-        clew->read_id = id;
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_lon (struct clew_input *input, void *context, int32_t lon)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_NODE) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE);
-                goto bail;
-        }
-
-        clew->read_lon = lon;
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_lat (struct clew_input *input, void *context, int32_t lat)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_NODE) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_NODE);
-                goto bail;
-        }
-
-        clew->read_lat = lat;
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_ref (struct clew_input *input, void *context, uint64_t ref)
-{
-        int rc;
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if ((clew_stack_peek_uint32(&clew->read_state) & (CLEW_READ_STATE_ND | CLEW_READ_STATE_MEMBER | CLEW_READ_STATE_RELATION)) == 0) {
-                clew_errorf("read_state is invalid, %d != %d | %d | %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_ND, CLEW_READ_STATE_MEMBER, CLEW_READ_STATE_RELATION);
-                goto bail;
-        }
-
-        rc = clew_stack_push_uint64(&clew->read_refs, ref);
+        rc = clew_bitmap_reserve(bitmap, clew_tag_last);
         if (rc < 0) {
-                clew_errorf("can not push ref");
+                clew_errorf("can not reserve keep tags");
                 goto bail;
         }
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_type (struct clew_input *input, void *context, const char *type)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-        (void) type;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_MEMBER) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_MEMBER);
-                goto bail;
-        }
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_role (struct clew_input *input, void *context, const char *role)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-        (void) role;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_MEMBER) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_MEMBER);
-                goto bail;
-        }
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_k (struct clew_input *input, void *context, const char *k)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_TAG) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_TAG);
-                goto bail;
-        }
-
-        strncpy(clew->read_tag_k, k, sizeof(clew->read_tag_k) - 1);
-        clew->read_tag_k[sizeof(clew->read_tag_k) - 1] = '\0';
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_v (struct clew_input *input, void *context, const char *v)
-{
-        struct clew *clew = (struct clew *) context;
-
-        (void) input;
-
-        if (clew_stack_peek_uint32(&clew->read_state) != CLEW_READ_STATE_TAG) {
-                clew_errorf("read_state is invalid, %d != %d", clew_stack_peek_uint32(&clew->read_state), CLEW_READ_STATE_TAG);
-                goto bail;
-        }
-
-        strncpy(clew->read_tag_v, v, sizeof(clew->read_tag_v) - 1);
-        clew->read_tag_v[sizeof(clew->read_tag_v) - 1] = '\0';
-
-        return 0;
-bail:   return -1;
-}
-
-static int input_callback_extract_error (struct clew_input *input, void *context, unsigned int reason)
-{
-        struct clew *clew = (struct clew *) context;
-        (void) input;
-        (void) clew;
-        (void) reason;
-        return 0;
-}
-
-static int node_stack_compare_elements (const void *a, const void *b)
-{
-        const struct clew_node *t1 = *(const struct clew_node * const *)a;
-        const struct clew_node *t2 = *(const struct clew_node * const *)b;
-        if (t1->id < t2->id) return -1;
-        if (t1->id > t2->id) return 1;
+        clew_bitmap_reset(bitmap);
+        for (tag = clew_tag_unknown + 1; tag < clew_tag_last; tag++) {
+                keep = 0;
+                if (all != NULL) {
+                        keep |= clew_expression_match_tags(all, &tag, 1, NULL) > 0;
+                }
+                if (element != NULL) {
+                        keep |= clew_expression_match_tags(element, &tag, 1, NULL) > 0;
+                }
+                if (mesh) {
+                        keep |= clew_tag_highway_rank(tag) != 0;
+                        keep |= clew_tag_oneway_direction(tag) != CLEW_TAG_ONEWAY_NONE;
+                        keep |= (clew_tag_group_bits(tag) & CLEW_TAG_GROUP_BIT(clew_tag_group_maxspeed)) != 0;
+                }
+                if (keep) {
+                        rc = clew_bitmap_mark(bitmap, tag);
+                        if (rc < 0) {
+                                clew_errorf("can not mark keep tag");
+                                goto bail;
+                        }
+                }
+        }
         return 0;
-}
-
-static void node_stack_destroy_element (void *context, void *elem)
-{
-        (void) context;
-        clew_node_destroy(*(struct clew_node **) elem);
+bail:   return -1;
 }
 
 static int way_stack_compare_elements (const void *a, const void *b)
@@ -1860,10 +1533,26 @@ static int way_stack_compare_elements (const void *a, const void *b)
         return 0;
 }
 
-static void way_stack_destroy_element (void *context, void *elem)
+static uint64_t way_stack_unique (struct clew_stack *ways)
 {
-        (void) context;
-        clew_way_destroy(*(struct clew_way **) elem);
+        uint64_t i;
+        uint64_t il;
+        uint64_t n;
+        struct clew_way **buffer;
+
+        buffer = (struct clew_way **) clew_stack_buffer(ways);
+        for (i = 0, n = 0, il = clew_stack_count(ways); i < il; i++) {
+                if (n > 0 && buffer[n - 1]->id == buffer[i]->id) {
+                        /* keep the most complete copy of a way cut at an extract border */
+                        if (buffer[i]->nrefs > buffer[n - 1]->nrefs) {
+                                buffer[n - 1] = buffer[i];
+                        }
+                        continue;
+                }
+                buffer[n++] = buffer[i];
+        }
+        clew_stack_resize(ways, n);
+        return il - n;
 }
 
 static int relation_stack_compare_elements (const void *a, const void *b)
@@ -1883,8 +1572,8 @@ static void relation_stack_destroy_element (void *context, void *elem)
 
 static int mesh_node_pqueue_compare (const void *a, const void *b)
 {
-        const struct clew_mesh_node *t1 = (const struct clew_mesh_node *) a;
-        const struct clew_mesh_node *t2 = (const struct clew_mesh_node *) b;
+        const struct clew_mesh_search *t1 = (const struct clew_mesh_search *) a;
+        const struct clew_mesh_search *t2 = (const struct clew_mesh_search *) b;
         if (t1->pqueue_cost > t2->pqueue_cost) return 1;
         //if (t1->pqueue_cost < t2->pqueue_cost) return -1;
         return 0;
@@ -1892,13 +1581,13 @@ static int mesh_node_pqueue_compare (const void *a, const void *b)
 
 static void mesh_node_pqueue_setpos (void *a, uint64_t position)
 {
-        struct clew_mesh_node *t1 = (struct clew_mesh_node *) a;
+        struct clew_mesh_search *t1 = (struct clew_mesh_search *) a;
         t1->pqueue_pos = position;
 }
 
 static uint64_t mesh_node_pqueue_getpos (const void *a)
 {
-        const struct clew_mesh_node *t1 = (const struct clew_mesh_node *) a;
+        const struct clew_mesh_search *t1 = (const struct clew_mesh_search *) a;
         return t1->pqueue_pos;
 }
 
@@ -1910,29 +1599,27 @@ static void mesh_solution_stack_destroy_element (void *context, void *elem)
 }
 
 static int64_t clew_mesh_node_neighbours_count_depth (
-        struct clew_mesh_node *mnode,
+        struct clew *clew,
+        uint64_t mnode,
         int64_t depth,
         int64_t mdepth,
         int64_t count,
-        int64_t mcount,
-        khash_t(mesh_visited) *visited)
+        int64_t mcount)
 {
-        if (mnode == NULL || (mdepth > 0 && depth >= mdepth)) {
+        if (mdepth > 0 && depth >= mdepth) {
                 return 0;
         }
 
-        khint_t k = kh_get(mesh_visited, visited, mnode->node->id);
-        if (k != kh_end(visited)) {
+        uint32_t *visited = (uint32_t *) clew_stack_buffer(&clew->mesh_visited);
+        if (visited[mnode] == clew->mesh_visited_stamp) {
                 return 0;
         }
+        visited[mnode] = clew->mesh_visited_stamp;
 
-        int ret;
-        k = kh_put(mesh_visited, visited, mnode->node->id, &ret);
-        (void) k;
-        (void) ret;
+        uint64_t nl;
+        const struct clew_graph_edge *neighbours = clew_graph_edges(clew->mesh, mnode, &nl);
 
         int64_t total = 0;
-        uint64_t nl = clew_stack_count(&mnode->mesh_neighbours);
 
         total += nl;
         if (mcount > 0 && count + total >= mcount) {
@@ -1940,57 +1627,25 @@ static int64_t clew_mesh_node_neighbours_count_depth (
         }
 
         for (uint64_t n = 0; n < nl; n++) {
-                struct clew_mesh_node_neighbour *rneig = (struct clew_mesh_node_neighbour *) clew_stack_at(&mnode->mesh_neighbours, n);
-                if (rneig && rneig->mesh_node) {
-                        total += clew_mesh_node_neighbours_count_depth(rneig->mesh_node, depth + 1, mdepth, count + total, mcount, visited);
-                        if (mcount > 0 && count + total >= mcount) {
-                                return total;
-                        }
+                total += clew_mesh_node_neighbours_count_depth(clew, neighbours[n].node, depth + 1, mdepth, count + total, mcount);
+                if (mcount > 0 && count + total >= mcount) {
+                        return total;
                 }
         }
 
         return total;
 }
 
-static int64_t clew_mesh_node_neighbours_count (struct clew_mesh_node *mnode, int64_t mcount)
+/* the visited set is a stamp per mesh node, a new stamp clears it without touching memory */
+static int64_t clew_mesh_node_neighbours_count (struct clew *clew, uint64_t mnode, int64_t mcount)
 {
         const int64_t mdepth = 16;
-        khash_t(mesh_visited) *visited = kh_init(mesh_visited);
-        int64_t result = clew_mesh_node_neighbours_count_depth(mnode, 0, mdepth, 0, mcount, visited);
-        kh_destroy(mesh_visited, visited);
-        return result;
-}
-
-static void clew_mesh_node_destroy (struct clew_mesh_node *mnode)
-{
-        clew_stack_uninit(&mnode->mesh_ways);
-        clew_stack_uninit(&mnode->mesh_neighbours);
-        free(mnode);
-}
-
-static void clew_node_destroy (struct clew_node *node)
-{
-        if (node == NULL) {
-                return;
-        }
-        if (node->tags != NULL) {
-                free(node->tags);
-        }
-        free(node);
-}
-
-static void clew_way_destroy (struct clew_way *way)
-{
-        if (way == NULL) {
-                return;
-        }
-        if (way->tags != NULL) {
-                free(way->tags);
-        }
-        if (way->refs != NULL) {
-                free(way->refs);
+        clew->mesh_visited_stamp += 1;
+        if (clew->mesh_visited_stamp == 0) {
+                memset(clew_stack_buffer(&clew->mesh_visited), 0, sizeof(uint32_t) * clew_stack_count(&clew->mesh_visited));
+                clew->mesh_visited_stamp = 1;
         }
-        free(way);
+        return clew_mesh_node_neighbours_count_depth(clew, mnode, 0, mdepth, 0, mcount);
 }
 
 static void clew_relation_destroy (struct clew_relation *relation)
@@ -2025,6 +1680,62 @@ static int clew_clip_strategy_value (const char *strategy)
         return CLEW_CLIP_STRATEGY_UNKNOWN;
 }
 
+/*
+ * key of everything the mesh is built of: graph version, identity of the
+ * inputs, filter, clip and keep options, the way type table and the tag
+ * properties. returns 1 if the inputs can not be identified, stdin for
+ * example.
+ */
+static int clew_graph_cache_key (struct clew *clew, uint64_t *key)
+{
+        int rc;
+        uint64_t i;
+        uint64_t il;
+        int64_t value;
+        struct stat st;
+        const char *path;
+        const char *text;
+        struct clew_expression *expressions[5];
+
+        *key  = CLEW_GRAPH_KEY_INIT;
+        value = CLEW_GRAPH_VERSION;
+        *key  = clew_graph_key_update(*key, &value, sizeof(value));
+        for (i = 0, il = clew_stack_count(&clew->options.inputs); i < il; i++) {
+                path = *(const char **) clew_stack_at(&clew->options.inputs, i);
+                rc = stat(path, &st);
+                if (rc < 0 || !S_ISREG(st.st_mode)) {
+                        return 1;
+                }
+                *key  = clew_graph_key_update(*key, path, strlen(path) + 1);
+                value = st.st_size;
+                *key  = clew_graph_key_update(*key, &value, sizeof(value));
+                value = st.st_mtime;
+                *key  = clew_graph_key_update(*key, &value, sizeof(value));
+        }
+        expressions[0] = clew->options.filter;
+        expressions[1] = clew->options.keep_tags;
+        expressions[2] = clew->options.keep_tags_node;
+        expressions[3] = clew->options.keep_tags_way;
+        expressions[4] = clew->options.keep_tags_relation;
+        for (i = 0; i < sizeof(expressions) / sizeof(expressions[0]); i++) {
+                text = clew_expression_orig(expressions[i]);
+                *key = clew_graph_key_update(*key, (text != NULL) ? text : "", (text != NULL) ? strlen(text) + 1 : 1);
+        }
+        *key = clew_graph_key_update(*key, clew_stack_buffer(&clew->options.clip_path), sizeof(int32_t) * clew_stack_count(&clew->options.clip_path));
+        *key = clew_graph_key_update(*key, &clew->options.clip_strategy, sizeof(clew->options.clip_strategy));
+        *key = clew_graph_key_update(*key, &clew->options.keep_nodes, sizeof(clew->options.keep_nodes));
+        *key = clew_graph_key_update(*key, &clew->options.keep_ways, sizeof(clew->options.keep_ways));
+        *key = clew_graph_key_update(*key, &clew->options.keep_relations, sizeof(clew->options.keep_relations));
+        *key = clew_graph_key_update(*key, clew_mesh_way_types, sizeof(clew_mesh_way_types));
+        value = clew_tag_last;
+        *key  = clew_graph_key_update(*key, &value, sizeof(value));
+        *key  = clew_graph_key_update(*key, clew_tag_properties, sizeof(struct clew_tag_property) * clew_tag_last);
+        if (*key == 0) {
+                *key = 1;
+        }
+        return 0;
+}
+
 #include <vector>
 #include <limits>
 #include <algorithm>
@@ -2378,17 +2089,28 @@ int main (int argc, char *argv[])
         uint64_t r;
         uint64_t rl;
 
-        struct clew_input *input;
-        struct clew_input_init_options input_init_options;
+        struct clew_reader *reader;
+        int64_t duplicates;
+        uint64_t graph_key;
+        struct clew_input_index *input_index;
+        char input_index_path[4096];
 
         struct clew *clew;
 
         rs = 0;
+        graph_key = 0;
         clew = NULL;
 
         clew_debug_init();
         clew_tag_init();
 
+        for (i = 0; i < sizeof(clew_mesh_way_types) / sizeof(clew_mesh_way_types[0]); i++) {
+                if (clew_tag_highway_rank(clew_mesh_way_types[i].tag) != i + 1) {
+                        clew_errorf("mesh way type %s does not match its highway rank", clew_tag_string(clew_mesh_way_types[i].tag));
+                        goto bail;
+                }
+        }
+
         clew = (struct clew *) malloc(sizeof(struct clew));
         if (clew == NULL) {
                 clew_errorf("can not allocate memory");
@@ -2402,6 +2124,13 @@ int main (int argc, char *argv[])
         clew->options.clip_strategy             = CLEW_CLIP_STRATEGY_SMART;
         clew->options.filter                    = NULL;
         clew->options.points                    = clew_stack_init(sizeof(int32_t));
+        clew->options.threads                   = 1;
+        clew->options.mmap                      = 1;
+        clew->options.index                     = 0;
+        clew->options.single_pass               = 0;
+        clew->options.dense_ids                 = 0;
+        clew->options.memory_limit              = 0;
+        clew->options.graph_cache               = NULL;
         clew->options.keep_tags                 = NULL;
         clew->options.keep_tags_node            = NULL;
         clew->options.keep_tags_way             = NULL;
@@ -2411,19 +2140,37 @@ int main (int argc, char *argv[])
         clew->options.keep_relations            = 1;
 
         clew->state             = CLEW_STATE_INITIAL;
-        clew->read_state        = clew_stack_init(sizeof(uint32_t));
-        clew->read_tags         = clew_stack_init(sizeof(uint32_t));
-        clew->read_refs         = clew_stack_init(sizeof(uint64_t));
-        clew->node_ids          = clew_bitmap_init(64 * 1024);
-        clew->way_ids           = clew_bitmap_init(64 * 1024);
-        clew->relation_ids      = clew_bitmap_init(64 * 1024);
-        clew->nodes             = clew_stack_init4(sizeof(struct clew_node *), 64 * 1024, node_stack_destroy_element, NULL);
-        clew->ways              = clew_stack_init4(sizeof(struct clew_way *), 64 * 1024, way_stack_destroy_element, NULL);
+        clew->input_indexes     = clew_stack_init3(sizeof(struct clew_input_index *), input_index_stack_destroy_element, NULL);
+        clew->readers           = clew_stack_init3(sizeof(struct clew_reader *), reader_stack_destroy_element, NULL);
+        clew->arenas            = clew_stack_init3(sizeof(struct clew_arena *), arena_stack_destroy_element, NULL);
+        clew->tagsets           = clew_tagset_create();
+        clew->keep_tags_prune   = 0;
+        clew->keep_tags_node    = clew_bitmap_init(64 * 1024);
+        clew->keep_tags_way     = clew_bitmap_init(64 * 1024);
+        clew->nodes             = clew_node_store_create();
+        clew->ways              = clew_stack_init2(sizeof(struct clew_way *), 64 * 1024);
         clew->relations         = clew_stack_init4(sizeof(struct clew_relation *), 64 * 1024, relation_stack_destroy_element, NULL);
         clew->mesh_ways         = clew_stack_init2(sizeof(struct clew_mesh_way), 64 * 1024);
-        clew->mesh_nodes        = kh_init(mesh_nodes);
+        clew->mesh_way_types    = clew_stack_init2(sizeof(struct clew_mesh_way_type), 4096);
+        clew->mesh              = clew_graph_create();
+        clew->mesh_node_index   = clew_stack_init2(sizeof(uint64_t), 64 * 1024);
+        clew->mesh_visited      = clew_stack_init2(sizeof(uint32_t), 64 * 1024);
+        clew->mesh_visited_stamp = 0;
         clew->mesh_points       = clew_stack_init(sizeof(struct clew_mesh_point));
         clew->mesh_solutions    = clew_stack_init4(sizeof(struct clew_mesh_solution), 64, mesh_solution_stack_destroy_element, NULL);
+        pthread_mutex_init(&clew->tagsets_mutex, NULL);
+        if (clew->tagsets == NULL) {
+                clew_errorf("can not create tag sets");
+                goto bail;
+        }
+        if (clew->nodes == NULL) {
+                clew_errorf("can not create node store");
+                goto bail;
+        }
+        if (clew->mesh == NULL) {
+                clew_errorf("can not create mesh");
+                goto bail;
+        }
 
         optind = 1;
         while (1) {
@@ -2504,6 +2251,35 @@ int main (int argc, char *argv[])
                                         }
                                 }
                         }       break;
+                        case OPTION_THREADS:
+                                clew->options.threads = atoi(optarg);
+                                if (clew->options.threads < 1) {
+                                        clew_errorf("threads is invalid: %s", optarg);
+                                        goto bail;
+                                }
+                                break;
+                        case OPTION_MMAP:
+                                clew->options.mmap = !!atoi(optarg);
+                                break;
+                        case OPTION_INDEX:
+                                clew->options.index = !!atoi(optarg);
+                                break;
+                        case OPTION_SINGLE_PASS:
+                                clew->options.single_pass = !!atoi(optarg);
+                                break;
+                        case OPTION_DENSE_IDS:
+                                clew->options.dense_ids = !!atoi(optarg);
+                                break;
+                        case OPTION_MEMORY_LIMIT:
+                                if (atoll(optarg) < 0) {
+                                        clew_errorf("memory-limit is invalid: %s", optarg);
+                                        goto bail;
+                                }
+                                clew->options.memory_limit = (uint64_t) atoll(optarg) * 1024 * 1024;
+                                break;
+                        case OPTION_GRAPH_CACHE:
+                                clew->options.graph_cache = optarg;
+                                break;
                         case OPTION_KEEP_TAGS:
                                 if (clew->options.keep_tags != NULL) {
                                         clew_errorf("keep_tags already exists");
@@ -2749,6 +2525,17 @@ int main (int argc, char *argv[])
                 clew_errorf("filter is invalid, see help");
                 goto bail;
         }
+        for (i = 0, il = clew_stack_count(&clew->options.inputs); i < il; i++) {
+                if (strcmp(*(char **) clew_stack_at(&clew->options.inputs, i), "-") == 0 && clew->options.single_pass == 0) {
+                        clew_warningf("stdin input can only be read once, enabling single pass");
+                        clew->options.single_pass = 1;
+                }
+        }
+
+        clew->node_ids          = clew_idset_init(clew->options.dense_ids ? CLEW_IDSET_MODE_DENSE : CLEW_IDSET_MODE_SPARSE);
+        clew->way_ids           = clew_idset_init(clew->options.dense_ids ? CLEW_IDSET_MODE_DENSE : CLEW_IDSET_MODE_SPARSE);
+        clew->relation_ids      = clew_idset_init(clew->options.dense_ids ? CLEW_IDSET_MODE_DENSE : CLEW_IDSET_MODE_SPARSE);
+        clew_node_store_set_limit(clew->nodes, clew->options.memory_limit / (clew_stack_count(&clew->options.inputs) + 1));
 
         clew_infof("clew");
         clew_infof("  inputs             :");
@@ -2760,6 +2547,13 @@ int main (int argc, char *argv[])
         for (i = 0, il = clew_stack_count(&clew->options.points); i < il; i += 2) {
                 clew_infof("    %12.7f,%12.7f", clew_stack_at_int32(&clew->options.points, i + 0) / 1e7, clew_stack_at_int32(&clew->options.points, i + 1) / 1e7);
         }
+        clew_infof("  threads            : %d", clew->options.threads);
+        clew_infof("  mmap               : %d", clew->options.mmap);
+        clew_infof("  index              : %d", clew->options.index);
+        clew_infof("  single-pass        : %d", clew->options.single_pass);
+        clew_infof("  dense-ids          : %d", clew->options.dense_ids);
+        clew_infof("  memory-limit       : %ld", clew->options.memory_limit / (1024 * 1024));
+        clew_infof("  graph-cache        : %s", (clew->options.graph_cache != NULL) ? clew->options.graph_cache : "");
         clew_infof("  clip-path          : %ld", clew_stack_count(&clew->options.clip_path) / 2);
         for (i = 0, il = clew_stack_count(&clew->options.clip_path); i < il; i += 2) {
                 clew_infof("    %12.7f,%12.7f", clew_stack_at_int32(&clew->options.clip_path, i + 0) / 1e7, clew_stack_at_int32(&clew->options.clip_path, i + 1) / 1e7);
@@ -2774,6 +2568,24 @@ int main (int argc, char *argv[])
         clew_infof("  keep-keep_ways     : %d", clew->options.keep_ways);
         clew_infof("  keep-keep_relations: %d", clew->options.keep_relations);
 
+        /* without keep tags for an element type every recognized tag is stored */
+        if (clew->options.keep_tags != NULL || clew->options.keep_tags_node != NULL) {
+                rc = clew_keep_tags_compile(&clew->keep_tags_node, clew->options.keep_tags, clew->options.keep_tags_node, 0);
+                if (rc < 0) {
+                        goto bail;
+                }
+                clew->keep_tags_prune |= CLEW_READ_STATE_NODE;
+                clew_infof("  node tags kept     : %ld", clew_bitmap_count(&clew->keep_tags_node));
+        }
+        if (clew->options.keep_tags != NULL || clew->options.keep_tags_way != NULL) {
+                rc = clew_keep_tags_compile(&clew->keep_tags_way, clew->options.keep_tags, clew->options.keep_tags_way, 1);
+                if (rc < 0) {
+                        goto bail;
+                }
+                clew->keep_tags_prune |= CLEW_READ_STATE_WAY;
+                clew_infof("  way tags kept      : %ld", clew_bitmap_count(&clew->keep_tags_way));
+        }
+
         {
                 FILE *fp = fopen("output-points.gpx", "w+b");
 
@@ -2831,228 +2643,346 @@ int main (int argc, char *argv[])
                 fclose(fp);
         }
 
-        clew_infof("selecting");
-        clew->state = CLEW_STATE_SELECT;
+        if (clew->options.graph_cache != NULL) {
+                rc = clew_graph_cache_key(clew, &graph_key);
+                if (rc != 0) {
+                        clew_warningf("inputs can not be identified, not using graph cache");
+                        graph_key = 0;
+                } else {
+                        rc = clew_graph_load(clew->mesh, clew->options.graph_cache, graph_key);
+                        if (rc < 0) {
+                                clew_errorf("can not load graph cache: %s", clew->options.graph_cache);
+                                goto bail;
+                        } else if (rc == 0) {
+                                clew_infof("loaded graph cache: %s", clew->options.graph_cache);
+                                clew_infof("  nodes: %ld, edges: %ld", clew_graph_count(clew->mesh), clew_graph_edges_count(clew->mesh));
+                                clew->state = CLEW_STATE_BUILD_MESH;
+                                goto points;
+                        }
+                        clew_infof("graph cache is missing or stale: %s", clew->options.graph_cache);
+                }
+        }
 
-        clew_bitmap_reset(&clew->node_ids);
-        clew_bitmap_reset(&clew->way_ids);
-        clew_bitmap_reset(&clew->relation_ids);
+        if (clew->options.single_pass == 0) {
+                clew_infof("selecting");
+                clew->state = CLEW_STATE_SELECT;
 
-        clew_stack_reset(&clew->read_state);
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_UNKNOWN);
-        clew->read_keep  = clew->options.keep_nodes     ? CLEW_READ_STATE_NODE     : 0;
-        clew->read_keep |= clew->options.keep_ways      ? CLEW_READ_STATE_WAY      : 0;
-        clew->read_keep |= clew->options.keep_relations ? CLEW_READ_STATE_RELATION : 0;
+                clew_idset_reset(&clew->node_ids);
+                clew_idset_reset(&clew->way_ids);
+                clew_idset_reset(&clew->relation_ids);
 
-        clew->read_node_start     = 0;
-        clew->read_way_start      = 0;
-        clew->read_relation_start = 0;
+                clew_infof("  reading inputs");
+                for (i = 0, il = clew_stack_count(&clew->options.inputs); i < il; i++) {
+                        clew_infof("    %ld: %s", i, *(char **) clew_stack_at(&clew->options.inputs, i));
 
-        clew_infof("  reading inputs");
-        for (i = 0, il = clew_stack_count(&clew->options.inputs); i < il; i++) {
-                clew_infof("    %ld: %s", i, *(char **) clew_stack_at(&clew->options.inputs, i));
-
-                clew_input_init_options_default(&input_init_options);
-                input_init_options.path                         = *(char **) clew_stack_at(&clew->options.inputs, i);
-                input_init_options.callback_bounds_start        = input_callback_select_bounds_start;
-                input_init_options.callback_bounds_end          = input_callback_select_bounds_end;
-                input_init_options.callback_node_start          = input_callback_select_node_start;
-                input_init_options.callback_node_end            = input_callback_select_node_end;
-                input_init_options.callback_way_start           = input_callback_select_way_start;
-                input_init_options.callback_way_end             = input_callback_select_way_end;
-                input_init_options.callback_relation_start      = input_callback_select_relation_start;
-                input_init_options.callback_relation_end        = input_callback_select_relation_end;
-                input_init_options.callback_tag_start           = input_callback_select_tag_start;
-                input_init_options.callback_tag_end             = input_callback_select_tag_end;
-                input_init_options.callback_nd_start            = input_callback_select_nd_start;
-                input_init_options.callback_nd_end              = input_callback_select_nd_end;
-                input_init_options.callback_member_start        = input_callback_select_member_start;
-                input_init_options.callback_member_end          = input_callback_select_member_end;
-                input_init_options.callback_minlon              = input_callback_select_minlon;
-                input_init_options.callback_minlat              = input_callback_select_minlat;
-                input_init_options.callback_maxlon              = input_callback_select_maxlon;
-                input_init_options.callback_maxlat              = input_callback_select_maxlat;
-                input_init_options.callback_id                  = input_callback_select_id;
-                input_init_options.callback_lat                 = input_callback_select_lat;
-                input_init_options.callback_lon                 = input_callback_select_lon;
-                input_init_options.callback_ref                 = input_callback_select_ref;
-                input_init_options.callback_type                = input_callback_select_type;
-                input_init_options.callback_role                = input_callback_select_role;
-                input_init_options.callback_k                   = input_callback_select_k;
-                input_init_options.callback_v                   = input_callback_select_v;
-                input_init_options.callback_error               = input_callback_select_error;
-                input_init_options.callback_context             = clew;
-
-                input = clew_input_create(&input_init_options);
-                if (input == NULL) {
-                        clew_errorf("can not create input for path: %s", input_init_options.path);
+                        input_index = clew_input_index_create();
+                        if (input_index == NULL) {
+                                clew_errorf("can not create input index");
+                                goto bail;
+                        }
+                        rc = clew_stack_push(&clew->input_indexes, &input_index);
+                        if (rc < 0) {
+                                clew_errorf("can not push input index");
+                                clew_input_index_destroy(input_index);
+                                goto bail;
+                        }
+                        reader = clew_reader_add(clew, *(char **) clew_stack_at(&clew->options.inputs, i));
+                        if (reader == NULL) {
+                                goto bail;
+                        }
+                        if (clew->options.index) {
+                                rc = snprintf(input_index_path, sizeof(input_index_path), "%s.idx", *(char **) clew_stack_at(&clew->options.inputs, i));
+                                if (rc < 0 || rc >= (int) sizeof(input_index_path)) {
+                                        clew_errorf("input index path is too long");
+                                        goto bail;
+                                }
+                                rc = clew_input_index_load(input_index, input_index_path, *(char **) clew_stack_at(&clew->options.inputs, i));
+                                if (rc < 0) {
+                                        clew_errorf("can not load input index: %s", input_index_path);
+                                        goto bail;
+                                } else if (rc == 0) {
+                                        clew_infof("      loaded index: %s, blobs: %ld", input_index_path, clew_input_index_count(input_index));
+                                        reader->index_loaded = 1;
+                                }
+                        }
+
+                        reader->input_init_options.index                = input_index;
+                        reader->input_init_options.kinds                = CLEW_INPUT_INDEX_KIND_HEADER;
+                        reader->input_init_options.kinds               |= clew->options.keep_nodes     ? CLEW_INPUT_INDEX_KIND_NODE     : 0;
+                        reader->input_init_options.kinds               |= clew->options.keep_ways      ? CLEW_INPUT_INDEX_KIND_WAY      : 0;
+                        reader->input_init_options.kinds               |= clew->options.keep_relations ? CLEW_INPUT_INDEX_KIND_RELATION : 0;
+                        reader->input_init_options.callback_block       = input_callback_select_block;
+                        reader->input_init_options.callback_bounds_start = input_callback_select_bounds_start;
+                        reader->input_init_options.callback_bounds_end  = input_callback_select_bounds_end;
+                        reader->input_init_options.callback_minlon      = input_callback_select_minlon;
+                        reader->input_init_options.callback_minlat      = input_callback_select_minlat;
+                        reader->input_init_options.callback_maxlon      = input_callback_select_maxlon;
+                        reader->input_init_options.callback_maxlat      = input_callback_select_maxlat;
+                        reader->input_init_options.callback_error       = input_callback_select_error;
+                }
+                rc = clew_readers_read(clew);
+                if (rc < 0) {
                         goto bail;
                 }
-                while (clew_input_read(input) == 0) {
-                        rc = clew_input_get_error(input);
-                        if (rc != 0) {
-                                clew_errorf("input error occured, error: %d", rc);
+                rc = clew_readers_merge(clew);
+                if (rc < 0) {
+                        goto bail;
+                }
+
+                for (i = 0, il = clew_stack_count(&clew->readers); i < il && clew->options.index; i++) {
+                        reader = *(struct clew_reader **) clew_stack_at(&clew->readers, i);
+                        if (reader->index_loaded) {
+                                continue;
+                        }
+                        rc = snprintf(input_index_path, sizeof(input_index_path), "%s.idx", reader->path);
+                        if (rc < 0 || rc >= (int) sizeof(input_index_path)) {
+                                clew_errorf("input index path is too long");
                                 goto bail;
                         }
+                        rc = clew_input_index_save(reader->input_init_options.index, input_index_path);
+                        if (rc < 0) {
+                                clew_errorf("can not save input index: %s", input_index_path);
+                                goto bail;
+                        }
+                        clew_infof("      saved index: %s, blobs: %ld", input_index_path, clew_input_index_count(reader->input_init_options.index));
                 }
-                rc = clew_input_get_error(input);
+                clew_readers_reset(clew);
+
+                clew_infof("  processed");
+                clew_infof("    inputs   : %ld", clew_stack_count(&clew->options.inputs));
+                clew_infof("    nodes    : %ld", clew->read_node_start);
+                clew_infof("    ways     : %ld", clew->read_way_start);
+                clew_infof("    relations: %ld", clew->read_relation_start);
+
+                rc  = clew_idset_optimize(&clew->node_ids);
+                rc |= clew_idset_optimize(&clew->way_ids);
+                rc |= clew_idset_optimize(&clew->relation_ids);
                 if (rc != 0) {
-                        clew_errorf("input error occured, error: %d", rc);
-                        clew_input_destroy(input);
+                        clew_errorf("can not optimize selection");
                         goto bail;
                 }
-                clew_input_destroy(input);
-        }
 
-        clew_infof("  processed");
-        clew_infof("    inputs   : %ld", clew_stack_count(&clew->options.inputs));
-        clew_infof("    nodes    : %ld", clew->read_node_start);
-        clew_infof("    ways     : %ld", clew->read_way_start);
-        clew_infof("    relations: %ld", clew->read_relation_start);
+                clew_infof("  selected");
+                clew_infof("    nodes    : %ld, %ld bytes", clew_idset_count(&clew->node_ids), clew_idset_memory(&clew->node_ids));
+                clew_infof("    ways     : %ld, %ld bytes", clew_idset_count(&clew->way_ids), clew_idset_memory(&clew->way_ids));
+                clew_infof("    relations: %ld, %ld bytes", clew_idset_count(&clew->relation_ids), clew_idset_memory(&clew->relation_ids));
+                clew_expression_stats_debug(clew->options.filter, &clew->filter_stats);
 
-        clew_infof("  selected");
-        clew_infof("    nodes    : %ld", clew_bitmap_count(&clew->node_ids));
-        clew_infof("    ways     : %ld", clew_bitmap_count(&clew->way_ids));
-        clew_infof("    relations: %ld", clew_bitmap_count(&clew->relation_ids));
+                clew_infof("extracting");
+                clew->state = CLEW_STATE_EXTRACT;
 
-        clew_infof("extracting");
-        clew->state = CLEW_STATE_EXTRACT;
+                clew_infof("  reading inputs");
+                for (i = 0, il = clew_stack_count(&clew->options.inputs); i < il; i++) {
+                        clew_infof("    %ld: %s", i, *(char **) clew_stack_at(&clew->options.inputs, i));
+
+                        reader = clew_reader_add(clew, *(char **) clew_stack_at(&clew->options.inputs, i));
+                        if (reader == NULL) {
+                                goto bail;
+                        }
+                        reader->input_init_options.index                = *(struct clew_input_index **) clew_stack_at(&clew->input_indexes, i);
+                        reader->input_init_options.kinds                = CLEW_INPUT_INDEX_KIND_HEADER | CLEW_INPUT_INDEX_KIND_NODE | CLEW_INPUT_INDEX_KIND_WAY;
+                        reader->input_init_options.kinds               |= clew->options.keep_relations ? CLEW_INPUT_INDEX_KIND_RELATION : 0;
+                        reader->input_init_options.callback_blob        = input_callback_extract_blob;
+                        reader->input_init_options.callback_block       = input_callback_extract_block;
+                        reader->input_init_options.callback_bounds_start = input_callback_extract_bounds_start;
+                        reader->input_init_options.callback_bounds_end  = input_callback_extract_bounds_end;
+                        reader->input_init_options.callback_minlon      = input_callback_extract_minlon;
+                        reader->input_init_options.callback_minlat      = input_callback_extract_minlat;
+                        reader->input_init_options.callback_maxlon      = input_callback_extract_maxlon;
+                        reader->input_init_options.callback_maxlat      = input_callback_extract_maxlat;
+                        reader->input_init_options.callback_error       = input_callback_extract_error;
+                }
+                rc = clew_readers_read(clew);
+                if (rc < 0) {
+                        goto bail;
+                }
+                rc = clew_readers_merge(clew);
+                if (rc < 0) {
+                        goto bail;
+                }
+                clew_readers_reset(clew);
+
+                clew_infof("  processed");
+                clew_infof("    inputs   : %ld", clew_stack_count(&clew->options.inputs));
+                clew_infof("    nodes    : %ld", clew->read_node_start);
+                clew_infof("    ways     : %ld", clew->read_way_start);
+                clew_infof("    relations: %ld", clew->read_relation_start);
+                clew_infof("    blobs    : %ld, skipped: %ld", clew->read_blobs, clew->read_blobs_skipped);
+        } else {
+                clew_infof("selecting and extracting");
+                clew->state = CLEW_STATE_EXTRACT;
 
-        clew_stack_reset(&clew->read_state);
-        clew_stack_push_uint32(&clew->read_state, CLEW_READ_STATE_UNKNOWN);
-        clew->read_keep  = clew->options.keep_nodes     ? CLEW_READ_STATE_NODE     : 0;
-        clew->read_keep |= clew->options.keep_ways      ? CLEW_READ_STATE_WAY      : 0;
-        clew->read_keep |= clew->options.keep_relations ? CLEW_READ_STATE_RELATION : 0;
+                clew_idset_reset(&clew->node_ids);
+                clew_idset_reset(&clew->way_ids);
+                clew_idset_reset(&clew->relation_ids);
 
-        clew->read_node_start     = 0;
-        clew->read_way_start      = 0;
-        clew->read_relation_start = 0;
+                clew_infof("  reading inputs");
+                for (i = 0, il = clew_stack_count(&clew->options.inputs); i < il; i++) {
+                        clew_infof("    %ld: %s", i, *(char **) clew_stack_at(&clew->options.inputs, i));
 
-        clew_infof("  reading inputs");
-        for (i = 0, il = clew_stack_count(&clew->options.inputs); i < il; i++) {
-                clew_infof("    %ld: %s", i, *(char **) clew_stack_at(&clew->options.inputs, i));
-
-                clew_input_init_options_default(&input_init_options);
-                input_init_options.path                         = *(char **) clew_stack_at(&clew->options.inputs, i);
-                input_init_options.callback_bounds_start        = input_callback_extract_bounds_start;
-                input_init_options.callback_bounds_end          = input_callback_extract_bounds_end;
-                input_init_options.callback_node_start          = input_callback_extract_node_start;
-                input_init_options.callback_node_end            = input_callback_extract_node_end;
-                input_init_options.callback_way_start           = input_callback_extract_way_start;
-                input_init_options.callback_way_end             = input_callback_extract_way_end;
-                input_init_options.callback_relation_start      = input_callback_extract_relation_start;
-                input_init_options.callback_relation_end        = input_callback_extract_relation_end;
-                input_init_options.callback_tag_start           = input_callback_extract_tag_start;
-                input_init_options.callback_tag_end             = input_callback_extract_tag_end;
-                input_init_options.callback_nd_start            = input_callback_extract_nd_start;
-                input_init_options.callback_nd_end              = input_callback_extract_nd_end;
-                input_init_options.callback_member_start        = input_callback_extract_member_start;
-                input_init_options.callback_member_end          = input_callback_extract_member_end;
-                input_init_options.callback_minlon              = input_callback_extract_minlon;
-                input_init_options.callback_minlat              = input_callback_extract_minlat;
-                input_init_options.callback_maxlon              = input_callback_extract_maxlon;
-                input_init_options.callback_maxlat              = input_callback_extract_maxlat;
-                input_init_options.callback_id                  = input_callback_extract_id;
-                input_init_options.callback_lat                 = input_callback_extract_lat;
-                input_init_options.callback_lon                 = input_callback_extract_lon;
-                input_init_options.callback_ref                 = input_callback_extract_ref;
-                input_init_options.callback_type                = input_callback_extract_type;
-                input_init_options.callback_role                = input_callback_extract_role;
-                input_init_options.callback_k                   = input_callback_extract_k;
-                input_init_options.callback_v                   = input_callback_extract_v;
-                input_init_options.callback_error               = input_callback_extract_error;
-                input_init_options.callback_context             = clew;
-
-                input = clew_input_create(&input_init_options);
-                if (input == NULL) {
-                        clew_errorf("can not create input for path: %s", input_init_options.path);
+                        reader = clew_reader_add(clew, *(char **) clew_stack_at(&clew->options.inputs, i));
+                        if (reader == NULL) {
+                                goto bail;
+                        }
+                        reader->locations = clew_location_create();
+                        if (reader->locations == NULL) {
+                                clew_errorf("can not create location store");
+                                goto bail;
+                        }
+                        reader->input_init_options.kinds                = CLEW_INPUT_INDEX_KIND_HEADER | CLEW_INPUT_INDEX_KIND_NODE;
+                        reader->input_init_options.kinds               |= clew->options.keep_ways      ? CLEW_INPUT_INDEX_KIND_WAY      : 0;
+                        reader->input_init_options.kinds               |= clew->options.keep_relations ? CLEW_INPUT_INDEX_KIND_RELATION : 0;
+                        reader->input_init_options.callback_block       = input_callback_single_block;
+                        reader->input_init_options.callback_bounds_start = input_callback_extract_bounds_start;
+                        reader->input_init_options.callback_bounds_end  = input_callback_extract_bounds_end;
+                        reader->input_init_options.callback_minlon      = input_callback_extract_minlon;
+                        reader->input_init_options.callback_minlat      = input_callback_extract_minlat;
+                        reader->input_init_options.callback_maxlon      = input_callback_extract_maxlon;
+                        reader->input_init_options.callback_maxlat      = input_callback_extract_maxlat;
+                        reader->input_init_options.callback_error       = input_callback_extract_error;
+                }
+                rc = clew_readers_read(clew);
+                if (rc < 0) {
                         goto bail;
                 }
-                while (clew_input_read(input) == 0) {
-                        rc = clew_input_get_error(input);
-                        if (rc != 0) {
-                                clew_errorf("input error occured, error: %d", rc);
+                rc = clew_readers_merge(clew);
+                if (rc < 0) {
+                        goto bail;
+                }
+
+                clew_infof("  processed");
+                clew_infof("    inputs   : %ld", clew_stack_count(&clew->options.inputs));
+                clew_infof("    nodes    : %ld", clew->read_node_start);
+                clew_infof("    ways     : %ld", clew->read_way_start);
+                clew_infof("    relations: %ld", clew->read_relation_start);
+
+                clew_infof("  locations");
+                for (i = 0, il = clew_stack_count(&clew->readers); i < il; i++) {
+                        reader = *(struct clew_reader **) clew_stack_at(&clew->readers, i);
+                        rc = clew_location_complete(reader->locations);
+                        if (rc < 0) {
+                                clew_errorf("can not complete location store");
                                 goto bail;
                         }
+                        clew_infof("    %ld: nodes: %ld, layout: %s, %ld bytes", i, clew_location_count(reader->locations), clew_location_dense(reader->locations) ? "dense" : "sparse", clew_location_memory(reader->locations));
                 }
-                rc = clew_input_get_error(input);
-                if (rc != 0) {
-                        clew_errorf("input error occured, error: %d", rc);
-                        clew_input_destroy(input);
-                        goto bail;
+
+                clew_infof("  resolving way refs");
+                for (w = 0, wl = clew_stack_count(&clew->ways); w < wl; w++) {
+                        struct clew_way *way = *(struct clew_way **) clew_stack_at(&clew->ways, w);
+                        struct clew_delta_iter refs = clew_delta_iter_init(way->refs);
+                        for (r = 0, rl = way->nrefs; r < rl; r++) {
+                                int32_t lon;
+                                int32_t lat;
+                                uint64_t ref = clew_delta_iter_next(&refs);
+
+                                if (clew_idset_marked(&clew->node_ids, ref)) {
+                                        continue;
+                                }
+                                rc = clew_idset_mark(&clew->node_ids, ref);
+                                if (rc < 0) {
+                                        clew_errorf("can not push node id");
+                                        goto bail;
+                                }
+                                for (i = 0, il = clew_stack_count(&clew->readers); i < il; i++) {
+                                        reader = *(struct clew_reader **) clew_stack_at(&clew->readers, i);
+                                        rc = clew_location_get(reader->locations, ref, &lon, &lat);
+                                        if (rc != 1) {
+                                                break;
+                                        }
+                                }
+                                if (rc < 0) {
+                                        clew_errorf("can not get location");
+                                        goto bail;
+                                } else if (rc == 1) {
+                                        continue;
+                                }
+
+                                rc = clew_node_store_push(clew->nodes, ref, lon, lat, CLEW_TAGSET_EMPTY);
+                                if (rc < 0) {
+                                        clew_errorf("can not push node");
+                                        goto bail;
+                                }
+                        }
                 }
-                clew_input_destroy(input);
-        }
+                clew_readers_reset(clew);
 
-        clew_infof("  processed");
-        clew_infof("    inputs   : %ld", clew_stack_count(&clew->options.inputs));
-        clew_infof("    nodes    : %ld", clew->read_node_start);
-        clew_infof("    ways     : %ld", clew->read_way_start);
-        clew_infof("    relations: %ld", clew->read_relation_start);
+                clew_infof("  selected");
+                clew_infof("    nodes    : %ld", clew_idset_count(&clew->node_ids));
+                clew_infof("    ways     : %ld", clew_idset_count(&clew->way_ids));
+                clew_infof("    relations: %ld", clew_idset_count(&clew->relation_ids));
+                clew_expression_stats_debug(clew->options.filter, &clew->filter_stats);
+        }
 
         clew_infof("  sorting");
-        clew_stack_sort(&clew->nodes, node_stack_compare_elements);
+        if (clew_node_store_runs(clew->nodes) > 0) {
+                clew_infof("    merging %ld node runs", clew_node_store_runs(clew->nodes));
+        }
+        duplicates = clew_node_store_complete(clew->nodes);
+        if (duplicates < 0) {
+                clew_errorf("can not complete node store");
+                goto bail;
+        }
         clew_stack_sort(&clew->ways, way_stack_compare_elements);
         clew_stack_sort(&clew->relations, relation_stack_compare_elements);
 
+        clew_infof("  removing duplicates");
+        clew_infof("    nodes    : %ld", duplicates);
+        clew_infof("    ways     : %ld", way_stack_unique(&clew->ways));
+
         clew_infof("  extracted");
-        clew_infof("    nodes    : %ld", clew_stack_count(&clew->nodes));
+        clew_infof("    nodes    : %ld", clew_node_store_count(clew->nodes));
         clew_infof("    ways     : %ld", clew_stack_count(&clew->ways));
+        {
+                uint64_t nrefs;
+                uint64_t srefs;
+                for (w = 0, wl = clew_stack_count(&clew->ways), nrefs = 0, srefs = 0; w < wl; w++) {
+                        struct clew_way *way = *(struct clew_way **) clew_stack_at(&clew->ways, w);
+                        nrefs += way->nrefs;
+                        srefs += way->srefs;
+                }
+                clew_infof("    refs     : %ld, %ld bytes, %ld bytes uncoded", nrefs, srefs, nrefs * sizeof(uint64_t));
+        }
+        clew_infof("    tag sets : %d, %ld bytes", clew_tagset_count(clew->tagsets), clew_tagset_memory(clew->tagsets));
         clew_infof("    relations: %ld", clew_stack_count(&clew->relations));
 
         clew_infof("building mesh");
         clew->state = CLEW_STATE_BUILD_MESH;
 
         clew_infof("  building mesh ways: %ld", clew_stack_count(&clew->ways));
+        rc = clew_stack_resize(&clew->mesh_way_types, clew_tagset_count(clew->tagsets));
+        if (rc < 0) {
+                clew_errorf("can not allocate mesh way types");
+                goto bail;
+        }
+        for (i = 0, il = clew_tagset_count(clew->tagsets); i < il; i++) {
+                uint32_t ntags;
+                const uint32_t *tags;
+                tags = clew_tagset_tags(clew->tagsets, i, &ntags);
+                clew_mesh_way_classify(tags, ntags, (struct clew_mesh_way_type *) clew_stack_at(&clew->mesh_way_types, i));
+        }
         for (w = 0, wl = clew_stack_count(&clew->ways); w < wl; w++) {
                 struct clew_way *way;
                 struct clew_mesh_way mway;
+                const struct clew_mesh_way_type *type;
 
-                mway.way      = NULL;
-                mway.tag      = clew_tag_unknown;
-                mway.oneway   = clew_tag_oneway_no;
-                mway.maxspeed = clew_tag_maxspeed_20;
-
-                way = *(struct clew_way **) clew_stack_at(&clew->ways, w);
-
-                for (i = 0, il = sizeof(clew_mesh_way_types) / sizeof(clew_mesh_way_types[0]); i < il; i++) {
-                        for (t = 0, tl = way->ntags; t < tl; t++) {
-                                if (clew_mesh_way_types[i].tag == way->tags[t]) {
-                                        mway.tag      = clew_mesh_way_types[i].tag;
-                                        mway.oneway   = clew_mesh_way_types[i].oneway;
-                                        mway.maxspeed = clew_mesh_way_types[i].maxspeed;
-                                        break;
-                                }
-                        }
-                        if (t < tl) {
-                                break;
-                        }
-                }
-                if (mway.tag == clew_tag_unknown) {
+                way  = *(struct clew_way **) clew_stack_at(&clew->ways, w);
+                type = (const struct clew_mesh_way_type *) clew_stack_at(&clew->mesh_way_types, way->tagset);
+                if (type->tag == clew_tag_unknown) {
+                        uint32_t ntags;
+                        const uint32_t *tags;
                         clew_errorf("way: %ld with invalid tags", way->id);
-                        for (t = 0, tl = way->ntags; t < tl; t++) {
-                                clew_errorf("  %d, %s", way->tags[t], clew_tag_string(way->tags[t]));
+                        tags = clew_tagset_tags(clew->tagsets, way->tagset, &ntags);
+                        for (t = 0, tl = ntags; t < tl; t++) {
+                                clew_errorf("  %d, %s", tags[t], clew_tag_string(tags[t]));
                         }
                         continue;
                 }
 
-                for (t = 0, tl = way->ntags; t < tl; t++) {
-                        if (way->tags[t] == clew_tag_oneway_no ||
-                            way->tags[t] == clew_tag_oneway_yes ||
-                            way->tags[t] == clew_tag_oneway__1) {
-                                mway.oneway = way->tags[t];
-                                break;
-                        }
-                }
-
-                for (t = 0, tl = way->ntags; t < tl; t++) {
-                        if (clew_tag_is_group_maxspeed(way->tags[t])) {
-                                mway.maxspeed = way->tags[t];
-                                break;
-                        }
-                }
-
-                mway.way = way;
+                mway.way      = way;
+                mway.tag      = type->tag;
+                mway.oneway   = type->oneway;
+                mway.maxspeed = type->maxspeed;
 
                 rc = clew_stack_push(&clew->mesh_ways, &mway);
                 if (rc < 0) {
@@ -3061,109 +2991,100 @@ int main (int argc, char *argv[])
                 }
         }
 
-        clew_infof("  building mesh nodes: %ld", clew_stack_count(&clew->nodes));
+        clew_infof("  building mesh nodes: %ld", clew_node_store_count(clew->nodes));
+        clew_graph_reset(clew->mesh);
+        rc = clew_stack_resize(&clew->mesh_node_index, clew_node_store_count(clew->nodes));
+        if (rc < 0) {
+                clew_errorf("can not allocate mesh node index");
+                goto bail;
+        }
+        memset(clew_stack_buffer(&clew->mesh_node_index), 0xff, sizeof(uint64_t) * clew_node_store_count(clew->nodes));
         for (w = 0, wl = clew_stack_count(&clew->mesh_ways); w < wl; w++) {
                 struct clew_way *way;
                 struct clew_mesh_way *mway;
 
-                struct clew_node *node;
-                struct clew_node _knode;
-                struct clew_node *knode;
-
-                khiter_t k;
-                struct clew_mesh_node *mnode;
-                struct clew_mesh_node *pmnode;
-                struct clew_mesh_node _kmnode;
-                struct clew_mesh_node *kmnode;
+                uint64_t ref;
+                uint64_t node;
+                uint64_t *mnode_index;
+                struct clew_delta_iter refs;
 
-                struct clew_mesh_node_neighbour *mnodeneigh;
-                struct clew_mesh_node_neighbour _mnodeneigh;
+                uint64_t imnode;
+                uint64_t ipmnode;
 
                 mway = (struct clew_mesh_way *) clew_stack_at(&clew->mesh_ways, w);
                 way  = mway->way;
 
-                pmnode = NULL;
+                ipmnode = CLEW_GRAPH_NODE_NONE;
+                refs    = clew_delta_iter_init(way->refs);
                 for (r = 0, rl = way->nrefs; r < rl; r++) {
-                        knode = &_knode;
-                        knode->id = way->refs[r];
-                        node = *(struct clew_node **) clew_stack_search(&clew->nodes, &knode, node_stack_compare_elements);
-
-                        kmnode = &_kmnode;
-                        kmnode->node = &_knode;
-                        kmnode->node->id = node->id;
-                        k = kh_get(mesh_nodes, clew->mesh_nodes, kmnode->node->id);
-                        if (k == kh_end(clew->mesh_nodes)) {
-                                mnode = (struct clew_mesh_node *) malloc(sizeof(struct clew_mesh_node));
-                                if (mnode == NULL) {
-                                        clew_errorf("can not allocate memory");
-                                        goto bail;
-                                }
-                                mnode->node = node;
-                                mnode->mesh_ways       = clew_stack_init2(sizeof(struct clew_mesh_way *), 2);
-                                mnode->mesh_neighbours = clew_stack_init2(sizeof(struct clew_mesh_node_neighbour), 2);
-                                k = kh_put(mesh_nodes, clew->mesh_nodes, mnode->node->id, &rc);
+                        ref = clew_delta_iter_next(&refs);
+                        rc  = clew_node_store_find(clew->nodes, ref, &node);
+                        if (rc < 0) {
+                                clew_errorf("can not find node");
+                                goto bail;
+                        } else if (rc == 1) {
+                                /* ref outside of the input, the way is broken here */
+                                ipmnode = CLEW_GRAPH_NODE_NONE;
+                                continue;
+                        }
+
+                        mnode_index = (uint64_t *) clew_stack_buffer(&clew->mesh_node_index) + node;
+                        if (*mnode_index == CLEW_GRAPH_NODE_NONE) {
+                                rc = clew_graph_add_node(clew->mesh, ref, clew_node_store_lon(clew->nodes, node), clew_node_store_lat(clew->nodes, node), mnode_index);
                                 if (rc < 0) {
                                         clew_errorf("can not push mesh node");
-                                        clew_mesh_node_destroy(mnode);
                                         goto bail;
                                 }
-                                kh_value(clew->mesh_nodes, k) = mnode;
-                        } else {
-                                mnode = kh_val(clew->mesh_nodes, k);
                         }
+                        imnode = *mnode_index;
 
-                        rc = clew_stack_push(&mnode->mesh_ways, &mway);
-                        if (rc < 0) {
-                                clew_errorf("can not push mesh way");
-                                goto bail;
-                        }
-
-                        if (pmnode != NULL) {
-                                struct clew_point a = clew_point_init(pmnode->node->lon, pmnode->node->lat);
-                                struct clew_point b = clew_point_init(mnode->node->lon, mnode->node->lat);
+                        if (ipmnode != CLEW_GRAPH_NODE_NONE) {
+                                struct clew_point a = clew_point_init(clew_graph_lon(clew->mesh, ipmnode), clew_graph_lat(clew->mesh, ipmnode));
+                                struct clew_point b = clew_point_init(clew_graph_lon(clew->mesh, imnode), clew_graph_lat(clew->mesh, imnode));
                                 double distance = clew_point_distance_euclidean(&a, &b);
-                                double duration = (distance * 3.60) / ((double) (mway->maxspeed - clew_tag_maxspeed_0));
+                                double duration = (distance * 3.60) / ((double) clew_tag_maxspeed_value(mway->maxspeed));
                                 double cost     = duration;
 
-                                mnodeneigh = &_mnodeneigh;
-                                mnodeneigh->distance  = distance;
-                                mnodeneigh->duration  = duration;
-                                mnodeneigh->cost      = cost;
-
+                                rc = 0;
                                 if (mway->oneway == clew_tag_oneway__1) {
-                                        mnodeneigh->mesh_node = pmnode;
-                                        rc = clew_stack_push(&mnode->mesh_neighbours, mnodeneigh);
-                                        if (rc < 0) {
-                                                clew_errorf("can not push mesh node neighbour");
-                                                goto bail;
-                                        }
+                                        rc |= clew_graph_add_edge(clew->mesh, imnode, ipmnode, distance, duration, cost);
                                 } else if (mway->oneway == clew_tag_oneway_yes) {
-                                        mnodeneigh->mesh_node = mnode;
-                                        rc = clew_stack_push(&pmnode->mesh_neighbours, mnodeneigh);
-                                        if (rc < 0) {
-                                                clew_errorf("can not push mesh node neighbour");
-                                                goto bail;
-                                        }
+                                        rc |= clew_graph_add_edge(clew->mesh, ipmnode, imnode, distance, duration, cost);
                                 } else if (mway->oneway == clew_tag_oneway_no) {
-                                        mnodeneigh->mesh_node = mnode;
-                                        rc = clew_stack_push(&pmnode->mesh_neighbours, mnodeneigh);
-                                        if (rc < 0) {
-                                                clew_errorf("can not push mesh node neighbour");
-                                                goto bail;
-                                        }
-
-                                        mnodeneigh->mesh_node = pmnode;
-                                        rc = clew_stack_push(&mnode->mesh_neighbours, mnodeneigh);
-                                        if (rc < 0) {
-                                                clew_errorf("can not push mesh node neighbour");
-                                                goto bail;
-                                        }
+                                        rc |= clew_graph_add_edge(clew->mesh, ipmnode, imnode, distance, duration, cost);
+                                        rc |= clew_graph_add_edge(clew->mesh, imnode, ipmnode, distance, duration, cost);
+                                }
+                                if (rc != 0) {
+                                        clew_errorf("can not push mesh node neighbour");
+                                        goto bail;
                                 }
                         }
 
-                        pmnode = mnode;
+                        ipmnode = imnode;
                 }
         }
+        rc = clew_graph_complete(clew->mesh);
+        if (rc < 0) {
+                clew_errorf("can not complete mesh");
+                goto bail;
+        }
+        clew_infof("  built mesh: nodes: %ld, edges: %ld, %ld bytes", clew_graph_count(clew->mesh), clew_graph_edges_count(clew->mesh), clew_graph_memory(clew->mesh));
+
+        if (clew->options.graph_cache != NULL && graph_key != 0) {
+                clew_infof("  saving graph cache: %s", clew->options.graph_cache);
+                rc = clew_graph_save(clew->mesh, clew->options.graph_cache, graph_key);
+                if (rc < 0) {
+                        clew_warningf("can not save graph cache: %s", clew->options.graph_cache);
+                }
+        }
+
+points:
+        rc = clew_stack_resize(&clew->mesh_visited, clew_graph_count(clew->mesh));
+        if (rc < 0) {
+                clew_errorf("can not allocate mesh visited set");
+                goto bail;
+        }
+        clew->mesh_visited_stamp = 0;
 
         clew_stack_reset(&clew->mesh_points);
         clew_stack_reset(&clew->mesh_solutions);
@@ -3172,10 +3093,10 @@ int main (int argc, char *argv[])
         for (i = 0, il = clew_stack_count(&clew->options.points); i < il; i += 2) {
                 double distance;
                 double sdistance;
-                struct clew_mesh_node *smnode;
+                uint64_t smnode;
 
-                khiter_t k;
-                struct clew_mesh_node *mnode;
+                uint64_t m;
+                uint64_t ml;
 
                 struct clew_point npoint;
                 struct clew_point spoint;
@@ -3186,9 +3107,9 @@ int main (int argc, char *argv[])
                 sdistance = INFINITY;
                 spoint    = clew_point_init(clew_stack_at_int32(&clew->options.points, i + 0), clew_stack_at_int32(&clew->options.points, i + 1));
                 sbound    = clew_bound_null();
-                smnode    = NULL;
+                smnode    = CLEW_GRAPH_NODE_NONE;
 
-                int64_t node_count = kh_size(clew->mesh_nodes);
+                int64_t node_count = clew_graph_count(clew->mesh);
                 int64_t min_neighbour_count = node_count * 0.01;
                 if (min_neighbour_count < 4) {
                         min_neighbour_count = 4;
@@ -3197,22 +3118,21 @@ int main (int argc, char *argv[])
                         min_neighbour_count = 8;
                 }
 
-                for (k = kh_begin(clew->mesh_nodes); k != kh_end(clew->mesh_nodes); k++) {
-                        if (!kh_exist(clew->mesh_nodes, k)) {
-                                continue;
-                        }
-                        mnode = kh_val(clew->mesh_nodes, k);
-
-                        npoint = clew_point_init(mnode->node->lon, mnode->node->lat);
+                for (m = 0, ml = clew_graph_count(clew->mesh); m < ml; m++) {
+                        npoint = clew_point_init(clew_graph_lon(clew->mesh, m), clew_graph_lat(clew->mesh, m));
                         if (clew_bound_invalid(&sbound) ||
                             clew_bound_contains_point(&sbound, &npoint)) {
                                 distance = clew_point_distance_euclidean(&spoint, &npoint);
-                                if (distance < sdistance) {
+                                if (distance < sdistance &&
+                                    clew_mesh_node_neighbours_count(clew, m, min_neighbour_count) >= min_neighbour_count) {
+                                        smnode = m;
+                                        sdistance = distance;
+                                        /* only nodes closer than the accepted one can follow, bound them around the point */
 #if 1
-                                        struct clew_point snpoint = clew_point_derived_position(&npoint, distance, 0);
-                                        struct clew_point sepoint = clew_point_derived_position(&npoint, distance, 90);
-                                        struct clew_point sspoint = clew_point_derived_position(&npoint, distance, 180);
-                                        struct clew_point swpoint = clew_point_derived_position(&npoint, distance, 270);
+                                        struct clew_point snpoint = clew_point_derived_position(&spoint, distance, 0);
+                                        struct clew_point sepoint = clew_point_derived_position(&spoint, distance, 90);
+                                        struct clew_point sspoint = clew_point_derived_position(&spoint, distance, 180);
+                                        struct clew_point swpoint = clew_point_derived_position(&spoint, distance, 270);
                                         sbound = clew_bound_null();
                                         sbound = clew_bound_union_point(&sbound, &snpoint);
                                         sbound = clew_bound_union_point(&sbound, &sepoint);
@@ -3221,20 +3141,20 @@ int main (int argc, char *argv[])
 #else
                                         #define METERS_TO_E7_LAT(m)             ((int32_t) ((m) / 0.011132))   // ~0.0000001 deg = 1.11 meters
                                         #define METERS_TO_E7_LON(m, lat)        ((int32_t) ((m) / (0.011132 * cos((lat) * 1e-7 * M_PI / 180.0))))
-                                        struct clew_point cpoint = clew_point_init(mnode->node->lon, mnode->node->lat);
+                                        struct clew_point cpoint = spoint;
                                         int32_t r_lat = METERS_TO_E7_LAT(distance);
                                         int32_t r_lon = METERS_TO_E7_LON(distance, cpoint.lat);
                                         sbound = clew_bound_init(cpoint.lon - r_lon, cpoint.lat - r_lat, cpoint.lon + r_lon, cpoint.lat + r_lat);
 #endif
-                                        if (clew_mesh_node_neighbours_count(mnode, min_neighbour_count) >= min_neighbour_count) {
-                                                smnode = mnode;
-                                                sdistance = distance;
-                                        }
                                 }
                         }
                 }
-                clew_infof("    nearest: %ld", smnode->node->id);
-                clew_infof("             %.7f, %.7f", smnode->node->lon * 1e-7, smnode->node->lat * 1e-7);
+                if (smnode == CLEW_GRAPH_NODE_NONE) {
+                        clew_errorf("can not find nearest mesh node");
+                        goto bail;
+                }
+                clew_infof("    nearest: %ld", clew_graph_id(clew->mesh, smnode));
+                clew_infof("             %.7f, %.7f", clew_graph_lon(clew->mesh, smnode) * 1e-7, clew_graph_lat(clew->mesh, smnode) * 1e-7);
                 clew_infof("             %.3f meters", sdistance);
 
                 {
@@ -3257,15 +3177,17 @@ int main (int argc, char *argv[])
         clew->state = CLEW_STATE_SOLVE_ROUTES;
 
         for (i = 0, il = clew_stack_count(&clew->mesh_points); i < il; i++) {
-                khiter_t k;
-                struct clew_mesh_node *mnode;
+                uint64_t m;
+                uint64_t ml;
+                struct clew_mesh_search *search;
+                struct clew_mesh_search *msearch;
 
                 double pqueue_ocost;
                 struct clew_pqueue *pqueue;
                 struct clew_mesh_point *mpoint = (struct clew_mesh_point *) clew_stack_at(&clew->mesh_points, i);
 
                 clew_infof("  %ld: %.7f,%.7f", i, mpoint->lon * 1e-7, mpoint->lat * 1e-7);
-                clew_infof("    nearest: %ld, %.3f meters", mpoint->nearest_node->node->id, mpoint->nearest_distance);
+                clew_infof("    nearest: %ld, %.3f meters", clew_graph_id(clew->mesh, mpoint->nearest_node), mpoint->nearest_distance);
 
                 for (j = 0, jl = clew_stack_count(&clew->mesh_points); j < jl; j++) {
                         struct clew_mesh_point *nmpoint = (struct clew_mesh_point *) clew_stack_at(&clew->mesh_points, j);
@@ -3273,28 +3195,37 @@ int main (int argc, char *argv[])
                 }
 
                 clew_infof("    building pqueue");
+                ml     = clew_graph_count(clew->mesh);
+                search = (struct clew_mesh_search *) malloc(sizeof(struct clew_mesh_search) * (ml + 1));
+                if (search == NULL) {
+                        clew_errorf("can not allocate memory");
+                        goto bail;
+                }
                 pqueue = clew_pqueue_create(
-                        kh_size(clew->mesh_nodes) + 2,
+                        ml + 2,
                         64 * 1024,
                         mesh_node_pqueue_compare,
                         mesh_node_pqueue_setpos,
                         mesh_node_pqueue_getpos
                 );
+                if (pqueue == NULL) {
+                        clew_errorf("can not create pqueue");
+                        free(search);
+                        goto bail;
+                }
 
-                for (k = kh_begin(clew->mesh_nodes); k != kh_end(clew->mesh_nodes); k++) {
-                        if (!kh_exist(clew->mesh_nodes, k)) {
-                                continue;
-                        }
-                        mnode = kh_val(clew->mesh_nodes, k);
-                        mnode->pqueue_cost      = INFINITY;
-                        mnode->pqueue_pos       = 0;
-                        mnode->pqueue_prev      = NULL;
-                        mnode->pqueue_distance  = 0;
-                        mnode->pqueue_duration  = 0;
-                        rc = clew_pqueue_add(pqueue, mnode);
+                for (m = 0; m < ml; m++) {
+                        msearch = &search[m];
+                        msearch->pqueue_cost      = INFINITY;
+                        msearch->pqueue_pos       = 0;
+                        msearch->pqueue_prev      = CLEW_GRAPH_NODE_NONE;
+                        msearch->pqueue_distance  = 0;
+                        msearch->pqueue_duration  = 0;
+                        rc = clew_pqueue_add(pqueue, msearch);
                         if (rc < 0) {
                                 clew_errorf("can not mesh node to pqueue");
                                 clew_pqueue_destroy(pqueue);
+                                free(search);
                                 goto bail;
                         }
                 }
@@ -3303,13 +3234,18 @@ int main (int argc, char *argv[])
                 {
                         uint64_t n;
                         uint64_t nl;
-                        struct clew_mesh_node *rnode;
-                        struct clew_mesh_node_neighbour *rneig;
-                        pqueue_ocost = mpoint->nearest_node->pqueue_cost;
-                        mpoint->nearest_node->pqueue_cost = 0;
-                        clew_pqueue_mod(pqueue, mpoint->nearest_node, pqueue_ocost > mpoint->nearest_node->pqueue_cost);
-                        while ((rnode = (struct clew_mesh_node *) clew_pqueue_pop(pqueue)) != NULL) {
-                                if (rnode->pqueue_cost == INFINITY) {
+                        uint64_t rindex;
+                        struct clew_mesh_search *rsearch;
+                        struct clew_mesh_search *nsearch;
+                        const struct clew_graph_edge *rneigs;
+                        const struct clew_graph_edge *rneig;
+                        msearch = &search[mpoint->nearest_node];
+                        pqueue_ocost = msearch->pqueue_cost;
+                        msearch->pqueue_cost = 0;
+                        clew_pqueue_mod(pqueue, msearch, pqueue_ocost > msearch->pqueue_cost);
+                        while ((rsearch = (struct clew_mesh_search *) clew_pqueue_pop(pqueue)) != NULL) {
+                                rindex = rsearch - search;
+                                if (rsearch->pqueue_cost == INFINITY) {
                                         clew_infof("      there are unsolved points");
                                         break;
                                 }
@@ -3323,47 +3259,51 @@ int main (int argc, char *argv[])
                                         }
                                         if (0) {
                                                 static double d = INFINITY;
-                                                static struct clew_mesh_node *dnode = NULL;
-                                                struct clew_point b = clew_point_init(rnode->node->lon, rnode->node->lat);
-                                                struct clew_point e = clew_point_init(nmpoint->nearest_node->node->lon, nmpoint->nearest_node->node->lat);
+                                                static uint64_t dnode = CLEW_GRAPH_NODE_NONE;
+                                                struct clew_point b = clew_point_init(clew_graph_lon(clew->mesh, rindex), clew_graph_lat(clew->mesh, rindex));
+                                                struct clew_point e = clew_point_init(clew_graph_lon(clew->mesh, nmpoint->nearest_node), clew_graph_lat(clew->mesh, nmpoint->nearest_node));
                                                 double f = clew_point_distance_euclidean(&b, &e);
                                                 if (f < d) {
                                                         d = f;
-                                                        dnode = rnode;
-                                                        clew_infof("d: %ld", dnode->node->id);
+                                                        dnode = rindex;
+                                                        clew_infof("d: %ld", clew_graph_id(clew->mesh, dnode));
                                                 }
                                         }
-                                        if (rnode == nmpoint->nearest_node) {
-                                                time_t ts    = (time_t) rnode->pqueue_duration;
+                                        if (rindex == nmpoint->nearest_node) {
+                                                time_t ts    = (time_t) rsearch->pqueue_duration;
                                                 struct tm *tm = gmtime(&ts);
                                                 char duration[80];
                                                 strftime(duration, sizeof(duration), "%H:%M:%S", tm);
 
-                                                clew_infof("      %2ld: distance: %10.3f, duration: %s, cost: %10.3f", j, rnode->pqueue_distance, duration, rnode->pqueue_cost);
+                                                clew_infof("      %2ld: distance: %10.3f, duration: %s, cost: %10.3f", j, rsearch->pqueue_distance, duration, rsearch->pqueue_cost);
 
                                                 uint64_t nprnode;
                                                 uint64_t tprnode;
-                                                struct clew_mesh_node *prnode;
+                                                uint64_t prnode;
                                                 struct clew_mesh_solution msolution;
-                                                for (tprnode = 0, prnode = rnode; prnode; prnode = prnode->pqueue_prev) {
+                                                for (tprnode = 0, prnode = rindex; prnode != CLEW_GRAPH_NODE_NONE; prnode = search[prnode].pqueue_prev) {
                                                         tprnode += 1;
                                                 }
 
                                                 msolution.source      = mpoint;
                                                 msolution.destination = nmpoint;
-                                                msolution.mesh_nodes  = clew_stack_init(sizeof(struct clew_mesh_node *));
-                                                msolution.duration    = rnode->pqueue_duration;
-                                                msolution.distance    = rnode->pqueue_distance;
-                                                msolution.cost        = rnode->pqueue_cost;
+                                                msolution.mesh_nodes  = clew_stack_init(sizeof(uint64_t));
+                                                msolution.duration    = rsearch->pqueue_duration;
+                                                msolution.distance    = rsearch->pqueue_distance;
+                                                msolution.cost        = rsearch->pqueue_cost;
                                                 rc = clew_stack_resize(&msolution.mesh_nodes, tprnode);
                                                 if (rc < 0) {
                                                         clew_errorf("stack reserve failed");
+                                                        clew_pqueue_destroy(pqueue);
+                                                        free(search);
                                                         goto bail;
                                                 }
-                                                for (nprnode = 0, prnode = rnode; prnode; prnode = prnode->pqueue_prev) {
+                                                for (nprnode = 0, prnode = rindex; prnode != CLEW_GRAPH_NODE_NONE; prnode = search[prnode].pqueue_prev) {
                                                         rc = clew_stack_put_at(&msolution.mesh_nodes, &prnode, tprnode - nprnode - 1);
                                                         if (rc < 0) {
                                                                 clew_errorf("stack put at failed, t: %ld, n: %ld", tprnode, nprnode);
+                                                                clew_pqueue_destroy(pqueue);
+                                                                free(search);
                                                                 goto bail;
                                                         }
                                                         nprnode += 1;
@@ -3386,16 +3326,18 @@ int main (int argc, char *argv[])
                                         clew_infof("      all points are solved");
                                         break;
                                 }
-                                for (n = 0, nl = clew_stack_count(&rnode->mesh_neighbours); n < nl; n++) {
-                                        rneig = (struct clew_mesh_node_neighbour *) clew_stack_at(&rnode->mesh_neighbours, n);
-                                        if (rnode->pqueue_cost + rneig->cost < rneig->mesh_node->pqueue_cost) {
-                                                rneig->mesh_node->pqueue_prev = rnode;
-
-                                                pqueue_ocost = rneig->mesh_node->pqueue_cost;
-                                                rneig->mesh_node->pqueue_cost     = rnode->pqueue_cost + rneig->cost;
-                                                rneig->mesh_node->pqueue_distance =  rnode->pqueue_distance + rneig->distance;
-                                                rneig->mesh_node->pqueue_duration =  rnode->pqueue_duration + rneig->duration;
-                                                clew_pqueue_mod(pqueue, rneig->mesh_node, pqueue_ocost > rneig->mesh_node->pqueue_cost);
+                                rneigs = clew_graph_edges(clew->mesh, rindex, &nl);
+                                for (n = 0; n < nl; n++) {
+                                        rneig   = &rneigs[n];
+                                        nsearch = &search[rneig->node];
+                                        if (rsearch->pqueue_cost + rneig->cost < nsearch->pqueue_cost) {
+                                                nsearch->pqueue_prev = rindex;
+
+                                                pqueue_ocost = nsearch->pqueue_cost;
+                                                nsearch->pqueue_cost     = rsearch->pqueue_cost + rneig->cost;
+                                                nsearch->pqueue_distance =  rsearch->pqueue_distance + rneig->distance;
+                                                nsearch->pqueue_duration =  rsearch->pqueue_duration + rneig->duration;
+                                                clew_pqueue_mod(pqueue, nsearch, pqueue_ocost > nsearch->pqueue_cost);
                                         }
                                 }
                         }
@@ -3411,6 +3353,7 @@ int main (int argc, char *argv[])
                 }
 
                 clew_pqueue_destroy(pqueue);
+                free(search);
         }
 
         clew_infof("writing routes");
@@ -3464,8 +3407,8 @@ int main (int argc, char *argv[])
                                 msolution->distance, msolution->duration, msolution->cost);
                         fprintf(fp, "  <trkseg>\n");
                         for (j = 0, jl = clew_stack_count(&msolution->mesh_nodes); j < jl; j++) {
-                                struct clew_mesh_node *mnode = *(struct clew_mesh_node **) clew_stack_at(&msolution->mesh_nodes, j);
-                                fprintf(fp, "   <trkpt lon=\"%.7f\" lat=\"%.7f\"/>\n", mnode->node->lon * 1e-7, mnode->node->lat * 1e-7);
+                                uint64_t mnode = clew_stack_at_uint64(&msolution->mesh_nodes, j);
+                                fprintf(fp, "   <trkpt lon=\"%.7f\" lat=\"%.7f\"/>\n", clew_graph_lon(clew->mesh, mnode) * 1e-7, clew_graph_lat(clew->mesh, mnode) * 1e-7);
                         }
                         fprintf(fp, "  </trkseg>\n");
                         fprintf(fp, " </trk>\n");
@@ -3561,8 +3504,8 @@ int main (int argc, char *argv[])
                                                 msolution->distance, msolution->duration, msolution->cost);
                                         fprintf(fp, "  <trkseg>\n");
                                         for (j = 0, jl = clew_stack_count(&optimized_route[route_idx]->mesh_nodes); j < jl; j++) {
-                                                struct clew_mesh_node *mnode = *(struct clew_mesh_node **) clew_stack_at(&optimized_route[route_idx]->mesh_nodes, j);
-                                                fprintf(fp, "   <trkpt lon=\"%.7f\" lat=\"%.7f\"/>\n", mnode->node->lon * 1e-7, mnode->node->lat * 1e-7);
+                                                uint64_t mnode = clew_stack_at_uint64(&optimized_route[route_idx]->mesh_nodes, j);
+                                                fprintf(fp, "   <trkpt lon=\"%.7f\" lat=\"%.7f\"/>\n", clew_graph_lon(clew->mesh, mnode) * 1e-7, clew_graph_lat(clew->mesh, mnode) * 1e-7);
                                         }
                                         fprintf(fp, "  </trkseg>\n");
                                         fprintf(fp, " </trk>\n");
@@ -3577,7 +3520,6 @@ int main (int argc, char *argv[])
 
 out:
         if (clew != NULL) {
-                struct clew_mesh_node *mnode;
                 clew_stack_uninit(&clew->options.inputs);
                 clew_stack_uninit(&clew->options.clip_path);
                 clew_stack_uninit(&clew->options.points);
@@ -3585,22 +3527,26 @@ out:
                 clew_expression_destroy(clew->options.keep_tags_node);
                 clew_expression_destroy(clew->options.keep_tags_way);
                 clew_expression_destroy(clew->options.keep_tags_relation);
-                clew_stack_uninit(&clew->read_state);
-                clew_bitmap_uninit(&clew->node_ids);
-                clew_bitmap_uninit(&clew->way_ids);
-                clew_bitmap_uninit(&clew->relation_ids);
-                clew_stack_uninit(&clew->nodes);
+                clew_idset_uninit(&clew->node_ids);
+                clew_idset_uninit(&clew->way_ids);
+                clew_idset_uninit(&clew->relation_ids);
+                clew_stack_uninit(&clew->input_indexes);
+                clew_stack_uninit(&clew->readers);
+                clew_node_store_destroy(clew->nodes);
+                clew_tagset_destroy(clew->tagsets);
+                pthread_mutex_destroy(&clew->tagsets_mutex);
+                clew_bitmap_uninit(&clew->keep_tags_node);
+                clew_bitmap_uninit(&clew->keep_tags_way);
                 clew_stack_uninit(&clew->ways);
                 clew_stack_uninit(&clew->relations);
                 clew_stack_uninit(&clew->mesh_ways);
-                kh_foreach_value(clew->mesh_nodes, mnode,
-                        clew_mesh_node_destroy(mnode);
-                )
-                kh_destroy(mesh_nodes, clew->mesh_nodes);
+                clew_stack_uninit(&clew->mesh_way_types);
+                clew_graph_destroy(clew->mesh);
+                clew_stack_uninit(&clew->mesh_node_index);
+                clew_stack_uninit(&clew->mesh_visited);
                 clew_stack_uninit(&clew->mesh_points);
                 clew_stack_uninit(&clew->mesh_solutions);
-                clew_stack_uninit(&clew->read_tags);
-                clew_stack_uninit(&clew->read_refs);
+                clew_stack_uninit(&clew->arenas);
                 clew_expression_destroy(clew->options.filter);
                 free(clew);
         }
@@ -0,0 +1,729 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "debug.h"
+#include "stack.h"
+#include "bitmap.h"
+#include "idset.h"
+#include "pqueue.h"
+#include "node-store.h"
+
+#define CLEW_NODE_STORE_SPILL_CHECK     (64 * 1024)
+
+enum {
+        CLEW_NODE_STORE_COLUMN_IDS      = 0,
+        CLEW_NODE_STORE_COLUMN_LONS     = 1,
+        CLEW_NODE_STORE_COLUMN_LATS     = 2,
+        CLEW_NODE_STORE_COLUMN_TAGSETS  = 3,
+        CLEW_NODE_STORE_COLUMN_COUNT    = 4
+};
+
+struct clew_node_store_order {
+        uint64_t id;
+        uint64_t index;
+};
+
+/* a node in a spilled run */
+struct clew_node_store_record {
+        uint64_t id;
+        int32_t lon;
+        int32_t lat;
+        uint32_t tagset;
+        uint32_t pad;
+};
+
+struct clew_node_store_run {
+        FILE *fp;
+        uint64_t index;
+        uint64_t pqueue_pos;
+        struct clew_node_store_record record;
+};
+
+struct clew_node_store {
+        int sorted;
+        int completed;
+        uint64_t count;
+
+        struct clew_stack ids;          /* uint64_t */
+        struct clew_stack lons;         /* int32_t */
+        struct clew_stack lats;         /* int32_t */
+        struct clew_stack tagsets;      /* uint32_t */
+
+        uint64_t limit;
+        uint64_t spilled;
+        struct clew_stack runs;         /* FILE *, sorted runs in push order */
+
+        /* columns read by find and the accessors, stack buffers or file mappings after a merge */
+        const uint64_t *pids;
+        const int32_t *plons;
+        const int32_t *plats;
+        const uint32_t *ptagsets;
+        void *maps[CLEW_NODE_STORE_COLUMN_COUNT];
+        uint64_t map_sizes[CLEW_NODE_STORE_COLUMN_COUNT];
+
+        struct clew_idset index;
+};
+
+static void run_stack_destroy_element (void *context, void *elem)
+{
+        (void) context;
+        if (*(FILE **) elem != NULL) {
+                fclose(*(FILE **) elem);
+        }
+}
+
+static void clew_node_store_close_runs (struct clew_node_store *store)
+{
+        uint64_t i;
+        for (i = 0; i < clew_stack_count(&store->runs); i++) {
+                run_stack_destroy_element(NULL, clew_stack_at(&store->runs, i));
+        }
+        clew_stack_reset(&store->runs);
+}
+
+/* temporary files are unlinked right away, they go away with the last reference */
+static FILE * clew_node_store_tmpfile (void)
+{
+        int fd;
+        FILE *fp;
+        const char *dir;
+        char path[4096];
+
+        dir = getenv("TMPDIR");
+        if (dir == NULL || dir[0] == '\0') {
+                dir = "/tmp";
+        }
+        snprintf(path, sizeof(path), "%s/clew-nodes-XXXXXX", dir);
+        fd = mkstemp(path);
+        if (fd < 0) {
+                clew_errorf("can not create temporary file in %s", dir);
+                return NULL;
+        }
+        unlink(path);
+        fp = fdopen(fd, "w+b");
+        if (fp == NULL) {
+                clew_errorf("can not open temporary file");
+                close(fd);
+                return NULL;
+        }
+        return fp;
+}
+
+static void clew_node_store_unmap (struct clew_node_store *store)
+{
+        int i;
+        for (i = 0; i < CLEW_NODE_STORE_COLUMN_COUNT; i++) {
+                if (store->maps[i] != NULL) {
+                        munmap(store->maps[i], store->map_sizes[i]);
+                }
+                store->maps[i]      = NULL;
+                store->map_sizes[i] = 0;
+        }
+}
+
+static void clew_node_store_point_columns (struct clew_node_store *store)
+{
+        store->pids     = (const uint64_t *) clew_stack_buffer(&store->ids);
+        store->plons    = (const int32_t *) clew_stack_buffer(&store->lons);
+        store->plats    = (const int32_t *) clew_stack_buffer(&store->lats);
+        store->ptagsets = (const uint32_t *) clew_stack_buffer(&store->tagsets);
+}
+
+static int run_pqueue_compare (const void *a, const void *b)
+{
+        const struct clew_node_store_run *r1 = (const struct clew_node_store_run *) a;
+        const struct clew_node_store_run *r2 = (const struct clew_node_store_run *) b;
+        if (r1->record.id > r2->record.id) return 1;
+        if (r1->record.id < r2->record.id) return 0;
+        return r1->index > r2->index;
+}
+
+static void run_pqueue_setpos (void *a, uint64_t position)
+{
+        ((struct clew_node_store_run *) a)->pqueue_pos = position;
+}
+
+static uint64_t run_pqueue_getpos (const void *a)
+{
+        return ((const struct clew_node_store_run *) a)->pqueue_pos;
+}
+
+/* returns 0 on record, 1 at end of run, -1 on error */
+static int run_read (struct clew_node_store_run *run)
+{
+        if (fread(&run->record, sizeof(struct clew_node_store_record), 1, run->fp) != 1) {
+                if (feof(run->fp)) {
+                        return 1;
+                }
+                clew_errorf("can not read node run");
+                return -1;
+        }
+        return 0;
+}
+
+static int clew_node_store_order_compare (const void *a, const void *b)
+{
+        const struct clew_node_store_order *o1 = (const struct clew_node_store_order *) a;
+        const struct clew_node_store_order *o2 = (const struct clew_node_store_order *) b;
+        if (o1->id < o2->id) {
+                return -1;
+        }
+        if (o1->id > o2->id) {
+                return 1;
+        }
+        if (o1->index < o2->index) {
+                return -1;
+        }
+        if (o1->index > o2->index) {
+                return 1;
+        }
+        return 0;
+}
+
+struct clew_node_store * clew_node_store_create (void)
+{
+        struct clew_node_store *store;
+
+        store = (struct clew_node_store *) malloc(sizeof(struct clew_node_store));
+        if (store == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        memset(store, 0, sizeof(struct clew_node_store));
+        store->ids      = clew_stack_init2(sizeof(uint64_t), 64 * 1024);
+        store->lons     = clew_stack_init2(sizeof(int32_t), 64 * 1024);
+        store->lats     = clew_stack_init2(sizeof(int32_t), 64 * 1024);
+        store->tagsets  = clew_stack_init2(sizeof(uint32_t), 64 * 1024);
+        store->runs     = clew_stack_init3(sizeof(FILE *), run_stack_destroy_element, NULL);
+        store->index    = clew_idset_init(CLEW_IDSET_MODE_SPARSE);
+        clew_node_store_reset(store);
+
+        return store;
+bail:   return NULL;
+}
+
+void clew_node_store_destroy (struct clew_node_store *store)
+{
+        if (store == NULL) {
+                return;
+        }
+        clew_node_store_unmap(store);
+        clew_stack_uninit(&store->ids);
+        clew_stack_uninit(&store->lons);
+        clew_stack_uninit(&store->lats);
+        clew_stack_uninit(&store->tagsets);
+        clew_stack_uninit(&store->runs);
+        clew_idset_uninit(&store->index);
+        free(store);
+}
+
+void clew_node_store_reset (struct clew_node_store *store)
+{
+        clew_node_store_unmap(store);
+        clew_stack_reset(&store->ids);
+        clew_stack_reset(&store->lons);
+        clew_stack_reset(&store->lats);
+        clew_stack_reset(&store->tagsets);
+        clew_node_store_close_runs(store);
+        clew_idset_reset(&store->index);
+        clew_node_store_point_columns(store);
+        store->sorted    = 1;
+        store->completed = 0;
+        store->count     = 0;
+        store->spilled   = 0;
+}
+
+void clew_node_store_set_limit (struct clew_node_store *store, uint64_t limit)
+{
+        store->limit = limit;
+}
+
+/* bytes held by the nodes pushed since the last spill, grown capacity is not counted */
+static uint64_t clew_node_store_used (const struct clew_node_store *store)
+{
+        return store->count * (sizeof(uint64_t) + sizeof(int32_t) + sizeof(int32_t) + sizeof(uint32_t));
+}
+
+/* writes the nodes in memory as a run sorted by id, the first copy of a duplicate id is kept */
+static int clew_node_store_spill (struct clew_node_store *store)
+{
+        int rc;
+        uint64_t i;
+        uint64_t at;
+        FILE *fp;
+        struct clew_node_store_order *order;
+        struct clew_node_store_record record;
+
+        fp    = NULL;
+        order = NULL;
+
+        if (store->count == 0) {
+                return 0;
+        }
+
+        order = (struct clew_node_store_order *) malloc(sizeof(struct clew_node_store_order) * store->count);
+        if (order == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        for (i = 0; i < store->count; i++) {
+                order[i].id    = clew_stack_at_uint64(&store->ids, i);
+                order[i].index = i;
+        }
+        if (store->sorted == 0) {
+                qsort(order, store->count, sizeof(struct clew_node_store_order), clew_node_store_order_compare);
+        }
+
+        fp = clew_node_store_tmpfile();
+        if (fp == NULL) {
+                goto bail;
+        }
+        memset(&record, 0, sizeof(struct clew_node_store_record));
+        for (i = 0; i < store->count; i++) {
+                if (i > 0 && order[i].id == order[i - 1].id) {
+                        continue;
+                }
+                at = order[i].index;
+                record.id     = order[i].id;
+                record.lon    = clew_stack_at_int32(&store->lons, at);
+                record.lat    = clew_stack_at_int32(&store->lats, at);
+                record.tagset = clew_stack_at_uint32(&store->tagsets, at);
+                if (fwrite(&record, sizeof(struct clew_node_store_record), 1, fp) != 1) {
+                        clew_errorf("can not write node run");
+                        goto bail;
+                }
+        }
+        if (fflush(fp) != 0) {
+                clew_errorf("can not write node run");
+                goto bail;
+        }
+        free(order);
+        order = NULL;
+
+        rc = clew_stack_push(&store->runs, &fp);
+        if (rc < 0) {
+                clew_errorf("can not push node run");
+                goto bail;
+        }
+
+        store->spilled += store->count;
+        clew_stack_reset(&store->ids);
+        clew_stack_reset(&store->lons);
+        clew_stack_reset(&store->lats);
+        clew_stack_reset(&store->tagsets);
+        store->sorted = 1;
+        store->count  = 0;
+
+        return 0;
+bail:   if (order != NULL) {
+                free(order);
+        }
+        if (fp != NULL) {
+                fclose(fp);
+        }
+        return -1;
+}
+
+int clew_node_store_push (struct clew_node_store *store, uint64_t id, int32_t lon, int32_t lat, uint32_t tagset)
+{
+        int rc;
+
+        if (store->completed) {
+                clew_errorf("node store is completed");
+                goto bail;
+        }
+        if (store->count > 0 && id <= clew_stack_at_uint64(&store->ids, store->count - 1)) {
+                store->sorted = 0;
+        }
+
+        rc  = clew_stack_push_uint64(&store->ids, id);
+        rc |= clew_stack_push_int32(&store->lons, lon);
+        rc |= clew_stack_push_int32(&store->lats, lat);
+        rc |= clew_stack_push_uint32(&store->tagsets, tagset);
+        if (rc != 0) {
+                clew_errorf("can not push node");
+                goto bail;
+        }
+
+        store->count += 1;
+
+        if (store->limit > 0 &&
+            (store->count % CLEW_NODE_STORE_SPILL_CHECK) == 0 &&
+            clew_node_store_used(store) > store->limit) {
+                rc = clew_node_store_spill(store);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        return 0;
+bail:   return -1;
+}
+
+int clew_node_store_append (struct clew_node_store *store, struct clew_node_store *other)
+{
+        int rc;
+        uint64_t i;
+
+        if (store->completed) {
+                clew_errorf("node store is completed");
+                goto bail;
+        }
+
+        /* runs of other are taken over, nodes in memory are spilled first to keep push order */
+        if (clew_stack_count(&other->runs) > 0) {
+                rc = clew_node_store_spill(store);
+                if (rc < 0) {
+                        goto bail;
+                }
+                for (i = 0; i < clew_stack_count(&other->runs); i++) {
+                        rc = clew_stack_push(&store->runs, clew_stack_at(&other->runs, i));
+                        if (rc < 0) {
+                                clew_errorf("can not push node run");
+                                goto bail;
+                        }
+                        *(FILE **) clew_stack_at(&other->runs, i) = NULL;
+                }
+                clew_stack_reset(&other->runs);
+                store->spilled += other->spilled;
+                other->spilled  = 0;
+        }
+
+        for (i = 0; i < other->count; i++) {
+                rc = clew_node_store_push(store,
+                                clew_stack_at_uint64(&other->ids, i),
+                                clew_stack_at_int32(&other->lons, i),
+                                clew_stack_at_int32(&other->lats, i),
+                                clew_stack_at_uint32(&other->tagsets, i));
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+        return 0;
+bail:   return -1;
+}
+
+static int clew_node_store_complete_memory (struct clew_node_store *store, int64_t *duplicates)
+{
+        int rc;
+        uint64_t i;
+        uint64_t at;
+        struct clew_node_store_order *order;
+        struct clew_node_store *sorted;
+
+        order  = NULL;
+        sorted = NULL;
+
+        if (store->sorted == 0) {
+                order = (struct clew_node_store_order *) malloc(sizeof(struct clew_node_store_order) * store->count);
+                if (order == NULL) {
+                        clew_errorf("can not allocate memory");
+                        goto bail;
+                }
+                for (i = 0; i < store->count; i++) {
+                        order[i].id    = clew_stack_at_uint64(&store->ids, i);
+                        order[i].index = i;
+                }
+                qsort(order, store->count, sizeof(struct clew_node_store_order), clew_node_store_order_compare);
+
+                /* gather columns in id order, the first copy of a duplicate id is kept */
+                sorted = clew_node_store_create();
+                if (sorted == NULL) {
+                        goto bail;
+                }
+                for (i = 0; i < store->count; i++) {
+                        if (i > 0 && order[i].id == order[i - 1].id) {
+                                continue;
+                        }
+                        at = order[i].index;
+                        rc = clew_node_store_push(sorted,
+                                        order[i].id,
+                                        clew_stack_at_int32(&store->lons, at),
+                                        clew_stack_at_int32(&store->lats, at),
+                                        clew_stack_at_uint32(&store->tagsets, at));
+                        if (rc < 0) {
+                                goto bail;
+                        }
+                }
+                free(order);
+                order = NULL;
+
+                *duplicates = store->count - sorted->count;
+                clew_stack_uninit(&store->ids);
+                clew_stack_uninit(&store->lons);
+                clew_stack_uninit(&store->lats);
+                clew_stack_uninit(&store->tagsets);
+                store->ids      = sorted->ids;
+                store->lons     = sorted->lons;
+                store->lats     = sorted->lats;
+                store->tagsets  = sorted->tagsets;
+                store->count    = sorted->count;
+                clew_stack_uninit(&sorted->runs);
+                clew_idset_uninit(&sorted->index);
+                free(sorted);
+                sorted = NULL;
+        } else {
+                *duplicates = 0;
+        }
+        store->sorted = 1;
+
+        for (i = 0; i < store->count; i++) {
+                rc = clew_idset_mark(&store->index, clew_stack_at_uint64(&store->ids, i));
+                if (rc < 0) {
+                        clew_errorf("can not index node");
+                        goto bail;
+                }
+        }
+        clew_node_store_point_columns(store);
+
+        return 0;
+bail:   if (order != NULL) {
+                free(order);
+        }
+        clew_node_store_destroy(sorted);
+        return -1;
+}
+
+/*
+ * k-way merge of the spilled runs into one file per column, which are then
+ * mapped read only. the mapped pages are backed by the files, so they can be
+ * dropped under memory pressure instead of counting against the limit.
+ */
+static int clew_node_store_complete_merge (struct clew_node_store *store, int64_t *duplicates)
+{
+        int rc;
+        uint64_t c;
+        uint64_t i;
+        uint64_t il;
+        uint64_t last;
+        uint64_t count;
+        long size;
+        void *map;
+        FILE *columns[CLEW_NODE_STORE_COLUMN_COUNT];
+        struct clew_pqueue *pqueue;
+        struct clew_node_store_run *run;
+        struct clew_node_store_run *runs;
+
+        runs   = NULL;
+        pqueue = NULL;
+        memset(columns, 0, sizeof(columns));
+
+        rc = clew_node_store_spill(store);
+        if (rc < 0) {
+                goto bail;
+        }
+        clew_stack_uninit(&store->ids);
+        clew_stack_uninit(&store->lons);
+        clew_stack_uninit(&store->lats);
+        clew_stack_uninit(&store->tagsets);
+
+        il   = clew_stack_count(&store->runs);
+        runs = (struct clew_node_store_run *) malloc(sizeof(struct clew_node_store_run) * il);
+        if (runs == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        for (i = 0; i < il; i++) {
+                runs[i].fp    = *(FILE **) clew_stack_at(&store->runs, i);
+                runs[i].index = i;
+        }
+        pqueue = clew_pqueue_create(il + 1, 64, run_pqueue_compare, run_pqueue_setpos, run_pqueue_getpos);
+        if (pqueue == NULL) {
+                clew_errorf("can not create pqueue");
+                goto bail;
+        }
+        for (i = 0; i < il; i++) {
+                rewind(runs[i].fp);
+                rc = run_read(&runs[i]);
+                if (rc < 0) {
+                        goto bail;
+                } else if (rc == 0) {
+                        rc = clew_pqueue_add(pqueue, &runs[i]);
+                        if (rc < 0) {
+                                clew_errorf("can not add node run");
+                                goto bail;
+                        }
+                }
+        }
+
+        for (c = 0; c < CLEW_NODE_STORE_COLUMN_COUNT; c++) {
+                columns[c] = clew_node_store_tmpfile();
+                if (columns[c] == NULL) {
+                        goto bail;
+                }
+        }
+
+        rc    = 0;
+        last  = 0;
+        count = 0;
+        while (rc == 0 && (run = (struct clew_node_store_run *) clew_pqueue_pop(pqueue)) != NULL) {
+                /* runs are popped in id then push order, so the first copy of a duplicate id is kept */
+                if (count == 0 || run->record.id != last) {
+                        rc |= (fwrite(&run->record.id, sizeof(uint64_t), 1, columns[CLEW_NODE_STORE_COLUMN_IDS]) != 1);
+                        rc |= (fwrite(&run->record.lon, sizeof(int32_t), 1, columns[CLEW_NODE_STORE_COLUMN_LONS]) != 1);
+                        rc |= (fwrite(&run->record.lat, sizeof(int32_t), 1, columns[CLEW_NODE_STORE_COLUMN_LATS]) != 1);
+                        rc |= (fwrite(&run->record.tagset, sizeof(uint32_t), 1, columns[CLEW_NODE_STORE_COLUMN_TAGSETS]) != 1);
+                        if (clew_idset_mark(&store->index, run->record.id) < 0) {
+                                clew_errorf("can not index node");
+                                goto bail;
+                        }
+                        last   = run->record.id;
+                        count += 1;
+                }
+                if (rc != 0) {
+                        break;
+                }
+                rc = run_read(run);
+                if (rc < 0) {
+                        goto bail;
+                } else if (rc == 0) {
+                        rc = clew_pqueue_add(pqueue, run);
+                        if (rc < 0) {
+                                clew_errorf("can not add node run");
+                                goto bail;
+                        }
+                }
+                rc = 0;
+        }
+        if (rc != 0) {
+                clew_errorf("can not write node columns");
+                goto bail;
+        }
+        *duplicates = store->spilled - count;
+
+        clew_pqueue_destroy(pqueue);
+        pqueue = NULL;
+        free(runs);
+        runs = NULL;
+        clew_node_store_close_runs(store);
+
+        for (c = 0; c < CLEW_NODE_STORE_COLUMN_COUNT; c++) {
+                if (fflush(columns[c]) != 0) {
+                        clew_errorf("can not write node columns");
+                        goto bail;
+                }
+                fseek(columns[c], 0, SEEK_END);
+                size = ftell(columns[c]);
+                if (size > 0) {
+                        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(columns[c]), 0);
+                        if (map == MAP_FAILED) {
+                                clew_errorf("can not map node columns");
+                                goto bail;
+                        }
+                        store->maps[c]      = map;
+                        store->map_sizes[c] = size;
+                }
+                fclose(columns[c]);
+                columns[c] = NULL;
+        }
+        store->pids     = (const uint64_t *) store->maps[CLEW_NODE_STORE_COLUMN_IDS];
+        store->plons    = (const int32_t *) store->maps[CLEW_NODE_STORE_COLUMN_LONS];
+        store->plats    = (const int32_t *) store->maps[CLEW_NODE_STORE_COLUMN_LATS];
+        store->ptagsets = (const uint32_t *) store->maps[CLEW_NODE_STORE_COLUMN_TAGSETS];
+        store->count    = count;
+        store->spilled  = 0;
+        store->sorted   = 1;
+
+        return 0;
+bail:   if (pqueue != NULL) {
+                clew_pqueue_destroy(pqueue);
+        }
+        if (runs != NULL) {
+                free(runs);
+        }
+        for (c = 0; c < CLEW_NODE_STORE_COLUMN_COUNT; c++) {
+                if (columns[c] != NULL) {
+                        fclose(columns[c]);
+                }
+        }
+        clew_node_store_unmap(store);
+        return -1;
+}
+
+int64_t clew_node_store_complete (struct clew_node_store *store)
+{
+        int rc;
+        int64_t duplicates;
+
+        if (store->completed) {
+                return 0;
+        }
+
+        if (clew_stack_count(&store->runs) > 0) {
+                rc = clew_node_store_complete_merge(store, &duplicates);
+        } else {
+                rc = clew_node_store_complete_memory(store, &duplicates);
+        }
+        if (rc < 0) {
+                goto bail;
+        }
+
+        rc = clew_idset_index(&store->index);
+        if (rc < 0) {
+                clew_errorf("can not index nodes");
+                goto bail;
+        }
+        store->completed = 1;
+
+        return duplicates;
+bail:   return -1;
+}
+
+uint64_t clew_node_store_count (const struct clew_node_store *store)
+{
+        return store->spilled + store->count;
+}
+
+uint64_t clew_node_store_memory (const struct clew_node_store *store)
+{
+        uint64_t memory;
+        memory  = store->ids.avail * sizeof(uint64_t);
+        memory += store->lons.avail * sizeof(int32_t);
+        memory += store->lats.avail * sizeof(int32_t);
+        memory += store->tagsets.avail * sizeof(uint32_t);
+        memory += clew_idset_memory(&store->index);
+        return memory;
+}
+
+uint64_t clew_node_store_runs (const struct clew_node_store *store)
+{
+        return clew_stack_count(&store->runs);
+}
+
+int clew_node_store_mapped (const struct clew_node_store *store)
+{
+        return store->maps[CLEW_NODE_STORE_COLUMN_IDS] != NULL;
+}
+
+int clew_node_store_find (const struct clew_node_store *store, uint64_t id, uint64_t *index)
+{
+        if (store->completed == 0) {
+                clew_errorf("node store is not completed");
+                return -1;
+        }
+        return clew_idset_rank(&store->index, id, index);
+}
+
+uint64_t clew_node_store_id (const struct clew_node_store *store, uint64_t index)
+{
+        return store->pids[index];
+}
+
+int32_t clew_node_store_lon (const struct clew_node_store *store, uint64_t index)
+{
+        return store->plons[index];
+}
+
+int32_t clew_node_store_lat (const struct clew_node_store *store, uint64_t index)
+{
+        return store->plats[index];
+}
+
+uint32_t clew_node_store_tagset (const struct clew_node_store *store, uint64_t index)
+{
+        return store->ptagsets[index];
+}
@@ -0,0 +1,46 @@
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * extracted nodes kept as columns: ids, lons, lats and tag set ids in
+ * parallel arrays, the tags themselves live in a struct clew_tagset of the
+ * caller. complete sorts by id, drops duplicates and indexes the ids, so
+ * find maps an id to its position with a rank lookup instead of a search.
+ *
+ * with a limit set, nodes in memory are written out as sorted runs to
+ * temporary files once they take more than limit bytes. complete then
+ * merges the runs into files mapped read only, and append takes over the
+ * runs of the other store.
+ */
+struct clew_node_store;
+
+struct clew_node_store * clew_node_store_create (void);
+void clew_node_store_destroy (struct clew_node_store *store);
+
+void clew_node_store_reset (struct clew_node_store *store);
+/* 0 keeps every node in memory, temporary files are created in $TMPDIR or /tmp */
+void clew_node_store_set_limit (struct clew_node_store *store, uint64_t limit);
+int clew_node_store_push (struct clew_node_store *store, uint64_t id, int32_t lon, int32_t lat, uint32_t tagset);
+int clew_node_store_append (struct clew_node_store *store, struct clew_node_store *other);
+/* returns number of duplicates dropped, -1 on error */
+int64_t clew_node_store_complete (struct clew_node_store *store);
+
+uint64_t clew_node_store_count (const struct clew_node_store *store);
+uint64_t clew_node_store_memory (const struct clew_node_store *store);
+uint64_t clew_node_store_runs (const struct clew_node_store *store);
+int clew_node_store_mapped (const struct clew_node_store *store);
+
+/* returns 0 if found, 1 if id is not in store, -1 if not completed */
+int clew_node_store_find (const struct clew_node_store *store, uint64_t id, uint64_t *index);
+
+uint64_t clew_node_store_id (const struct clew_node_store *store, uint64_t index);
+int32_t clew_node_store_lon (const struct clew_node_store *store, uint64_t index);
+int32_t clew_node_store_lat (const struct clew_node_store *store, uint64_t index);
+uint32_t clew_node_store_tagset (const struct clew_node_store *store, uint64_t index);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,296 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "debug.h"
+#include "tag.h"
+#include "tag-parse.h"
+
+#define CLEW_TAG_PARSE_K_LENGTH         512
+#define CLEW_TAG_PARSE_V_LENGTH         512
+#define CLEW_TAG_PARSE_S_LENGTH         (CLEW_TAG_PARSE_K_LENGTH + CLEW_TAG_PARSE_V_LENGTH)
+
+/*
+ * numeric values, parsed straight to their tag id. a parser returns
+ * UINT32_MAX if the value is not a number it understands, the value is then
+ * looked up as a string like any other.
+ */
+
+struct parse_tag_number {
+        const char *k;
+        uint32_t (*value) (const char *v);
+};
+
+/* decimal number with optional sign and fraction, returns the end or NULL */
+static const char * parse_tag_number_value (const char *v, double *value)
+{
+        int sign;
+        double scale;
+        const char *s;
+
+        while (*v == ' ') {
+                v++;
+        }
+        sign = 1;
+        if (*v == '-') {
+                sign = -1;
+                v++;
+        } else if (*v == '+') {
+                v++;
+        }
+        s      = v;
+        *value = 0;
+        while (*v >= '0' && *v <= '9') {
+                *value = *value * 10 + (*v++ - '0');
+        }
+        if (*v == '.') {
+                if (v[1] < '0' || v[1] > '9') {
+                        return NULL;
+                }
+                for (v++, scale = 0.1; *v >= '0' && *v <= '9'; v++, scale /= 10) {
+                        *value += (*v - '0') * scale;
+                }
+        }
+        if (v == s) {
+                return NULL;
+        }
+        *value *= sign;
+        while (*v == ' ') {
+                v++;
+        }
+        return v;
+}
+
+/* unit is name, case insensitive, followed only by spaces */
+static int parse_tag_number_unit (const char *unit, const char *name)
+{
+        while (*name != '\0') {
+                if (tolower((unsigned char) *unit++) != *name++) {
+                        return 0;
+                }
+        }
+        while (*unit == ' ') {
+                unit++;
+        }
+        return *unit == '\0';
+}
+
+static uint32_t parse_tag_length (const char *v)
+{
+        int length;
+        double value;
+        double inches;
+        const char *unit;
+
+        unit = parse_tag_number_value(v, &value);
+        if (unit == NULL) {
+                return UINT32_MAX;
+        }
+        if (*unit == '\0' || parse_tag_number_unit(unit, "m")) {
+                /* meters */
+        } else if (parse_tag_number_unit(unit, "km")) {
+                value *= 1000;
+        } else if (parse_tag_number_unit(unit, "mi")) {
+                value *= 1609.344;
+        } else if (parse_tag_number_unit(unit, "nmi")) {
+                value *= 1852;
+        } else if (parse_tag_number_unit(unit, "ft")) {
+                value *= 0.3048;
+        } else if (*unit == '"') {
+                if (!parse_tag_number_unit(unit + 1, "")) {
+                        return UINT32_MAX;
+                }
+                value *= 0.0254;
+        } else if (*unit == '\'') {
+                /* feet, with optional inches, like 16'3" */
+                value *= 0.3048;
+                if (!parse_tag_number_unit(unit + 1, "")) {
+                        unit = parse_tag_number_value(unit + 1, &inches);
+                        if (unit == NULL || *unit != '"' || !parse_tag_number_unit(unit + 1, "")) {
+                                return UINT32_MAX;
+                        }
+                        value += inches * 0.0254;
+                }
+        } else {
+                return UINT32_MAX;
+        }
+
+        length = (int) round((value < 0.0) ? 0.0 : (value > 2000000.0) ? 2000000.0 : value);
+        if (length == 0) {
+                return clew_tag_length_0;
+        } else if (length >= 1 && length <= 100) {
+                return clew_tag_length_1 + (length - 1);
+        } else if (length >= 110 && length <= 1000) {
+                return clew_tag_length_110 + ((length - 110) / 10);
+        } else if (length >= 1010 && length <= 5000) {
+                return clew_tag_length_1010 + ((length - 1010) / 10);
+        } else if (length >= 5025 && length <= 10000) {
+                return clew_tag_length_5025 + ((length - 5025) / 25);
+        } else if (length >= 10050 && length <= 50000) {
+                return clew_tag_length_10050 + ((length - 10050) / 50);
+        } else if (length >= 50100 && length <= 100000) {
+                return clew_tag_length_50100 + ((length - 50100) / 100);
+        } else if (length >= 100250 && length <= 500000) {
+                return clew_tag_length_100250 + ((length - 100250) / 250);
+        } else if (length >= 500500 && length <= 1000000) {
+                return clew_tag_length_500500 + ((length - 500500) / 500);
+        }
+        return clew_tag_length_unknown;
+}
+
+/* km/h, returns -1 if not a speed of 0 to 2000 km/h */
+static int parse_tag_speed (const char *v)
+{
+        double value;
+        const char *unit;
+
+        unit = parse_tag_number_value(v, &value);
+        if (unit == NULL) {
+                return -1;
+        }
+        if (*unit == '\0' || parse_tag_number_unit(unit, "km/h") || parse_tag_number_unit(unit, "kmh") || parse_tag_number_unit(unit, "kph")) {
+                /* km/h */
+        } else if (parse_tag_number_unit(unit, "mph")) {
+                value *= 1.609344;
+        } else if (parse_tag_number_unit(unit, "knots")) {
+                value *= 1.852;
+        } else {
+                return -1;
+        }
+        if (value < 0.0 || value > 2000.0) {
+                return -1;
+        }
+        return (int) round(value);
+}
+
+static uint32_t parse_tag_maxspeed (const char *v)
+{
+        int speed;
+        speed = parse_tag_speed(v);
+        if (speed < 0) {
+                return UINT32_MAX;
+        }
+        return clew_tag_maxspeed_0 + speed;
+}
+
+static uint32_t parse_tag_minspeed (const char *v)
+{
+        int speed;
+        speed = parse_tag_speed(v);
+        if (speed < 0) {
+                return UINT32_MAX;
+        }
+        return clew_tag_minspeed_0 + speed;
+}
+
+static uint32_t parse_tag_layer (const char *v)
+{
+        int sign;
+        int layer;
+
+        while (*v == ' ') {
+                v++;
+        }
+        sign = 1;
+        if (*v == '-') {
+                sign = -1;
+                v++;
+        } else if (*v == '+') {
+                v++;
+        }
+        if (*v < '0' || *v > '9') {
+                return UINT32_MAX;
+        }
+        for (layer = 0; *v >= '0' && *v <= '9' && layer < 100; v++) {
+                layer = layer * 10 + (*v - '0');
+        }
+        if (!parse_tag_number_unit(v, "")) {
+                return UINT32_MAX;
+        }
+        if (layer == 0) {
+                return clew_tag_layer_ground;
+        } else if (layer <= 5) {
+                return (sign > 0) ? clew_tag_layer_above1 + (layer - 1) : clew_tag_layer_below1 + (layer - 1);
+        }
+        return clew_tag_unknown;
+}
+
+static const struct parse_tag_number parse_tag_numbers[] = {
+        { "layer",      parse_tag_layer },
+        { "length",     parse_tag_length },
+        { "maxspeed",   parse_tag_maxspeed },
+        { "minspeed",   parse_tag_minspeed },
+};
+
+static void parse_tag_fix (char *k, char *v)
+{
+        char *c;
+        for (c = k; c && *c; c++) {
+                if (*c == '-') {
+                        *c = '_';
+                }
+        }
+        for (c = v; c && *c; c++) {
+                if (*c == '-') {
+                        *c = '_';
+                }
+        }
+}
+
+uint32_t clew_tag_parse (const char *k, const char *v)
+{
+        int kl;
+        int vl;
+        int sl;
+        char tag_k[CLEW_TAG_PARSE_K_LENGTH];
+        char tag_v[CLEW_TAG_PARSE_V_LENGTH];
+        char tag_s[CLEW_TAG_PARSE_S_LENGTH];
+        uint32_t tag;
+        uint32_t i;
+
+        for (i = 0; i < sizeof(parse_tag_numbers) / sizeof(parse_tag_numbers[0]); i++) {
+                if (strcasecmp(k, parse_tag_numbers[i].k) == 0) {
+                        tag = parse_tag_numbers[i].value(v);
+                        if (tag != UINT32_MAX) {
+                                return tag;
+                        }
+                        break;
+                }
+        }
+
+        strncpy(tag_k, k, sizeof(tag_k) - 1);
+        tag_k[sizeof(tag_k) - 1] = '\0';
+        strncpy(tag_v, v, sizeof(tag_v) - 1);
+        tag_v[sizeof(tag_v) - 1] = '\0';
+
+        kl = strlen(tag_k);
+        if (kl <= 0) {
+                clew_debugf("k is invalid: %s = %s", tag_k, tag_v);
+                return clew_tag_unknown;
+        }
+        vl = strlen(tag_v);
+        if (vl <= 0) {
+                clew_debugf("v is invalid: %s = %s", tag_k, tag_v);
+                return clew_tag_unknown;
+        }
+        if (kl + 1 + vl >= (int) sizeof(tag_s)) {
+                clew_errorf("tag string too long: %s_%s", tag_k, tag_v);
+                return clew_tag_unknown;
+        }
+
+        parse_tag_fix(tag_k, tag_v);
+
+        sl = 0;
+        tag_s[sl] = '\0';
+        memcpy(tag_s + sl, tag_k, kl); sl += kl;
+        memcpy(tag_s + sl, "_", 1);    sl += 1;
+        memcpy(tag_s + sl, tag_v, vl); sl += vl;
+        tag_s[sl] = '\0';
+
+        return clew_tag_value(tag_s);
+}
@@ -0,0 +1,12 @@
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t clew_tag_parse (const char *k, const char *v);
+
+#ifdef __cplusplus
+}
+#endif
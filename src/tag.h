@@ -1449,6 +1449,46 @@ uint32_t * clew_tags_group_tunnel (void);
 int clew_tag_is_group_maxspeed (uint32_t tag);
 uint32_t * clew_tags_group_maxspeed (void);
 
+/* groups are the last tags, bits count back from the last */
+#define CLEW_TAG_GROUP_BIT(group)       (1u << (clew_tag_last - 1 - (group)))
+
+enum {
+        CLEW_TAG_ONEWAY_NONE            = 0,
+        CLEW_TAG_ONEWAY_NO              = 1,
+        CLEW_TAG_ONEWAY_YES             = 2,
+        CLEW_TAG_ONEWAY_REVERSE         = 3
+};
+
+/* generated by tag.sh, indexed by tag id */
+struct clew_tag_property {
+        uint32_t groups;                /* bits of the groups the tag is in */
+        uint16_t maxspeed;              /* km/h of a maxspeed tag */
+        uint8_t highway;                /* rank of a routable highway, 1 is the highest, 0 if not */
+        uint8_t oneway;                 /* direction of a oneway tag */
+};
+
+extern const struct clew_tag_property clew_tag_properties[];
+
+static inline uint32_t clew_tag_group_bits (uint32_t tag)
+{
+        return clew_tag_properties[tag].groups;
+}
+
+static inline uint32_t clew_tag_maxspeed_value (uint32_t tag)
+{
+        return clew_tag_properties[tag].maxspeed;
+}
+
+static inline uint32_t clew_tag_highway_rank (uint32_t tag)
+{
+        return clew_tag_properties[tag].highway;
+}
+
+static inline uint32_t clew_tag_oneway_direction (uint32_t tag)
+{
+        return clew_tag_properties[tag].oneway;
+}
+
 void clew_tag_init (void);
 void clew_tag_fini (void);
 
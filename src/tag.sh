@@ -1,5 +1,129 @@
 #!/bin/sh
 
+# multiply add hashes over the case folded name, mixed once at the end, all
+# arithmetic modulo 2^32
+TAG_HASH_MA=16777619
+TAG_HASH_SA=2166136261
+TAG_HASH_MB=1540483477
+TAG_HASH_SB=3266489909
+TAG_HASH_MC=668265261
+TAG_HASH_SC=374761393
+
+# routable highway classes, highest rank first, the order of the mesh way
+# types in main.cpp
+TAG_HIGHWAY_RANKS="motorway motorway_link trunk trunk_link primary primary_link secondary secondary_link tertiary tertiary_link unclassified road residential living_street service track path cycleway bridleway"
+
+# reads "name tag" lines and prints a minimal perfect hash table over the
+# names, hash and displace: names are split into buckets by hash a, buckets
+# are placed largest first, each at the first displacement d that sends all
+# of its names to free slots (b + (d / count) * c + (d % count)) % count.
+# if a bucket can not be placed the hashes are seeded again with a new salt.
+tag_hash_table () {
+	awk -v table=$1 \
+	    -v ma=$TAG_HASH_MA -v sa=$TAG_HASH_SA \
+	    -v mb=$TAG_HASH_MB -v sb=$TAG_HASH_SB \
+	    -v mc=$TAG_HASH_MC -v sc=$TAG_HASH_SC '
+	function mul32 (x, y,   xl) {
+		xl = x % 65536;
+		return ((((x - xl) / 65536) * y % 65536) * 65536 + xl * y) % 4294967296;
+	}
+	function hash (s, m, h,   i) {
+		for (i = 1; i <= length(s); i++) {
+			h = (mul32(h, m) + ord[substr(s, i, 1)]) % 4294967296;
+		}
+		h = (h + int(h / 65536)) % 4294967296;
+		return int(mul32(h, 2246822519) / 4096);
+	}
+	function build (salt,   k, g, b, d, j, s, size, smax) {
+		split("", bn);
+		split("", bk);
+		split("", slot);
+		split("", seen);
+		smax = 0;
+		for (k = 1; k <= n; k++) {
+			g     = hash(name[k], ma, (sa + salt) % 4294967296) % r;
+			f1[k] = hash(name[k], mb, (sb + salt) % 4294967296) % m;
+			f2[k] = (m > 1) ? hash(name[k], mc, (sc + salt) % 4294967296) % (m - 1) + 1 : 0;
+			bn[g]++;
+			bk[g, bn[g]] = k;
+			if (bn[g] > smax) {
+				smax = bn[g];
+			}
+		}
+		stamp = 0;
+		for (size = smax; size > 0; size--) {
+			for (b = 0; b < r; b++) {
+				if (bn[b] != size) {
+					continue;
+				}
+				for (d = 0; d < m * m; d++) {
+					stamp++;
+					for (j = 1; j <= size; j++) {
+						s = (f1[bk[b, j]] + int(d / m) * f2[bk[b, j]] + d % m) % m;
+						if ((s in slot) || seen[s] == stamp) {
+							break;
+						}
+						seen[s] = stamp;
+					}
+					if (j > size) {
+						break;
+					}
+				}
+				if (d >= m * m) {
+					return 0;
+				}
+				displacement[b] = d;
+				for (j = 1; j <= size; j++) {
+					slot[(f1[bk[b, j]] + int(d / m) * f2[bk[b, j]] + d % m) % m] = bk[b, j];
+				}
+			}
+		}
+		return 1;
+	}
+	BEGIN {
+		for (i = 1; i < 128; i++) {
+			ord[sprintf("%c", i)] = i;
+		}
+	}
+	{
+		n++;
+		name[n] = $1;
+		tag[n]  = $2;
+		if (length($1) > lmax) {
+			lmax = length($1);
+		}
+	}
+	END {
+		m = n;
+		r = int(n / 4) + 1;
+		for (salt = 0; salt < 256; salt++) {
+			if (build(salt)) {
+				break;
+			}
+		}
+		if (salt >= 256) {
+			print "can not build hash table " table > "/dev/stderr";
+			exit 1;
+		}
+		printf "#define %s_LENGTH_MAX %d\n", toupper(table), lmax;
+		printf "#define %s_SALT %d\n", toupper(table), salt;
+		printf "\n";
+		printf "static const uint32_t %s_displacements[] = {\n", table;
+		for (b = 0; b < r; b++) {
+			printf "\t%d,\n", displacement[b];
+		}
+		printf "};\n";
+		printf "\n";
+		printf "static const struct tag_hash %s[] = {\n", table;
+		for (s = 0; s < m; s++) {
+			k = slot[s];
+			printf "\t{ %s, %d, \"%s\" },\n", tag[k], length(name[k]), name[k];
+		}
+		printf "};\n";
+		printf "\n";
+	}'
+}
+
 printf "\n";
 printf "/* auto generated file, do not edit */\n";
 printf "\n";
@@ -27,13 +151,29 @@ done;
 printf "};\n";
 printf "\n";
 
-printf "static struct tag tags_n[] = {\n";
-for t in `cat $1tag*.h  | grep "clew_tag_"  | grep "," | awk {'print $1'} | cut -d "," -f 1 | cut -b 10- | cut -d" " -f1 | sort -V | uniq`; do
-  printf "\t{ clew_tag_$t, \"$t\" },\n";
-done;
+printf "struct tag_hash {\n";
+printf "\tuint32_t tag;\n";
+printf "\tuint32_t length;\n";
+printf "\tconst char *name;\n";
 printf "};\n";
 printf "\n";
 
+printf "#define TAG_HASH_MA %du\n" $TAG_HASH_MA;
+printf "#define TAG_HASH_SA %du\n" $TAG_HASH_SA;
+printf "#define TAG_HASH_MB %du\n" $TAG_HASH_MB;
+printf "#define TAG_HASH_SB %du\n" $TAG_HASH_SB;
+printf "#define TAG_HASH_MC %du\n" $TAG_HASH_MC;
+printf "#define TAG_HASH_SC %du\n" $TAG_HASH_SC;
+printf "\n";
+
+# case folded names
+cat $1tag*.h  | grep "clew_tag_"  | grep "," | awk {'print $1'} | cut -d "," -f 1 | cut -b 10- | cut -d" " -f1 | sort -V | uniq | \
+	awk 'NF { print tolower($1), "clew_tag_" $1 }' | tag_hash_table tags_hash || exit 1
+
+# key prefixes of the *_unknown tags, the fallback for values not known
+cat $1tag*.h  | grep "clew_tag_"  | grep "," | awk {'print $1'} | cut -d "," -f 1 | cut -b 10- | cut -d" " -f1 | sort -V | uniq | \
+	awk '/_unknown$/ { print tolower(substr($1, 1, length($1) - 8)), "clew_tag_" $1 }' | tag_hash_table tags_prefix || exit 1
+
 printf "static struct tag tags_country_v[] = {\n";
 paste -d, $1tag-country-code-2.h $1tag-country-name.h | while IFS=, read c n; do printf "\t{ $c $n },\n"; done;
 paste -d, $1tag-country-code-3.h $1tag-country-name.h | while IFS=, read c n; do printf "\t{ $c $n },\n"; done;
@@ -46,53 +186,61 @@ paste -d, $1tag-language-code-2.h $1tag-language-name.h | while IFS=, read c n;
 printf "};\n";
 printf "\n";
 
-printf "static int compare_tag_name (const void *a, const void *b)\n";
+printf "static const struct tag_hash * tag_hash_lookup (const uint32_t *displacements, uint32_t buckets, const struct tag_hash *table, uint32_t count, uint32_t salt, const char *name, uint32_t length)\n";
 printf "{\n";
-printf "\tstruct tag *key = (struct tag *) a;\n";
-printf "\tstruct tag *tag = (struct tag *) b;\n";
-printf "\treturn strcasecmp(key->name, tag->name);\n";
-printf "};\n";
+printf "\tuint32_t i;\n";
+printf "\tuint32_t a;\n";
+printf "\tuint32_t b;\n";
+printf "\tuint32_t c;\n";
+printf "\tuint64_t d;\n";
+printf "\tconst struct tag_hash *t;\n";
+printf "\ta = TAG_HASH_SA + salt;\n";
+printf "\tb = TAG_HASH_SB + salt;\n";
+printf "\tc = TAG_HASH_SC + salt;\n";
+printf "\tfor (i = 0; i < length; i++) {\n";
+printf "\t\ta = a * TAG_HASH_MA + (uint8_t) name[i];\n";
+printf "\t\tb = b * TAG_HASH_MB + (uint8_t) name[i];\n";
+printf "\t\tc = c * TAG_HASH_MC + (uint8_t) name[i];\n";
+printf "\t}\n";
+printf "\ta = (a + (a >> 16)) * 2246822519u;\n";
+printf "\tb = (b + (b >> 16)) * 2246822519u;\n";
+printf "\tc = (c + (c >> 16)) * 2246822519u;\n";
+printf "\td = displacements[(a >> 12) %% buckets];\n";
+printf "\tt = &table[((b >> 12) %% count + (d / count) * ((count > 1) ? (c >> 12) %% (count - 1) + 1 : 0) + d %% count) %% count];\n";
+printf "\treturn (t->length == length && memcmp(t->name, name, length) == 0) ? t : NULL;\n";
+printf "}\n";
 printf "\n";
 
 printf "uint32_t clew_tag_value (const char *tag)\n";
 printf "{\n";
-printf "\tstruct tag k;\n";
-printf "\tstruct tag *t;\n";
+printf "\tuint32_t i;\n";
+printf "\tuint32_t length;\n";
+printf "\tchar name[TAGS_HASH_LENGTH_MAX + 1];\n";
+printf "\tconst struct tag_hash *t;\n";
 printf "\tif (tag == NULL) {\n";
 printf "\t\treturn clew_tag_unknown;\n";
 printf "\t}\n";
 printf "\tif (strncmp(tag, \"clew_tag_\", strlen(\"clew_tag_\")) == 0) {\n";
-printf "\t\tk.name = tag + strlen(\"clew_tag_\");\n";
-printf "\t} else {\n";
-printf "\t\tk.name = tag;\n";
+printf "\t\ttag += strlen(\"clew_tag_\");\n";
 printf "\t}\n";
-printf "\tt = (struct tag *) bsearch(&k, tags_n, sizeof(tags_n) / sizeof(tags_n[0]), sizeof(tags_n[0]), compare_tag_name);\n";
-printf "#if 1\n";
-printf "\tif (t) {\n";
+printf "\tfor (length = 0; length <= TAGS_HASH_LENGTH_MAX && tag[length] != '\\\0'; length++) {\n";
+printf "\t\tname[length] = (tag[length] >= 'A' && tag[length] <= 'Z') ? tag[length] - 'A' + 'a' : tag[length];\n";
+printf "\t}\n";
+printf "\tt = tag_hash_lookup(tags_hash_displacements, sizeof(tags_hash_displacements) / sizeof(tags_hash_displacements[0]), tags_hash, sizeof(tags_hash) / sizeof(tags_hash[0]), TAGS_HASH_SALT, name, length);\n";
+printf "\tif (t != NULL) {\n";
 printf "\t\treturn t->tag;\n";
-printf "\t} else {\n";
-printf "\t\tchar _tag[64];\n";
-printf "\t\tstrncpy(_tag, k.name, sizeof(_tag));\n";
-printf "\t\t_tag[sizeof(_tag) - 1] = '\\\0';\n";
-printf "\t\twhile (1) {\n";
-printf "\t\t\tchar *ptr = strrchr(_tag, '_');\n";
-printf "\t\t\tif (!ptr) {\n";
-printf "\t\t\t\tbreak;\n";
-printf "\t\t\t}\n";
-printf "\t\t\t*ptr = '\\\0';\n";
-printf "\t\t\tstrncat(_tag, \"_unknown\", sizeof(_tag) - strlen(_tag) - 1);\n";
-printf "\t\t\tk.name = _tag;\n";
-printf "\t\t\tt = (struct tag *) bsearch(&k, tags_n, sizeof(tags_n) / sizeof(tags_n[0]), sizeof(tags_n[0]), compare_tag_name);\n";
-printf "\t\t\tif (t) {\n";
-printf "\t\t\t\treturn t->tag;\n";
-printf "\t\t\t}\n";
-printf "\t\t\t*ptr = '\\\0';\n";
+printf "\t}\n";
+printf "\t/* unknown value, the longest prefix up to an _ with a prefix_unknown tag */\n";
+printf "\tfor (i = (length <= TAGS_PREFIX_LENGTH_MAX) ? length : TAGS_PREFIX_LENGTH_MAX + 1; i-- > 0; ) {\n";
+printf "\t\tif (name[i] != '_') {\n";
+printf "\t\t\tcontinue;\n";
+printf "\t\t}\n";
+printf "\t\tt = tag_hash_lookup(tags_prefix_displacements, sizeof(tags_prefix_displacements) / sizeof(tags_prefix_displacements[0]), tags_prefix, sizeof(tags_prefix) / sizeof(tags_prefix[0]), TAGS_PREFIX_SALT, name, i);\n";
+printf "\t\tif (t != NULL) {\n";
+printf "\t\t\treturn t->tag;\n";
 printf "\t\t}\n";
 printf "\t}\n";
 printf "\treturn clew_tag_unknown;\n";
-printf "#else\n";
-printf "\treturn (t != NULL) ? t->tag : clew_tag_unknown;\n";
-printf "#endif\n";
 printf "}\n";
 printf "\n";
 
@@ -281,13 +429,48 @@ printf "\treturn (g != NULL) ? g->function() : NULL;\n";
 printf "}\n";
 printf "\n";
 
+if [ `echo $groups | wc -w` -gt 32 ]; then
+	echo "too many tag groups for clew_tag_property" > /dev/stderr
+	exit 1
+fi
+
+# group bits, maxspeed in km/h, highway rank and oneway direction by tag id,
+# only tags with any of them are listed
+printf "const struct clew_tag_property clew_tag_properties[clew_tag_last] = {\n";
+cat $1tag*.h  | grep "clew_tag_"  | grep "," | awk {'print $1'} | cut -d "," -f 1 | cut -b 10- | cut -d" " -f1 | sort -V | uniq | \
+	awk -v groups="`echo $groups`" -v ranks="$TAG_HIGHWAY_RANKS" '
+	BEGIN {
+		ngroups = split(groups, group, " ");
+		nranks  = split(ranks, r, " ");
+		for (i = 1; i <= nranks; i++) {
+			rank[r[i]] = i;
+		}
+		oneway["oneway_no"]  = "CLEW_TAG_ONEWAY_NO";
+		oneway["oneway_yes"] = "CLEW_TAG_ONEWAY_YES";
+		oneway["oneway__1"]  = "CLEW_TAG_ONEWAY_REVERSE";
+	}
+	NF {
+		bits = "";
+		for (i = 1; i <= ngroups; i++) {
+			if (index($1, group[i] "_") == 1 && $1 != group[i] "_no") {
+				bits = bits ((bits == "") ? "" : " | ") "CLEW_TAG_GROUP_BIT(clew_tag_group_" group[i] ")";
+			}
+		}
+		speed = ($1 ~ /^maxspeed_[0-9]+$/) ? substr($1, 10) + 0 : 0;
+		highway = (index($1, "highway_") == 1 && (substr($1, 9) in rank)) ? rank[substr($1, 9)] : 0;
+		if (bits == "" && speed == 0 && highway == 0 && !($1 in oneway)) {
+			next;
+		}
+		printf "\t[clew_tag_%s] = { %s, %d, %d, %s },\n", $1, (bits == "") ? "0" : bits, speed, highway, ($1 in oneway) ? oneway[$1] : "CLEW_TAG_ONEWAY_NONE";
+	}' || exit 1
+printf "};\n";
+printf "\n";
+
 printf "void clew_tag_init (void)\n";
 printf "{\n";
 printf "\tclew_debugf(\"init tag\");\n";
 printf "\tclew_debugf(\"  sorting tag values\");\n";
 printf "\tqsort(tags_v, sizeof(tags_v) / sizeof(tags_v[0]), sizeof(tags_v[0]), compare_tag_value);\n";
-printf "\tclew_debugf(\"  sorting tag names\");\n";
-printf "\tqsort(tags_n, sizeof(tags_n) / sizeof(tags_n[0]), sizeof(tags_n[0]), compare_tag_name);\n";
 printf "\tclew_debugf(\"  sorting tag country values\");\n";
 printf "\tqsort(tags_country_v, sizeof(tags_country_v) / sizeof(tags_country_v[0]), sizeof(tags_country_v[0]), compare_tag_value);\n";
 printf "\tclew_debugf(\"  sorting tag language values\");\n";
@@ -0,0 +1,188 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "debug.h"
+#include "stack.h"
+#include "tagset.h"
+
+#define CLEW_TAGSET_SLOTS_INIT          1024
+
+struct clew_tagset {
+        struct clew_stack offsets;      /* uint64_t, count + 1 offsets into tags */
+        struct clew_stack tags;         /* uint32_t */
+        struct clew_stack hashes;       /* uint64_t by id */
+
+        uint32_t *slots;                /* id + 1, 0: free, open addressing with linear probing */
+        uint64_t nslots;
+};
+
+static uint64_t clew_tagset_hash (const uint32_t *tags, uint32_t ntags)
+{
+        uint32_t i;
+        uint64_t hash;
+        hash = 0xcbf29ce484222325ULL ^ ntags;
+        for (i = 0; i < ntags; i++) {
+                hash ^= tags[i];
+                hash *= 0x100000001b3ULL;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+}
+
+static int clew_tagset_equal (const struct clew_tagset *tagset, uint32_t id, const uint32_t *tags, uint32_t ntags)
+{
+        uint32_t n;
+        const uint32_t *t;
+        t = clew_tagset_tags(tagset, id, &n);
+        return (n == ntags) && (ntags == 0 || memcmp(t, tags, sizeof(uint32_t) * ntags) == 0);
+}
+
+static int clew_tagset_grow (struct clew_tagset *tagset)
+{
+        uint64_t i;
+        uint64_t s;
+        uint64_t count;
+        uint64_t nslots;
+        uint32_t *slots;
+
+        nslots = (tagset->nslots == 0) ? CLEW_TAGSET_SLOTS_INIT : tagset->nslots * 2;
+        slots  = (uint32_t *) calloc(nslots, sizeof(uint32_t));
+        if (slots == NULL) {
+                clew_errorf("can not allocate memory");
+                return -1;
+        }
+        for (i = 0, count = clew_stack_count(&tagset->hashes); i < count; i++) {
+                for (s = clew_stack_at_uint64(&tagset->hashes, i) & (nslots - 1); slots[s] != 0; s = (s + 1) & (nslots - 1)) {
+                }
+                slots[s] = i + 1;
+        }
+        free(tagset->slots);
+        tagset->slots  = slots;
+        tagset->nslots = nslots;
+        return 0;
+}
+
+struct clew_tagset * clew_tagset_create (void)
+{
+        struct clew_tagset *tagset;
+
+        tagset = (struct clew_tagset *) malloc(sizeof(struct clew_tagset));
+        if (tagset == NULL) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        memset(tagset, 0, sizeof(struct clew_tagset));
+        tagset->offsets = clew_stack_init2(sizeof(uint64_t), 4096);
+        tagset->tags    = clew_stack_init2(sizeof(uint32_t), 16 * 1024);
+        tagset->hashes  = clew_stack_init2(sizeof(uint64_t), 4096);
+        clew_tagset_reset(tagset);
+        if (clew_stack_count(&tagset->hashes) != 1) {
+                goto bail;
+        }
+
+        return tagset;
+bail:   clew_tagset_destroy(tagset);
+        return NULL;
+}
+
+void clew_tagset_destroy (struct clew_tagset *tagset)
+{
+        if (tagset == NULL) {
+                return;
+        }
+        clew_stack_uninit(&tagset->offsets);
+        clew_stack_uninit(&tagset->tags);
+        clew_stack_uninit(&tagset->hashes);
+        free(tagset->slots);
+        free(tagset);
+}
+
+void clew_tagset_reset (struct clew_tagset *tagset)
+{
+        uint32_t id;
+        clew_stack_reset(&tagset->offsets);
+        clew_stack_reset(&tagset->tags);
+        clew_stack_reset(&tagset->hashes);
+        clew_stack_push_uint64(&tagset->offsets, 0);
+        if (tagset->slots != NULL) {
+                memset(tagset->slots, 0, sizeof(uint32_t) * tagset->nslots);
+        }
+        clew_tagset_intern(tagset, NULL, 0, &id);
+}
+
+int clew_tagset_intern (struct clew_tagset *tagset, const uint32_t *tags, uint32_t ntags, uint32_t *id)
+{
+        int rc;
+        uint64_t s;
+        uint64_t at;
+        uint64_t hash;
+        uint64_t count;
+
+        count = clew_stack_count(&tagset->hashes);
+        if ((count + 1) * 2 > tagset->nslots) {
+                rc = clew_tagset_grow(tagset);
+                if (rc < 0) {
+                        goto bail;
+                }
+        }
+
+        hash = clew_tagset_hash(tags, ntags);
+        for (s = hash & (tagset->nslots - 1); tagset->slots[s] != 0; s = (s + 1) & (tagset->nslots - 1)) {
+                if (clew_stack_at_uint64(&tagset->hashes, tagset->slots[s] - 1) == hash &&
+                    clew_tagset_equal(tagset, tagset->slots[s] - 1, tags, ntags)) {
+                        *id = tagset->slots[s] - 1;
+                        return 0;
+                }
+        }
+        if (count >= UINT32_MAX) {
+                clew_errorf("too many tag sets");
+                goto bail;
+        }
+
+        at = clew_stack_count(&tagset->tags);
+        rc = clew_stack_resize(&tagset->tags, at + ntags);
+        if (rc < 0) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        if (ntags > 0) {
+                memcpy(clew_stack_buffer(&tagset->tags) + sizeof(uint32_t) * at, tags, sizeof(uint32_t) * ntags);
+        }
+        rc  = clew_stack_push_uint64(&tagset->offsets, at + ntags);
+        rc |= clew_stack_push_uint64(&tagset->hashes, hash);
+        if (rc != 0) {
+                clew_errorf("can not allocate memory");
+                goto bail;
+        }
+        tagset->slots[s] = count + 1;
+
+        *id = count;
+        return 1;
+bail:   return -1;
+}
+
+uint32_t clew_tagset_count (const struct clew_tagset *tagset)
+{
+        return clew_stack_count(&tagset->hashes);
+}
+
+uint64_t clew_tagset_memory (const struct clew_tagset *tagset)
+{
+        uint64_t memory;
+        memory  = tagset->offsets.avail * sizeof(uint64_t);
+        memory += tagset->tags.avail * sizeof(uint32_t);
+        memory += tagset->hashes.avail * sizeof(uint64_t);
+        memory += tagset->nslots * sizeof(uint32_t);
+        return memory;
+}
+
+const uint32_t * clew_tagset_tags (const struct clew_tagset *tagset, uint32_t id, uint32_t *ntags)
+{
+        const uint64_t *offsets;
+        offsets = (const uint64_t *) clew_stack_buffer(&tagset->offsets);
+        *ntags  = offsets[id + 1] - offsets[id];
+        return (const uint32_t *) clew_stack_buffer(&tagset->tags) + offsets[id];
+}
@@ -0,0 +1,34 @@
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * dictionary of distinct tag sets. a set is a sorted array of tag ids, it
+ * is stored once and referred to by a dense 32 bit id, numbered 0..n-1 in
+ * the order sets are first interned. the empty set is always id 0, so
+ * anything computed from tags can be computed once per id and looked up.
+ *
+ * intern must not race with other calls, the tags of an id stay valid until
+ * reset.
+ */
+
+#define CLEW_TAGSET_EMPTY               0
+
+struct clew_tagset;
+
+struct clew_tagset * clew_tagset_create (void);
+void clew_tagset_destroy (struct clew_tagset *tagset);
+
+void clew_tagset_reset (struct clew_tagset *tagset);
+/* tags must be sorted, returns 1 if the set was new, 0 if it existed, -1 on error */
+int clew_tagset_intern (struct clew_tagset *tagset, const uint32_t *tags, uint32_t ntags, uint32_t *id);
+
+uint32_t clew_tagset_count (const struct clew_tagset *tagset);
+uint64_t clew_tagset_memory (const struct clew_tagset *tagset);
+const uint32_t * clew_tagset_tags (const struct clew_tagset *tagset, uint32_t id, uint32_t *ntags);
+
+#ifdef __cplusplus
+}
+#endif
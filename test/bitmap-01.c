@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "bitmap.h"
+
+#define THREADS 4
+#define MARKS   (1 << 20)
+
+struct worker {
+        pthread_t thread;
+        struct clew_bitmap_atomic *bitmap;
+        uint64_t seed;
+        uint64_t marked;
+};
+
+static void * worker_thread (void *context)
+{
+        uint64_t i;
+        uint64_t state;
+        struct worker *worker = (struct worker *) context;
+
+        state = worker->seed;
+        for (i = 0; i < MARKS; i++) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                /* overlapping ids across threads, spread over a few segments */
+                if (clew_bitmap_atomic_mark(worker->bitmap, (i * 3) + (state % 4) * ((uint64_t) 1 << 24)) == 1) {
+                        worker->marked += 1;
+                }
+        }
+        return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        uint64_t i;
+        uint64_t marked;
+        struct worker workers[THREADS];
+        struct clew_bitmap_atomic a;
+        struct clew_bitmap_atomic b;
+
+        (void) argc;
+        (void) argv;
+
+        rc = 0;
+        a  = clew_bitmap_atomic_init();
+        b  = clew_bitmap_atomic_init();
+
+        for (i = 0; i < THREADS; i++) {
+                workers[i].bitmap = &a;
+                workers[i].seed   = 0x9e3779b97f4a7c15ULL + i;
+                workers[i].marked = 0;
+                pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]);
+        }
+        marked = 0;
+        for (i = 0; i < THREADS; i++) {
+                pthread_join(workers[i].thread, NULL);
+                marked += workers[i].marked;
+        }
+        if (marked != clew_bitmap_atomic_count(&a)) {
+                fprintf(stderr, "count mismatch: %ld != %ld\n", marked, clew_bitmap_atomic_count(&a));
+                rc = -1;
+        }
+
+        clew_bitmap_atomic_mark(&b, 1);
+        clew_bitmap_atomic_mark(&b, ((uint64_t) 1 << 30) + 5);
+        rc |= clew_bitmap_atomic_or(&b, &a);
+        if (clew_bitmap_atomic_count(&b) != marked + 2 ||
+            clew_bitmap_atomic_marked(&b, ((uint64_t) 1 << 30) + 5) != 1 ||
+            clew_bitmap_atomic_marked_range(&b, ((uint64_t) 1 << 30) + 6, ((uint64_t) 1 << 31)) != 0 ||
+            clew_bitmap_atomic_marked_range(&b, ((uint64_t) 1 << 29), ((uint64_t) 1 << 30) + 5) != 1) {
+                fprintf(stderr, "or mismatch\n");
+                rc = -1;
+        }
+
+        fprintf(stdout, "marked: %ld, memory: %ld, %s\n", marked, clew_bitmap_atomic_memory(&b), (rc == 0) ? "ok" : "failed");
+
+        clew_bitmap_atomic_uninit(&a);
+        clew_bitmap_atomic_uninit(&b);
+        return (rc == 0) ? 0 : -1;
+}
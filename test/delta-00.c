@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "delta.h"
+
+#define COUNT   (1 << 20)
+
+static int check (const uint64_t *ids, uint64_t count)
+{
+        uint64_t i;
+        uint64_t size;
+        uint8_t *buffer;
+        struct clew_delta_iter iter;
+
+        size   = clew_delta_encoded_size(ids, count);
+        buffer = (uint8_t *) malloc(size + 1);
+        if (buffer == NULL) {
+                return -1;
+        }
+        if (clew_delta_encode(buffer, ids, count) != size) {
+                fprintf(stderr, "size mismatch\n");
+                free(buffer);
+                return -1;
+        }
+        iter = clew_delta_iter_init(buffer);
+        for (i = 0; i < count; i++) {
+                if (clew_delta_iter_next(&iter) != ids[i]) {
+                        fprintf(stderr, "id mismatch at %ld\n", i);
+                        free(buffer);
+                        return -1;
+                }
+        }
+        if (iter.ptr != buffer + size) {
+                fprintf(stderr, "decode overrun\n");
+                free(buffer);
+                return -1;
+        }
+        free(buffer);
+        return 0;
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        uint64_t i;
+        uint64_t id;
+        uint64_t state;
+        uint64_t *ids;
+        const uint64_t edges[] = { 0, 1, 0, UINT64_MAX, 0, (uint64_t) 1 << 63, 7, UINT64_MAX - 1, 127, 128 };
+
+        (void) argc;
+        (void) argv;
+
+        rc  = 0;
+        rc |= check(edges, sizeof(edges) / sizeof(edges[0]));
+
+        /* way like runs: nearby refs with an occasional jump */
+        ids = (uint64_t *) malloc(sizeof(uint64_t) * COUNT);
+        if (ids == NULL) {
+                return -1;
+        }
+        state = 0x9e3779b97f4a7c15ULL;
+        for (i = 0, id = 0; i < COUNT; i++) {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                if ((i % 16) == 0) {
+                        id = 10000000000ULL + (state % 1000000000ULL);
+                } else {
+                        id += (state % 64) - 16;
+                }
+                ids[i] = id;
+        }
+        rc |= check(ids, COUNT);
+
+        fprintf(stdout, "refs: %d, bytes: %ld, %s\n", COUNT, clew_delta_encoded_size(ids, COUNT), (rc == 0) ? "ok" : "failed");
+
+        free(ids);
+        return (rc == 0) ? 0 : -1;
+}
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tag.h"
+#include "expression.h"
+
+/*
+ * checks the short circuit and the compiled match against the postfix
+ * stack program on random tag sets drawn from the tags each expression
+ * refers to, before and after ordering the clauses, and through the cache,
+ * and times them.
+ */
+
+static const char *g_expressions[] = {
+        "highway_primary",
+        "not highway_primary",
+        "highway_primary or highway_secondary and surface_asphalt",
+        "( highway_primary or highway_secondary ) and not surface_asphalt",
+        "not ( highway_primary and not ( surface_asphalt or oneway_yes ) ) or access_no",
+        "not ( not highway_track or not highway_path ) and not ( access_no and motor_vehicle_no )",
+        "highway_* and not ( access_no or access_private )",
+        "building_* or ( highway_footway and not layer_* )",
+        "( highway_primary or highway_primary_link or highway_secondary or highway_secondary_link or "
+        "highway_tertiary or highway_tertiary_link or highway_unclassified or highway_road or "
+        "highway_residential or highway_living_street or (( highway_track or highway_path ) and surface_asphalt )) "
+        "and not ( motor_vehicle_no or motor_vehicle_private ) and not ( access_no or access_private) ",
+};
+
+static double now (void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct tags {
+        const uint32_t *tags;
+        uint32_t ntags;
+};
+
+static int tags_has (void *context, uint32_t tag)
+{
+        uint32_t i;
+        const struct tags *tags = (const struct tags *) context;
+        for (i = 0; i < tags->ntags; i++) {
+                if (tags->tags[i] == tag) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+/* passing the operators runs the stack program, without short circuit */
+static int tags_and (int first, int second)
+{
+        return first && second;
+}
+
+static int tags_or (int first, int second)
+{
+        return first || second;
+}
+
+static int tags_not (int first)
+{
+        return !first;
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        int match;
+        uint32_t e;
+        uint32_t i;
+        uint32_t t;
+        uint32_t n;
+        uint32_t rounds;
+        uint32_t npool;
+        uint32_t *pool;
+        uint32_t *sets;
+        uint64_t a;
+        uint64_t b;
+        uint64_t c;
+        uint64_t d;
+        uint64_t f;
+        double t0;
+        double t1;
+        double t2;
+        double t3;
+        double t4;
+        double t5;
+        double t6;
+        struct tags tags;
+        struct clew_expression *clone;
+        struct clew_expression *expression;
+        struct clew_expression_stats stats;
+        struct clew_expression_cache *cache;
+
+        rounds = (argc > 1) ? atoi(argv[1]) : 100000;
+
+        clew_tag_init();
+        srand(1);
+
+        rc   = 0;
+        pool = (uint32_t *) malloc(sizeof(uint32_t) * clew_tag_last);
+        sets = (uint32_t *) malloc(sizeof(uint32_t) * rounds * 8);
+        cache = (struct clew_expression_cache *) calloc(1, sizeof(struct clew_expression_cache));
+        if (pool == NULL || sets == NULL || cache == NULL) {
+                return -1;
+        }
+        for (e = 0; e < sizeof(g_expressions) / sizeof(g_expressions[0]); e++) {
+                expression = clew_expression_create(g_expressions[e]);
+                if (expression == NULL) {
+                        fprintf(stderr, "can not create: %s\n", g_expressions[e]);
+                        return -1;
+                }
+                /* referred tags, plus a few others */
+                for (t = clew_tag_unknown + 1, npool = 0; t < clew_tag_last; t++) {
+                        if (clew_expression_has(expression, t) > 0 || (rand() % 4096) == 0) {
+                                pool[npool++] = t;
+                        } else if (clew_expression_match_tags(expression, &t, 1, NULL) > 0 && (rand() % 8) == 0) {
+                                /* members of groups */
+                                pool[npool++] = t;
+                        }
+                }
+                for (i = 0; i < rounds * 8; i++) {
+                        sets[i] = pool[rand() % npool];
+                }
+
+                t0 = now();
+                for (i = 0, a = 0; i < rounds; i++) {
+                        tags.tags  = sets + i * 8;
+                        tags.ntags = i % 8;
+                        a += clew_expression_match(expression, &tags, tags_and, tags_or, tags_not, tags_has);
+                }
+                t1 = now();
+                for (i = 0, b = 0; i < rounds; i++) {
+                        tags.tags  = sets + i * 8;
+                        tags.ntags = i % 8;
+                        b += clew_expression_match(expression, &tags, NULL, NULL, NULL, tags_has);
+                }
+                t2 = now();
+                for (i = 0, c = 0; i < rounds; i++) {
+                        c += clew_expression_match_tags(expression, sets + i * 8, i % 8, NULL);
+                }
+                t3 = now();
+
+                clone = clew_expression_clone(expression);
+                if (clone == NULL) {
+                        return -1;
+                }
+                memset(&stats, 0, sizeof(stats));
+                for (i = 0; i < rounds / 10; i++) {
+                        clew_expression_match_tags(clone, sets + i * 8, i % 8, &stats);
+                }
+                clew_expression_optimize(clone, &stats);
+                t4 = now();
+                for (i = 0, d = 0; i < rounds; i++) {
+                        d += clew_expression_match_tags(clone, sets + i * 8, i % 8, NULL);
+                }
+                t5 = now();
+                memset(cache, 0, sizeof(struct clew_expression_cache));
+                for (i = 0, f = 0; i < rounds; i++) {
+                        f += clew_expression_match_cached(clone, cache, sets + i * 8, i % 8, NULL);
+                }
+                t6 = now();
+
+                memset(cache, 0, sizeof(struct clew_expression_cache));
+                for (i = 0, n = 0; i < rounds; i++) {
+                        tags.tags  = sets + i * 8;
+                        tags.ntags = i % 8;
+                        match = clew_expression_match(expression, &tags, tags_and, tags_or, tags_not, tags_has);
+                        n += clew_expression_match(expression, &tags, NULL, NULL, NULL, tags_has) != match;
+                        n += clew_expression_match_tags(expression, sets + i * 8, i % 8, NULL) != match;
+                        n += clew_expression_match_tags(clone, sets + i * 8, i % 8, NULL) != match;
+                        n += clew_expression_match_cached(expression, cache, sets + i * 8, i % 8, NULL) != match;
+                }
+                fprintf(stdout, "expression %d: matches: %llu, postfix: %.1f ns, short: %.1f ns, compiled: %.1f ns, ordered: %.1f ns, cached: %.1f ns, mismatches: %d\n",
+                        e, (unsigned long long) a, (t1 - t0) * 1e9 / rounds, (t2 - t1) * 1e9 / rounds, (t3 - t2) * 1e9 / rounds, (t5 - t4) * 1e9 / rounds, (t6 - t5) * 1e9 / rounds, n);
+                if (a != b || a != c || a != d || d != f || n != 0) {
+                        rc = -1;
+                }
+                clew_expression_destroy(clone);
+                clew_expression_destroy(expression);
+        }
+
+        free(cache);
+        free(sets);
+        free(pool);
+        clew_tag_fini();
+        return rc;
+}
@@ -0,0 +1,194 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tag.h"
+#include "input.h"
+#include "expression.h"
+
+/*
+ * times the compiled match against the cached one on the tag sets of the
+ * elements of a file, as the reader collects them, and checks they agree.
+ */
+
+static const char *g_expressions[] = {
+        "highway_primary",
+        "highway_* and not ( access_no or access_private )",
+        "building_* or ( highway_footway and not layer_* )",
+        "( highway_primary or highway_primary_link or highway_secondary or highway_secondary_link or "
+        "highway_tertiary or highway_tertiary_link or highway_unclassified or highway_road or "
+        "highway_residential or highway_living_street ) "
+        "and not ( motor_vehicle_no or motor_vehicle_private ) and not ( access_no or access_private) ",
+        "( highway_primary or highway_primary_link or highway_secondary or highway_secondary_link or "
+        "highway_tertiary or highway_tertiary_link or highway_unclassified or highway_road or "
+        "highway_residential or highway_living_street or (( highway_track or highway_path ) and surface_asphalt )) "
+        "and not ( motor_vehicle_no or motor_vehicle_private ) and not ( access_no or access_private) ",
+};
+
+struct sets {
+        uint32_t *tags;
+        uint64_t ntags;
+        uint64_t atags;
+        uint64_t *offsets;      /* nsets + 1 */
+        uint64_t nsets;
+        uint64_t asets;
+};
+
+static double now (void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int sets_push (struct sets *sets, const uint32_t *tags, uint64_t ntags)
+{
+        uint64_t i;
+        uint64_t start;
+
+        start = sets->ntags;
+        for (i = 0; i < ntags; i++) {
+                if (tags[i] == clew_tag_unknown) {
+                        continue;
+                }
+                if (sets->ntags == sets->atags) {
+                        sets->atags = (sets->atags == 0) ? 4096 : (sets->atags * 2);
+                        sets->tags  = (uint32_t *) realloc(sets->tags, sizeof(uint32_t) * sets->atags);
+                        if (sets->tags == NULL) {
+                                return -1;
+                        }
+                }
+                sets->tags[sets->ntags++] = tags[i];
+        }
+        if (sets->ntags == start) {
+                return 0;
+        }
+        if (sets->nsets + 2 > sets->asets) {
+                sets->asets   = (sets->asets == 0) ? 4096 : (sets->asets * 2);
+                sets->offsets = (uint64_t *) realloc(sets->offsets, sizeof(uint64_t) * sets->asets);
+                if (sets->offsets == NULL) {
+                        return -1;
+                }
+        }
+        sets->offsets[sets->nsets++] = start;
+        sets->offsets[sets->nsets]   = sets->ntags;
+        return 0;
+}
+
+static int callback_block (struct clew_input *input, void *context, const struct clew_input_block *block)
+{
+        uint64_t i;
+        struct sets *sets = (struct sets *) context;
+
+        (void) input;
+        for (i = 0; i < block->nnodes; i++) {
+                if (sets_push(sets, block->tags + block->node_tags[i], block->node_tags[i + 1] - block->node_tags[i]) < 0) {
+                        return -1;
+                }
+        }
+        for (i = 0; i < block->nways; i++) {
+                if (sets_push(sets, block->tags + block->way_tags[i], block->way_tags[i + 1] - block->way_tags[i]) < 0) {
+                        return -1;
+                }
+        }
+        for (i = 0; i < block->nrelations; i++) {
+                if (sets_push(sets, block->tags + block->relation_tags[i], block->relation_tags[i + 1] - block->relation_tags[i]) < 0) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        int r;
+        int rounds;
+        uint32_t e;
+        uint64_t i;
+        uint64_t a;
+        uint64_t b;
+        double t0;
+        double t1;
+        double t2;
+        struct sets sets;
+        struct clew_input *input;
+        struct clew_input_init_options options;
+        struct clew_expression *expression;
+        struct clew_expression_stats stats;
+        struct clew_expression_cache *cache;
+
+        if (argc < 2) {
+                fprintf(stdout, "usage: %s <file.osm.pbf> [rounds]\n", argv[0]);
+                return 0;
+        }
+        rounds = (argc > 2) ? atoi(argv[2]) : 10;
+
+        clew_tag_init();
+
+        memset(&sets, 0, sizeof(sets));
+        clew_input_init_options_default(&options);
+        options.path             = argv[1];
+        options.callback_block   = callback_block;
+        options.callback_context = &sets;
+        input = clew_input_create(&options);
+        if (input == NULL) {
+                fprintf(stderr, "can not open: %s\n", argv[1]);
+                return -1;
+        }
+        while (clew_input_read(input) == 0) {
+                if (clew_input_get_error(input) != 0) {
+                        break;
+                }
+        }
+        rc = (clew_input_get_error(input) == 0) ? 0 : -1;
+        clew_input_destroy(input);
+        if (rc < 0 || sets.nsets == 0) {
+                fprintf(stderr, "can not read: %s\n", argv[1]);
+                return -1;
+        }
+
+        cache = (struct clew_expression_cache *) malloc(sizeof(struct clew_expression_cache));
+        if (cache == NULL) {
+                return -1;
+        }
+        fprintf(stdout, "sets      : %llu, %llu tags, %d rounds\n", (unsigned long long) sets.nsets, (unsigned long long) sets.ntags, rounds);
+        for (e = 0; e < sizeof(g_expressions) / sizeof(g_expressions[0]); e++) {
+                expression = clew_expression_create(g_expressions[e]);
+                if (expression == NULL) {
+                        fprintf(stderr, "can not create: %s\n", g_expressions[e]);
+                        return -1;
+                }
+                t0 = now();
+                for (r = 0, a = 0; r < rounds; r++) {
+                        for (i = 0; i < sets.nsets; i++) {
+                                a += clew_expression_match_tags(expression, sets.tags + sets.offsets[i], sets.offsets[i + 1] - sets.offsets[i], NULL);
+                        }
+                }
+                t1 = now();
+                memset(&stats, 0, sizeof(stats));
+                for (r = 0, b = 0; r < rounds; r++) {
+                        memset(cache, 0, sizeof(struct clew_expression_cache));
+                        for (i = 0; i < sets.nsets; i++) {
+                                b += clew_expression_match_cached(expression, cache, sets.tags + sets.offsets[i], sets.offsets[i + 1] - sets.offsets[i], &stats);
+                        }
+                }
+                t2 = now();
+                fprintf(stdout, "expression %d: matches: %llu, compiled: %.1f ns, cached: %.1f ns, skipped: %llu, cached: %llu, %s\n",
+                        e, (unsigned long long) a / rounds, (t1 - t0) * 1e9 / rounds / sets.nsets, (t2 - t1) * 1e9 / rounds / sets.nsets,
+                        (unsigned long long) stats.skipped / rounds, (unsigned long long) stats.cached / rounds, (a == b) ? "match" : "mismatch");
+                if (a != b) {
+                        rc = -1;
+                }
+                clew_expression_destroy(expression);
+        }
+
+        free(cache);
+        free(sets.offsets);
+        free(sets.tags);
+        clew_tag_fini();
+        return rc;
+}
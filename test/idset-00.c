@@ -0,0 +1,119 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "bitmap.h"
+#include "idset.h"
+
+static uint64_t next (uint64_t *state)
+{
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+        return *state;
+}
+
+static int check (struct clew_idset *idset, struct clew_bitmap *bitmap, uint64_t range)
+{
+        uint64_t i;
+        uint64_t j;
+
+        if (clew_idset_count(idset) != clew_bitmap_count(bitmap)) {
+                fprintf(stderr, "count mismatch: %ld != %ld\n", clew_idset_count(idset), clew_bitmap_count(bitmap));
+                return -1;
+        }
+        for (i = 0; i < range; i++) {
+                if (clew_idset_marked(idset, i) != clew_bitmap_marked(bitmap, i)) {
+                        fprintf(stderr, "marked mismatch at: %ld\n", i);
+                        return -1;
+                }
+        }
+        for (i = 0; i < range; i += 997) {
+                for (j = i; j < range && j < i + 70000; j += 4099) {
+                        if (clew_idset_marked_range(idset, i, j) != clew_bitmap_marked_range(bitmap, i, j)) {
+                                fprintf(stderr, "marked range mismatch at: %ld, %ld\n", i, j);
+                                return -1;
+                        }
+                }
+        }
+        return 0;
+}
+
+static int check_rank (struct clew_idset *idset, struct clew_bitmap *bitmap, uint64_t range)
+{
+        int rc;
+        uint64_t i;
+        uint64_t n;
+        uint64_t rank;
+
+        for (i = 0, n = 0; i < range; i++) {
+                rc = clew_idset_rank(idset, i, &rank);
+                if (rc != !clew_bitmap_marked(bitmap, i) || (rc == 0 && rank != n)) {
+                        fprintf(stderr, "rank mismatch at: %ld\n", i);
+                        return -1;
+                }
+                n += (rc == 0);
+        }
+        return 0;
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        int mode;
+        uint64_t i;
+        uint64_t id;
+        uint64_t state;
+        uint64_t range;
+        struct clew_idset a;
+        struct clew_idset b;
+        struct clew_bitmap bitmap;
+
+        (void) argc;
+        (void) argv;
+
+        rc    = 0;
+        state = 0x9e3779b97f4a7c15ULL;
+        range = 1 << 22;
+
+        for (mode = CLEW_IDSET_MODE_SPARSE; mode <= CLEW_IDSET_MODE_DENSE; mode++) {
+                a      = clew_idset_init(mode);
+                b      = clew_idset_init(CLEW_IDSET_MODE_SPARSE);
+                bitmap = clew_bitmap_init(64 * 1024);
+
+                /* scattered ids, a dense block and a long run */
+                for (i = 0; i < 20000; i++) {
+                        id = next(&state) % range;
+                        clew_idset_mark(&a, id);
+                        clew_bitmap_mark(&bitmap, id);
+                }
+                for (i = 0; i < 10000; i++) {
+                        id = 1000000 + (next(&state) % 20000);
+                        clew_idset_mark(&b, id);
+                        clew_bitmap_mark(&bitmap, id);
+                }
+                for (i = 2000000; i < 2200000; i++) {
+                        clew_idset_mark(&b, i);
+                        clew_bitmap_mark(&bitmap, i);
+                }
+                rc |= clew_idset_or(&a, &b);
+                rc |= check(&a, &bitmap, range);
+                rc |= clew_idset_optimize(&a);
+                rc |= check(&a, &bitmap, range);
+                if (mode == CLEW_IDSET_MODE_SPARSE) {
+                        rc |= clew_idset_index(&a);
+                        rc |= check_rank(&a, &bitmap, range);
+                }
+                clew_idset_mark(&a, 2300000);
+                clew_bitmap_mark(&bitmap, 2300000);
+                rc |= check(&a, &bitmap, range);
+
+                fprintf(stdout, "mode: %d, count: %ld, memory: %ld, %s\n", mode, clew_idset_count(&a), clew_idset_memory(&a), (rc == 0) ? "ok" : "failed");
+
+                clew_idset_uninit(&a);
+                clew_idset_uninit(&b);
+                clew_bitmap_uninit(&bitmap);
+        }
+        return (rc == 0) ? 0 : -1;
+}
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "input.h"
+#include "input-index.h"
+
+/*
+ * reads a file of two data blocks, each with a node group and a way group,
+ * nodes first in one and ways first in the other, asking for ways only.
+ * blocks must not be skipped by the kind of their first group, with and
+ * without building an index, and from a completed index.
+ */
+
+struct buffer {
+        uint8_t data[4096];
+        size_t length;
+};
+
+static void put_varint (struct buffer *buffer, uint64_t value)
+{
+        while (value >= 0x80) {
+                buffer->data[buffer->length++] = (uint8_t) (value | 0x80);
+                value >>= 7;
+        }
+        buffer->data[buffer->length++] = (uint8_t) value;
+}
+
+static void put_key (struct buffer *buffer, uint32_t field, uint32_t wire)
+{
+        put_varint(buffer, (field << 3) | wire);
+}
+
+static void put_bytes (struct buffer *buffer, uint32_t field, const void *data, size_t length)
+{
+        put_key(buffer, field, 2);
+        put_varint(buffer, length);
+        memcpy(buffer->data + buffer->length, data, length);
+        buffer->length += length;
+}
+
+static uint64_t zigzag (int64_t value)
+{
+        return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static void put_packed (struct buffer *buffer, uint32_t field, const uint64_t *values, size_t count)
+{
+        size_t i;
+        struct buffer packed;
+
+        packed.length = 0;
+        for (i = 0; i < count; i++) {
+                put_varint(&packed, values[i]);
+        }
+        put_bytes(buffer, field, packed.data, packed.length);
+}
+
+static void put_node_group (struct buffer *block)
+{
+        struct buffer group;
+        struct buffer dense;
+        uint64_t ids[2]  = { zigzag(10), zigzag(1) };
+        uint64_t lats[2] = { zigzag(4650000), zigzag(100) };
+        uint64_t lons[2] = { zigzag(1060000), zigzag(100) };
+
+        dense.length = 0;
+        put_packed(&dense, 1, ids, 2);
+        put_packed(&dense, 8, lats, 2);
+        put_packed(&dense, 9, lons, 2);
+        group.length = 0;
+        put_bytes(&group, 2, dense.data, dense.length);
+        put_bytes(block, 2, group.data, group.length);
+}
+
+static void put_way_group (struct buffer *block)
+{
+        struct buffer group;
+        struct buffer way;
+        uint64_t keys[1] = { 1 };
+        uint64_t vals[1] = { 2 };
+        uint64_t refs[2] = { zigzag(10), zigzag(1) };
+
+        way.length = 0;
+        put_key(&way, 1, 0);
+        put_varint(&way, 100);
+        put_packed(&way, 2, keys, 1);
+        put_packed(&way, 3, vals, 1);
+        put_packed(&way, 8, refs, 2);
+        group.length = 0;
+        put_bytes(&group, 3, way.data, way.length);
+        put_bytes(block, 2, group.data, group.length);
+}
+
+static int write_blob (FILE *fp, int ways_first)
+{
+        uLongf zlength;
+        uint8_t prefix[4];
+        uint8_t zdata[4096];
+        struct buffer block;
+        struct buffer strings;
+        struct buffer blob;
+        struct buffer header;
+
+        strings.length = 0;
+        put_bytes(&strings, 1, "", 0);
+        put_bytes(&strings, 1, "highway", 7);
+        put_bytes(&strings, 1, "primary", 7);
+        block.length = 0;
+        put_bytes(&block, 1, strings.data, strings.length);
+        if (ways_first) {
+                put_way_group(&block);
+                put_node_group(&block);
+        } else {
+                put_node_group(&block);
+                put_way_group(&block);
+        }
+
+        zlength = sizeof(zdata);
+        if (compress(zdata, &zlength, block.data, block.length) != Z_OK) {
+                return -1;
+        }
+        blob.length = 0;
+        put_key(&blob, 2, 0);
+        put_varint(&blob, block.length);
+        put_bytes(&blob, 3, zdata, zlength);
+
+        header.length = 0;
+        put_bytes(&header, 1, "OSMData", 7);
+        put_key(&header, 3, 0);
+        put_varint(&header, blob.length);
+
+        prefix[0] = (uint8_t) (header.length >> 24);
+        prefix[1] = (uint8_t) (header.length >> 16);
+        prefix[2] = (uint8_t) (header.length >> 8);
+        prefix[3] = (uint8_t) (header.length >> 0);
+        if (fwrite(prefix, 1, 4, fp) != 4 ||
+            fwrite(header.data, 1, header.length, fp) != header.length ||
+            fwrite(blob.data, 1, blob.length, fp) != blob.length) {
+                return -1;
+        }
+        return 0;
+}
+
+static int callback_block (struct clew_input *input, void *context, const struct clew_input_block *block)
+{
+        (void) input;
+        *(uint64_t *) context += block->nways;
+        return 0;
+}
+
+static int read_ways (const char *path, int threads, struct clew_input_index *index, uint64_t *ways)
+{
+        int rc;
+        struct clew_input *input;
+        struct clew_input_init_options options;
+
+        *ways = 0;
+        clew_input_init_options_default(&options);
+        options.path             = path;
+        options.threads          = threads;
+        options.index            = index;
+        options.kinds            = CLEW_INPUT_INDEX_KIND_HEADER | CLEW_INPUT_INDEX_KIND_WAY;
+        options.callback_block   = callback_block;
+        options.callback_context = ways;
+        input = clew_input_create(&options);
+        if (input == NULL) {
+                return -1;
+        }
+        while (clew_input_read(input) == 0) {
+                if (clew_input_get_error(input) != 0) {
+                        break;
+                }
+        }
+        rc = (clew_input_get_error(input) == 0) ? 0 : -1;
+        clew_input_destroy(input);
+        return rc;
+}
+
+int main (int argc, char *argv[])
+{
+        int fd;
+        int rc;
+        int threads;
+        FILE *fp;
+        uint64_t ways;
+        char path[] = "/tmp/clew-input-osm-pbf-00-XXXXXX.osm.pbf";
+        struct clew_input_index *index;
+
+        (void) argc;
+        (void) argv;
+
+        fd = mkstemps(path, strlen(".osm.pbf"));
+        if (fd < 0) {
+                return -1;
+        }
+        fp = fdopen(fd, "wb");
+        if (fp == NULL || write_blob(fp, 0) != 0 || write_blob(fp, 1) != 0) {
+                return -1;
+        }
+        fclose(fp);
+
+        rc    = 0;
+        index = clew_input_index_create();
+        if (index == NULL) {
+                return -1;
+        }
+        for (threads = 1; threads <= 2; threads++) {
+                if (read_ways(path, threads, NULL, &ways) < 0 || ways != 2) {
+                        fprintf(stderr, "threads: %d, ways: %llu, expected: 2\n", threads, (unsigned long long) ways);
+                        rc = -1;
+                }
+        }
+        if (read_ways(path, 1, index, &ways) < 0 || ways != 2 || !clew_input_index_completed(index)) {
+                fprintf(stderr, "building index, ways: %llu, expected: 2\n", (unsigned long long) ways);
+                rc = -1;
+        }
+        if (read_ways(path, 1, index, &ways) < 0 || ways != 2) {
+                fprintf(stderr, "from index, ways: %llu, expected: 2\n", (unsigned long long) ways);
+                rc = -1;
+        }
+        fprintf(stdout, "mixed blocks: %s\n", (rc == 0) ? "ok" : "mismatch");
+
+        clew_input_index_destroy(index);
+        unlink(path);
+        return rc;
+}
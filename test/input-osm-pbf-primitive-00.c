@@ -0,0 +1,256 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "stack.h"
+#include "input-osm-pbf-primitive.h"
+#include "input-osm-pbf-fileformat.pb-c.h"
+#include "input-osm-pbf-osmformat.pb-c.h"
+
+struct block {
+        unsigned char *data;
+        size_t length;
+};
+
+struct checksum {
+        uint64_t elements;
+        uint64_t ids;
+        int64_t lats;
+        int64_t lons;
+        uint64_t refs;
+        uint64_t tags;
+};
+
+static double now (void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int read_blocks (const char *path, struct block **blocks, size_t *nblocks)
+{
+        FILE *fp;
+        uint32_t length;
+        unsigned char prefix[4];
+        unsigned char *buffer;
+        OSMPBF__BlobHeader *header;
+        OSMPBF__Blob *blob;
+        struct block block;
+
+        fp = fopen(path, "rb");
+        if (fp == NULL) {
+                fprintf(stderr, "can not open: %s\n", path);
+                return -1;
+        }
+        buffer   = malloc(1024 * 1024 * 64);
+        *blocks  = NULL;
+        *nblocks = 0;
+        while (fread(prefix, 1, 4, fp) == 4) {
+                length = (prefix[0] << 24) | (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];
+                if (fread(buffer, 1, length, fp) != length) {
+                        break;
+                }
+                header = osmpbf__blob_header__unpack(NULL, length, buffer);
+                if (header == NULL) {
+                        break;
+                }
+                length = header->datasize;
+                if (fread(buffer, 1, length, fp) != length) {
+                        osmpbf__blob_header__free_unpacked(header, NULL);
+                        break;
+                }
+                blob = osmpbf__blob__unpack(NULL, length, buffer);
+                if (blob != NULL && strcmp(header->type, "OSMData") == 0) {
+                        block.length = blob->raw_size;
+                        block.data   = malloc(block.length);
+                        if (blob->data_case == OSMPBF__BLOB__DATA_RAW) {
+                                block.length = blob->raw.len;
+                                memcpy(block.data, blob->raw.data, block.length);
+                        } else {
+                                uLongf dlength = block.length;
+                                uncompress(block.data, &dlength, blob->zlib_data.data, blob->zlib_data.len);
+                                block.length = dlength;
+                        }
+                        *blocks = realloc(*blocks, sizeof(struct block) * (*nblocks + 1));
+                        (*blocks)[(*nblocks)++] = block;
+                }
+                if (blob != NULL) {
+                        osmpbf__blob__free_unpacked(blob, NULL);
+                }
+                osmpbf__blob_header__free_unpacked(header, NULL);
+        }
+        free(buffer);
+        fclose(fp);
+        return 0;
+}
+
+static int run_protobuf_c (const struct block *block, struct checksum *checksum)
+{
+        uint64_t i;
+        uint64_t j;
+        uint64_t k;
+        int64_t id;
+        int64_t lat;
+        int64_t lon;
+        int64_t ref;
+        OSMPBF__PrimitiveBlock *primitive_block;
+        OSMPBF__PrimitiveGroup *primitive_group;
+
+        primitive_block = osmpbf__primitive_block__unpack(NULL, block->length, block->data);
+        if (primitive_block == NULL) {
+                return -1;
+        }
+        for (i = 0; i < primitive_block->n_primitivegroup; i++) {
+                primitive_group = primitive_block->primitivegroup[i];
+                for (j = 0, id = 0, lat = 0, lon = 0; primitive_group->dense != NULL && j < primitive_group->dense->n_id; j++) {
+                        id  += primitive_group->dense->id[j];
+                        lat += primitive_group->dense->lat[j];
+                        lon += primitive_group->dense->lon[j];
+                        checksum->elements += 1;
+                        checksum->ids      += id;
+                        checksum->lats     += (int32_t) lat;
+                        checksum->lons     += (int32_t) lon;
+                }
+                for (j = 0; primitive_group->dense != NULL && j < primitive_group->dense->n_keys_vals; j++) {
+                        checksum->tags += primitive_group->dense->keys_vals[j];
+                }
+                for (j = 0; j < primitive_group->n_ways; j++) {
+                        checksum->elements += 1;
+                        checksum->ids      += primitive_group->ways[j]->id;
+                        for (k = 0, ref = 0; k < primitive_group->ways[j]->n_refs; k++) {
+                                ref += primitive_group->ways[j]->refs[k];
+                                checksum->refs += ref;
+                        }
+                        for (k = 0; k < primitive_group->ways[j]->n_keys; k++) {
+                                checksum->tags += primitive_group->ways[j]->keys[k] + primitive_group->ways[j]->vals[k];
+                        }
+                }
+                for (j = 0; j < primitive_group->n_relations; j++) {
+                        checksum->elements += 1;
+                        checksum->ids      += primitive_group->relations[j]->id;
+                        for (k = 0, ref = 0; k < primitive_group->relations[j]->n_memids; k++) {
+                                ref += primitive_group->relations[j]->memids[k];
+                                checksum->refs += ref;
+                        }
+                        for (k = 0; k < primitive_group->relations[j]->n_keys; k++) {
+                                checksum->tags += primitive_group->relations[j]->keys[k] + primitive_group->relations[j]->vals[k];
+                        }
+                }
+        }
+        osmpbf__primitive_block__free_unpacked(primitive_block, NULL);
+        return 0;
+}
+
+static int run_primitive (struct clew_input_osm_pbf_primitive *primitive, const struct block *block, struct checksum *checksum)
+{
+        int rc;
+        uint64_t i;
+        uint64_t il;
+        const uint64_t *ids;
+        const int32_t *lats;
+        const int32_t *lons;
+        const uint64_t *refs;
+        const struct clew_input_osm_pbf_tag *tags;
+
+        rc = clew_input_osm_pbf_primitive_decode(primitive, block->data, block->length);
+        if (rc < 0) {
+                return -1;
+        }
+        ids  = (const uint64_t *) clew_stack_buffer(&primitive->node_ids);
+        lats = (const int32_t *) clew_stack_buffer(&primitive->node_lats);
+        lons = (const int32_t *) clew_stack_buffer(&primitive->node_lons);
+        for (i = 0, il = clew_stack_count(&primitive->node_ids); i < il; i++) {
+                checksum->elements += 1;
+                checksum->ids      += ids[i];
+                checksum->lats     += lats[i];
+                checksum->lons     += lons[i];
+        }
+        ids = (const uint64_t *) clew_stack_buffer(&primitive->way_ids);
+        for (i = 0, il = clew_stack_count(&primitive->way_ids); i < il; i++) {
+                checksum->elements += 1;
+                checksum->ids      += ids[i];
+        }
+        ids = (const uint64_t *) clew_stack_buffer(&primitive->relation_ids);
+        for (i = 0, il = clew_stack_count(&primitive->relation_ids); i < il; i++) {
+                checksum->elements += 1;
+                checksum->ids      += ids[i];
+        }
+        refs = (const uint64_t *) clew_stack_buffer(&primitive->refs);
+        for (i = 0, il = clew_stack_count(&primitive->refs); i < il; i++) {
+                checksum->refs += refs[i];
+        }
+        refs = (const uint64_t *) clew_stack_buffer(&primitive->member_ids);
+        for (i = 0, il = clew_stack_count(&primitive->member_ids); i < il; i++) {
+                checksum->refs += refs[i];
+        }
+        tags = (const struct clew_input_osm_pbf_tag *) clew_stack_buffer(&primitive->tags);
+        for (i = 0, il = clew_stack_count(&primitive->tags); i < il; i++) {
+                checksum->tags += tags[i].k + tags[i].v;
+        }
+        return 0;
+}
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        int r;
+        int rounds;
+        size_t i;
+        size_t nblocks;
+        size_t bytes;
+        double t0;
+        double t1;
+        double t2;
+        struct block *blocks;
+        struct checksum a;
+        struct checksum b;
+        struct clew_input_osm_pbf_primitive *primitive;
+
+        if (argc < 2) {
+                fprintf(stdout, "usage: %s <file.osm.pbf> [rounds]\n", argv[0]);
+                return 0;
+        }
+        rounds = (argc > 2) ? atoi(argv[2]) : 5;
+
+        rc = read_blocks(argv[1], &blocks, &nblocks);
+        if (rc < 0) {
+                return -1;
+        }
+        for (i = 0, bytes = 0; i < nblocks; i++) {
+                bytes += blocks[i].length;
+        }
+        primitive = clew_input_osm_pbf_primitive_create();
+
+        memset(&a, 0, sizeof(a));
+        memset(&b, 0, sizeof(b));
+        t0 = now();
+        for (r = 0; r < rounds; r++) {
+                for (i = 0; i < nblocks; i++) {
+                        run_protobuf_c(&blocks[i], &a);
+                }
+        }
+        t1 = now();
+        for (r = 0; r < rounds; r++) {
+                for (i = 0; i < nblocks; i++) {
+                        run_primitive(primitive, &blocks[i], &b);
+                }
+        }
+        t2 = now();
+
+        fprintf(stdout, "blocks    : %zu, %zu bytes, %d rounds\n", nblocks, bytes, rounds);
+        fprintf(stdout, "protobuf-c: %.3f s, %.1f MB/s\n", t1 - t0, bytes * rounds / (t1 - t0) / 1e6);
+        fprintf(stdout, "primitive : %.3f s, %.1f MB/s\n", t2 - t1, bytes * rounds / (t2 - t1) / 1e6);
+        fprintf(stdout, "checksum  : %s\n", (a.elements == b.elements && a.ids == b.ids && a.lats == b.lats && a.lons == b.lons && a.refs == b.refs && a.tags == b.tags) ? "match" : "mismatch");
+
+        clew_input_osm_pbf_primitive_destroy(primitive);
+        for (i = 0; i < nblocks; i++) {
+                free(blocks[i].data);
+        }
+        free(blocks);
+        return (a.elements == b.elements && a.ids == b.ids) ? 0 : -1;
+}
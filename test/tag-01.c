@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "tag.h"
+
+/*
+ * compares clew_tag_value against the sorted table lookup it replaced, a
+ * bsearch with strcasecmp that retries with key_unknown after cutting at
+ * each _ from the right. tags are "key_value" strings as clew_tag_parse
+ * builds them, read as "count tag" lines (uniq -c output) from the given
+ * file, or from a built in mix modelled on common osm tags.
+ */
+
+struct sample {
+        int count;
+        const char *tag;
+};
+
+static const struct sample g_samples[] = {
+        { 600, "building_yes" },
+        { 150, "addr_housenumber_12" },
+        { 140, "addr_street_Hauptstraße" },
+        { 100, "name_Via Roma" },
+        {  65, "highway_residential" },
+        {  60, "highway_service" },
+        {  45, "surface_asphalt" },
+        {  40, "source_bing" },
+        {  35, "highway_footway" },
+        {  30, "natural_tree" },
+        {  27, "highway_track" },
+        {  25, "oneway_yes" },
+        {  20, "highway_path" },
+        {  20, "building_levels_2" },
+        {  20, "height_6" },
+        {  17, "highway_unclassified" },
+        {  15, "lanes_2" },
+        {  12, "surface_unpaved" },
+        {  12, "power_pole" },
+        {  12, "access_private" },
+        {  12, "service_driveway" },
+        {  10, "maxspeed_50" },
+        {  10, "highway_crossing" },
+        {   9, "highway_tertiary" },
+        {   8, "surface_gravel" },
+        {   8, "landuse_residential" },
+        {   8, "power_tower" },
+        {   7, "barrier_fence" },
+        {   6, "maxspeed_30" },
+        {   6, "tracktype_grade3" },
+        {   6, "landuse_farmland" },
+        {   5, "highway_secondary" },
+        {   5, "natural_water" },
+        {   5, "layer_layer_above_1" },
+        {   4, "highway_primary" },
+        {   4, "surface_paving_stones" },
+        {   3, "maxspeed_30 mph" },
+        {   2, "shop_convenience" },
+        {   2, "shop_something_new" },
+        {   2, "highway_traffic_signals" },
+        {   1, "Highway_Motorway" },
+        {   1, "country_DEU" },
+        {   1, "clew_tag_highway_primary" },
+};
+
+static double now (void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct name {
+        uint32_t tag;
+        const char *name;
+};
+
+static struct name *g_names;
+static size_t g_nnames;
+
+static int compare_name (const void *a, const void *b)
+{
+        return strcasecmp(((const struct name *) a)->name, ((const struct name *) b)->name);
+}
+
+static int reference_init (void)
+{
+        uint32_t tag;
+        const char *name;
+
+        g_names = (struct name *) malloc(sizeof(struct name) * clew_tag_last);
+        if (g_names == NULL) {
+                return -1;
+        }
+        for (tag = clew_tag_unknown + 1, g_nnames = 0; tag < clew_tag_last; tag++) {
+                name = clew_tag_string(tag);
+                if (strcmp(name, "unknown") == 0) {
+                        continue;
+                }
+                g_names[g_nnames].tag  = tag;
+                g_names[g_nnames].name = name;
+                g_nnames++;
+        }
+        qsort(g_names, g_nnames, sizeof(struct name), compare_name);
+        return 0;
+}
+
+static uint32_t reference_value (const char *tag)
+{
+        char _tag[64];
+        char *ptr;
+        struct name k;
+        struct name *t;
+
+        if (strncmp(tag, "clew_tag_", strlen("clew_tag_")) == 0) {
+                tag += strlen("clew_tag_");
+        }
+        k.name = tag;
+        t = (struct name *) bsearch(&k, g_names, g_nnames, sizeof(struct name), compare_name);
+        if (t != NULL) {
+                return t->tag;
+        }
+        strncpy(_tag, tag, sizeof(_tag) - 1);
+        _tag[sizeof(_tag) - 1] = '\0';
+        while ((ptr = strrchr(_tag, '_')) != NULL) {
+                *ptr = '\0';
+                strncat(_tag, "_unknown", sizeof(_tag) - strlen(_tag) - 1);
+                k.name = _tag;
+                t = (struct name *) bsearch(&k, g_names, g_nnames, sizeof(struct name), compare_name);
+                if (t != NULL) {
+                        return t->tag;
+                }
+                *ptr = '\0';
+        }
+        return clew_tag_unknown;
+}
+
+static int read_samples (const char *path, char ***tags, size_t *ntags)
+{
+        int count;
+        size_t l;
+        FILE *fp;
+        char line[1024];
+        char *tag;
+        char **buffer;
+
+        fp = fopen(path, "r");
+        if (fp == NULL) {
+                fprintf(stderr, "can not open: %s\n", path);
+                return -1;
+        }
+        while (fgets(line, sizeof(line), fp) != NULL) {
+                l = strlen(line);
+                if (l > 0 && line[l - 1] == '\n') {
+                        line[--l] = '\0';
+                }
+                count = strtol(line, &tag, 10);
+                while (*tag == ' ') {
+                        tag++;
+                }
+                if (count <= 0 || *tag == '\0') {
+                        continue;
+                }
+                buffer = (char **) realloc(*tags, sizeof(char *) * (*ntags + count));
+                if (buffer == NULL) {
+                        fclose(fp);
+                        return -1;
+                }
+                *tags = buffer;
+                tag   = strdup(tag);
+                while (count-- > 0) {
+                        (*tags)[(*ntags)++] = tag;
+                }
+        }
+        fclose(fp);
+        return 0;
+}
+
+int main (int argc, char *argv[])
+{
+        int r;
+        int rounds;
+        size_t i;
+        size_t j;
+        size_t ntags;
+        size_t mismatches;
+        uint64_t a;
+        uint64_t b;
+        double t0;
+        double t1;
+        double t2;
+        char **tags;
+
+        rounds = (argc > 2) ? atoi(argv[2]) : 1000;
+
+        clew_tag_init();
+        if (reference_init() != 0) {
+                return -1;
+        }
+
+        tags  = NULL;
+        ntags = 0;
+        if (argc > 1) {
+                if (read_samples(argv[1], &tags, &ntags) != 0) {
+                        return -1;
+                }
+        } else {
+                for (i = 0; i < sizeof(g_samples) / sizeof(g_samples[0]); i++) {
+                        ntags += g_samples[i].count;
+                }
+                tags = (char **) malloc(sizeof(char *) * ntags);
+                for (i = 0, ntags = 0; i < sizeof(g_samples) / sizeof(g_samples[0]); i++) {
+                        for (j = 0; j < (size_t) g_samples[i].count; j++) {
+                                tags[ntags++] = (char *) g_samples[i].tag;
+                        }
+                }
+        }
+        /* interleave, so consecutive lookups do not hit the same entry */
+        for (i = ntags; i > 1; i--) {
+                char *t;
+                j = (i * 2654435761u) % i;
+                t = tags[i - 1];
+                tags[i - 1] = tags[j];
+                tags[j] = t;
+        }
+
+        for (i = 0, mismatches = 0; i < ntags; i++) {
+                if (clew_tag_value(tags[i]) != reference_value(tags[i])) {
+                        if (mismatches++ < 10) {
+                                fprintf(stderr, "mismatch: %s, %s != %s\n", tags[i], clew_tag_string(clew_tag_value(tags[i])), clew_tag_string(reference_value(tags[i])));
+                        }
+                }
+        }
+
+        a  = 0;
+        b  = 0;
+        t0 = now();
+        for (r = 0; r < rounds; r++) {
+                for (i = 0; i < ntags; i++) {
+                        a += reference_value(tags[i]);
+                }
+        }
+        t1 = now();
+        for (r = 0; r < rounds; r++) {
+                for (i = 0; i < ntags; i++) {
+                        b += clew_tag_value(tags[i]);
+                }
+        }
+        t2 = now();
+
+        fprintf(stdout, "lookups   : %zu, %d rounds, %zu names\n", ntags, rounds, g_nnames);
+        fprintf(stdout, "bsearch   : %.3f s, %.1f ns/lookup\n", t1 - t0, (t1 - t0) * 1e9 / ntags / rounds);
+        fprintf(stdout, "hash      : %.3f s, %.1f ns/lookup\n", t2 - t1, (t2 - t1) * 1e9 / ntags / rounds);
+        fprintf(stdout, "checksum  : %s\n", (a == b && mismatches == 0) ? "match" : "mismatch");
+
+        free(g_names);
+        clew_tag_fini();
+        return (a == b && mismatches == 0) ? 0 : -1;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tag.h"
+
+/*
+ * checks the generated tag properties against the group tables and the tag
+ * names, and times a maxspeed group test through both.
+ */
+
+static double now (void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main (int argc, char *argv[])
+{
+        int r;
+        int rounds;
+        uint32_t tag;
+        uint32_t bits;
+        uint32_t speed;
+        uint32_t *group;
+        uint32_t *tags;
+        uint64_t a;
+        uint64_t b;
+        uint64_t mismatches;
+        double t0;
+        double t1;
+        double t2;
+        const char *name;
+
+        rounds = (argc > 1) ? atoi(argv[1]) : 100;
+
+        clew_tag_init();
+
+        mismatches = 0;
+        for (tag = clew_tag_unknown + 1; tag < clew_tag_last; tag++) {
+                bits = 0;
+                for (group = clew_tag_groups(); *group != clew_tag_unknown; group++) {
+                        for (tags = clew_tags_group_value(*group); *tags != clew_tag_unknown; tags++) {
+                                if (*tags == tag) {
+                                        bits |= CLEW_TAG_GROUP_BIT(*group);
+                                        break;
+                                }
+                        }
+                }
+                name  = clew_tag_string(tag);
+                speed = (strncmp(name, "maxspeed_", 9) == 0) ? atoi(name + 9) : 0;
+                if (clew_tag_group_bits(tag) != bits ||
+                    clew_tag_maxspeed_value(tag) != speed ||
+                    (clew_tag_highway_rank(tag) != 0 && strncmp(name, "highway_", 8) != 0) ||
+                    (clew_tag_oneway_direction(tag) != CLEW_TAG_ONEWAY_NONE && strncmp(name, "oneway_", 7) != 0)) {
+                        if (mismatches++ < 10) {
+                                fprintf(stderr, "mismatch: %s, groups: 0x%08x != 0x%08x, maxspeed: %u != %u\n", name, clew_tag_group_bits(tag), bits, clew_tag_maxspeed_value(tag), speed);
+                        }
+                }
+        }
+        if (clew_tag_highway_rank(clew_tag_highway_motorway) != 1 ||
+            clew_tag_highway_rank(clew_tag_highway_footway) != 0 ||
+            clew_tag_oneway_direction(clew_tag_oneway__1) != CLEW_TAG_ONEWAY_REVERSE ||
+            clew_tag_oneway_direction(clew_tag_oneway_no) != CLEW_TAG_ONEWAY_NO) {
+                fprintf(stderr, "mismatch: highway rank or oneway direction\n");
+                mismatches++;
+        }
+
+        a  = 0;
+        b  = 0;
+        t0 = now();
+        for (r = 0; r < rounds; r++) {
+                for (tag = clew_tag_unknown + 1; tag < clew_tag_last; tag++) {
+                        a += clew_tag_is_group_maxspeed(tag);
+                }
+        }
+        t1 = now();
+        for (r = 0; r < rounds; r++) {
+                for (tag = clew_tag_unknown + 1; tag < clew_tag_last; tag++) {
+                        b += (clew_tag_group_bits(tag) & CLEW_TAG_GROUP_BIT(clew_tag_group_maxspeed)) != 0;
+                }
+        }
+        t2 = now();
+
+        fprintf(stdout, "tags      : %d, %d rounds\n", clew_tag_last, rounds);
+        fprintf(stdout, "bsearch   : %.3f s, %.1f ns/tag\n", t1 - t0, (t1 - t0) * 1e9 / rounds / clew_tag_last);
+        fprintf(stdout, "table     : %.3f s, %.1f ns/tag\n", t2 - t1, (t2 - t1) * 1e9 / rounds / clew_tag_last);
+        fprintf(stdout, "checks    : %s\n", (a == b && mismatches == 0) ? "ok" : "mismatch");
+
+        clew_tag_fini();
+        return (a == b && mismatches == 0) ? 0 : -1;
+}
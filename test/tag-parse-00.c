@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "tag.h"
+#include "tag-parse.h"
+
+/* UINT32_MAX expects the string lookup of "k_v" */
+struct check {
+        const char *k;
+        const char *v;
+        uint32_t tag;
+};
+
+static const struct check g_checks[] = {
+        { "layer",      "0",            clew_tag_layer_ground },
+        { "layer",      "1",            clew_tag_layer_above1 },
+        { "layer",      "+2",           clew_tag_layer_above2 },
+        { "layer",      "-1",           clew_tag_layer_below1 },
+        { "layer",      "-5",           clew_tag_layer_below5 },
+        { "layer",      "7",            clew_tag_unknown },
+        { "layer",      "1.5",          clew_tag_unknown },
+        { "Layer",      "3",            clew_tag_layer_above3 },
+        { "length",     "0",            clew_tag_length_0 },
+        { "length",     "12",           clew_tag_length_12 },
+        { "length",     "12.4 m",       clew_tag_length_12 },
+        { "length",     "115",          clew_tag_length_110 },
+        { "length",     "1.2 km",       clew_tag_length_1200 },
+        { "length",     "1 mi",         clew_tag_length_1600 },
+        { "length",     "10 ft",        clew_tag_length_3 },
+        { "length",     "16'3\"",       clew_tag_length_5 },
+        { "length",     "6'",           clew_tag_length_2 },
+        { "length",     "40\"",         clew_tag_length_1 },
+        { "length",     "2000000",      clew_tag_length_unknown },
+        { "length",     "long",         clew_tag_length_unknown },
+        { "maxspeed",   "50",           clew_tag_maxspeed_50 },
+        { "maxspeed",   "50 km/h",      clew_tag_maxspeed_50 },
+        { "maxspeed",   "30 mph",       clew_tag_maxspeed_48 },
+        { "maxspeed",   "30mph",        clew_tag_maxspeed_48 },
+        { "maxspeed",   "10 knots",     clew_tag_maxspeed_19 },
+        { "maxspeed",   "none",         clew_tag_unknown },
+        { "maxspeed",   "DE:urban",     clew_tag_unknown },
+        { "maxspeed",   "50;30",        clew_tag_unknown },
+        { "maxspeed",   "3000",         UINT32_MAX },
+        { "maxspeed",   "1500 mph",     UINT32_MAX },
+        { "minspeed",   "2001",         UINT32_MAX },
+        { "minspeed",   "60",           clew_tag_minspeed_60 },
+        { "minspeed",   "40 mph",       clew_tag_minspeed_64 },
+        { "highway",    "primary",      clew_tag_highway_primary },
+        { "highway",    "primary-link", clew_tag_highway_primary_link },
+};
+
+/* approximate mix of way tags, numeric keys dominate on a routable extract */
+static const struct check g_samples[] = {
+        { "highway",    "residential",  0 },
+        { "maxspeed",   "50",           0 },
+        { "maxspeed",   "30",           0 },
+        { "maxspeed",   "30 mph",       0 },
+        { "layer",      "1",            0 },
+        { "layer",      "-1",           0 },
+        { "length",     "120",          0 },
+        { "surface",    "asphalt",      0 },
+        { "oneway",     "yes",          0 },
+        { "minspeed",   "60",           0 },
+};
+
+static double now (void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main (int argc, char *argv[])
+{
+        int r;
+        int rc;
+        int rounds;
+        uint32_t i;
+        uint32_t tag;
+        uint32_t expect;
+        uint64_t sum;
+        char kv[64];
+        double t0;
+        double t1;
+
+        rounds = (argc > 1) ? atoi(argv[1]) : 100000;
+
+        clew_tag_init();
+
+        rc = 0;
+        for (i = 0; i < sizeof(g_checks) / sizeof(g_checks[0]); i++) {
+                tag    = clew_tag_parse(g_checks[i].k, g_checks[i].v);
+                expect = g_checks[i].tag;
+                if (expect == UINT32_MAX) {
+                        snprintf(kv, sizeof(kv), "%s_%s", g_checks[i].k, g_checks[i].v);
+                        expect = clew_tag_value(kv);
+                }
+                if (tag != expect) {
+                        fprintf(stderr, "mismatch: %s = %s, %s != %s\n", g_checks[i].k, g_checks[i].v, clew_tag_string(tag), clew_tag_string(expect));
+                        rc = -1;
+                }
+        }
+
+        sum = 0;
+        t0  = now();
+        for (r = 0; r < rounds; r++) {
+                for (i = 0; i < sizeof(g_samples) / sizeof(g_samples[0]); i++) {
+                        sum += clew_tag_parse(g_samples[i].k, g_samples[i].v);
+                }
+        }
+        t1 = now();
+
+        fprintf(stdout, "parses    : %d, sum: %llu\n", rounds * (int) (sizeof(g_samples) / sizeof(g_samples[0])), (unsigned long long) sum);
+        fprintf(stdout, "parse     : %.3f s, %.1f ns/tag\n", t1 - t0, (t1 - t0) * 1e9 / rounds / (sizeof(g_samples) / sizeof(g_samples[0])));
+        fprintf(stdout, "checks    : %s\n", (rc == 0) ? "ok" : "mismatch");
+
+        clew_tag_fini();
+        return rc;
+}
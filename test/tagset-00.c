@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "tagset.h"
+
+#define COUNT   (1 << 16)
+#define SETS    1000
+
+int main (int argc, char *argv[])
+{
+        int rc;
+        uint32_t i;
+        uint32_t t;
+        uint32_t n;
+        uint32_t id;
+        uint32_t ntags;
+        uint32_t tags[8];
+        uint32_t *ids;
+        const uint32_t *stored;
+        struct clew_tagset *tagset;
+
+        (void) argc;
+        (void) argv;
+
+        rc     = -1;
+        ids    = NULL;
+        tagset = clew_tagset_create();
+        if (tagset == NULL) {
+                goto out;
+        }
+        ids = (uint32_t *) malloc(sizeof(uint32_t) * SETS);
+        if (ids == NULL) {
+                goto out;
+        }
+        for (i = 0; i < SETS; i++) {
+                ids[i] = UINT32_MAX;
+        }
+
+        if (clew_tagset_intern(tagset, NULL, 0, &id) != 0 || id != CLEW_TAGSET_EMPTY) {
+                fprintf(stderr, "empty set is not id 0\n");
+                goto out;
+        }
+
+        /* sets are derived from i % SETS, so each one is interned many times */
+        for (i = 0; i < COUNT; i++) {
+                n = (i % SETS) % 7 + 1;
+                for (t = 0; t < n; t++) {
+                        tags[t] = (i % SETS) * 8 + t;
+                }
+                if (clew_tagset_intern(tagset, tags, n, &id) < 0) {
+                        fprintf(stderr, "can not intern\n");
+                        goto out;
+                }
+                if (ids[i % SETS] == UINT32_MAX) {
+                        ids[i % SETS] = id;
+                } else if (ids[i % SETS] != id) {
+                        fprintf(stderr, "id mismatch at %d\n", i);
+                        goto out;
+                }
+        }
+        if (clew_tagset_count(tagset) != SETS + 1) {
+                fprintf(stderr, "count mismatch: %d\n", clew_tagset_count(tagset));
+                goto out;
+        }
+        for (i = 0; i < SETS; i++) {
+                stored = clew_tagset_tags(tagset, ids[i], &ntags);
+                if (ntags != i % 7 + 1) {
+                        fprintf(stderr, "ntags mismatch at %d\n", i);
+                        goto out;
+                }
+                for (t = 0; t < ntags; t++) {
+                        if (stored[t] != i * 8 + t) {
+                                fprintf(stderr, "tag mismatch at %d\n", i);
+                                goto out;
+                        }
+                }
+        }
+
+        fprintf(stdout, "sets: %d, memory: %ld, ok\n", clew_tagset_count(tagset), clew_tagset_memory(tagset));
+        rc = 0;
+out:    free(ids);
+        clew_tagset_destroy(tagset);
+        return rc;
+}